@@ -0,0 +1,180 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "arena.h"
+
+typedef struct arenaChunk {
+    struct arenaChunk *prev, *next;
+    NodeArena *arena;
+    size_t size;    // the chunk's capacity
+    size_t used;    // the chunk's allocated bytes
+    size_t dedicated;  // the chunk is dedicated to a single allocation (keeps data aligned)
+    char data[];
+} arenaChunk;
+
+#define __arena_align(size) (((size) + 7) & ~(size_t)7)
+#define __arena_isLarge(a, size) ((size) > (a)->chunkSize / 4)
+#define __arena_chunk(p) ((arenaChunk *)((char *)(p)-offsetof(arenaChunk, data)))
+
+static size_t __arena_chunkSize = 0;
+
+void NodeArena_SetChunkSize(size_t size) {
+    if (size && size < NODE_ARENA_MIN_CHUNK_SIZE) size = NODE_ARENA_MIN_CHUNK_SIZE;
+    if (size > NODE_ARENA_MAX_CHUNK_SIZE) size = NODE_ARENA_MAX_CHUNK_SIZE;
+    __arena_chunkSize = size;
+}
+
+size_t NodeArena_GetChunkSize() { return __arena_chunkSize; }
+
+NodeArena *NewNodeArena(size_t hint) {
+    if (!__arena_chunkSize) return NULL;
+
+    NodeArena *a = RedisModule_Calloc(1, sizeof(NodeArena));
+    a->chunkSize = __arena_chunkSize;
+    a->nextChunkSize = NODE_ARENA_MIN_CHUNK_SIZE;
+    while (a->nextChunkSize < hint && a->nextChunkSize < a->chunkSize) a->nextChunkSize <<= 1;
+    return a;
+}
+
+/* Adds a new chunk to the head of a list, or right after it for dedicated chunks. */
+static arenaChunk *__arena_newChunk(NodeArena *a, arenaChunk **list, size_t size, int dedicated) {
+    arenaChunk *c = RedisModule_Alloc(sizeof(arenaChunk) + size);
+    c->arena = a;
+    c->size = size;
+    c->used = 0;
+    c->dedicated = dedicated;
+
+    arenaChunk *head = *list;
+    if (dedicated && head) {
+        c->prev = head;
+        c->next = head->next;
+        if (head->next) head->next->prev = c;
+        head->next = c;
+    } else {
+        c->prev = NULL;
+        c->next = head;
+        if (head) head->prev = c;
+        *list = c;
+    }
+
+    a->allocated += size;
+    return c;
+}
+
+static void __arena_freeChunk(NodeArena *a, arenaChunk **list, arenaChunk *c) {
+    if (c->prev) c->prev->next = c->next;
+    else *list = c->next;
+    if (c->next) c->next->prev = c->prev;
+
+    a->allocated -= c->size;
+    RedisModule_Free(c);
+}
+
+/* Returns a zeroed block from the current chunk of a list, or from a new chunk. */
+static void *__arena_alloc(NodeArena *a, arenaChunk **list, size_t size, arenaChunk **chunk) {
+    size = __arena_align(size);
+    a->used += size;
+
+    arenaChunk *c = *list;
+    if (__arena_isLarge(a, size)) {
+        c = __arena_newChunk(a, list, size, 1);
+    } else if (!c || c->dedicated || c->size - c->used < size) {
+        c = __arena_newChunk(a, list, a->nextChunkSize, 0);
+        if (a->nextChunkSize < a->chunkSize) a->nextChunkSize <<= 1;
+    }
+
+    void *p = &c->data[c->used];
+    c->used += size;
+    memset(p, 0, size);
+    if (chunk) *chunk = c;
+    return p;
+}
+
+Node *NodeArena_AllocNode(NodeArena *a, NodeType type, size_t size) {
+    arenaChunk *c;
+    Node *n = __arena_alloc(a, N_KEYVAL == type ? &a->kvchunks : &a->chunks, size, &c);
+    n->type = type;
+    n->flags = N_F_ARENA;
+    n->chunkoff = ((char *)n - (char *)c) / 8;
+    return n;
+}
+
+NodeArena *NodeArena_Of(const Node *n) {
+    return ((arenaChunk *)((char *)n - (size_t)n->chunkoff * 8))->arena;
+}
+
+void NodeArena_FreeNode(NodeArena *a, Node *n, size_t size) {
+    arenaChunk *c = (arenaChunk *)((char *)n - (size_t)n->chunkoff * 8);
+    size = __arena_align(size);
+
+    if (c->dedicated) {
+        // whatever else the chunk had held was already accounted for as freed
+        a->used -= c->size;
+        a->freed -= c->size - size;
+        __arena_freeChunk(a, &a->chunks, c);
+    } else {
+        a->freed += size;
+        // freed key-value nodes are skipped when the arena is released
+        n->type = 0;
+    }
+}
+
+void *NodeArena_Alloc(NodeArena *a, size_t size) { return __arena_alloc(a, &a->chunks, size, NULL); }
+
+void *NodeArena_Realloc(NodeArena *a, void *p, size_t oldsize, size_t size) {
+    if (!p) return NodeArena_Alloc(a, size);
+    if (__arena_align(size) == __arena_align(oldsize)) return p;
+
+    void *newp = NodeArena_Alloc(a, size);
+    memcpy(newp, p, MIN(oldsize, size));
+    NodeArena_Free(a, p, oldsize);
+    return newp;
+}
+
+void NodeArena_Free(NodeArena *a, void *p, size_t size) {
+    size = __arena_align(size);
+    if (p && __arena_isLarge(a, size)) {
+        // a dedicated chunk
+        a->used -= size;
+        __arena_freeChunk(a, &a->chunks, __arena_chunk(p));
+    } else {
+        a->freed += size;
+    }
+}
+
+int NodeArena_NeedsCompaction(const NodeArena *a) {
+    return a->allocated > a->chunkSize && a->freed > a->used * NODE_ARENA_COMPACT_RATIO;
+}
+
+size_t NodeArena_Size(const NodeArena *a) { return sizeof(NodeArena) + a->allocated; }
+
+size_t NodeArena_Waste(const NodeArena *a) { return a->allocated - (a->used - a->freed); }
+
+void NodeArena_Release(NodeArena *a) {
+    if (!a) return;
+
+    while (a->kvchunks) {
+        arenaChunk *c = a->kvchunks;
+        for (size_t off = 0; off < c->used; off += __arena_align(sizeof(Node))) {
+            Node *kv = (Node *)&c->data[off];
+            if (N_KEYVAL == kv->type) Intern_Release(kv->value.kvval.key);
+        }
+        __arena_freeChunk(a, &a->kvchunks, c);
+    }
+    while (a->chunks) __arena_freeChunk(a, &a->chunks, a->chunks);
+    RedisModule_Free(a);
+}
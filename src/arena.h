@@ -0,0 +1,97 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include "object.h"
+
+/*
+* A node arena allocates the nodes of a single document, and the memory they own, from contiguous
+* chunks. Chunks start small and double in size up to the arena's chunk size, and allocations that
+* are larger than a quarter of it get a dedicated chunk. Memory that's freed in an arena is only
+* accounted for (except for dedicated chunks, which are freed), so it is reclaimed either when the
+* entire arena is released or by compacting the document into a new arena.
+*
+* Key-value nodes are kept in chunks of their own. This lets an arena release the interned keys of
+* all its live key-value nodes with a linear scan, instead of walking the document's tree.
+*/
+struct NodeArena {
+    struct arenaChunk *chunks;    // chunks for nodes and their data, the current chunk first
+    struct arenaChunk *kvchunks;  // chunks for key-value nodes, the current chunk first
+    size_t chunkSize;             // the maximal size of a regular chunk
+    size_t nextChunkSize;         // the size of the next regular chunk
+    size_t allocated;             // the total size of the chunks
+    size_t used;                  // bytes handed out by the arena
+    size_t freed;                 // bytes handed out and then freed
+};
+
+// The minimal and maximal sizes of an arena's chunks
+#define NODE_ARENA_MIN_CHUNK_SIZE 256
+#define NODE_ARENA_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+
+// The fraction of an arena's used memory that, once freed, makes compacting it worthwhile
+#define NODE_ARENA_COMPACT_RATIO 0.5
+
+/**
+* Set the chunk size of new arenas, 0 disables arenas (the default). The size is clamped to the
+* minimal and maximal chunk sizes.
+*/
+void NodeArena_SetChunkSize(size_t size);
+
+/** Returns the chunk size of new arenas, 0 if arenas are disabled. */
+size_t NodeArena_GetChunkSize();
+
+/**
+* Creates a new arena or returns NULL if arenas are disabled. `hint` is the expected size of the
+* arena's contents, used for sizing its first chunk, and may be 0.
+*/
+NodeArena *NewNodeArena(size_t hint);
+
+/** Allocates a zeroed node of the given size, that's flagged as belonging to the arena. */
+Node *NodeArena_AllocNode(NodeArena *a, NodeType type, size_t size);
+
+/** Returns the arena that a node belongs to. */
+NodeArena *NodeArena_Of(const Node *n);
+
+/** Frees an arena allocated node of the given size. */
+void NodeArena_FreeNode(NodeArena *a, Node *n, size_t size);
+
+/** Allocates a zeroed block, e.g. a container's entries, from the arena. */
+void *NodeArena_Alloc(NodeArena *a, size_t size);
+
+/** Reallocates a block from the arena. Its contents are copied as needed. */
+void *NodeArena_Realloc(NodeArena *a, void *p, size_t oldsize, size_t size);
+
+/** Frees a block from the arena. A NULL block only accounts for size bytes as freed. */
+void NodeArena_Free(NodeArena *a, void *p, size_t size);
+
+/** Returns non-zero if enough of the arena's memory had been freed for compacting it. */
+int NodeArena_NeedsCompaction(const NodeArena *a);
+
+/** Reports the arena's size, and how much of it isn't used by live allocations. */
+size_t NodeArena_Size(const NodeArena *a);
+size_t NodeArena_Waste(const NodeArena *a);
+
+/**
+* Releases the arena, and with it all the nodes that were allocated from it, in a single pass over
+* its chunks. The nodes must not be referenced by nodes from other arenas or from the heap.
+*/
+void NodeArena_Release(NodeArena *a);
+
+#endif
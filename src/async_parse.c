@@ -0,0 +1,176 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include "async_parse.h"
+#include "json_object.h"
+
+static struct {
+    pthread_mutex_t lock;   // guards the queue and the counters
+    pthread_cond_t cond;    // signalled when jobs are queued
+    AsyncParseJob *head;    // the queue of jobs, oldest first
+    AsyncParseJob *tail;
+    int started;
+    size_t pending;
+    size_t parsed;
+} __asyncparse = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0};
+
+static size_t __asyncparseThreshold = ASYNCPARSE_DEFAULT_THRESHOLD;
+
+void AsyncParse_SetThreshold(size_t threshold) { __asyncparseThreshold = threshold; }
+
+size_t AsyncParse_GetThreshold() { return __asyncparseThreshold; }
+
+/* Parses a value into an arena of its own, on the calling thread. */
+static void _AsyncParse_Parse(AsyncParseValue *v) {
+    v->arena = NewNodeArena(v->len);
+    NodeArena *prev = Node_UseArena(v->arena);
+    v->rc = CreateNodeFromJSON(v->json, v->len, &v->value, &v->err);
+    Node_UseArena(prev);
+    if (JSONOBJECT_OK != v->rc) {
+        if (v->arena) NodeArena_Release(v->arena);
+        v->arena = NULL;
+        v->value = NULL;
+    }
+}
+
+static void *_AsyncParse_Main(void *arg) {
+    pthread_mutex_lock(&__asyncparse.lock);
+    while (1) {
+        while (!__asyncparse.head) pthread_cond_wait(&__asyncparse.cond, &__asyncparse.lock);
+        AsyncParseJob *job = __asyncparse.head;
+        __asyncparse.head = job->next;
+        if (!__asyncparse.head) __asyncparse.tail = NULL;
+        pthread_mutex_unlock(&__asyncparse.lock);
+
+        // stop at the first error, as the command replies with it
+        for (int i = 0; i < job->nvalues; i++) {
+            _AsyncParse_Parse(&job->values[i]);
+            if (JSONOBJECT_OK != job->values[i].rc) break;
+        }
+
+        pthread_mutex_lock(&__asyncparse.lock);
+        __asyncparse.pending--;
+        __asyncparse.parsed++;
+        pthread_mutex_unlock(&__asyncparse.lock);
+
+        // the job is owned by the client from here on
+        RedisModule_UnblockClient(job->bc, job);
+
+        pthread_mutex_lock(&__asyncparse.lock);
+    }
+    return NULL;
+}
+
+int AsyncParse_Start() {
+    if (__asyncparse.started) return OBJ_OK;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, _AsyncParse_Main, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc) return OBJ_ERR;
+
+    __asyncparse.started = 1;
+    return OBJ_OK;
+}
+
+/* Returns true while the server loads its data, when clients can't be blocked. */
+static int _AsyncParse_IsLoading(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, "INFO", "c", "persistence");
+    if (!reply) return 1;
+    size_t len;
+    const char *info = RedisModule_CallReplyStringPtr(reply, &len);
+    int loading = !info || memmem(info, len, "loading:1", 9) != NULL;
+    RedisModule_FreeCallReply(reply);
+    return loading;
+}
+
+int AsyncParse_Wanted(RedisModuleCtx *ctx, size_t len) {
+    return __asyncparse.started && __asyncparseThreshold && len >= __asyncparseThreshold &&
+           !_AsyncParse_IsLoading(ctx);
+}
+
+/* Frees a job once its client is unblocked, on the main thread. */
+static void _AsyncParse_FreeJob(void *privdata) {
+    AsyncParseJob *job = privdata;
+    for (int i = 0; i < job->nvalues; i++) {
+        AsyncParseValue *v = &job->values[i];
+        if (v->arena) NodeArena_Release(v->arena);
+        else if (v->value) Node_Free(v->value);
+        if (v->err) RedisModule_Free(v->err);
+    }
+    for (int i = 0; i < job->argc; i++) sdsfree(job->args[i]);
+    RedisModule_Free(job->values);
+    RedisModule_Free(job->args);
+    RedisModule_Free(job->argv);
+    RedisModule_Free(job);
+}
+
+int AsyncParse_Block(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int first, int last,
+                     RedisModuleCmdFunc reply) {
+    AsyncParseJob *job = RedisModule_Calloc(1, sizeof(AsyncParseJob));
+    // the arguments are copied, as the server frees them when the command returns
+    job->argc = argc;
+    job->args = RedisModule_Alloc(argc * sizeof(sds));
+    for (int i = 0; i < argc; i++) {
+        size_t len;
+        const char *arg = RedisModule_StringPtrLen(argv[i], &len);
+        job->args[i] = sdsnewlen(arg, len);
+    }
+    job->first = first;
+    job->nvalues = last - first;
+    job->values = RedisModule_Calloc(job->nvalues, sizeof(AsyncParseValue));
+    for (int i = 0; i < job->nvalues; i++) {
+        job->values[i].json = job->args[first + i];
+        job->values[i].len = sdslen(job->args[first + i]);
+    }
+    job->bc = RedisModule_BlockClient(ctx, reply, NULL, _AsyncParse_FreeJob, 0);
+
+    pthread_mutex_lock(&__asyncparse.lock);
+    if (__asyncparse.tail) __asyncparse.tail->next = job;
+    else __asyncparse.head = job;
+    __asyncparse.tail = job;
+    __asyncparse.pending++;
+    pthread_cond_signal(&__asyncparse.cond);
+    pthread_mutex_unlock(&__asyncparse.lock);
+    return REDISMODULE_OK;
+}
+
+AsyncParseJob *AsyncParse_GetJob(RedisModuleCtx *ctx) {
+    if (!RedisModule_IsBlockedReplyRequest(ctx)) return NULL;
+    AsyncParseJob *job = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (!job->argv) {
+        RedisModule_AutoMemory(ctx);
+        job->argv = RedisModule_Alloc(job->argc * sizeof(RedisModuleString *));
+        for (int i = 0; i < job->argc; i++) {
+            job->argv[i] = RedisModule_CreateString(ctx, job->args[i], sdslen(job->args[i]));
+        }
+    }
+    return job;
+}
+
+void AsyncParse_GetStats(AsyncParseStats *stats) {
+    pthread_mutex_lock(&__asyncparse.lock);
+    stats->pending = __asyncparse.pending;
+    stats->parsed = __asyncparse.parsed;
+    pthread_mutex_unlock(&__asyncparse.lock);
+    stats->threshold = __asyncparseThreshold;
+}
@@ -0,0 +1,100 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ASYNC_PARSE_H__
+#define __ASYNC_PARSE_H__
+
+#include <stddef.h>
+#include <sds.h>
+#include "object.h"
+#include "arena.h"
+#include "redismodule.h"
+
+// The default size, in bytes, of a command's JSON from which it's parsed in the background
+#define ASYNCPARSE_DEFAULT_THRESHOLD 0
+
+/*
+* Background parsing of large JSON payloads. Parsing a payload of tens of megabytes stalls the
+* server, so write commands with payloads above a threshold block their client and hand the payload
+* to a module-owned background thread. Once it's parsed, the command is called again as the
+* blocked client's reply callback, on the main thread, with the parsed values and the arguments it
+* was called with. It then looks the key up again, as it may have changed meanwhile, and applies the
+* values like a regular call would.
+*
+* The module API can't tell whether a command runs in a MULTI or a script, where clients can't be
+* blocked, so it's disabled by default. Payloads are always parsed synchronously while the server is
+* loading.
+*/
+
+/* A JSON argument parsed in the background. */
+typedef struct {
+    const char *json;         // the argument's buffer, in the job's copy
+    size_t len;
+    Node *value;              // the value, in its own arena, or NULL if it had been taken
+    NodeArena *arena;
+    int rc;                   // the parser's return code
+    char *err;                // the parser's error message, if any
+} AsyncParseValue;
+
+/* A blocked command. */
+typedef struct asyncParseJob {
+    struct asyncParseJob *next;
+    RedisModuleBlockedClient *bc;
+    sds *args;                 // copies of the command's arguments, owned by the module
+    RedisModuleString **argv;  // the arguments of the reply callback, see AsyncParse_GetJob
+    int argc;
+    AsyncParseValue *values;   // the parsed arguments, from the first to the last
+    int first;
+    int nvalues;
+} AsyncParseJob;
+
+/* The background parsing counters. */
+typedef struct {
+    size_t pending;    // commands waiting for the background thread
+    size_t parsed;     // commands parsed by the background thread
+    size_t threshold;  // size of the JSON from which commands are parsed in the background
+} AsyncParseStats;
+
+/** Sets the size of the JSON from which commands are parsed in the background, 0 disables it. */
+void AsyncParse_SetThreshold(size_t threshold);
+
+/** Returns the size of the JSON from which commands are parsed in the background. */
+size_t AsyncParse_GetThreshold();
+
+/** Starts the background thread, payloads are parsed synchronously until it's started. */
+int AsyncParse_Start();
+
+/** Returns true if a command with `len` bytes of JSON should be parsed in the background. */
+int AsyncParse_Wanted(RedisModuleCtx *ctx, size_t len);
+
+/**
+* Blocks the client and parses the arguments from `first` to `last` (exclusive) in the background.
+* `reply` is called with the job once they're parsed, unless the client disconnects meanwhile.
+*/
+int AsyncParse_Block(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int first, int last,
+                     RedisModuleCmdFunc reply);
+
+/**
+* Returns the job of a blocked client's reply callback, or NULL for a regular call. The job's argv
+* is created in the callback's context, and enables its automatic memory management to free them.
+*/
+AsyncParseJob *AsyncParse_GetJob(RedisModuleCtx *ctx);
+
+/** Fills the background parsing counters. */
+void AsyncParse_GetStats(AsyncParseStats *stats);
+
+#endif
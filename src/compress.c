@@ -0,0 +1,151 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compress.h"
+#include <pthread.h>
+#include <string.h>
+#define ZSTD_STATIC_LINKING_ONLY  // for the contexts' allocator
+#include <zstd.h>
+#include <zdict.h>
+#include "object.h"
+#include "redismodule.h"
+
+static void *__compress_alloc(void *opaque, size_t size) { return RedisModule_Alloc(size); }
+
+static void __compress_free(void *opaque, void *p) {
+    if (p) RedisModule_Free(p);
+}
+
+static const ZSTD_customMem __compress_mem = {__compress_alloc, __compress_free, NULL};
+
+/* The contexts of a thread, which are freed when it exits. */
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} __compress_ctx;
+
+struct CompressDict {
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+    size_t len;     // the size of the trained dictionary
+    uint32_t refs;  // the references, taken and dropped by any thread
+};
+
+static pthread_key_t __compress_key;
+static pthread_once_t __compress_once = PTHREAD_ONCE_INIT;
+
+static void __compress_ctx_free(void *p) {
+    __compress_ctx *ctx = p;
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    RedisModule_Free(ctx);
+}
+
+static void __compress_init() { pthread_key_create(&__compress_key, __compress_ctx_free); }
+
+static __compress_ctx *__compress_ctx_get() {
+    pthread_once(&__compress_once, __compress_init);
+    __compress_ctx *ctx = pthread_getspecific(__compress_key);
+    if (ctx) return ctx;
+
+    // the callers keep the sizes and the dictionaries, so the frames leave them out
+    ctx = RedisModule_Alloc(sizeof(__compress_ctx));
+    ctx->cctx = ZSTD_createCCtx_advanced(__compress_mem);
+    ctx->dctx = ZSTD_createDCtx_advanced(__compress_mem);
+    ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel, COMPRESS_LEVEL);
+    ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_contentSizeFlag, 0);
+    ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_dictIDFlag, 0);
+    pthread_setspecific(__compress_key, ctx);
+    return ctx;
+}
+
+size_t Compress_Bound(size_t len) { return ZSTD_compressBound(len); }
+
+size_t Compress_Encode(const void *src, size_t len, void *dst, size_t cap) {
+    return Compress_EncodeDict(NULL, src, len, dst, cap);
+}
+
+size_t Compress_EncodeDict(const CompressDict *dict, const void *src, size_t len, void *dst,
+                           size_t cap) {
+    // a dictionary is only referenced for the call
+    ZSTD_CCtx *cctx = __compress_ctx_get()->cctx;
+    if (dict) ZSTD_CCtx_refCDict(cctx, dict->cdict);
+    size_t ret = ZSTD_compress2(cctx, dst, cap, src, len);
+    if (dict) ZSTD_CCtx_refCDict(cctx, NULL);
+    return ZSTD_isError(ret) ? 0 : ret;
+}
+
+int Compress_Decode(const void *src, size_t len, void *dst, size_t size) {
+    return Compress_DecodeDict(NULL, src, len, dst, size);
+}
+
+int Compress_DecodeDict(const CompressDict *dict, const void *src, size_t len, void *dst,
+                        size_t size) {
+    ZSTD_DCtx *dctx = __compress_ctx_get()->dctx;
+    if (dict) ZSTD_DCtx_refDDict(dctx, dict->ddict);
+    size_t ret = ZSTD_decompressDCtx(dctx, dst, size, src, len);
+    if (dict) ZSTD_DCtx_refDDict(dctx, NULL);
+    return !ZSTD_isError(ret) && ret == size ? OBJ_OK : OBJ_ERR;
+}
+
+CompressDict *Compress_Train(const char **samples, const size_t *lens, size_t n, size_t cap) {
+    if (cap > COMPRESS_MAX_DICT) cap = COMPRESS_MAX_DICT;
+
+    // the samples are trained on one after the other
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) total += lens[i];
+    char *buf = RedisModule_Alloc(total ? total : 1), *p = buf;
+    for (size_t i = 0; i < n; i++, p += lens[i - 1]) memcpy(p, samples[i], lens[i]);
+
+    char *data = RedisModule_Alloc(cap);
+    size_t len = ZDICT_trainFromBuffer(data, cap, buf, lens, (unsigned)n);
+    RedisModule_Free(buf);
+    if (ZDICT_isError(len)) {
+        RedisModule_Free(data);
+        return NULL;
+    }
+
+    // the digested dictionaries keep copies of the data
+    CompressDict *dict = RedisModule_Alloc(sizeof(CompressDict));
+    ZSTD_compressionParameters params = ZSTD_getCParams(COMPRESS_LEVEL, 0, len);
+    dict->cdict = ZSTD_createCDict_advanced(data, len, ZSTD_dlm_byCopy, ZSTD_dct_fullDict, params,
+                                            __compress_mem);
+    dict->ddict =
+        ZSTD_createDDict_advanced(data, len, ZSTD_dlm_byCopy, ZSTD_dct_fullDict, __compress_mem);
+    dict->len = len;
+    dict->refs = 1;
+    RedisModule_Free(data);
+    if (!dict->cdict || !dict->ddict) {
+        Compress_DictRelease(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+CompressDict *Compress_DictRetain(CompressDict *dict) {
+    if (dict) __atomic_add_fetch(&dict->refs, 1, __ATOMIC_RELAXED);
+    return dict;
+}
+
+void Compress_DictRelease(CompressDict *dict) {
+    if (!dict || __atomic_sub_fetch(&dict->refs, 1, __ATOMIC_ACQ_REL)) return;
+    ZSTD_freeCDict(dict->cdict);
+    ZSTD_freeDDict(dict->ddict);
+    RedisModule_Free(dict);
+}
+
+size_t Compress_DictSize(const CompressDict *dict) { return dict ? dict->len : 0; }
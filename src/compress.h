@@ -0,0 +1,78 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stddef.h>
+
+/*
+* Compression of large string values and of frozen values, with zstd (vendored in deps/zstd). The
+* frames leave out the sizes of the data, which the callers keep. Every thread compresses with its
+* own contexts, so the functions are thread safe.
+*
+* Small inputs that are alike, e.g. documents of the same shape, compress better with a dictionary
+* that's trained on samples of them. A dictionary is digested once for compression and once for
+* decompression, and is reference counted, so data outlives the code that stopped using it.
+*/
+
+// The compression level, which favors speed
+#define COMPRESS_LEVEL 1
+// The largest dictionary that's trained
+#define COMPRESS_MAX_DICT (8 * 1024)
+
+typedef struct CompressDict CompressDict;
+
+/** Returns the most bytes that compressing `len` bytes can take. */
+size_t Compress_Bound(size_t len);
+
+/**
+* Compresses `len` bytes from `src` into `dst`, which has room for `cap` bytes. Returns the size of
+* the compressed data, or 0 if it doesn't fit.
+*/
+size_t Compress_Encode(const void *src, size_t len, void *dst, size_t cap);
+
+/**
+* Decompresses `len` bytes from `src` into `dst`, which must be exactly the size of the original
+* data. Returns OBJ_OK, or OBJ_ERR if the data is corrupt.
+*/
+int Compress_Decode(const void *src, size_t len, void *dst, size_t size);
+
+/** Compresses like Compress_Encode, with a dictionary. A NULL dictionary is ignored. */
+size_t Compress_EncodeDict(const CompressDict *dict, const void *src, size_t len, void *dst,
+                           size_t cap);
+
+/** Decompresses data that was compressed with a dictionary. A NULL dictionary is ignored. */
+int Compress_DecodeDict(const CompressDict *dict, const void *src, size_t len, void *dst,
+                        size_t size);
+
+/**
+* Trains a dictionary of up to `cap` bytes (and COMPRESS_MAX_DICT at most) on `n` samples, with a
+* reference for the caller. Returns NULL if the samples are too few or too small.
+*/
+CompressDict *Compress_Train(const char **samples, const size_t *lens, size_t n, size_t cap);
+
+/** Takes a reference to a dictionary. Returns the dictionary, NULL is ignored. */
+CompressDict *Compress_DictRetain(CompressDict *dict);
+
+/** Drops a reference to a dictionary, freeing it with the last one. NULL is ignored. */
+void Compress_DictRelease(CompressDict *dict);
+
+/** Returns the size of a dictionary as it was trained, 0 for NULL. */
+size_t Compress_DictSize(const CompressDict *dict);
+
+#endif
@@ -0,0 +1,409 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "expiry.h"
+
+#define __EXPIRY_MASK (EXPIRY_WHEEL_SLOTS - 1)
+
+/**
+* A hierarchical timer wheel. An entry is placed in the lowest level whose span holds its delay,
+* in the slot of its expiry time's digit at that level. The slots of the upper levels are cascaded
+* to the lower ones when the wheel reaches them, and those of the lowest level are due. The occupied
+* slots are flagged in bitmaps, so the wheel skips to its next occupied slot.
+*/
+static struct {
+    ExpiryEntry slots[EXPIRY_WHEEL_LEVELS * EXPIRY_WHEEL_SLOTS];  // the heads of circular lists
+    uint64_t occupied[EXPIRY_WHEEL_LEVELS];
+    ExpiryEntry due;
+    ExpiryEntry parked;
+    uint64_t current;  // the time that the wheel was advanced to
+    uint64_t next;     // no slot is reached before this time
+    size_t count;      // the number of entries, including the due ones
+    size_t pending;    // the number of entries in the slots
+    int init;
+} __wheel;
+
+static void __wheel_init() {
+    for (int i = 0; i < EXPIRY_WHEEL_LEVELS * EXPIRY_WHEEL_SLOTS; i++) {
+        __wheel.slots[i].prev = __wheel.slots[i].next = &__wheel.slots[i];
+    }
+    __wheel.due.prev = __wheel.due.next = &__wheel.due;
+    __wheel.parked.prev = __wheel.parked.next = &__wheel.parked;
+    __wheel.next = UINT64_MAX;
+    __wheel.init = 1;
+}
+
+static inline void __list_append(ExpiryEntry *head, ExpiryEntry *e) {
+    e->prev = head->prev;
+    e->next = head;
+    head->prev->next = e;
+    head->prev = e;
+}
+
+/* Removes an entry from its slot, or from the due or parked entries. */
+static void __wheel_unlink(ExpiryEntry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    if (-2 == e->slot) e->doc->parked--;
+    if (e->slot >= 0) {
+        __wheel.pending--;
+        ExpiryEntry *head = &__wheel.slots[e->slot];
+        if (head->next == head) {
+            __wheel.occupied[e->slot >> EXPIRY_WHEEL_BITS] &= ~(1ULL << (e->slot & __EXPIRY_MASK));
+        }
+    }
+}
+
+/* Places an entry in the wheel relative to its current time, or in the due entries. */
+static void __wheel_insert(ExpiryEntry *e) {
+    if (e->when <= __wheel.current) {
+        e->slot = -1;
+        __list_append(&__wheel.due, e);
+        return;
+    }
+
+    // entries beyond the wheel's span are placed in its last slot, and again when it's reached
+    uint64_t delay = e->when - __wheel.current;
+    if (delay >= EXPIRY_WHEEL_SPAN) delay = EXPIRY_WHEEL_SPAN - 1;
+    uint64_t when = __wheel.current + delay;
+    int level = (63 - __builtin_clzll(delay)) / EXPIRY_WHEEL_BITS;
+    int shift = level * EXPIRY_WHEEL_BITS;
+    int slot = (when >> shift) & __EXPIRY_MASK;
+
+    e->slot = level * EXPIRY_WHEEL_SLOTS + slot;
+    __list_append(&__wheel.slots[e->slot], e);
+    __wheel.occupied[level] |= 1ULL << slot;
+    __wheel.pending++;
+
+    // the slot is reached at the start of its span
+    uint64_t reached = (when >> shift) << shift;
+    if (reached < __wheel.next) __wheel.next = reached;
+}
+
+/* Returns the time at which the wheel reaches its next occupied slot, UINT64_MAX if it's empty. */
+static uint64_t __wheel_nextSlot() {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < EXPIRY_WHEEL_LEVELS; level++) {
+        uint64_t occupied = __wheel.occupied[level];
+        if (!occupied) continue;
+        int shift = level * EXPIRY_WHEEL_BITS;
+        // rotate the bitmap so it starts at the level's next slot
+        uint64_t index = (__wheel.current >> shift) + 1;
+        int start = index & __EXPIRY_MASK;
+        if (start) occupied = (occupied >> start) | (occupied << (64 - start));
+        uint64_t reached = (index + __builtin_ctzll(occupied)) << shift;
+        if (reached < next) next = reached;
+    }
+    return next;
+}
+
+/* Moves the entries of a slot to the lower levels, or to the due entries. */
+static void __wheel_cascade(int slot) {
+    ExpiryEntry *head = &__wheel.slots[slot];
+    while (head->next != head) {
+        ExpiryEntry *e = head->next;
+        __wheel_unlink(e);
+        __wheel_insert(e);
+    }
+}
+
+void Expiry_Advance(uint64_t now) {
+    if (!__wheel.init) __wheel_init();
+    while (__wheel.pending) {
+        uint64_t t = __wheel_nextSlot();
+        if (t > now) break;
+        __wheel.current = t;
+        for (int level = EXPIRY_WHEEL_LEVELS - 1; level >= 0; level--) {
+            int shift = level * EXPIRY_WHEEL_BITS;
+            if (t & ((1ULL << shift) - 1)) continue;
+            __wheel_cascade(level * EXPIRY_WHEEL_SLOTS + ((t >> shift) & __EXPIRY_MASK));
+        }
+    }
+    if (now > __wheel.current) __wheel.current = now;
+    __wheel.next = __wheel.pending ? __wheel_nextSlot() : UINT64_MAX;
+}
+
+int Expiry_Pending(uint64_t now) {
+    return __wheel.count && (__wheel.due.next != &__wheel.due || __wheel.next <= now);
+}
+
+ExpiryEntry *Expiry_NextDue() {
+    if (!__wheel.init || __wheel.due.next == &__wheel.due) return NULL;
+    return __wheel.due.next;
+}
+
+size_t Expiry_Count() { return __wheel.count; }
+
+/* Returns the index of the first entry of a value whose path isn't less than a path. */
+static uint32_t __expiryDoc_lowerBound(const ExpiryDoc *doc, const char *path) {
+    uint32_t lo = 0, hi = doc->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(doc->entries[mid]->path, path) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void __expiry_free(ExpiryEntry *e) {
+    __wheel_unlink(e);
+    __wheel.count--;
+    sdsfree(e->path);
+    RedisModule_Free(e);
+}
+
+/* Frees a range of a value's entries, and the value's TTLs if none are left. */
+static void __expiryDoc_delRange(ExpiryDoc *doc, uint32_t start, uint32_t stop) {
+    for (uint32_t i = start; i < stop; i++) __expiry_free(doc->entries[i]);
+    memmove(&doc->entries[start], &doc->entries[stop], (doc->len - stop) * sizeof(ExpiryEntry *));
+    doc->len -= stop - start;
+    if (doc->len) return;
+
+    doc->jt->expiries = NULL;
+    sdsfree(doc->key);
+    RedisModule_Free(doc->entries);
+    RedisModule_Free(doc);
+}
+
+void Expiry_Set(JSONType_t *jt, int db, const char *key, size_t keylen, const char *path,
+                size_t pathlen, uint64_t when) {
+    if (!__wheel.init) __wheel_init();
+    ExpiryDoc *doc = jt->expiries;
+    if (!doc) {
+        doc = RedisModule_Calloc(1, sizeof(ExpiryDoc));
+        doc->jt = jt;
+        doc->db = -1;
+        jt->expiries = doc;
+    }
+    if (key) Expiry_Bind(jt, db, key, keylen);
+
+    sds p = sdsnewlen(path, pathlen);
+    uint32_t i = __expiryDoc_lowerBound(doc, p);
+    ExpiryEntry *e;
+    if (i < doc->len && !strcmp(doc->entries[i]->path, p)) {
+        e = doc->entries[i];
+        __wheel_unlink(e);
+        sdsfree(p);
+    } else {
+        if (doc->len == doc->cap) {
+            doc->cap = doc->cap ? doc->cap * 2 : 4;
+            doc->entries = RedisModule_Realloc(doc->entries, doc->cap * sizeof(ExpiryEntry *));
+        }
+        memmove(&doc->entries[i + 1], &doc->entries[i], (doc->len - i) * sizeof(ExpiryEntry *));
+        e = RedisModule_Calloc(1, sizeof(ExpiryEntry));
+        e->path = p;
+        e->doc = doc;
+        doc->entries[i] = e;
+        doc->len++;
+        __wheel.count++;
+    }
+    e->when = when;
+    __wheel_insert(e);
+}
+
+uint64_t Expiry_Get(const JSONType_t *jt, const char *path) {
+    const ExpiryDoc *doc = jt->expiries;
+    if (!doc) return 0;
+    uint32_t i = __expiryDoc_lowerBound(doc, path);
+    return i < doc->len && !strcmp(doc->entries[i]->path, path) ? doc->entries[i]->when : 0;
+}
+
+int Expiry_Passed(const JSONType_t *jt, uint64_t now) {
+    const ExpiryDoc *doc = jt->expiries;
+    for (uint32_t i = 0; doc && i < doc->len; i++) {
+        if (doc->entries[i]->when <= now) return 1;
+    }
+    return 0;
+}
+
+void Expiry_Clear(JSONType_t *jt, const char *path) {
+    ExpiryDoc *doc = jt->expiries;
+    if (!doc) return;
+
+    // the canonical paths of the descendants are those that the path prefixes
+    size_t len = strlen(path);
+    uint32_t start = __expiryDoc_lowerBound(doc, path), stop = start;
+    while (stop < doc->len && !strncmp(doc->entries[stop]->path, path, len)) stop++;
+    if (stop > start) __expiryDoc_delRange(doc, start, stop);
+}
+
+static int __expiry_cmpPaths(const void *a, const void *b) {
+    return strcmp((*(const ExpiryEntry **)a)->path, (*(const ExpiryEntry **)b)->path);
+}
+
+void Expiry_Splice(JSONType_t *jt, const char *array, long index, long deleted, long inserted) {
+    ExpiryDoc *doc = jt->expiries;
+    if (!doc || (!deleted && !inserted)) return;
+
+    // the paths of the elements' TTLs are prefixed by the array's, and stay so when they're shifted
+    size_t len = strlen(array);
+    uint32_t start = __expiryDoc_lowerBound(doc, array), i = start;
+    int shifted = 0;
+    while (i < doc->len && !strncmp(doc->entries[i]->path, array, len)) {
+        ExpiryEntry *e = doc->entries[i];
+        const char *p = e->path + len;
+        char *end;
+        long at = '[' == p[0] && '"' != p[1] && '\'' != p[1] ? strtol(p + 1, &end, 10) : -1;
+        if (at < index) {
+            i++;
+        } else if (at < index + deleted) {
+            __expiryDoc_delRange(doc, i, i + 1);
+            if (!jt->expiries) return;
+        } else {
+            sds path = sdsnewlen(e->path, len);
+            path = sdscatfmt(path, "[%I", (long long)(at + inserted - deleted));
+            path = sdscat(path, end);
+            sdsfree(e->path);
+            e->path = path;
+            shifted = 1;
+            i++;
+        }
+    }
+    if (shifted) qsort(&doc->entries[start], i - start, sizeof(ExpiryEntry *), __expiry_cmpPaths);
+}
+
+void Expiry_Remove(ExpiryEntry *e) {
+    ExpiryDoc *doc = e->doc;
+    uint32_t i = __expiryDoc_lowerBound(doc, e->path);
+    __expiryDoc_delRange(doc, i, i + 1);
+}
+
+void Expiry_Forget(JSONType_t *jt) {
+    if (jt->expiries) __expiryDoc_delRange(jt->expiries, 0, jt->expiries->len);
+}
+
+uint32_t Expiry_Bind(JSONType_t *jt, int db, const char *key, size_t len) {
+    ExpiryDoc *doc = jt->expiries;
+    if (!doc) return 0;
+    if (!doc->key || doc->db != db || sdslen(doc->key) != len || memcmp(doc->key, key, len)) {
+        sdsfree(doc->key);
+        doc->key = sdsnewlen(key, len);
+        doc->db = db;
+    }
+
+    // parked entries are past their expiry times, so they're due again
+    uint32_t parked = doc->parked;
+    for (uint32_t i = 0; doc->parked && i < doc->len; i++) {
+        ExpiryEntry *e = doc->entries[i];
+        if (-2 != e->slot) continue;
+        __wheel_unlink(e);
+        __wheel_insert(e);
+    }
+    return parked;
+}
+
+void Expiry_Park(ExpiryEntry *e) {
+    __wheel_unlink(e);
+    e->slot = -2;
+    e->doc->parked++;
+    __list_append(&__wheel.parked, e);
+}
+
+size_t Expiry_MemoryUsage(const JSONType_t *jt) {
+    const ExpiryDoc *doc = jt->expiries;
+    if (!doc) return 0;
+    size_t memory = sizeof(ExpiryDoc) + doc->cap * sizeof(ExpiryEntry *);
+    for (uint32_t i = 0; i < doc->len; i++) {
+        memory += sizeof(ExpiryEntry) + sdsAllocSize(doc->entries[i]->path);
+    }
+    return memory;
+}
+
+sds Expiry_FormatPath(const SearchPath *sp, Node *root) {
+    sds path = sdsempty();
+    Node *n = root;  // the value at the path so far, NULL once it's outside of the document
+    for (size_t i = 0; i < sp->len; i++) {
+        const PathNode *pn = &sp->nodes[i];
+        if (NT_ROOT == pn->type) continue;
+        if (NT_INDEX == pn->type) {
+            int index = pn->value.index;
+            int isarr = n && N_ARRAY == NODETYPE(n);
+            if (index < 0 && isarr) index += Node_Length(n);
+            if (index < 0) {
+                sdsfree(path);
+                return NULL;
+            }
+            if (!isarr || OBJ_OK != Node_ArrayItem(n, index, &n)) n = NULL;
+            path = sdscatfmt(path, "[%i]", index);
+            continue;
+        }
+        if (NT_KEY == pn->type && n) {
+            if (N_DICT != NODETYPE(n) || OBJ_OK != Node_DictGetInterned(n, pn->value.key, &n)) {
+                n = NULL;
+            }
+        }
+        char quote = 0;
+        if (NT_KEY == pn->type) {
+            quote = !strchr(pn->value.key, '"') ? '"' : !strchr(pn->value.key, '\'') ? '\'' : 0;
+        }
+        if (!quote) {
+            sdsfree(path);
+            return NULL;
+        }
+        path = sdscatlen(path, "[", 1);
+        path = sdscatlen(path, &quote, 1);
+        path = sdscat(path, pn->value.key);
+        path = sdscatlen(path, &quote, 1);
+        path = sdscatlen(path, "]", 1);
+    }
+    return path;
+}
+
+/* Returns the number of deleted elements of an array at a canonical path, up to an index. */
+static long __countDeleted(const char *array, size_t len, long index, const sds *deleted,
+                           size_t n) {
+    long count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (sdslen(deleted[i]) <= len + 2 || memcmp(deleted[i], array, len) ||
+            '[' != deleted[i][len] || '"' == deleted[i][len + 1] || '\'' == deleted[i][len + 1]) {
+            continue;
+        }
+        char *end;
+        long deletedIndex = strtol(deleted[i] + len + 1, &end, 10);
+        if (']' == end[0] && !end[1] && deletedIndex <= index) count++;
+    }
+    return count;
+}
+
+sds Expiry_UnshiftPath(const char *path, const sds *deleted, size_t n) {
+    sds unshifted = sdsempty();
+    while (*path) {
+        // keys are quoted with a quote that they don't have
+        if ('"' == path[1] || '\'' == path[1]) {
+            const char *end = strchr(path + 2, path[1]) + 2;
+            unshifted = sdscatlen(unshifted, path, end - path);
+            path = end;
+            continue;
+        }
+
+        // every deleted element up to the index shifted it down
+        char *end;
+        long shifted = strtol(path + 1, &end, 10), index = shifted, next;
+        size_t len = sdslen(unshifted);
+        while ((next = shifted + __countDeleted(unshifted, len, index, deleted, n)) != index) {
+            index = next;
+        }
+        unshifted = sdscatfmt(unshifted, "[%I]", (long long)index);
+        path = end + 1;
+    }
+    return unshifted;
+}
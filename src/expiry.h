@@ -0,0 +1,134 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __EXPIRY_H__
+#define __EXPIRY_H__
+
+#include <stdint.h>
+#include <sds.h>
+#include "json_type.h"
+#include "path.h"
+
+// A level of the timer wheel has 2^EXPIRY_WHEEL_BITS slots, each level's slot spans a whole lower
+// level
+#define EXPIRY_WHEEL_BITS 6
+#define EXPIRY_WHEEL_SLOTS (1 << EXPIRY_WHEEL_BITS)
+#define EXPIRY_WHEEL_LEVELS 6
+
+// The longest delay in milliseconds that the wheel holds, about 2 years, entries that expire later
+// are placed again when they're reached
+#define EXPIRY_WHEEL_SPAN (1ULL << (EXPIRY_WHEEL_BITS * EXPIRY_WHEEL_LEVELS))
+
+struct ExpiryDoc;
+
+/* The TTL of a path in a JSON value. */
+typedef struct ExpiryEntry {
+    struct ExpiryEntry *prev, *next;  // the entries of a slot of the wheel, the due or parked ones
+    int slot;                         // the index of the wheel's slot, -1 when due, -2 when parked
+    uint64_t when;                    // the expiry time in milliseconds
+    sds path;                         // the canonical path (see Expiry_FormatPath)
+    struct ExpiryDoc *doc;
+} ExpiryEntry;
+
+/* The TTLs of a JSON value, ordered by their paths so a path's descendants are adjacent. */
+typedef struct ExpiryDoc {
+    JSONType_t *jt;
+    sds key;  // the name of the value's key, NULL when unknown, e.g. after loading from RDB
+    int db;
+    ExpiryEntry **entries;
+    uint32_t len, cap;
+    uint32_t parked;  // the number of parked entries
+} ExpiryDoc;
+
+/**
+* Sets the expiry time of a path in a JSON value, replacing the path's previous one. The path is
+* canonical. The key name, if given, is the value's key in db.
+*
+* Expiry times are kept in a hierarchical timer wheel with millisecond ticks, so scheduling and
+* expiring a TTL take constant time, regardless of how many TTLs there are and how far they are.
+*/
+void Expiry_Set(JSONType_t *jt, int db, const char *key, size_t keylen, const char *path,
+                size_t pathlen, uint64_t when);
+
+/* Returns the expiry time of a canonical path in a JSON value, 0 if it has no TTL. */
+uint64_t Expiry_Get(const JSONType_t *jt, const char *path);
+
+/* Returns true if a JSON value has TTLs that passed by now, whether or not they're due yet. */
+int Expiry_Passed(const JSONType_t *jt, uint64_t now);
+
+/* Clears the TTLs of a canonical path and its descendants in a JSON value. */
+void Expiry_Clear(JSONType_t *jt, const char *path);
+
+/**
+* Adjusts the TTLs of the elements of an array at a canonical path, and of their descendants, to a
+* splice of the array: those of the `deleted` elements from `index` are cleared, and those of the
+* following elements are shifted by `inserted` - `deleted`, so TTLs stay with their elements.
+*/
+void Expiry_Splice(JSONType_t *jt, const char *array, long index, long deleted, long inserted);
+
+/* Clears a single TTL. */
+void Expiry_Remove(ExpiryEntry *e);
+
+/* Clears the TTLs of a JSON value that's freed. */
+void Expiry_Forget(JSONType_t *jt);
+
+/**
+* Sets the key name of a JSON value that has TTLs, making its parked TTLs due again. Returns the
+* number of those.
+*/
+uint32_t Expiry_Bind(JSONType_t *jt, int db, const char *key, size_t len);
+
+/**
+* Parks a due entry whose value isn't in the key it's bound to, until the value is bound again. Parked
+* entries aren't returned by Expiry_NextDue.
+*/
+void Expiry_Park(ExpiryEntry *e);
+
+/* Returns the memory used by the TTLs of a JSON value. */
+size_t Expiry_MemoryUsage(const JSONType_t *jt);
+
+/* Returns the number of TTLs. */
+size_t Expiry_Count();
+
+/* Returns true if the wheel has entries that are due, or that must be placed again, by now. */
+int Expiry_Pending(uint64_t now);
+
+/**
+* Advances the wheel to now, moving the entries that expired by then to the due entries. Due entries
+* are returned by Expiry_NextDue, in no particular order, until they're cleared.
+*/
+void Expiry_Advance(uint64_t now);
+
+/* Returns a due entry, NULL if there are none. */
+ExpiryEntry *Expiry_NextDue();
+
+/**
+* Formats the canonical form of a path, in which keys are quoted in brackets, e.g. ["a"][3]['b"c'],
+* and the root is empty. Negative indices are counted from the ends of the arrays in `root`, so a
+* value has one form however it's addressed. Returns NULL for paths that can match multiple values,
+* for keys that have both kinds of quotes, and for negative indices outside of `root`'s arrays.
+*/
+sds Expiry_FormatPath(const SearchPath *sp, Node *root);
+
+/**
+* Returns the canonical path that a canonical path had before the array elements at other canonical
+* paths were deleted, e.g. [3] for [2] after [0] and [2] were deleted. The deleted paths are those
+* that the elements had before the deletions.
+*/
+sds Expiry_UnshiftPath(const char *path, const sds *deleted, size_t n);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include "redismodule.h"
+#include "intern.h"
+
+/* An interned string's header, the string itself follows it. */
+typedef struct internEntry {
+    struct internEntry *next;  // next entry in the bucket's chain
+    uint32_t refcount;
+    uint32_t hash;
+    uint32_t len;
+    char data[];
+} internEntry;
+
+#define __intern_entry(s) ((internEntry *)((s) - offsetof(internEntry, data)))
+
+// a refcount that had reached this value is never changed, so the string is never freed
+#define INTERN_REFCOUNT_MAX UINT32_MAX
+
+// the table's initial number of buckets, must be a power of 2
+#define INTERN_INITIAL_SIZE 1024
+
+static struct {
+    internEntry **buckets;
+    size_t size;   // number of buckets
+    size_t count;  // number of entries
+} __intern_table = {NULL, 0, 0};
+
+// guards the table and the refcounts, as keys are also released by the lazy free thread
+static pthread_mutex_t __intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t Intern_HashBuffer(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Doubles the number of buckets and rehashes the entries. */
+static void __intern_grow() {
+    size_t size = __intern_table.size ? __intern_table.size * 2 : INTERN_INITIAL_SIZE;
+    internEntry **buckets = RedisModule_Calloc(size, sizeof(internEntry *));
+
+    for (size_t i = 0; i < __intern_table.size; i++) {
+        internEntry *e = __intern_table.buckets[i];
+        while (e) {
+            internEntry *next = e->next;
+            e->next = buckets[e->hash & (size - 1)];
+            buckets[e->hash & (size - 1)] = e;
+            e = next;
+        }
+    }
+
+    if (__intern_table.buckets) RedisModule_Free(__intern_table.buckets);
+    __intern_table.buckets = buckets;
+    __intern_table.size = size;
+}
+
+static internEntry *__intern_lookup(const char *s, size_t len, uint32_t hash) {
+    if (!__intern_table.size) return NULL;
+
+    internEntry *e = __intern_table.buckets[hash & (__intern_table.size - 1)];
+    while (e && (e->hash != hash || e->len != len || memcmp(e->data, s, len))) e = e->next;
+    return e;
+}
+
+static inline void __intern_retain(internEntry *e) {
+    if (e->refcount != INTERN_REFCOUNT_MAX) e->refcount++;
+}
+
+const char *Intern_Acquire(const char *s, size_t len) {
+    uint32_t hash = Intern_HashBuffer(s, len);
+    pthread_mutex_lock(&__intern_lock);
+    internEntry *e = __intern_lookup(s, len, hash);
+    if (e) {
+        __intern_retain(e);
+        pthread_mutex_unlock(&__intern_lock);
+        return e->data;
+    }
+
+    if (__intern_table.count >= __intern_table.size) __intern_grow();
+
+    e = RedisModule_Alloc(sizeof(internEntry) + len + 1);
+    e->refcount = 1;
+    e->hash = hash;
+    e->len = len;
+    memcpy(e->data, s, len);
+    e->data[len] = '\0';
+
+    internEntry **bucket = &__intern_table.buckets[hash & (__intern_table.size - 1)];
+    e->next = *bucket;
+    *bucket = e;
+    __intern_table.count++;
+    pthread_mutex_unlock(&__intern_lock);
+
+    return e->data;
+}
+
+const char *Intern_Retain(const char *s) {
+    pthread_mutex_lock(&__intern_lock);
+    __intern_retain(__intern_entry(s));
+    pthread_mutex_unlock(&__intern_lock);
+    return s;
+}
+
+void Intern_Release(const char *s) {
+    if (!s) return;
+
+    internEntry *e = __intern_entry(s);
+    pthread_mutex_lock(&__intern_lock);
+    if (e->refcount == INTERN_REFCOUNT_MAX || --e->refcount) {
+        pthread_mutex_unlock(&__intern_lock);
+        return;
+    }
+
+    // unlink and free the entry
+    internEntry **p = &__intern_table.buckets[e->hash & (__intern_table.size - 1)];
+    while (*p != e) p = &(*p)->next;
+    *p = e->next;
+    __intern_table.count--;
+    pthread_mutex_unlock(&__intern_lock);
+    RedisModule_Free(e);
+}
+
+const char *Intern_Find(const char *s, uint32_t *hash) {
+    size_t len = strlen(s);
+    uint32_t h = Intern_HashBuffer(s, len);
+    pthread_mutex_lock(&__intern_lock);
+    internEntry *e = __intern_lookup(s, len, h);
+    if (e) __intern_retain(e);
+    pthread_mutex_unlock(&__intern_lock);
+    if (hash) *hash = h;
+    return e ? e->data : NULL;
+}
+
+uint32_t Intern_Len(const char *s) { return __intern_entry(s)->len; }
+
+uint32_t Intern_Hash(const char *s) { return __intern_entry(s)->hash; }
+
+uint32_t Intern_Refcount(const char *s) {
+    pthread_mutex_lock(&__intern_lock);
+    uint32_t refcount = __intern_entry(s)->refcount;
+    pthread_mutex_unlock(&__intern_lock);
+    return refcount;
+}
+
+size_t Intern_Size(const char *s) { return sizeof(internEntry) + __intern_entry(s)->len + 1; }
+
+size_t Intern_Count() {
+    pthread_mutex_lock(&__intern_lock);
+    size_t count = __intern_table.count;
+    pthread_mutex_unlock(&__intern_lock);
+    return count;
+}
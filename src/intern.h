@@ -0,0 +1,66 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* A module-wide table of interned strings, used for the keys of dictionaries. Every distinct key is
+* stored once and shared by all the key-value nodes that use it, so keys are compared by pointer.
+* Interned strings are reference counted and NULL terminated. They must never be modified or freed
+* other than with Intern_Release. The table is thread safe, as values may be freed in the background
+* (see lazyfree.h).
+*/
+
+/** Returns the interned copy of the buffer, adding it to the table if needed. Takes a reference. */
+const char *Intern_Acquire(const char *s, size_t len);
+
+/** Takes another reference to an interned string. */
+const char *Intern_Retain(const char *s);
+
+/** Drops a reference to an interned string, freeing it when no references are left. */
+void Intern_Release(const char *s);
+
+/**
+* Returns the interned copy of a c-string or NULL if it isn't interned. A reference is taken, so the
+* string can't be freed by another thread while it's used, and must be dropped with Intern_Release.
+* If `hash` isn't NULL it's set to the string's hash.
+*/
+const char *Intern_Find(const char *s, uint32_t *hash);
+
+/** Returns the length of an interned string. */
+uint32_t Intern_Len(const char *s);
+
+/** Returns the hash of an interned string, as computed by Intern_HashBuffer. */
+uint32_t Intern_Hash(const char *s);
+
+/** Returns the number of references to an interned string. */
+uint32_t Intern_Refcount(const char *s);
+
+/** Returns the memory used by an interned string. */
+size_t Intern_Size(const char *s);
+
+/** Returns the number of strings in the table. */
+size_t Intern_Count();
+
+/** The hash function used by the table (FNV-1a). */
+uint32_t Intern_HashBuffer(const char *s, size_t len);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "intern.h"
+#include "json_cache.h"
+#include "redismodule.h"
+
+#define JSON_CACHE_INITIAL_BUCKETS 64
+
+/* A cached serialization, that's both in the hash table and in the LRU list. */
+typedef struct cacheEntry {
+    struct cacheEntry *hnext;  // next entry in the bucket
+    struct cacheEntry *prev;   // more recently used entry
+    struct cacheEntry *next;   // less recently used entry
+    uint64_t version;          // the value's version
+    uint32_t hash;             // hash of the version and request
+    size_t reqlen;             // length of the request
+    size_t len;                // length of the serialization
+    char data[];               // the request followed by the serialization
+} cacheEntry;
+
+static struct {
+    cacheEntry **buckets;  // hash table of entries
+    size_t nbuckets;       // number of buckets, a power of 2
+    cacheEntry *head;      // the most recently used entry
+    cacheEntry *tail;      // the least recently used entry
+    JSONCacheStats stats;
+} __json_cache = {.stats = {.maxmemory = JSON_CACHE_DEFAULT_MAX_MEMORY}};
+
+#define __entrySize(reqlen, len) (sizeof(cacheEntry) + (reqlen) + (len))
+
+static inline uint32_t __hash(uint64_t version, const char *req, size_t reqlen) {
+    return Intern_HashBuffer(req, reqlen) ^ (uint32_t)(version * 0x9e3779b97f4a7c15ULL >> 32);
+}
+
+static inline cacheEntry **__bucket(uint32_t hash) {
+    return &__json_cache.buckets[hash & (__json_cache.nbuckets - 1)];
+}
+
+static void __lru_unlink(cacheEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else __json_cache.head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else __json_cache.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void __lru_push(cacheEntry *e) {
+    e->prev = NULL;
+    e->next = __json_cache.head;
+    if (__json_cache.head) __json_cache.head->prev = e;
+    __json_cache.head = e;
+    if (!__json_cache.tail) __json_cache.tail = e;
+}
+
+static void __entry_evict(cacheEntry *e) {
+    cacheEntry **pe = __bucket(e->hash);
+    while (*pe != e) pe = &(*pe)->hnext;
+    *pe = e->hnext;
+    __lru_unlink(e);
+    __json_cache.stats.entries--;
+    __json_cache.stats.memory -= __entrySize(e->reqlen, e->len);
+    RedisModule_Free(e);
+}
+
+/* Doubles the number of buckets and rehashes the entries. */
+static void __grow() {
+    size_t nbuckets = __json_cache.nbuckets ? __json_cache.nbuckets * 2 : JSON_CACHE_INITIAL_BUCKETS;
+    cacheEntry **buckets = RedisModule_Calloc(nbuckets, sizeof(cacheEntry *));
+    for (size_t i = 0; i < __json_cache.nbuckets; i++) {
+        cacheEntry *e = __json_cache.buckets[i], *next;
+        for (; e; e = next) {
+            next = e->hnext;
+            e->hnext = buckets[e->hash & (nbuckets - 1)];
+            buckets[e->hash & (nbuckets - 1)] = e;
+        }
+    }
+    RedisModule_Free(__json_cache.buckets);
+    __json_cache.buckets = buckets;
+    __json_cache.nbuckets = nbuckets;
+}
+
+void JSONCache_Clear() {
+    while (__json_cache.tail) __entry_evict(__json_cache.tail);
+}
+
+void JSONCache_SetMaxMemory(size_t maxmemory) {
+    JSONCache_Clear();
+    __json_cache.stats.maxmemory = maxmemory;
+}
+
+size_t JSONCache_GetMaxMemory() { return __json_cache.stats.maxmemory; }
+
+const char *JSONCache_Get(uint64_t version, const char *req, size_t reqlen, size_t *len) {
+    if (!__json_cache.stats.maxmemory) return NULL;
+
+    if (__json_cache.nbuckets) {
+        uint32_t hash = __hash(version, req, reqlen);
+        for (cacheEntry *e = *__bucket(hash); e; e = e->hnext) {
+            if (e->hash == hash && e->version == version && e->reqlen == reqlen &&
+                !memcmp(e->data, req, reqlen)) {
+                __json_cache.stats.hits++;
+                if (e != __json_cache.head) {
+                    __lru_unlink(e);
+                    __lru_push(e);
+                }
+                *len = e->len;
+                return &e->data[reqlen];
+            }
+        }
+    }
+
+    __json_cache.stats.misses++;
+    return NULL;
+}
+
+void JSONCache_Put(uint64_t version, const char *req, size_t reqlen, const char *json,
+                   size_t len) {
+    size_t size = __entrySize(reqlen, len);
+    if (size > __json_cache.stats.maxmemory / 4) return;
+
+    // make room
+    while (__json_cache.stats.memory + size > __json_cache.stats.maxmemory) {
+        __json_cache.stats.evictions++;
+        __entry_evict(__json_cache.tail);
+    }
+    if (__json_cache.stats.entries >= __json_cache.nbuckets) __grow();
+
+    cacheEntry *e = RedisModule_Alloc(size);
+    e->version = version;
+    e->hash = __hash(version, req, reqlen);
+    e->reqlen = reqlen;
+    e->len = len;
+    memcpy(e->data, req, reqlen);
+    memcpy(&e->data[reqlen], json, len);
+
+    cacheEntry **bucket = __bucket(e->hash);
+    e->hnext = *bucket;
+    *bucket = e;
+    __lru_push(e);
+    __json_cache.stats.entries++;
+    __json_cache.stats.memory += size;
+}
+
+void JSONCache_GetStats(JSONCacheStats *stats) { *stats = __json_cache.stats; }
@@ -0,0 +1,70 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_CACHE_H__
+#define __JSON_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The default maximal memory of the cache in bytes
+#define JSON_CACHE_DEFAULT_MAX_MEMORY (16 * 1024 * 1024)
+
+/*
+* A module-wide cache of serialized JSON values. Entries are keyed by a value's version and by the
+* request, i.e. the paths and formatting options, that produced the serialization. Every
+* modification gives a value a new, module-wide unique, version (see JSONTypeTouch), so entries of
+* modified values are never matched again and are left for the LRU eviction to discard.
+*/
+
+/* The cache's counters. */
+typedef struct {
+    size_t hits;       // lookups that found a serialization
+    size_t misses;     // lookups that didn't
+    size_t evictions;  // entries that were evicted to make room for others
+    size_t entries;    // entries in the cache
+    size_t memory;     // memory used by the entries
+    size_t maxmemory;  // maximal memory of the entries
+} JSONCacheStats;
+
+/** Sets the maximal memory of the cache, 0 disables it. Empties the cache. */
+void JSONCache_SetMaxMemory(size_t maxmemory);
+
+/** Returns the maximal memory of the cache. */
+size_t JSONCache_GetMaxMemory();
+
+/**
+* Looks up the serialization of a value's version for a request. Returns NULL on misses, otherwise
+* the serialization, which is valid until the cache is modified, and its length in `len`.
+*/
+const char *JSONCache_Get(uint64_t version, const char *req, size_t reqlen, size_t *len);
+
+/**
+* Caches a copy of the serialization of a value's version for a request, evicting the least
+* recently used entries to make room for it. Serializations that are larger than a quarter of the
+* cache are not cached.
+*/
+void JSONCache_Put(uint64_t version, const char *req, size_t reqlen, const char *json,
+                   size_t len);
+
+/** Evicts all entries. */
+void JSONCache_Clear();
+
+/** Fills the cache's counters. */
+void JSONCache_GetStats(JSONCacheStats *stats);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "json_index.h"
+#include "redismodule.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSONINDEX_X86
+#endif
+
+/* The classification of a 64 byte block's characters, a bit per character. */
+typedef struct {
+    uint64_t quote;      // quotation marks
+    uint64_t backslash;  // reverse solidi
+    uint64_t op;         // structural characters
+    uint64_t ctrl;       // control characters
+} blockMasks;
+
+typedef void (*classifyFunc)(const unsigned char *p, blockMasks *m);
+
+/* === Scalar classification === */
+
+#define C_QUOTE 0x1
+#define C_BACKSLASH 0x2
+#define C_OP 0x4
+#define C_CTRL 0x8
+
+static const uint8_t __classes[256] = {
+    [0x00 ... 0x1f] = C_CTRL,
+    ['"'] = C_QUOTE,
+    ['\\'] = C_BACKSLASH,
+    ['{'] = C_OP,
+    ['}'] = C_OP,
+    ['['] = C_OP,
+    [']'] = C_OP,
+    [':'] = C_OP,
+    [','] = C_OP,
+};
+
+static void __classifyScalar(const unsigned char *p, blockMasks *m) {
+    uint64_t quote = 0, backslash = 0, op = 0, ctrl = 0;
+    for (int i = 0; i < 64; i++) {
+        uint64_t c = __classes[p[i]];
+        if (!c) continue;
+        quote |= (c & 1) << i;
+        backslash |= (c >> 1 & 1) << i;
+        op |= (c >> 2 & 1) << i;
+        ctrl |= (c >> 3 & 1) << i;
+    }
+    m->quote = quote;
+    m->backslash = backslash;
+    m->op = op;
+    m->ctrl = ctrl;
+}
+
+#ifdef JSONINDEX_X86
+/* === SSE2 classification === */
+
+/* Braces and brackets are told apart by a single bit, so both pairs are matched on the lower case. */
+__attribute__((target("sse2"))) static void __classifySSE2(const unsigned char *p, blockMasks *m) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i obrace = _mm_set1_epi8('{');
+    const __m128i cbrace = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i ctrlmax = _mm_set1_epi8(0x1f);
+
+    m->quote = m->backslash = m->op = m->ctrl = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        __m128i lv = _mm_or_si128(v, lower);
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lv, obrace), _mm_cmpeq_epi8(lv, cbrace)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctrlmax), v);
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (16 * i);
+        m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << (16 * i);
+        m->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << (16 * i);
+        m->ctrl |= (uint64_t)(uint16_t)_mm_movemask_epi8(ctrl) << (16 * i);
+    }
+}
+
+/* === AVX2 classification === */
+
+__attribute__((target("avx2"))) static void __classifyAVX2(const unsigned char *p, blockMasks *m) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i obrace = _mm256_set1_epi8('{');
+    const __m256i cbrace = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i ctrlmax = _mm256_set1_epi8(0x1f);
+
+    m->quote = m->backslash = m->op = m->ctrl = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+        __m256i lv = _mm256_or_si256(v, lower);
+        __m256i op =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lv, obrace), _mm256_cmpeq_epi8(lv, cbrace)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrlmax), v);
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << (32 * i);
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash))
+                        << (32 * i);
+        m->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << (32 * i);
+        m->ctrl |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ctrl) << (32 * i);
+    }
+}
+#endif
+
+/* === Implementation selection === */
+
+static int __supportedAlways() { return 1; }
+
+#ifdef JSONINDEX_X86
+static int __supportedSSE2() { return __builtin_cpu_supports("sse2"); }
+static int __supportedAVX2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+// the implementations, by order of preference
+static const struct {
+    const char *name;
+    classifyFunc classify;
+    int (*supported)();
+} __implementations[] = {
+#ifdef JSONINDEX_X86
+    {"avx2", __classifyAVX2, __supportedAVX2},
+    {"sse2", __classifySSE2, __supportedSSE2},
+#endif
+    {"scalar", __classifyScalar, __supportedAlways},
+    {NULL, NULL, NULL},
+};
+
+static int __implementation = -1;
+
+static void __selectImplementation() {
+    int i = 0;
+    while (!__implementations[i].supported()) i++;
+    __implementation = i;
+}
+
+const char *JSONIndex_GetImplementation() {
+    if (__implementation < 0) __selectImplementation();
+    return __implementations[__implementation].name;
+}
+
+int JSONIndex_SetImplementation(const char *name) {
+    for (int i = 0; __implementations[i].name; i++) {
+        if (!strcmp(name, __implementations[i].name)) {
+            if (!__implementations[i].supported()) return JSONINDEX_ERR;
+            __implementation = i;
+            return JSONINDEX_OK;
+        }
+    }
+    return JSONINDEX_ERR;
+}
+
+/* === Index === */
+
+static inline void __ensureCapacity(JSONIndex *idx, size_t n) {
+    if (idx->len + n <= idx->cap) return;
+    while (idx->len + n > idx->cap) idx->cap *= 2;
+    idx->pos = RedisModule_Realloc(idx->pos, idx->cap * sizeof(uint32_t));
+}
+
+int JSONIndex_Build(JSONIndex *idx, const char *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned char tail[64];
+    size_t escpos = (size_t)-1;  // the position of the character that follows a reverse solidus
+    int instr = 0;               // in a string
+    int escaped = 0;             // the current string has escapes
+    classifyFunc classify;
+    blockMasks m;
+
+    if (__implementation < 0) __selectImplementation();
+    classify = __implementations[__implementation].classify;
+
+    idx->len = 0;
+    if (len > JSONINDEX_MAX_LEN) return JSONINDEX_ERR;
+    if (!idx->cap) {
+        idx->cap = len / 8 + 16;
+        idx->pos = RedisModule_Alloc(idx->cap * sizeof(uint32_t));
+    }
+
+    for (size_t base = 0; base < len; base += 64) {
+        const unsigned char *block = p + base;
+
+        // the last partial block is padded with spaces, which are never structural
+        if (len - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+        classify(block, &m);
+
+        // resolve the quotes that delimit strings and the string mask, a bit per character in one
+        uint64_t qb = m.quote | m.backslash;
+        uint64_t strmask = instr ? ~0ULL : 0;
+        uint64_t quotes = 0, escclose = 0;
+        while (qb) {
+            int i = __builtin_ctzll(qb);
+            size_t at = base + i;
+            qb &= qb - 1;
+
+            if (at == escpos) continue;
+            if (m.backslash >> i & 1) {
+                if (!instr) return JSONINDEX_ERR;
+                escpos = at + 1;
+                escaped = 1;
+                continue;
+            }
+            quotes |= 1ULL << i;
+            strmask ^= ~0ULL << i;
+            if (instr && escaped) escclose |= 1ULL << i;
+            escaped = 0;
+            instr = !instr;
+        }
+        if (m.ctrl & strmask) return JSONINDEX_ERR;
+
+        // record the quotes and the structural characters outside of strings
+        uint64_t bits = (m.op & ~strmask) | quotes;
+        __ensureCapacity(idx, __builtin_popcountll(bits));
+        while (bits) {
+            int i = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            idx->pos[idx->len++] = (uint32_t)(base + i) | (escclose >> i & 1 ? JSONINDEX_ESCAPED : 0);
+        }
+    }
+
+    return instr ? JSONINDEX_ERR : JSONINDEX_OK;
+}
+
+void JSONIndex_Free(JSONIndex *idx) {
+    if (idx->pos) RedisModule_Free(idx->pos);
+    idx->pos = NULL;
+    idx->len = 0;
+    idx->cap = 0;
+}
@@ -0,0 +1,70 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __JSON_INDEX_H__
+#define __JSON_INDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSONINDEX_OK 0
+#define JSONINDEX_ERR 1
+
+// Flags the closing quote of a string that has escapes in it
+#define JSONINDEX_ESCAPED 0x80000000U
+#define JSONINDEX_POS(p) ((p) & ~JSONINDEX_ESCAPED)
+
+// The largest buffer that can be indexed
+#define JSONINDEX_MAX_LEN ((size_t)JSONINDEX_ESCAPED - 1)
+
+/*
+* The structural index of a JSON buffer is the first stage of the indexed parser. It is the ordered
+* list of the positions of both quotes of every string, and of every structural character ({}[]:,)
+* outside of strings. The parser's second stage walks the index to build the tree, so it never has
+* to look at the contents of strings.
+*
+* The index is built 64 bytes at a time: vector instructions classify a block's characters into
+* bitmasks, and the string boundaries and escapes are resolved from the masks. AVX2 and SSE2
+* implementations are selected at runtime when the CPU supports them, with a portable scalar
+* fallback.
+*/
+typedef struct {
+    uint32_t *pos;  // the positions of the structural characters
+    size_t len;     // number of positions
+    size_t cap;     // capacity of positions
+} JSONIndex;
+
+/**
+* Builds the structural index of `buf`. Returns JSONINDEX_ERR if the buffer is not well-formed at
+* the character level: a string that isn't terminated, a control character in a string or an escape
+* outside of a string. Positions are released with JSONIndex_Free regardless of the result.
+*/
+int JSONIndex_Build(JSONIndex *idx, const char *buf, size_t len);
+
+/** Releases the positions of an index. */
+void JSONIndex_Free(JSONIndex *idx);
+
+/** Returns the name of the implementation that builds indices: "avx2", "sse2" or "scalar". */
+const char *JSONIndex_GetImplementation();
+
+/**
+* Selects the implementation that builds indices by name. Returns JSONINDEX_ERR if it is unknown or
+* isn't supported by the CPU.
+*/
+int JSONIndex_SetImplementation(const char *name);
+
+#endif
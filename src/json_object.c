@@ -16,6 +16,7 @@
 */
 
 #include "json_object.h"
+#include "json_index.h"
 
 /* === Parser === */
 /* A custom context for the JSON lexer. */
@@ -151,7 +152,7 @@ inline static void popCallback(jsonsl_t jsn, jsonsl_action_t action, struct json
 
     // anything that pops needs to be set in its parent, except the root element and keys
     if (joctx->nlen > 1 && state->type != JSONSL_T_HKEY) {
-        NodeType p = joctx->nodes[joctx->nlen - 2]->type;
+        NodeType p = NODETYPE(joctx->nodes[joctx->nlen - 2]);
         switch (p) {
             case N_DICT:
                 Node_DictSetKeyVal(joctx->nodes[joctx->nlen - 1], _popNode(joctx));
@@ -169,6 +170,315 @@ inline static void popCallback(jsonsl_t jsn, jsonsl_action_t action, struct json
     }
 }
 
+/* === Indexed parser === */
+/* The indexed parser is a strict two-stage parser: it builds the structural index of the buffer
+ * (see json_index.h) and then walks it to create the nodes. It only accepts JSON that the lexer
+ * accepts too, so on any error the lexer parses the buffer again to report it.
+*/
+
+// the maximal depth of containers, kept shy of the lexer's levels so it reports the errors
+#define INDEXED_MAX_DEPTH (JSONSL_MAX_LEVELS - 2)
+
+static int __jsonParser = JSONOBJECT_PARSER_JSONSL;
+
+void SetJSONParser(int parser) { __jsonParser = parser; }
+
+int GetJSONParser() { return __jsonParser; }
+
+static inline int _hex4(const char *p, size_t len, unsigned *cp) {
+    if (len < 4) return 0;
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!isxdigit((unsigned char)p[i])) return 0;
+        *cp = *cp << 4 | (isdigit((unsigned char)p[i]) ? p[i] - '0' : (p[i] | 0x20) - 'a' + 10);
+    }
+    return 1;
+}
+
+/* Unescapes the contents of a string into `out`, that has at least `len` bytes. The escapes are
+ * checked as strictly as the lexer does: \u0000 and unpaired surrogates are invalid, and code
+ * points are encoded in UTF-8 just like jsonsl_util_unescape does. Returns the unescaped length,
+ * or 0 on error.
+*/
+static size_t _indexedUnescape(const char *p, size_t len, char *out) {
+    const char *end = p + len, *bs;
+    char *o = out;
+    unsigned cp, lo;
+
+    while ((bs = memchr(p, '\\', end - p))) {
+        // copy the run up to the escape
+        memcpy(o, p, bs - p);
+        o += bs - p;
+        p = bs + 1;
+        if (p == end) return 0;
+
+        switch (*p) {
+            case 'b':
+                *o++ = '\b';
+                break;
+            case 'f':
+                *o++ = '\f';
+                break;
+            case 'n':
+                *o++ = '\n';
+                break;
+            case 'r':
+                *o++ = '\r';
+                break;
+            case 't':
+                *o++ = '\t';
+                break;
+            case '"':
+            case '\\':
+            case '/':
+                *o++ = *p;
+                break;
+            case 'u':
+                if (!_hex4(p + 1, end - p - 1, &cp)) return 0;
+                p += 4;
+                if (!cp || (cp >= 0xdc00 && cp <= 0xdfff)) return 0;
+                if (cp >= 0xd800 && cp <= 0xdbff) {
+                    if (end - p < 3 || '\\' != p[1] || 'u' != p[2] ||
+                        !_hex4(p + 3, end - p - 3, &lo) || lo < 0xdc00 || lo > 0xdfff)
+                        return 0;
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                }
+                if (cp < 0x80) {
+                    *o++ = cp;
+                } else if (cp < 0x800) {
+                    *o++ = 0xc0 | cp >> 6;
+                    *o++ = 0x80 | (cp & 0x3f);
+                } else if (cp < 0x10000) {
+                    *o++ = 0xe0 | cp >> 12;
+                    *o++ = 0x80 | (cp >> 6 & 0x3f);
+                    *o++ = 0x80 | (cp & 0x3f);
+                } else {
+                    *o++ = 0xf0 | cp >> 18;
+                    *o++ = 0x80 | (cp >> 12 & 0x3f);
+                    *o++ = 0x80 | (cp >> 6 & 0x3f);
+                    *o++ = 0x80 | (cp & 0x3f);
+                }
+                break;
+            default:
+                return 0;
+        }
+        p++;
+    }
+    memcpy(o, p, end - p);
+    o += end - p;
+    return o - out;
+}
+
+/* Creates a string node, or a key-value node for keys, from the contents of a string. */
+static int _indexedString(const char *pos, size_t len, int escaped, int iskey, Node **n) {
+    char *buffer = NULL;  // a temporary buffer for unescaped strings
+
+    if (escaped) {
+        buffer = RedisModule_Alloc(len);
+        len = _indexedUnescape(pos, len, buffer);
+        if (!len) {
+            RedisModule_Free(buffer);
+            return JSONOBJECT_ERROR;
+        }
+        pos = buffer;
+    }
+
+    *n = iskey ? NewKeyValNode(pos, len, NULL) : NewStringNode(pos, len);
+    if (buffer) RedisModule_Free(buffer);
+    return JSONOBJECT_OK;
+}
+
+/* Creates a node from a literal or a number, converted just like the lexer's callback does. */
+static int _indexedScalar(const char *p, size_t len, Node **n) {
+    size_t i = 0;
+    int isint = 1;
+
+    switch (*p) {
+        case 't':
+            if (4 != len || memcmp(p, "true", 4)) return JSONOBJECT_ERROR;
+            *n = NewBoolNode(1);
+            return JSONOBJECT_OK;
+        case 'f':
+            if (5 != len || memcmp(p, "false", 5)) return JSONOBJECT_ERROR;
+            *n = NewBoolNode(0);
+            return JSONOBJECT_OK;
+        case 'n':
+            if (4 != len || memcmp(p, "null", 4)) return JSONOBJECT_ERROR;
+            *n = NULL;
+            return JSONOBJECT_OK;
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (i < len && '-' == p[i]) i++;
+    if (i == len || !isdigit((unsigned char)p[i])) return JSONOBJECT_ERROR;
+    if ('0' == p[i++]) {
+        if (i < len && isdigit((unsigned char)p[i])) return JSONOBJECT_ERROR;
+    } else {
+        while (i < len && isdigit((unsigned char)p[i])) i++;
+    }
+    if (i < len && '.' == p[i]) {
+        isint = 0;
+        if (++i == len || !isdigit((unsigned char)p[i])) return JSONOBJECT_ERROR;
+        while (i < len && isdigit((unsigned char)p[i])) i++;
+    }
+    if (i < len && 'e' == (p[i] | 0x20)) {
+        isint = 0;
+        if (++i < len && ('+' == p[i] || '-' == p[i])) i++;
+        if (i == len || !isdigit((unsigned char)p[i])) return JSONOBJECT_ERROR;
+        while (i < len && isdigit((unsigned char)p[i])) i++;
+    }
+    if (i != len) return JSONOBJECT_ERROR;
+
+    // integers of up to 18 digits can't overflow
+    if (isint && len <= 18) {
+        int64_t value = 0;
+        for (i = '-' == *p; i < len; i++) value = value * 10 + (p[i] - '0');
+        *n = NewIntNode('-' == *p ? -value : value);
+        return JSONOBJECT_OK;
+    }
+
+    // the conversion functions need a terminated string
+    char buf[64], *eptr;
+    if (len >= sizeof(buf)) return JSONOBJECT_ERROR;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    errno = 0;
+    if (isint) {
+        long long value = strtoll(buf, &eptr, 10);
+        if ((errno == ERANGE && (value == LLONG_MAX || value == LLONG_MIN)) ||
+            (errno != 0 && value == 0) || (eptr != buf + len))
+            return JSONOBJECT_ERROR;
+        *n = NewIntNode((int64_t)value);
+    } else {
+        double value = strtod(buf, &eptr);
+        if ((errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL)) ||
+            (errno != 0 && value == 0) || isnan(value) || (eptr != buf + len))
+            return JSONOBJECT_ERROR;
+        *n = NewDoubleNode(value);
+    }
+    return JSONOBJECT_OK;
+}
+
+/* Parses a buffer with the indexed parser. No error is reported, as the lexer does that. */
+static int _IndexedParse(const char *buf, size_t len, Node **node) {
+    JSONIndex idx = {0};
+    Node *stack[INDEXED_MAX_DEPTH];  // the open containers
+    Node *keys[INDEXED_MAX_DEPTH];   // the pending key-value node of every open dictionary
+    int depth = 0;
+    size_t off = 0, i = 0, end;
+    Node *v;
+    char c;
+
+#define _skipWhitespace() \
+    while (off < len && _IsAllowedWhitespace(buf[off])) off++
+// the position of the next structural character, or the end of the buffer
+#define _nextPos() (i < idx.len ? JSONINDEX_POS(idx.pos[i]) : len)
+
+    if (JSONINDEX_OK != JSONIndex_Build(&idx, buf, len)) goto error;
+    _skipWhitespace();
+
+value:
+    if (off >= len) goto error;
+    c = buf[off];
+    if ('{' == c || '[' == c) {
+        if (off != _nextPos() || INDEXED_MAX_DEPTH == depth) goto error;
+        i++;
+        off++;
+        stack[depth] = '{' == c ? NewDictNode(1) : NewArrayNode(1);
+        keys[depth] = NULL;
+        depth++;
+        _skipWhitespace();
+        if (off < len && ('{' == c ? '}' : ']') == buf[off]) {
+            if (off != _nextPos()) goto error;
+            i++;
+            off++;
+            v = stack[--depth];
+            goto done;
+        }
+        if ('{' == c) goto key;
+        goto value;
+    } else if ('"' == c) {
+        // the closing quote is the next position of the index
+        if (off != _nextPos()) goto error;
+        end = JSONINDEX_POS(idx.pos[i + 1]);
+        if (_indexedString(&buf[off + 1], end - off - 1, idx.pos[i + 1] & JSONINDEX_ESCAPED, 0, &v))
+            goto error;
+        i += 2;
+        off = end + 1;
+    } else {
+        // scalars end with whitespace or a structural character
+        size_t next = _nextPos();
+        for (end = off; end < next && !_IsAllowedWhitespace(buf[end]); end++)
+            ;
+        if (end == off || _indexedScalar(&buf[off], end - off, &v)) goto error;
+        off = end;
+    }
+
+done:
+    _skipWhitespace();
+    if (!depth) {
+        // the root element must be all there is
+        if (off != len) {
+            Node_Free(v);
+            goto error;
+        }
+        JSONIndex_Free(&idx);
+        *node = v;
+        return JSONOBJECT_OK;
+    }
+
+    // set the value in its parent
+    if (N_DICT == NODETYPE(stack[depth - 1])) {
+        keys[depth - 1]->value.kvval.val = v;
+        Node_DictSetKeyVal(stack[depth - 1], keys[depth - 1]);
+        keys[depth - 1] = NULL;
+    } else {
+        Node_ArrayAppend(stack[depth - 1], v);
+    }
+
+    // a delimiter or the end of the parent
+    if (off >= len || off != _nextPos()) goto error;
+    c = buf[off];
+    i++;
+    off++;
+    if (',' == c) {
+        _skipWhitespace();
+        if (N_DICT == NODETYPE(stack[depth - 1])) goto key;
+        goto value;
+    }
+    if ((N_DICT == NODETYPE(stack[depth - 1]) ? '}' : ']') != c) goto error;
+    v = stack[--depth];
+    goto done;
+
+key:
+    if (off >= len || '"' != buf[off] || off != _nextPos()) goto error;
+    end = JSONINDEX_POS(idx.pos[i + 1]);
+    if (_indexedString(&buf[off + 1], end - off - 1, idx.pos[i + 1] & JSONINDEX_ESCAPED, 1,
+                       &keys[depth - 1]))
+        goto error;
+    i += 2;
+    off = end + 1;
+    _skipWhitespace();
+    if (off >= len || ':' != buf[off] || off != _nextPos()) goto error;
+    i++;
+    off++;
+    _skipWhitespace();
+    goto value;
+
+error:
+    while (depth--) {
+        if (keys[depth]) Node_Free(keys[depth]);
+        Node_Free(stack[depth]);
+    }
+    JSONIndex_Free(&idx);
+    return JSONOBJECT_ERROR;
+
+#undef _skipWhitespace
+#undef _nextPos
+}
+
 int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err) {
     int levels = JSONSL_MAX_LEVELS;  // TODO: heur levels from len since we're not really streaming?
 
@@ -176,6 +486,10 @@ int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err) {
     char *_buf = (char *)buf;
     int is_scalar = 0;
 
+    // the indexed parser is strict, so it leaves reporting errors to the lexer
+    if (JSONOBJECT_PARSER_INDEXED == __jsonParser && JSONOBJECT_OK == _IndexedParse(buf, len, node))
+        return JSONOBJECT_OK;
+
     // munch any leading whitespaces
     while (_IsAllowedWhitespace(_buf[_off]) && _off < _len) _off++;
 
@@ -254,6 +568,7 @@ error:
     // free any nodes that are in the stack
     while (joctx->nlen) Node_Free(_popNode(joctx));
 
+    if (is_scalar) RedisModule_Free(_buf);
     sdsfree(serr);
     RedisModule_Free(joctx->nodes);
     RedisModule_Free(joctx);
@@ -272,54 +587,127 @@ typedef struct {
     sds newlinestr;  // newline string
     sds spacestr;    // space string
     sds delimstr;    // delimiter string
+    size_t chunk;    // the size of the chunks passed to the chunk callback, 0 if unchunked
+    JSONSerializeChunkFunc fn;
+    void *fnarg;
 } _JSONBuilderContext;
 
+/* Passes the buffer's full chunks to the chunk callback, and the rest of it as well if `all`. */
+static void _JSONSerialize_Flush(_JSONBuilderContext *b, int all) {
+    size_t len = sdslen(b->buf), off = 0;
+    for (; len - off >= b->chunk; off += b->chunk) b->fn(b->fnarg, b->buf + off, b->chunk);
+    if (all && off < len) {
+        b->fn(b->fnarg, b->buf + off, len - off);
+        off = len;
+    }
+    if (off) sdsrange(b->buf, off, -1);
+}
+
+#define _JSONSerialize_MaybeFlush(b) \
+    if (b->chunk && sdslen(b->buf) >= b->chunk) _JSONSerialize_Flush(b, 0)
+
 #define _JSONSerialize_Indent(b) \
     if (b->indent)               \
         for (int i = 0; i < b->depth; i++) b->buf = sdscatsds(b->buf, b->indentstr);
 
+/* The escape of every byte in a string: 0 for bytes that are copied as is, 'u' for ones that are
+ * escaped as \u00XX and otherwise the character that follows the reverse solidus.
+*/
+static const char _JSONStringEscapes[256] = {
+    [0x00 ... 0x1f] = 'u',
+    ['"'] = '"',   // quotation mark
+    ['\\'] = '\\', // reverse solidus
+    ['/'] = '/',   // the standard is clear wrt solidus so we're zealous
+    ['\b'] = 'b',  // backspace
+    ['\f'] = 'f',  // formfeed
+    ['\n'] = 'n',  // newline
+    ['\r'] = 'r',  // carriage return
+    ['\t'] = 't',  // horizontal tab
+    [0x7f ... 0xff] = 'u',
+};
+
+// SWAR helpers for finding bytes that need escaping 8 at a time
+#define _SWAR_ONES 0x0101010101010101ULL
+#define _SWAR_HIGHS 0x8080808080808080ULL
+#define _SWAR_HASLESS(x, n) (((x) - _SWAR_ONES * (n)) & ~(x) & _SWAR_HIGHS)
+#define _SWAR_HASBYTE(x, n) _SWAR_HASLESS((x) ^ (_SWAR_ONES * (n)), 1)
+
+/* Returns the length of the string's prefix that needs no escaping. */
+static inline size_t _JSONSerialize_EscapeFreeLen(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x;
+        memcpy(&x, p + i, 8);
+        if ((x & _SWAR_HIGHS) || _SWAR_HASLESS(x, 0x20) || _SWAR_HASBYTE(x, '"') ||
+            _SWAR_HASBYTE(x, '\\') || _SWAR_HASBYTE(x, '/') || _SWAR_HASBYTE(x, 0x7f))
+            break;
+    }
+    while (i < len && !_JSONStringEscapes[p[i]]) i++;
+    return i;
+}
+
 inline static void _JSONSerialize_StringValue(Node *n, void *ctx) {
+    static const char hex[] = "0123456789abcdef";
     _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
     size_t len = n->value.strval.len;
-    const char *p = n->value.strval.data;
+    char *decompressed;
+    const unsigned char *p = (const unsigned char *)Node_StringData(n, &decompressed);
 
-    b->buf = sdsMakeRoomFor(b->buf, len + 2);  // we'll need at least as much room as the original
+    // we'll need at least as much room as the original, unless it's passed on in chunks
+    if (!b->chunk) b->buf = sdsMakeRoomFor(b->buf, len + 2);
     b->buf = sdscatlen(b->buf, "\"", 1);
-    while (len--) {
-        switch (*p) {
-            case '"':   // quotation mark
-            case '\\':  // reverse solidus
-                b->buf = sdscatprintf(b->buf, "\\%c", *p);
-                break;
-            case '/':  // the standard is clear wrt solidus so we're zealous
-                b->buf = sdscatlen(b->buf, "\\/", 2);
-                break;
-            case '\b':  // backspace
-                b->buf = sdscatlen(b->buf, "\\b", 2);
-                break;
-            case '\f':  // formfeed
-                b->buf = sdscatlen(b->buf, "\\f", 2);
-                break;
-            case '\n':  // newline
-                b->buf = sdscatlen(b->buf, "\\n", 2);
-                break;
-            case '\r':  // carriage return
-                b->buf = sdscatlen(b->buf, "\\r", 2);
-                break;
-            case '\t':  // horizontal tab
-                b->buf = sdscatlen(b->buf, "\\t", 2);
-                break;
-            default:
-                if ((unsigned char)*p > 31 && isprint(*p))
-                    b->buf = sdscatprintf(b->buf, "%c", *p);
-                else
-                    b->buf = sdscatprintf(b->buf, "\\u%04x", (unsigned char)*p);
-                break;
+    while (len) {
+        // copy escape-free runs in bulk, a chunk at a time at most
+        size_t run = _JSONSerialize_EscapeFreeLen(p, b->chunk && len > b->chunk ? b->chunk : len);
+        if (run) b->buf = sdscatlen(b->buf, p, run);
+        p += run;
+        len -= run;
+        _JSONSerialize_MaybeFlush(b);
+        if (!len) break;
+
+        char e = _JSONStringEscapes[*p];
+        if (!e) continue;  // the run was cut at the chunk's end
+        if ('u' == e) {
+            char esc[6] = {'\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xf]};
+            b->buf = sdscatlen(b->buf, esc, 6);
+        } else {
+            char esc[2] = {'\\', e};
+            b->buf = sdscatlen(b->buf, esc, 2);
         }
         p++;
+        len--;
     }
-
     b->buf = sdscatlen(b->buf, "\"", 1);
+    Node_StringRelease(decompressed);
+}
+
+/* Formats an integer to the end of the buffer. */
+static inline sds _JSONSerialize_Integer(sds buf, int64_t val) {
+    char s[21], *p = &s[sizeof(s)];
+    uint64_t u = val < 0 ? -(uint64_t)val : (uint64_t)val;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (val < 0) *--p = '-';
+    return sdscatlen(buf, p, &s[sizeof(s)] - p);
+}
+
+/* Formats a double to the end of the buffer. */
+static inline sds _JSONSerialize_Number(sds buf, double val) {
+    char s[64];
+    int len;
+    if (fabs(floor(val) - val) <= DBL_EPSILON && fabs(val) < 1.0e60) {
+        // integral values that a double holds exactly are formatted as integers
+        if (fabs(val) < 9007199254740992.0 && !(0 == val && signbit(val)))
+            return _JSONSerialize_Integer(buf, (int64_t)floor(val));
+        len = snprintf(s, sizeof(s), "%.0f", val);
+    } else if (fabs(val) < 1.0e-6 || fabs(val) > 1.0e9) {
+        len = snprintf(s, sizeof(s), "%e", val);
+    } else {
+        len = snprintf(s, sizeof(s), "%.17g", val);
+    }
+    return sdscatlen(buf, s, len);
 }
 
 inline static void _JSONSerialize_BeginValue(Node *n, void *ctx) {
@@ -328,31 +716,28 @@ inline static void _JSONSerialize_BeginValue(Node *n, void *ctx) {
     if (!n) {  // NULL nodes are literal nulls
         b->buf = sdscatlen(b->buf, "null", 4);
     } else {
-        switch (n->type) {
+        switch (NODETYPE(n)) {
             case N_BOOLEAN:
-                if (n->value.boolval) {
+                if (NODE_BOOLVAL(n)) {
                     b->buf = sdscatlen(b->buf, "true", 4);
                 } else {
                     b->buf = sdscatlen(b->buf, "false", 5);
                 }
                 break;
             case N_INTEGER:
-                b->buf = sdscatfmt(b->buf, "%I", n->value.intval);
+                b->buf = _JSONSerialize_Integer(b->buf, NODE_INTVAL(n));
                 break;
             case N_NUMBER:
-                if (fabs(floor(n->value.numval) - n->value.numval) <= DBL_EPSILON &&
-                    fabs(n->value.numval) < 1.0e60)
-                    b->buf = sdscatprintf(b->buf, "%.0f", n->value.numval);
-                else if (fabs(n->value.numval) < 1.0e-6 || fabs(n->value.numval) > 1.0e9)
-                    b->buf = sdscatprintf(b->buf, "%e", n->value.numval);
-                else
-                    b->buf = sdscatprintf(b->buf, "%.17g", n->value.numval);
+                b->buf = _JSONSerialize_Number(b->buf, n->value.numval);
                 break;
             case N_STRING:
                 _JSONSerialize_StringValue(n, b);
                 break;
             case N_KEYVAL:
-                b->buf = sdscatfmt(b->buf, "\"%s\":%s", n->value.kvval.key, b->spacestr);
+                b->buf = sdscatlen(b->buf, "\"", 1);
+                b->buf = sdscatlen(b->buf, n->value.kvval.key, Intern_Len(n->value.kvval.key));
+                b->buf = sdscatlen(b->buf, "\":", 2);
+                b->buf = sdscatsds(b->buf, b->spacestr);
                 break;
             case N_DICT:
                 b->buf = sdscatlen(b->buf, "{", 1);
@@ -374,12 +759,13 @@ inline static void _JSONSerialize_BeginValue(Node *n, void *ctx) {
                 break;
         }  // switch(n->type)
     }
+    _JSONSerialize_MaybeFlush(b);
 }
 
 inline static void _JSONSerialize_EndValue(Node *n, void *ctx) {
     _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
     if (n) {
-        switch (n->type) {
+        switch (NODETYPE(n)) {
             case N_DICT:
                 if (n->value.dictval.len) {
                     b->buf = sdscatsds(b->buf, b->newlinestr);
@@ -400,17 +786,86 @@ inline static void _JSONSerialize_EndValue(Node *n, void *ctx) {
                 break;
         }
     }
+    _JSONSerialize_MaybeFlush(b);
 }
 
 inline static void _JSONSerialize_ContainerDelimiter(void *ctx) {
     _JSONBuilderContext *b = (_JSONBuilderContext *)ctx;
     b->buf = sdscat(b->buf, b->delimstr);
     _JSONSerialize_Indent(b);
+    _JSONSerialize_MaybeFlush(b);
 }
 
-void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json) {
+/* Estimates the size of a node's serialization so the output buffer can be allocated once. Escapes
+ * and long numbers aside the estimate is exact.
+*/
+static size_t _JSONSerialize_EstimateSize(const Node *n, const _JSONBuilderContext *b, int depth) {
+    size_t size, delim, entry;
+    uint32_t len;
+    Node **entries;
+
+    switch (NODETYPE(n)) {
+        case N_NULL:
+        case N_BOOLEAN:
+            return 5;
+        case N_INTEGER:
+            return 20;
+        case N_NUMBER:
+            return 24;
+        case N_STRING:
+            return n->value.strval.len + 2;
+        case N_KEYVAL:
+            return Intern_Len(n->value.kvval.key) + 3 + sdslen(b->spacestr) +
+                   _JSONSerialize_EstimateSize(n->value.kvval.val, b, depth);
+        case N_DICT:
+        case N_ARRAY:
+            // brackets, and the newlines, delimiters and indentation of the entries
+            len = Node_Length(n);
+            if (!len) return 2;
+            entries = N_DICT == n->type ? n->value.dictval.entries : n->value.arrval.entries;
+            delim = sdslen(b->delimstr);
+            entry = b->indent * (depth + 1);
+            size = 2 + 2 * sdslen(b->newlinestr) + b->indent * depth + len * (delim + entry);
+            for (uint32_t i = 0; i < len; i++)
+                size += _JSONSerialize_EstimateSize(entries[i], b, depth + 1);
+            return size;
+    }
+    return 0;
+}
+
+size_t EstimateNodeJSONSize(const Node *node, size_t limit) {
+    size_t size;
+    uint32_t len;
+    Node **entries;
+
+    switch (NODETYPE(node)) {
+        case N_NULL:
+        case N_BOOLEAN:
+            return 5;
+        case N_INTEGER:
+            return 20;
+        case N_NUMBER:
+            return 24;
+        case N_STRING:
+            return node->value.strval.len + 2;
+        case N_KEYVAL:
+            return Intern_Len(node->value.kvval.key) + 3 +
+                   EstimateNodeJSONSize(node->value.kvval.val, limit);
+        case N_DICT:
+        case N_ARRAY:
+            // brackets and delimiters, and the entries until the limit is exceeded
+            len = Node_Length(node);
+            entries = N_DICT == node->type ? node->value.dictval.entries : node->value.arrval.entries;
+            size = 2 + (len ? len - 1 : 0);
+            for (uint32_t i = 0; i < len && size <= limit; i++)
+                size += EstimateNodeJSONSize(entries[i], limit - size);
+            return size;
+    }
+    return 0;
+}
 
-    // set up the builder
+/* Sets up a builder for serializing with the options. */
+static _JSONBuilderContext *_JSONSerialize_NewBuilder(const JSONSerializeOpt *opt) {
     _JSONBuilderContext *b = RedisModule_Calloc(1, sizeof(_JSONBuilderContext));
     b->indentstr = opt->indentstr ? sdsnew(opt->indentstr) : sdsempty();
     b->newlinestr = opt->newlinestr ? sdsnew(opt->newlinestr) : sdsempty();
@@ -418,19 +873,10 @@ void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *jso
     b->indent = sdslen(b->indentstr);
     b->delimstr = sdsnewlen(",", 1);
     b->delimstr = sdscat(b->delimstr, b->newlinestr);
+    return b;
+}
 
-    NodeSerializerOpt nso = {.fBegin = _JSONSerialize_BeginValue,
-                             .xBegin = 0xffff,
-                             .fEnd = _JSONSerialize_EndValue,
-                             .xEnd = (N_DICT | N_ARRAY),
-                             .fDelim = _JSONSerialize_ContainerDelimiter,
-                             .xDelim = (N_DICT | N_ARRAY)};
-
-    // the real work
-    b->buf = *json;
-    Node_Serializer(node, &nso, b);
-    *json = b->buf;
-
+static void _JSONSerialize_FreeBuilder(_JSONBuilderContext *b) {
     sdsfree(b->indentstr);
     sdsfree(b->newlinestr);
     sdsfree(b->spacestr);
@@ -438,6 +884,40 @@ void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *jso
     RedisModule_Free(b);
 }
 
+static const NodeSerializerOpt _JSONSerializerOpt = {.fBegin = _JSONSerialize_BeginValue,
+                                                     .xBegin = 0xffff,
+                                                     .fEnd = _JSONSerialize_EndValue,
+                                                     .xEnd = (N_DICT | N_ARRAY),
+                                                     .fDelim = _JSONSerialize_ContainerDelimiter,
+                                                     .xDelim = (N_DICT | N_ARRAY)};
+
+void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json) {
+    _JSONBuilderContext *b = _JSONSerialize_NewBuilder(opt);
+
+    // the real work, with room made for it in advance
+    b->buf = sdsMakeRoomFor(*json, _JSONSerialize_EstimateSize(node, b, 0));
+    Node_Serializer(node, &_JSONSerializerOpt, b);
+    *json = b->buf;
+
+    _JSONSerialize_FreeBuilder(b);
+}
+
+void SerializeNodeToJSONChunked(const Node *node, const JSONSerializeOpt *opt, size_t chunk,
+                                JSONSerializeChunkFunc fn, void *arg) {
+    _JSONBuilderContext *b = _JSONSerialize_NewBuilder(opt);
+    b->chunk = chunk ? chunk : 1;
+    b->fn = fn;
+    b->fnarg = arg;
+
+    // the buffer holds a chunk and whatever a single step adds to it
+    b->buf = sdsMakeRoomFor(sdsempty(), b->chunk);
+    Node_Serializer(node, &_JSONSerializerOpt, b);
+    _JSONSerialize_Flush(b, 1);
+    sdsfree(b->buf);
+
+    _JSONSerialize_FreeBuilder(b);
+}
+
 // clang-format off
 // from jsonsl.c
 
@@ -44,6 +44,19 @@
 */
 int CreateNodeFromJSON(const char *buf, size_t len, Node **node, char **err);
 
+// The parsers that CreateNodeFromJSON can use
+#define JSONOBJECT_PARSER_JSONSL 0   // the jsonsl streaming lexer (default)
+#define JSONOBJECT_PARSER_INDEXED 1  // the two-stage indexed parser
+
+/**
+* Selects the parser of CreateNodeFromJSON. Both parsers create identical objects and report
+* identical errors, as the indexed parser falls back to the lexer on errors.
+*/
+void SetJSONParser(int parser);
+
+/** Returns the parser of CreateNodeFromJSON. */
+int GetJSONParser();
+
 typedef struct {
     char *indentstr;   // indentation string
     char *newlinestr;  // linebreak string
@@ -55,4 +68,21 @@ typedef struct {
 */
 void SerializeNodeToJSON(const Node *node, const JSONSerializeOpt *opt, sds *json);
 
+/* Receives a chunk of a serialization. */
+typedef void (*JSONSerializeChunkFunc)(void *arg, const char *buf, size_t len);
+
+/**
+* Produces a JSON serialization from an object in chunks of `chunk` bytes (the last one may be
+* shorter), that are passed to `fn` as they're produced. The serialization never needs a buffer much
+* larger than a chunk, regardless of the object's size.
+*/
+void SerializeNodeToJSONChunked(const Node *node, const JSONSerializeOpt *opt, size_t chunk,
+                                JSONSerializeChunkFunc fn, void *arg);
+
+/**
+* Estimates the size of an object's compact serialization, escapes aside. The estimate stops once
+* it exceeds `limit`, so it only costs as much as the limit.
+*/
+size_t EstimateNodeJSONSize(const Node *node, size_t limit);
+
 #endif
\ No newline at end of file
@@ -16,6 +16,19 @@
 */
 
 #include "json_path.h"
+#include "path_filter.h"
+
+/* Converts a token's digits, with an optional minus sign, to an int. We can't use atoi because it
+ * expects NULL terminated strings. */
+static int64_t _tokenNumber(const token *tok) {
+    int64_t num = 0;
+    for (int i = !isdigit(tok->s[0]); i < tok->len; i++) {
+        int digit = tok->s[i] - '0';
+        num = num * 10 + digit;
+    }
+    if ('-' == tok->s[0]) num = -num;
+    return num;
+}
 
 int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPathError_t *err) {
     tokenizerState st = S_NULL;
@@ -25,6 +38,9 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
     tok.s = pos;
     tok.len = 0;
     char *jsperr = NULL;
+    int slice[3] = {0, 0, 1};  // a slice's start, stop and step
+    int sliceFlags = 0;        // the slice's specified bounds
+    int slicePart = 0;         // the part of the slice that's being tokenized
     while (offset < len) {
         char c = *pos;
         switch (st) {
@@ -73,6 +89,33 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                     // this could be the beginning of a negative index
                     tok.len++;
                     st = S_MINUS;
+                } else if (':' == c) {
+                    // a slice from the start
+                    slicePart = 1;
+                    st = S_SLICE;
+                } else if ('*' == c) {
+                    st = S_WILDCARD;
+                } else if ('?' == c) {
+                    // a filter's expression is compiled as a whole
+                    size_t flen, foff;
+                    PathFilter *f =
+                        PathFilter_Compile(pos + 1, len - offset - 1, &flen, &jsperr, &foff);
+                    if (!f) {
+                        offset += 1 + foff;
+                        goto syntaxerror;
+                    }
+                    SearchPath_AppendFilter(path, f);
+                    pos += 1 + flen;
+                    offset += 1 + flen;
+                    if (offset == len || ']' != *pos) {
+                        jsperr = JSON_PATH_FILTER_ERR;
+                        goto syntaxerror;
+                    }
+                    st = S_NULL;
+                    tok.type = T_FILTER;
+                    pos++;
+                    offset++;
+                    goto tokenend;
                 } else {
                     jsperr = JSON_PATH_BRACKET_FIRST_CHAR_ERR;
                     goto syntaxerror;
@@ -86,12 +129,57 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                 if (isalpha(c) || '$' == c || '_' == c) {
                     tok.len++;
                     st = S_IDENT;
+                } else if ('*' == c) {
+                    st = S_NULL;
+                    tok.type = T_WILDCARD;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                } else if ('.' == c) {
+                    // a second dot is a recursive descent
+                    st = S_DESCENT;
+                    tok.type = T_DESCENT;
+                    pos++;
+                    offset++;
+                    goto tokenend;
                 } else {
                     jsperr = JSON_PATH_IDENT_FIRST_CHAR_ERR;
                     goto syntaxerror;
                 }
                 break;
 
+            // we're after a recursive descent, which is followed by what it looks for
+            case S_DESCENT:
+                if (isalpha(c) || '$' == c || '_' == c) {
+                    tok.len++;
+                    st = S_IDENT;
+                } else if ('[' == c) {
+                    tok.s++;
+                    st = S_BRACKET;
+                } else if ('*' == c) {
+                    st = S_NULL;
+                    tok.type = T_WILDCARD;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                } else {
+                    jsperr = JSON_PATH_DESCENT_ERR;
+                    goto syntaxerror;
+                }
+                break;
+
+            // we're after a wildcard in square brackets
+            case S_WILDCARD:
+                if (']' == c) {
+                    st = S_NULL;
+                    tok.type = T_WILDCARD;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                }
+                jsperr = JSON_PATH_WILDCARD_ERR;
+                goto syntaxerror;
+
             // we're within a number (array index)
             case S_NUMBER:
                 if (isdigit(c)) {
@@ -105,9 +193,79 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
                     offset++;
                     goto tokenend;
                 }
+                if (c == ':') {
+                    // the index is a slice's start
+                    slice[0] = _tokenNumber(&tok);
+                    sliceFlags |= PATH_SLICE_START;
+                    slicePart = 1;
+                    st = S_SLICE;
+                    break;
+                }
                 jsperr = JSON_PATH_NUMBER_ERR;
                 goto syntaxerror;
 
+            // we're after a colon in a slice, where the stop or the step may follow
+            case S_SLICE:
+                if (isdigit(c) || '-' == c) {
+                    tok.s = pos;
+                    tok.len = 1;
+                    st = isdigit(c) ? S_SLICE_NUMBER : S_SLICE_MINUS;
+                } else if (':' == c && 1 == slicePart) {
+                    slicePart = 2;
+                } else if (']' == c) {
+                    st = S_NULL;
+                    tok.type = T_SLICE;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                } else {
+                    jsperr = JSON_PATH_SLICE_ERR;
+                    goto syntaxerror;
+                }
+                break;
+
+            // we're within a slice's stop or step
+            case S_SLICE_NUMBER:
+                if (isdigit(c)) {
+                    tok.len++;
+                    break;
+                }
+                if ((':' == c && 1 == slicePart) || ']' == c) {
+                    int num = _tokenNumber(&tok);
+                    if (1 == slicePart) {
+                        slice[1] = num;
+                        sliceFlags |= PATH_SLICE_STOP;
+                    } else if (num) {
+                        slice[2] = num;
+                    } else {
+                        jsperr = JSON_PATH_SLICE_STEP_ERR;
+                        goto syntaxerror;
+                    }
+                    if (':' == c) {
+                        slicePart = 2;
+                        st = S_SLICE;
+                        break;
+                    }
+                    st = S_NULL;
+                    tok.type = T_SLICE;
+                    pos++;
+                    offset++;
+                    goto tokenend;
+                }
+                jsperr = JSON_PATH_SLICE_ERR;
+                goto syntaxerror;
+
+            // we're within a negative slice bound or step so we expect a digit now
+            case S_SLICE_MINUS:
+                if (isdigit(c)) {
+                    tok.len++;
+                    st = S_SLICE_NUMBER;
+                } else {
+                    jsperr = JSON_PATH_NEGATIVE_NUMBER_ERR;
+                    goto syntaxerror;
+                }
+                break;
+
             // we're within an ident string
             case S_IDENT:
                 // end of ident
@@ -185,15 +343,16 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
 
     tokenend: {
         if (T_INDEX == tok.type) {
-            // convert the string to int. we can't use atoi because it expects
-            // NULL termintated strings
-            int64_t num = 0;
-            for (int i = !isdigit(tok.s[0]); i < tok.len; i++) {
-                int digit = tok.s[i] - '0';
-                num = num * 10 + digit;
-            }
-            if ('-' == tok.s[0]) num = -num;
-            SearchPath_AppendIndex(path, num);
+            SearchPath_AppendIndex(path, _tokenNumber(&tok));
+        } else if (T_WILDCARD == tok.type) {
+            SearchPath_AppendWildcard(path);
+        } else if (T_DESCENT == tok.type) {
+            SearchPath_AppendDescent(path);
+        } else if (T_SLICE == tok.type) {
+            SearchPath_AppendSlice(path, slice[0], slice[1], slice[2], sliceFlags);
+            slice[0] = slice[1] = 0;
+            slice[2] = 1;
+            sliceFlags = slicePart = 0;
         } else if (T_KEY == tok.type) {
             if ((1 == offset) && (1 == len) && '.' == c) {  // check for root
                 SearchPath_AppendRoot(path);
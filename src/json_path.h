@@ -28,15 +28,24 @@
 
 #define JSON_PATH_IDENT_FIRST_CHAR_ERR "an identifier can only begin with a letter, a dollar sign or an underscore - use bracket notation for anything else"
 #define JSON_PATH_IDENT_ERR "an identifier can only contain letters, digits, dollar signs or underscores - use bracket notation for anything else"
-#define JSON_PATH_BRACKET_FIRST_CHAR_ERR "square brackets can only contain integers, single- or double-quoted strings"
+#define JSON_PATH_BRACKET_FIRST_CHAR_ERR "square brackets can only contain integers, slices, wildcards, filters, single- or double-quoted strings"
 #define JSON_PATH_NUMBER_ERR "expecting a digit - that's what integers are made of - or a closing bracket"
 #define JSON_PATH_NEGATIVE_NUMBER_ERR "expecting a digit - a negative integer must have at least one"
 #define JSON_PATH_MISSING_BRACKET_ERR "expecting a right square bracket after a string identifier"
+#define JSON_PATH_SLICE_ERR "expecting a digit, a colon or a right square bracket in a slice"
+#define JSON_PATH_SLICE_STEP_ERR "a slice's step can't be zero"
+#define JSON_PATH_WILDCARD_ERR "expecting a right square bracket after a wildcard"
+#define JSON_PATH_FILTER_ERR "expecting a right square bracket after a filter"
+#define JSON_PATH_DESCENT_ERR "a recursive descent must be followed by an identifier, a wildcard or square brackets"
 
 // token type identifier
 typedef enum {
     T_KEY,
     T_INDEX,
+    T_SLICE,
+    T_WILDCARD,
+    T_DESCENT,
+    T_FILTER,  // appended to the path by the tokenizer itself
 } tokenType;
 
 // tokenizer state
@@ -50,6 +59,11 @@ typedef enum {
     S_BRACKET, // subscript (could be a key or an index)
     S_DOT,     // child separator
     S_MINUS,   // a negative index
+    S_SLICE,   // after a colon in a slice
+    S_SLICE_NUMBER, // a slice's bound or step
+    S_SLICE_MINUS,  // a negative slice bound or step
+    S_WILDCARD,     // a wildcard in square brackets
+    S_DESCENT,      // after a recursive descent
 } tokenizerState;
 
 // the token we're now on
@@ -74,6 +88,10 @@ int _tokenizePath(const char *json, size_t len, SearchPath *path, JSONSearchPath
 *   foo.bar.baz[3]
 *   foo["bar"]["baz"][3]
 *   foo[3]
+*   foo[1:-1:2].bar
+*   foo[*].bar, foo.*.bar
+*   foo..bar
+*   foo[?(@.bar < 10 && @.baz == "x")]
 *
 * `json` is the path and `len` is its length. `path` is a pointer to the resulting search path, and
 * `err` is an optional error container.
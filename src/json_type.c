@@ -15,7 +15,205 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <time.h>
+#include <pthread.h>
 #include "json_type.h"
+#include "sindex.h"
+#include "expiry.h"
+
+// the last version given to a JSON value
+static uint64_t __jsonTypeVersion = 0;
+
+// the server's main thread, and the values that other threads freed, which it hasn't reaped yet
+static pthread_t __mainThread;
+static int __mainThreadSet = 0;
+typedef struct {
+    void (*free)(void *);
+    void *value;
+} _Orphan;
+static struct {
+    pthread_mutex_t lock;
+    _Orphan *values;
+    size_t len, cap;
+} __orphans = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+/* === Frozen values ===
+ * Values that aren't frozen are kept in a list by their access times, least recently accessed
+ * first. Commands access values, which moves them to the list's end, and freeze values from its
+ * start that have been idle for long enough. A value that's thawed without being accessed goes
+ * back to the start, as it's still idle.
+*/
+static uint64_t __freezeIdleTime = 0;
+static JSONType_t *__freezeHead = NULL, *__freezeTail = NULL;
+static JSONTypeFreezeStats __freezeStats = {0};
+
+// the dictionary, and the samples it's trained on until it's trained
+static CompressDict *__freezeDict = NULL;
+static int __freezeTrained = 0;
+static char *__freezeSamples[JSONTYPE_FREEZE_SAMPLES];
+static size_t __freezeSampleLens[JSONTYPE_FREEZE_SAMPLES], __freezeNumSamples = 0;
+
+static uint64_t _mstime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void _FreezeList_Unlink(JSONType_t *jt) {
+    if (jt->prev) jt->prev->next = jt->next;
+    else __freezeHead = jt->next;
+    if (jt->next) jt->next->prev = jt->prev;
+    else __freezeTail = jt->prev;
+    jt->prev = jt->next = NULL;
+}
+
+static void _FreezeList_Append(JSONType_t *jt) {
+    jt->prev = __freezeTail;
+    jt->next = NULL;
+    if (__freezeTail) __freezeTail->next = jt;
+    else __freezeHead = jt;
+    __freezeTail = jt;
+}
+
+static void _FreezeList_Prepend(JSONType_t *jt) {
+    jt->prev = NULL;
+    jt->next = __freezeHead;
+    if (__freezeHead) __freezeHead->prev = jt;
+    else __freezeTail = jt;
+    __freezeHead = jt;
+}
+
+JSONType_t *NewJSONType(Node *root, NodeArena *arena) {
+    JSONType_t *jt = RedisModule_Calloc(1, sizeof(JSONType_t));
+    jt->root = root;
+    jt->arena = arena;
+    jt->atime = _mstime();
+    _FreezeList_Append(jt);
+    JSONTypeTouch(jt);
+    return jt;
+}
+
+void JSONTypeTouch(JSONType_t *jt) { jt->version = ++__jsonTypeVersion; }
+
+JSONType_t *JSONTypeAccess(JSONType_t *jt) {
+    if (!jt) return NULL;
+    JSONTypeThaw(jt);
+    jt->atime = _mstime();
+    _FreezeList_Unlink(jt);
+    _FreezeList_Append(jt);
+    return jt;
+}
+
+/* Keeps a prefix of a packed encoding as a sample, and trains the dictionary on enough of them. */
+static void _Freeze_Sample(const char *packed, size_t len) {
+    if (__freezeTrained) return;
+    len = MIN(len, JSONTYPE_FREEZE_SAMPLE_SIZE);
+    __freezeSamples[__freezeNumSamples] = RedisModule_Alloc(len);
+    memcpy(__freezeSamples[__freezeNumSamples], packed, len);
+    __freezeSampleLens[__freezeNumSamples++] = len;
+    if (__freezeNumSamples < JSONTYPE_FREEZE_SAMPLES) return;
+
+    __freezeDict = Compress_Train((const char **)__freezeSamples, __freezeSampleLens,
+                                  __freezeNumSamples, COMPRESS_MAX_DICT);
+    __freezeTrained = 1;
+    for (size_t i = 0; i < __freezeNumSamples; i++) RedisModule_Free(__freezeSamples[i]);
+    __freezeNumSamples = 0;
+}
+
+int JSONTypeFreeze(JSONType_t *jt) {
+    if (jt->frozen) return OBJ_ERR;
+
+    sds packed = ObjectTypePack(jt->root);
+    size_t len = sdslen(packed), cap = Compress_Bound(len);
+    _Freeze_Sample(packed, len);
+    JSONFrozen *f = RedisModule_Alloc(sizeof(JSONFrozen) + cap);
+    f->len = len;
+    f->dict = Compress_DictRetain(__freezeDict);
+    f->clen = Compress_EncodeDict(f->dict, packed, len, f->data, cap);
+    sdsfree(packed);
+    jt->frozen = RedisModule_Realloc(f, sizeof(JSONFrozen) + f->clen);
+
+    LazyFree_Value(jt->root, jt->arena);
+    jt->root = NULL;
+    jt->arena = NULL;
+    _FreezeList_Unlink(jt);
+    __freezeStats.frozen++;
+    __freezeStats.freezes++;
+    __freezeStats.memory += jt->frozen->clen;
+    __freezeStats.packed += len;
+    return OBJ_OK;
+}
+
+/* Decompresses a frozen value's packed encoding to a new buffer. */
+static char *_Frozen_Unpack(const JSONFrozen *f) {
+    // the data was compressed by us, so it can't be corrupt
+    char *packed = RedisModule_Alloc(f->len);
+    Compress_DecodeDict(f->dict, f->data, f->clen, packed, f->len);
+    return packed;
+}
+
+/* Forgets a frozen value's data. */
+static void _Frozen_Free(JSONType_t *jt) {
+    __freezeStats.frozen--;
+    __freezeStats.memory -= jt->frozen->clen;
+    __freezeStats.packed -= jt->frozen->len;
+    Compress_DictRelease(jt->frozen->dict);
+    RedisModule_Free(jt->frozen);
+    jt->frozen = NULL;
+}
+
+void JSONTypeThaw(JSONType_t *jt) {
+    if (!jt->frozen) return;
+
+    // the nodes are loaded to an arena like in JSONTypeRdbLoad
+    char *packed = _Frozen_Unpack(jt->frozen);
+    jt->arena = NewNodeArena(jt->frozen->len);
+    NodeArena *prev = Node_UseArena(jt->arena);
+    ObjectTypeUnpack(packed, jt->frozen->len, &jt->root);
+    Node_UseArena(prev);
+    RedisModule_Free(packed);
+
+    _Frozen_Free(jt);
+    _FreezeList_Prepend(jt);
+    __freezeStats.thaws++;
+}
+
+Node *JSONTypeDecode(const JSONType_t *jt) {
+    char *packed = _Frozen_Unpack(jt->frozen);
+    Node *root = NULL;
+    ObjectTypeUnpack(packed, jt->frozen->len, &root);
+    RedisModule_Free(packed);
+    return root;
+}
+
+size_t JSONTypeFreezeIdle(size_t max) {
+    if (!__freezeIdleTime || !__freezeHead) return 0;
+
+    uint64_t now = _mstime();
+    size_t frozen = 0;
+    while (frozen < max && __freezeHead && now - __freezeHead->atime >= __freezeIdleTime) {
+        JSONTypeFreeze(__freezeHead);
+        frozen++;
+    }
+    return frozen;
+}
+
+void JSONTypeSetFreezeIdleTime(uint64_t ms) { __freezeIdleTime = ms; }
+
+uint64_t JSONTypeGetFreezeIdleTime() { return __freezeIdleTime; }
+
+void JSONTypeGetFreezeStats(JSONTypeFreezeStats *stats) {
+    *stats = __freezeStats;
+    stats->dictionary = Compress_DictSize(__freezeDict);
+}
+
+void JSONTypeFreezeReset() {
+    for (size_t i = 0; i < __freezeNumSamples; i++) RedisModule_Free(__freezeSamples[i]);
+    __freezeNumSamples = 0;
+    Compress_DictRelease(__freezeDict);
+    __freezeDict = NULL;
+    __freezeTrained = 0;
+}
 
 void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver) {
     if (encver < 0 || encver > JSONTYPE_ENCODING_VERSION) {
@@ -26,43 +224,289 @@ void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver) {
         return NULL;
     }
 
-    JSONType_t *jt = RedisModule_Calloc(1, sizeof(JSONType_t));
-    jt->root = ObjectTypeRdbLoad(rdb);
+    JSONType_t *jt = NewJSONType(NULL, NewNodeArena(0));
+    NodeArena *prev = Node_UseArena(jt->arena);
+    int ret = OBJ_OK;
+    if (JSONTYPE_ENCODING_VERSION_PLAIN == encver) {
+        ret = ObjectTypeRdbLoad(rdb, &jt->root);
+    } else {
+        ret = ObjectTypeRdbLoadPacked(rdb, &jt->root);
+    }
+    Node_UseArena(prev);
+
+    // the TTLs are bound to the value's key when they expire
+    if (OBJ_OK == ret && encver >= JSONTYPE_ENCODING_VERSION_EXPIRY) {
+        uint64_t len = RedisModule_LoadUnsigned(rdb);
+        for (uint64_t i = 0; i < len; i++) {
+            size_t pathlen;
+            char *path = RedisModule_LoadStringBuffer(rdb, &pathlen);
+            Expiry_Set(jt, -1, NULL, 0, path, pathlen, RedisModule_LoadUnsigned(rdb));
+            RedisModule_Free(path);
+        }
+    }
+
+    if (OBJ_OK != ret) {
+        RedisModule_LogIOError(rdb, RM_LOGLEVEL_WARNING,
+                               "Can't load JSON from RDB due to a corrupt encoding");
+        JSONTypeFree(jt);
+        return NULL;
+    }
     return jt;
 }
 
 void JSONTypeRdbSave(RedisModuleIO *rdb, void *value) {
     JSONType_t *jt = (JSONType_t *)value;
-    ObjectTypeRdbSave(rdb, jt->root);    
+    if (jt->frozen) {
+        // a frozen value is already encoded
+        char *packed = _Frozen_Unpack(jt->frozen);
+        ObjectTypeRdbSavePacked(rdb, packed, jt->frozen->len);
+        RedisModule_Free(packed);
+    } else {
+        ObjectTypeRdbSave(rdb, jt->root);
+    }
+    const ExpiryDoc *doc = jt->expiries;
+    RedisModule_SaveUnsigned(rdb, doc ? doc->len : 0);
+    for (uint32_t i = 0; doc && i < doc->len; i++) {
+        RedisModule_SaveStringBuffer(rdb, doc->entries[i]->path, sdslen(doc->entries[i]->path));
+        RedisModule_SaveUnsigned(rdb, doc->entries[i]->when);
+    }
+}
+
+// the size of the JSON of a command in a rewritten AOF
+static size_t __aofChunkSize = JSONTYPE_AOF_DEFAULT_CHUNK_SIZE;
+
+void JSONTypeSetAofChunkSize(size_t size) { __aofChunkSize = size; }
+
+size_t JSONTypeGetAofChunkSize() { return __aofChunkSize; }
+
+/* The state of rewriting a value to the AOF. */
+typedef struct {
+    RedisModuleIO *aof;
+    RedisModuleCtx *ctx;
+    RedisModuleString *key;
+    sds json;                    // serialization buffer, reused by all commands
+    RedisModuleString **values;  // the pending values of a JSON.ARRAPPEND
+    size_t nvalues;
+    size_t cvalues;
+    size_t size;                 // the size of the pending values
+} _AofRewriter;
+
+static const JSONSerializeOpt _aofJsopt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+
+/* Returns the path of a value in the AOF, an empty path is the root. */
+static inline const char *_AofPath(const sds path) {
+    return sdslen(path) ? path : OBJECT_ROOT_PATH;
+}
+
+/* Serializes a node to the rewriter's buffer. */
+static void _AofSerialize(_AofRewriter *w, const Node *n) {
+    sdsclear(w->json);
+    SerializeNodeToJSON(n, &_aofJsopt, &w->json);
+}
+
+/* Emits the pending values of an array. */
+static void _AofFlushValues(_AofRewriter *w, const sds path) {
+    if (!w->nvalues) return;
+    RedisModule_EmitAOF(w->aof, "JSON.ARRAPPEND", "scv", w->key, _AofPath(path), w->values,
+                        w->nvalues);
+    for (size_t i = 0; i < w->nvalues; i++) RedisModule_FreeString(w->ctx, w->values[i]);
+    w->nvalues = 0;
+    w->size = 0;
+}
+
+/* Returns the quote of a dictionary's key in a path, or 0 if the path syntax can't express it. */
+static char _AofKeyQuote(const char *key) {
+    if (!strchr(key, '"')) return '"';
+    if (!strchr(key, '\'')) return '\'';
+    return 0;
+}
+
+/* Emits the commands that recreate a node at a path. */
+static void _AofEmit(_AofRewriter *w, const sds path, const Node *n) {
+    if (!__aofChunkSize || EstimateNodeJSONSize(n, __aofChunkSize) <= __aofChunkSize) goto whole;
+
+    switch (NODETYPE(n)) {
+        case N_STRING: {
+            // an empty string that slices are appended to, without splitting UTF-8 sequences
+            char *buf;
+            const char *str = Node_StringData(n, &buf);
+            uint32_t len = n->value.strval.len;
+            RedisModule_EmitAOF(w->aof, "JSON.SET", "scc", w->key, _AofPath(path), "\"\"");
+            for (uint32_t off = 0, slen; off < len; off += slen) {
+                slen = len - off < __aofChunkSize ? len - off : __aofChunkSize;
+                while (off + slen < len && 1 < slen && 0x80 == (str[off + slen] & 0xc0)) slen--;
+                Node *slice = NewStringNode(str + off, slen);
+                _AofSerialize(w, slice);
+                Node_Free(slice);
+                RedisModule_EmitAOF(w->aof, "JSON.STRAPPEND", "scb", w->key, _AofPath(path),
+                                    w->json, sdslen(w->json));
+            }
+            Node_StringRelease(buf);
+        } break;
+        case N_DICT: {
+            // an empty dictionary that's set key by key
+            Node **entries = n->value.dictval.entries;
+            uint32_t len = n->value.dictval.len;
+            for (uint32_t i = 0; i < len; i++) {
+                if (!_AofKeyQuote(entries[i]->value.kvval.key)) goto whole;
+            }
+            RedisModule_EmitAOF(w->aof, "JSON.SET", "scc", w->key, _AofPath(path), "{}");
+            for (uint32_t i = 0; i < len; i++) {
+                const char *key = entries[i]->value.kvval.key;
+                char quote = _AofKeyQuote(key);
+                sds kpath = sdscatlen(sdsdup(path), "[", 1);
+                kpath = sdscatlen(kpath, &quote, 1);
+                kpath = sdscat(kpath, key);
+                kpath = sdscatlen(kpath, &quote, 1);
+                kpath = sdscatlen(kpath, "]", 1);
+                _AofEmit(w, kpath, entries[i]->value.kvval.val);
+                sdsfree(kpath);
+            }
+        } break;
+        case N_ARRAY: {
+            // an empty array that's appended to in chunks, with placeholders for large values
+            Node **entries = n->value.arrval.entries;
+            uint32_t len = n->value.arrval.len;
+            RedisModule_EmitAOF(w->aof, "JSON.SET", "scc", w->key, _AofPath(path), "[]");
+            for (uint32_t i = 0; i < len; i++) {
+                size_t size = EstimateNodeJSONSize(entries[i], __aofChunkSize);
+                if (size > __aofChunkSize) {
+                    _AofFlushValues(w, path);
+                    RedisModule_EmitAOF(w->aof, "JSON.ARRAPPEND", "scc", w->key, _AofPath(path),
+                                        "null");
+                    sds ipath = sdscatfmt(sdsdup(path), "[%u]", i);
+                    _AofEmit(w, ipath, entries[i]);
+                    sdsfree(ipath);
+                    continue;
+                }
+
+                if (w->size + size > __aofChunkSize) _AofFlushValues(w, path);
+                if (w->nvalues == w->cvalues) {
+                    w->cvalues = w->cvalues ? w->cvalues * 2 : 16;
+                    w->values = RedisModule_Realloc(w->values, w->cvalues * sizeof(*w->values));
+                }
+                _AofSerialize(w, entries[i]);
+                w->values[w->nvalues++] = RedisModule_CreateString(w->ctx, w->json, sdslen(w->json));
+                w->size += size;
+            }
+            _AofFlushValues(w, path);
+        } break;
+        default:
+            goto whole;
+    }
+    return;
+
+whole:
+    _AofSerialize(w, n);
+    RedisModule_EmitAOF(w->aof, "JSON.SET", "scb", w->key, _AofPath(path), w->json,
+                        sdslen(w->json));
 }
 
 void JSONTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
-    // two approaches:
-    // 1. For small documents it makes more sense to serialze the entire document in one go
-    // 2. Large documents need to be broken to smaller pieces in order to stay within 0.5GB, but
-    // we'll need some meta data to make sane-sized chunks so this gets lower priority atm
+    // small documents are serialized in one go, whereas large ones are broken to chunks that are
+    // serialized one at a time
     JSONType_t *jt = (JSONType_t *)value;
+    _AofRewriter w = {.aof = aof, .ctx = RedisModule_GetContextFromIO(aof), .key = key};
+    w.json = sdsempty();
+    sds path = sdsempty();
+    Node *root = jt->frozen ? JSONTypeDecode(jt) : jt->root;
+    _AofEmit(&w, path, root);
+    if (jt->frozen) Node_Free(root);
+    sdsfree(path);
+
+    // the TTLs are absolute, so they don't restart when the AOF is loaded
+    const ExpiryDoc *doc = jt->expiries;
+    for (uint32_t i = 0; doc && i < doc->len; i++) {
+        RedisModule_EmitAOF(aof, "JSON.PEXPIREAT", "scl", key, doc->entries[i]->path,
+                            (long long)doc->entries[i]->when);
+    }
+    sdsfree(w.json);
+    RedisModule_Free(w.values);
+}
 
-    // serialize it
-    JSONSerializeOpt jsopt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
-    sds json = sdsempty();
-    SerializeNodeToJSON(jt->root, &jsopt, &json);
-    RedisModule_EmitAOF(aof, "JSON.SET", "scb", key, OBJECT_ROOT_PATH, json, sdslen(json));
-    sdsfree(json);
+/* Detaches a value from the indexes, the timer wheel and the frozen values' list, and frees it. */
+static void _JSONType_Free(JSONType_t *jt) {
+    SIndex_Forget(jt);
+    Expiry_Forget(jt);
+    if (jt->frozen) _Frozen_Free(jt);
+    else _FreezeList_Unlink(jt);
+    LazyFree_Value(jt->root, jt->arena);
+    RedisModule_Free(jt);
 }
 
 void JSONTypeFree(void *value) {
-    JSONType_t *jt = (JSONType_t *)value;
-    if (jt) {
-        Node_Free(jt->root);
-        RedisModule_Free(jt);
+    if (value && !JSONTypeDeferFree(JSONTypeFree, value)) _JSONType_Free(value);
+}
+
+void JSONTypeSetMainThread() {
+    __mainThread = pthread_self();
+    __mainThreadSet = 1;
+}
+
+int JSONTypeDeferFree(void (*free)(void *), void *value) {
+    // the module's structures are only changed by the main thread, so values that the server frees
+    // in the background (e.g. FLUSHALL ASYNC) are left untouched until it reaps them
+    if (!__mainThreadSet || pthread_equal(pthread_self(), __mainThread)) return 0;
+
+    pthread_mutex_lock(&__orphans.lock);
+    if (__orphans.len == __orphans.cap) {
+        __orphans.cap = __orphans.cap ? __orphans.cap * 2 : 64;
+        __orphans.values =
+            RedisModule_Realloc(__orphans.values, __orphans.cap * sizeof(_Orphan));
     }
+    __orphans.values[__orphans.len].free = free;
+    __orphans.values[__orphans.len++].value = value;
+    pthread_mutex_unlock(&__orphans.lock);
+    return 1;
+}
+
+size_t JSONTypeReap() {
+    pthread_mutex_lock(&__orphans.lock);
+    size_t len = __orphans.len;
+    _Orphan *values = __orphans.values;
+    __orphans.values = NULL;
+    __orphans.len = __orphans.cap = 0;
+    pthread_mutex_unlock(&__orphans.lock);
+
+    for (size_t i = 0; i < len; i++) values[i].free(values[i].value);
+    if (values) RedisModule_Free(values);
+    return len;
 }
 
 size_t JSONTypeMemoryUsage(const void *value) {
     const JSONType_t *jt = (JSONType_t *)value;
     size_t memory = sizeof(JSONType_t);
 
+    if (jt->frozen) memory += sizeof(JSONFrozen) + jt->frozen->clen;
     memory += ObjectTypeMemoryUsage(jt->root);
+    if (jt->arena) memory += NodeArena_Waste(jt->arena);
+    memory += Expiry_MemoryUsage(jt);
     return memory;
 }
+
+Node *JSONTypeAdopt(JSONType_t *jt, Node *n, NodeArena *arena) {
+    if (arena == jt->arena) return n;
+
+    NodeArena *prev = Node_UseArena(jt->arena);
+    Node *copy = Node_Copy(n);
+    Node_UseArena(prev);
+
+    if (arena) NodeArena_Release(arena);
+    else Node_Free(n);
+    return copy;
+}
+
+void JSONTypeCompact(JSONType_t *jt) {
+    if (!jt->arena || !NodeArena_NeedsCompaction(jt->arena)) return;
+
+    // copy the value to a new arena that's sized for it, and release the old one
+    NodeArena *arena = NewNodeArena(jt->arena->used - jt->arena->freed);
+    if (!arena) return;
+    NodeArena *prev = Node_UseArena(arena);
+    Node *root = Node_Copy(jt->root);
+    Node_UseArena(prev);
+
+    NodeArena_Release(jt->arena);
+    jt->arena = arena;
+    jt->root = root;
+}
@@ -22,23 +22,159 @@
 #include "object_type.h"
 #include "json_object.h"
 #include "redismodule.h"
+#include "arena.h"
+#include "lazyfree.h"
+#include "compress.h"
 
-#define JSONTYPE_ENCODING_VERSION 0
+// The RDB encodings, values are saved in the latest
+#define JSONTYPE_ENCODING_VERSION_PLAIN 0
+#define JSONTYPE_ENCODING_VERSION_PACKED 1
+#define JSONTYPE_ENCODING_VERSION_EXPIRY 2  // packed, followed by the TTLs of paths
+#define JSONTYPE_ENCODING_VERSION JSONTYPE_ENCODING_VERSION_EXPIRY
 #define JSONTYPE_NAME "ReJSON-RL"
 
 #define RM_LOGLEVEL_WARNING "warning"
 
 #define OBJECT_ROOT_PATH "."
 
-/* A wrapper for a JSON value. */
+// The default size of the JSON of a command in a rewritten AOF
+#define JSONTYPE_AOF_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+// The most idle values that are frozen before a command
+#define JSONTYPE_FREEZE_BATCH 4
+// The number of frozen values, and the size of each one's prefix, that the dictionary is trained on
+#define JSONTYPE_FREEZE_SAMPLES 32
+#define JSONTYPE_FREEZE_SAMPLE_SIZE (2 * 1024)
+
+/*
+* A frozen JSON value: its packed encoding (see object_type.h), compressed with the dictionary that
+* was trained on the first values that were frozen, once there is one. The value holds a reference
+* to its dictionary, which outlives a newer one.
+*/
 typedef struct {
+    size_t len;                  // the size of the packed encoding
+    size_t clen;                 // the size of the compressed data
+    CompressDict *dict;          // the dictionary of the data, NULL if there's none
+    char data[];
+} JSONFrozen;
+
+/* A wrapper for a JSON value. */
+typedef struct JSONType {
     Node *root;
+    NodeArena *arena;  // the arena of the value's nodes, NULL if they're allocated from the heap
+    uint64_t version;  // module-wide unique version of the value, changed by every modification
+    struct SIndexDoc *indexed;  // the value's documents in secondary indexes (see sindex.h)
+    struct ExpiryDoc *expiries;  // the TTLs of the value's paths (see expiry.h)
+    JSONFrozen *frozen;  // the frozen value, without a root, or NULL if the value isn't frozen
+    uint64_t atime;      // the value's last access time, in milliseconds of a monotonic clock
+    struct JSONType *prev, *next;  // the values that aren't frozen, by their access times
 } JSONType_t;
 
+/** Creates a JSON value of a root node and its arena. */
+JSONType_t *NewJSONType(Node *root, NodeArena *arena);
+
+/**
+* Accesses a JSON value: a frozen value is thawed and the value's access time is updated. Commands
+* must access values before they use them. A NULL value is ignored. Returns the value.
+*/
+JSONType_t *JSONTypeAccess(JSONType_t *jt);
+
+/**
+* Freezes a JSON value, replacing its nodes with their compressed packed encoding. Returns OBJ_ERR
+* if the value is already frozen.
+*/
+int JSONTypeFreeze(JSONType_t *jt);
+
+/**
+* Thaws a frozen JSON value without accessing it, e.g. for a scan of many values. It's frozen
+* again once it's been idle long enough.
+*/
+void JSONTypeThaw(JSONType_t *jt);
+
+/**
+* Decodes the nodes of a frozen value without thawing it, e.g. to read it without accessing it.
+* The caller frees them.
+*/
+Node *JSONTypeDecode(const JSONType_t *jt);
+
+/**
+* Freezes up to `max` of the values that weren't accessed in the freeze idle time, least recently
+* accessed first. Returns the number of frozen values.
+*/
+size_t JSONTypeFreezeIdle(size_t max);
+
+/** Sets the time in milliseconds after which values that weren't accessed are frozen, 0 never. */
+void JSONTypeSetFreezeIdleTime(uint64_t ms);
+
+/** Returns the freeze idle time in milliseconds. */
+uint64_t JSONTypeGetFreezeIdleTime();
+
+/* The counters of frozen values. */
+typedef struct {
+    size_t frozen;      // the values that are frozen
+    size_t freezes;     // the times values were frozen
+    size_t thaws;       // the times values were thawed
+    size_t memory;      // the memory of the frozen values' compressed data
+    size_t packed;      // the size of the frozen values' packed encodings
+    size_t dictionary;  // the size of the trained dictionary, 0 until it's trained
+} JSONTypeFreezeStats;
+
+/** Fills the counters of frozen values. */
+void JSONTypeGetFreezeStats(JSONTypeFreezeStats *stats);
+
+/**
+* Forgets the samples and the dictionary of frozen values, e.g. in tests, so that the next values
+* train a new one. Values that were frozen with the old dictionary keep it until they're thawed.
+*/
+void JSONTypeFreezeReset();
+
+/** Records the calling thread as the main thread, the only one that may detach freed values. */
+void JSONTypeSetMainThread();
+
+/**
+* Defers freeing a value of one of the module's types to the main thread if it's freed by another,
+* e.g. the server's background thread in a FLUSHALL ASYNC. Returns 1 if it's deferred, and 0 if the
+* caller must free it.
+*/
+int JSONTypeDeferFree(void (*free)(void *), void *value);
+
+/** Frees the values that were deferred. Must be called by the main thread. Returns their number. */
+size_t JSONTypeReap();
+
+/**
+* Gives a JSON value a new version, invalidating its cached serializations. Must be called by every
+* command that modifies the value.
+*/
+void JSONTypeTouch(JSONType_t *jt);
+
 void *JSONTypeRdbLoad(RedisModuleIO *rdb, int encver);
 void JSONTypeRdbSave(RedisModuleIO *rdb, void *value);
 void JSONTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+/**
+* Frees a JSON value, large values are freed in the background (see lazyfree.h). A value that's
+* freed by another thread than the main one is only freed once the main thread reaps it.
+*/
 void JSONTypeFree(void *value);
 size_t JSONTypeMemoryUsage(const void *value);
 
+/**
+* Links a new value, that was created in its own arena, to a JSON value by copying it into the
+* value's arena (when the arenas differ). The new value's arena is released. Returns the node to
+* link.
+*/
+Node *JSONTypeAdopt(JSONType_t *jt, Node *n, NodeArena *arena);
+
+/** Compacts a JSON value's arena if enough of it had been freed. */
+void JSONTypeCompact(JSONType_t *jt);
+
+/**
+* Sets the approximate size of the JSON of a command in a rewritten AOF. Larger values are emitted
+* as a skeleton that's filled by subsequent commands, so rewriting needs about as much memory as a
+* chunk. 0 emits every value in a single command.
+*/
+void JSONTypeSetAofChunkSize(size_t size);
+
+/** Returns the size of the JSON of a command in a rewritten AOF. */
+size_t JSONTypeGetAofChunkSize();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include "redismodule.h"
+#include "lazyfree.h"
+
+/* A value waiting for the background thread. */
+typedef struct lazyFreeJob {
+    struct lazyFreeJob *next;
+    Node *root;
+    NodeArena *arena;
+} lazyFreeJob;
+
+static struct {
+    pthread_mutex_t lock;   // guards the queue and the counters
+    pthread_cond_t cond;    // signalled when jobs are queued
+    lazyFreeJob *head;      // the queue of jobs, oldest first
+    lazyFreeJob *tail;
+    int started;
+    size_t pending;
+    size_t freed;
+} __lazyfree = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0};
+
+static size_t __lazyfreeThreshold = LAZYFREE_DEFAULT_THRESHOLD;
+
+void LazyFree_SetThreshold(size_t threshold) { __lazyfreeThreshold = threshold; }
+
+size_t LazyFree_GetThreshold() { return __lazyfreeThreshold; }
+
+/* Frees a value on the calling thread. */
+static void _LazyFree_Free(Node *root, NodeArena *arena) {
+    // an arena frees all the nodes at once
+    if (arena) NodeArena_Release(arena);
+    else Node_Free(root);
+}
+
+static void *_LazyFree_Main(void *arg) {
+    pthread_mutex_lock(&__lazyfree.lock);
+    while (1) {
+        while (!__lazyfree.head) pthread_cond_wait(&__lazyfree.cond, &__lazyfree.lock);
+        lazyFreeJob *job = __lazyfree.head;
+        __lazyfree.head = job->next;
+        if (!__lazyfree.head) __lazyfree.tail = NULL;
+        pthread_mutex_unlock(&__lazyfree.lock);
+
+        _LazyFree_Free(job->root, job->arena);
+        RedisModule_Free(job);
+
+        pthread_mutex_lock(&__lazyfree.lock);
+        __lazyfree.pending--;
+        __lazyfree.freed++;
+    }
+    return NULL;
+}
+
+int LazyFree_Start() {
+    if (__lazyfree.started) return OBJ_OK;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, _LazyFree_Main, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc) return OBJ_ERR;
+
+    __lazyfree.started = 1;
+    return OBJ_OK;
+}
+
+void LazyFree_Value(Node *root, NodeArena *arena) {
+    /* The subtree of a value in an arena is freed by accounting for it in the arena, which is only
+     * safe on the arena's thread. */
+    int offthread = arena || !root || NODE_IS_TAGGED(root) || !(root->flags & N_F_ARENA);
+    if (!__lazyfree.started || !__lazyfreeThreshold || !offthread ||
+        Node_Count(root) <= __lazyfreeThreshold) {
+        _LazyFree_Free(root, arena);
+        return;
+    }
+
+    lazyFreeJob *job = RedisModule_Alloc(sizeof(lazyFreeJob));
+    job->next = NULL;
+    job->root = root;
+    job->arena = arena;
+
+    pthread_mutex_lock(&__lazyfree.lock);
+    if (__lazyfree.tail) __lazyfree.tail->next = job;
+    else __lazyfree.head = job;
+    __lazyfree.tail = job;
+    __lazyfree.pending++;
+    pthread_cond_signal(&__lazyfree.cond);
+    pthread_mutex_unlock(&__lazyfree.lock);
+}
+
+void LazyFree_GetStats(LazyFreeStats *stats) {
+    pthread_mutex_lock(&__lazyfree.lock);
+    stats->pending = __lazyfree.pending;
+    stats->freed = __lazyfree.freed;
+    pthread_mutex_unlock(&__lazyfree.lock);
+    stats->threshold = __lazyfreeThreshold;
+}
@@ -0,0 +1,61 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LAZYFREE_H__
+#define __LAZYFREE_H__
+
+#include <stddef.h>
+#include "object.h"
+#include "arena.h"
+
+// The default number of nodes above which a value is freed in the background
+#define LAZYFREE_DEFAULT_THRESHOLD 10000
+
+/*
+* Lazy freeing of large values. Freeing a value with millions of nodes takes long enough to stall
+* the server, so values above a threshold are detached and handed to a module-owned background
+* thread that frees them. Smaller values, and values that the thread can't free (such as subtrees of
+* a value in an arena), are freed by the caller. The thread only touches the nodes it's given and
+* the intern table, which is thread safe.
+*/
+
+/* The lazy free counters. */
+typedef struct {
+    size_t pending;    // values waiting for the background thread
+    size_t freed;      // values freed by the background thread
+    size_t threshold;  // number of nodes above which values are freed in the background
+} LazyFreeStats;
+
+/** Sets the number of nodes above which values are freed in the background, 0 disables it. */
+void LazyFree_SetThreshold(size_t threshold);
+
+/** Returns the number of nodes above which values are freed in the background. */
+size_t LazyFree_GetThreshold();
+
+/** Starts the background thread, values are freed by the caller until it's started. */
+int LazyFree_Start();
+
+/**
+* Frees a detached value, possibly in the background. If `arena` isn't NULL it's the value's arena
+* and it is released with it, otherwise the value must not be referenced by any other node.
+*/
+void LazyFree_Value(Node *root, NodeArena *arena);
+
+/** Fills the lazy free counters. */
+void LazyFree_GetStats(LazyFreeStats *stats);
+
+#endif
@@ -16,19 +16,124 @@
 */
 
 #include "object.h"
+#include "arena.h"
+#include "compress.h"
 
-Node *__newNode(NodeType t) {
-    Node *ret = RedisModule_Calloc(1, sizeof(Node));
+/* === Node memory ===
+ * Nodes are allocated from the current arena, if there's one, or from the heap. The data that a
+ * node owns, i.e. containers' entries and strings that aren't embedded, is allocated from the same
+ * arena as the node.
+*/
+static __thread NodeArena *__node_arena = NULL;
+
+NodeArena *Node_UseArena(NodeArena *a) {
+    NodeArena *prev = __node_arena;
+    __node_arena = a;
+    return prev;
+}
+
+#define __node_inArena(n) ((n)->flags & N_F_ARENA)
+
+/* Allocates a zeroed node, with size including any data that's embedded in it. */
+static Node *__node_alloc(NodeType t, size_t size) {
+    if (__node_arena) return NodeArena_AllocNode(__node_arena, t, size);
+
+    Node *ret = RedisModule_Calloc(1, size);
     ret->type = t;
     return ret;
 }
 
-Node *NewBoolNode(int val) {
-    Node *ret = __newNode(N_BOOLEAN);
-    ret->value.boolval = val != 0;
-    return ret;
+static void __node_dealloc(Node *n, size_t size) {
+    if (__node_inArena(n)) NodeArena_FreeNode(NodeArena_Of(n), n, size);
+    else RedisModule_Free(n);
+}
+
+/* Allocates, reallocates and frees data that's owned by a node. */
+static void *__node_allocData(Node *n, size_t size) {
+    if (__node_inArena(n)) return NodeArena_Alloc(NodeArena_Of(n), size);
+    return RedisModule_Calloc(1, size);
+}
+
+static void *__node_reallocData(Node *n, void *p, size_t oldsize, size_t size) {
+    if (__node_inArena(n)) return NodeArena_Realloc(NodeArena_Of(n), p, oldsize, size);
+    return RedisModule_Realloc(p, size);
 }
 
+static void __node_freeData(Node *n, void *p, size_t size) {
+    if (__node_inArena(n)) NodeArena_Free(NodeArena_Of(n), p, size);
+    else if (p) RedisModule_Free(p);
+}
+
+Node *__newNode(NodeType t) { return __node_alloc(t, sizeof(Node)); }
+
+/* === Container sizes ===
+ * Containers keep the sizes of their subtrees (see t_sizes) right before their entries. Every
+ * mutator links and unlinks children through __node_link and __node_unlink, which keep the sizes
+ * of the container and of its ancestors up to date, and the parent of children that are containers.
+*/
+#define __node_sizes(n) ((t_sizes *)(n)->value.arrval.entries - 1)
+#define __node_isContainer(n) (N_DICT == NODETYPE(n) || N_ARRAY == NODETYPE(n))
+
+/* The size of a string's data, compressed or not. */
+#define __node_strSize(n) \
+    ((n)->flags & N_F_COMPRESSED ? (n)->value.strval.clen : (n)->value.strval.len)
+
+/* Returns the sizes of a value, containers keep theirs and other values are sized as is. */
+static inline t_sizes __node_sizeOf(const Node *n) {
+    if (!n || NODE_IS_TAGGED(n)) return (t_sizes){NULL, 1, 0};
+
+    switch (n->type) {
+        case N_DICT:
+        case N_ARRAY:
+            return *__node_sizes(n);
+        case N_STRING:
+            return (t_sizes){NULL, 1, sizeof(Node) + __node_strSize(n)};
+        case N_KEYVAL: {
+            t_sizes s = __node_sizeOf(n->value.kvval.val);
+            return (t_sizes){NULL, s.nodes + 1, s.bytes + sizeof(Node) + Intern_Size(n->value.kvval.key)};
+        }
+        default:
+            return (t_sizes){NULL, 1, sizeof(Node)};
+    }
+}
+
+/* Adds to the sizes of a container and of its ancestors. */
+static inline void __node_grow(Node *c, int64_t nodes, int64_t bytes) {
+    for (; c; c = __node_sizes(c)->parent) {
+        t_sizes *s = __node_sizes(c);
+        s->nodes += nodes;
+        s->bytes += bytes;
+    }
+}
+
+/* Sets the parent of a child, or of a key-value's value, if it's a container. */
+static inline void __node_setParent(Node *child, Node *parent) {
+    if (child && !NODE_IS_TAGGED(child) && N_KEYVAL == child->type) child = child->value.kvval.val;
+    if (child && __node_isContainer(child)) __node_sizes(child)->parent = parent;
+}
+
+/* Accounts for a child that's linked to a container. */
+static inline void __node_link(Node *c, Node *child) {
+    t_sizes s = __node_sizeOf(child);
+    __node_setParent(child, c);
+    __node_grow(c, s.nodes, s.bytes);
+}
+
+/* Accounts for a child that's unlinked from a container, before it's freed or detached. */
+static inline void __node_unlink(Node *c, Node *child) {
+    t_sizes s = __node_sizeOf(child);
+    __node_setParent(child, NULL);
+    __node_grow(c, -(int64_t)s.nodes, -(int64_t)s.bytes);
+}
+
+size_t Node_Count(const Node *n) { return __node_sizeOf(n).nodes; }
+
+size_t Node_MemoryUsage(const Node *n) { return __node_sizeOf(n).bytes; }
+
+void Node_ChildResized(Node *container, int64_t bytes) { __node_grow(container, 0, bytes); }
+
+Node *NewBoolNode(int val) { return (Node *)(((uintptr_t)(val != 0) << 2) | N_TAG_BOOLEAN); }
+
 Node *NewDoubleNode(double val) {
     Node *ret = __newNode(N_NUMBER);
     ret->value.numval = val;
@@ -36,15 +141,97 @@ Node *NewDoubleNode(double val) {
 }
 
 Node *NewIntNode(int64_t val) {
+    if (val >= N_TAG_MIN_INT && val <= N_TAG_MAX_INT)
+        return (Node *)(((uintptr_t)(intptr_t)val << 2) | N_TAG_INTEGER);
+
     Node *ret = __newNode(N_INTEGER);
     ret->value.intval = val;
     return ret;
 }
 
+/* === String compression ===
+ * Strings that are at least as long as the threshold are stored compressed, unless that saves less
+ * than an eighth of their length. Compressed strings are decompressed whenever they're read.
+*/
+static uint32_t __node_compressThreshold = 0;
+
+void Node_StringSetCompressThreshold(uint32_t threshold) { __node_compressThreshold = threshold; }
+
+uint32_t Node_StringGetCompressThreshold() { return __node_compressThreshold; }
+
+/* Returns the string compressed in a new buffer, or NULL if it shouldn't be compressed. */
+static char *__node_compress(const char *s, uint32_t len, uint32_t *clen) {
+    if (!__node_compressThreshold || len < __node_compressThreshold) return NULL;
+
+    size_t cap = len - len / 8;
+    char *buf = RedisModule_Alloc(cap);
+    *clen = Compress_Encode(s, len, buf, cap);
+    if (!*clen) {
+        RedisModule_Free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+const char *Node_StringData(const Node *n, char **buf) {
+    const t_string *s = &n->value.strval;
+    *buf = NULL;
+    if (!(n->flags & N_F_COMPRESSED)) return s->data;
+
+    // the data was compressed by us, so it can't be corrupt
+    *buf = RedisModule_Alloc(s->len + 1);
+    Compress_Decode(s->data, s->clen, *buf, s->len);
+    (*buf)[s->len] = '\0';
+    return *buf;
+}
+
+void Node_StringRelease(char *buf) {
+    if (buf) RedisModule_Free(buf);
+}
+
+void Node_CompressionStats(const Node *n, size_t *strings, size_t *saved) {
+    if (!n || NODE_IS_TAGGED(n)) return;
+
+    switch (n->type) {
+        case N_STRING:
+            if (n->flags & N_F_COMPRESSED) {
+                (*strings)++;
+                *saved += n->value.strval.len - n->value.strval.clen;
+            }
+            break;
+        case N_KEYVAL:
+            Node_CompressionStats(n->value.kvval.val, strings, saved);
+            break;
+        case N_ARRAY:
+            for (uint32_t i = 0; i < n->value.arrval.len; i++)
+                Node_CompressionStats(n->value.arrval.entries[i], strings, saved);
+            break;
+        case N_DICT:
+            for (uint32_t i = 0; i < n->value.dictval.len; i++)
+                Node_CompressionStats(n->value.dictval.entries[i], strings, saved);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Creates a string node with the string's data, which is already compressed if clen isn't 0. */
+static Node *__node_newString(const char *data, uint32_t len, uint32_t clen) {
+    // the string is embedded in the node's allocation
+    Node *ret = __node_alloc(N_STRING, sizeof(Node) + (clen ? clen : len + 1));
+    ret->flags |= N_F_EMBSTR | (clen ? N_F_COMPRESSED : 0);
+    memcpy(ret + 1, data, clen ? clen : len);
+    ret->value.strval = (t_string){(const char *)(ret + 1), len, clen};
+    return ret;
+}
+
 Node *NewStringNode(const char *s, uint32_t len) {
-    Node *ret = __newNode(N_STRING);
-    ret->value.strval.data = rmstrndup(s, len);
-    ret->value.strval.len = len;
+    uint32_t clen = 0;
+    char *c = __node_compress(s, len, &clen);
+    if (!c) return __node_newString(s, len, 0);
+
+    Node *ret = __node_newString(c, len, clen);
+    RedisModule_Free(c);
     return ret;
 }
 
@@ -52,57 +239,80 @@ Node *NewCStringNode(const char *s) { return NewStringNode(s, strlen(s)); }
 
 Node *NewKeyValNode(const char *key, uint32_t len, Node *n) {
     Node *ret = __newNode(N_KEYVAL);
-    ret->value.kvval.key = rmstrndup(key, len);
+    ret->value.kvval.key = Intern_Acquire(key, len);
+    ret->value.kvval.val = n;
+    return ret;
+}
+
+Node *NewInternedKeyValNode(const char *key, Node *n) {
+    Node *ret = __newNode(N_KEYVAL);
+    ret->value.kvval.key = Intern_Retain(key);
     ret->value.kvval.val = n;
     return ret;
 }
 
 Node *NewArrayNode(uint32_t cap) {
     Node *ret = __newNode(N_ARRAY);
+    size_t size = sizeof(t_sizes) + cap * sizeof(Node *);
+    t_sizes *sizes = __node_allocData(ret, size);
+    sizes->nodes = 1;
+    sizes->bytes = sizeof(Node) + size;
     ret->value.arrval.cap = cap;
     ret->value.arrval.len = 0;
-    ret->value.arrval.entries = RedisModule_Calloc(cap, sizeof(Node *));
+    ret->value.arrval.entries = (Node **)(sizes + 1);
     return ret;
 }
 
+static void __dict_resize(Node *obj, uint32_t cap);
+
 Node *NewDictNode(uint32_t cap) {
     Node *ret = __newNode(N_DICT);
-    ret->value.dictval.cap = cap;
+    ret->value.dictval.cap = 0;
     ret->value.dictval.len = 0;
-    ret->value.dictval.entries = RedisModule_Calloc(cap, sizeof(Node *));
+    ret->value.dictval.entries = NULL;
+    __dict_resize(ret, cap);
     return ret;
 }
 
 void __node_FreeKV(Node *n) {
     Node_Free(n->value.kvval.val);
-    RedisModule_Free((char *)n->value.kvval.key);
-    RedisModule_Free(n);
+    Intern_Release(n->value.kvval.key);
+    __node_dealloc(n, sizeof(Node));
 }
 
 void __node_FreeObj(Node *n) {
     for (int i = 0; i < n->value.dictval.len; i++) {
         Node_Free(n->value.dictval.entries[i]);
     }
-    if (n->value.dictval.entries) RedisModule_Free(n->value.dictval.entries);
-    RedisModule_Free(n);
+    __node_freeData(n, __node_sizes(n), sizeof(t_sizes) + n->value.dictval.cap * sizeof(Node *) +
+                                            Node_DictIndexSize(n));
+    __node_dealloc(n, sizeof(Node));
 }
 
 void __node_FreeArr(Node *n) {
     for (int i = 0; i < n->value.arrval.len; i++) {
         Node_Free(n->value.arrval.entries[i]);
     }
-    RedisModule_Free(n->value.arrval.entries);
-    RedisModule_Free(n);
+    __node_freeData(n, __node_sizes(n), sizeof(t_sizes) + n->value.arrval.cap * sizeof(Node *));
+    __node_dealloc(n, sizeof(Node));
 }
 
+/* The size of an embedded string's data, uncompressed strings are NULL terminated. */
+#define __node_embSize(n) \
+    ((n)->flags & N_F_COMPRESSED ? (n)->value.strval.clen : (n)->value.strval.len + 1)
+
 void __node_FreeString(Node *n) {
-    RedisModule_Free((char *)n->value.strval.data);
-    RedisModule_Free(n);
+    if (n->flags & N_F_EMBSTR) {
+        __node_dealloc(n, sizeof(Node) + __node_embSize(n));
+    } else {
+        __node_freeData(n, (char *)n->value.strval.data, __node_strSize(n));
+        __node_dealloc(n, sizeof(Node));
+    }
 }
 
 void Node_Free(Node *n) {
-    // ignore NULL nodes
-    if (!n) return;
+    // ignore NULL and tagged nodes
+    if (!n || NODE_IS_TAGGED(n)) return;
 
     switch (n->type) {
         case N_ARRAY:
@@ -118,14 +328,14 @@ void Node_Free(Node *n) {
             __node_FreeKV(n);
             break;
         default:
-            RedisModule_Free(n);
+            __node_dealloc(n, sizeof(Node));
     }
 }
 
 int Node_Length(const Node *n) {
     // Length is only defined for arrays, dictionaries and strings
     if (n) {
-        switch (n->type) {
+        switch (NODETYPE(n)) {
             case N_ARRAY:
                 return n->value.arrval.len;
                 break;
@@ -146,14 +356,31 @@ int Node_Length(const Node *n) {
 int Node_StringAppend(Node *dst, Node *src) {
     t_string *d = &dst->value.strval;
     t_string *s = &src->value.strval;
+    uint32_t len = d->len + s->len;
+
+    // compressed strings are decompressed, appended to and compressed again
+    char *dbuf, *sbuf, *c;
+    const char *ddata = Node_StringData(dst, &dbuf), *sdata = Node_StringData(src, &sbuf);
+    char *newval = __node_allocData(dst, len);
+    memcpy(newval, ddata, d->len);
+    memcpy(&newval[d->len], sdata, s->len);
+    Node_StringRelease(dbuf);
+    Node_StringRelease(sbuf);
+
+    uint32_t clen = 0;
+    if ((c = __node_compress(newval, len, &clen))) {
+        __node_freeData(dst, newval, len);
+        newval = __node_allocData(dst, clen);
+        memcpy(newval, c, clen);
+        RedisModule_Free(c);
+    }
 
-    char *newval = RedisModule_Calloc(d->len + s->len, sizeof(char));
-    strncpy(newval, d->data, d->len);
-    strncpy(&newval[d->len], s->data, s->len);
-
-    RedisModule_Free((char *)d->data);
-    d->data = newval;
-    d->len += s->len;
+    // an embedded string's memory stays with the node, but is no longer used
+    if (dst->flags & N_F_EMBSTR) __node_freeData(dst, NULL, __node_embSize(dst));
+    else __node_freeData(dst, (char *)d->data, __node_strSize(dst));
+    dst->flags &= ~(N_F_EMBSTR | N_F_COMPRESSED);
+    dst->flags |= clen ? N_F_COMPRESSED : 0;
+    *d = (t_string){newval, len, clen};
 
     return OBJ_OK;
 }
@@ -167,7 +394,10 @@ int Node_ArrayDelRange(Node *arr, const int index, const int count) {
     int stop = MIN(start + count, a->len);  // stop is exclusive
 
     // free range
-    for (int i = start; i < stop; i++) Node_Free(a->entries[i]);
+    for (int i = start; i < stop; i++) {
+        __node_unlink(arr, a->entries[i]);
+        Node_Free(a->entries[i]);
+    }
 
     // move whatever remains on the left side
     if (stop < a->len)
@@ -206,8 +436,11 @@ void __node_ArrayMakeRoomFor(Node *arr, uint32_t addlen) {
         nextcap = ((newcap / CHUNK_SIZE) + 1) * CHUNK_SIZE;
     }
 
+    t_sizes *sizes = __node_reallocData(arr, __node_sizes(arr), sizeof(t_sizes) + a->cap * sizeof(Node *),
+                                        sizeof(t_sizes) + nextcap * sizeof(Node *));
+    a->entries = (Node **)(sizes + 1);
+    __node_grow(arr, 0, (int64_t)(nextcap - a->cap) * sizeof(Node *));
     a->cap = nextcap;
-    a->entries = RedisModule_Realloc(a->entries, a->cap * sizeof(Node *));
 }
 
 int Node_ArrayInsert(Node *arr, int index, Node *sub) {
@@ -223,9 +456,13 @@ int Node_ArrayInsert(Node *arr, int index, Node *sub) {
         memmove(&a->entries[index + s->len], &a->entries[index], (a->len - index) * sizeof(Node *));
     }
 
-    // copy the references
+    // copy the references, and move their sizes along with them
     memcpy(&a->entries[index], s->entries, s->len * sizeof(Node *));
     a->len += s->len;
+    t_sizes *subsizes = __node_sizes(sub);
+    size_t subown = sizeof(Node) + sizeof(t_sizes) + s->cap * sizeof(Node *);
+    for (uint32_t i = 0; i < s->len; i++) __node_setParent(s->entries[i], arr);
+    __node_grow(arr, subsizes->nodes - 1, subsizes->bytes - subown);
 
     // destroy all traces
     s->len = 0;
@@ -238,6 +475,7 @@ int Node_ArrayAppend(Node *arr, Node *n) {
     t_array *a = &arr->value.arrval;
     __node_ArrayMakeRoomFor(arr, 1);
     a->entries[a->len++] = n;
+    __node_link(arr, n);
 
     return OBJ_OK;
 }
@@ -255,7 +493,9 @@ int Node_ArraySet(Node *arr, int index, Node *n) {
     if (index < 0 || index >= a->len) {
         return OBJ_ERR;
     }
+    __node_unlink(arr, a->entries[index]);
     a->entries[index] = n;
+    __node_link(arr, n);
 
     return OBJ_OK;
 }
@@ -272,6 +512,17 @@ int Node_ArrayItem(Node *arr, int index, Node **n) {
     return OBJ_OK;
 }
 
+/* Compares two string nodes, either may be compressed. */
+static int __node_stringEquals(const Node *a, const Node *b) {
+    if (a->value.strval.len != b->value.strval.len) return 0;
+
+    char *abuf, *bbuf;
+    int eq = !strncmp(Node_StringData(a, &abuf), Node_StringData(b, &bbuf), a->value.strval.len);
+    Node_StringRelease(abuf);
+    Node_StringRelease(bbuf);
+    return eq;
+}
+
 int Node_ArrayIndex(Node *arr, Node *n, int start, int stop) {
     t_array *a = &arr->value.arrval;
 
@@ -295,25 +546,21 @@ int Node_ArrayIndex(Node *arr, Node *n, int start, int stop) {
     for (int i = start; i < stop; i++) {
         if (!n && !a->entries[i]) return i;             // both are nulls
         if (!n || !a->entries[i]) continue;             // just one null
-        if (a->entries[i]->type != n->type) continue;   // types not the same
+        if (NODETYPE(a->entries[i]) != NODETYPE(n)) continue;  // types not the same
 
         // Check equality per scalar type
-        switch (n->type) {
+        switch (NODETYPE(n)) {
             case N_STRING:
-                if ((n->value.strval.len == a->entries[i]->value.strval.len) &&
-                    !strncmp(n->value.strval.data, a->entries[i]->value.strval.data,
-                             n->value.strval.len)) {
-                    return i;
-                }
+                if (__node_stringEquals(n, a->entries[i])) return i;
                 break;
             case N_NUMBER:
                 if (n->value.numval == a->entries[i]->value.numval) return i;
                 break;
             case N_INTEGER:
-                if (n->value.intval == a->entries[i]->value.intval) return i;
+                if (NODE_INTVAL(n) == NODE_INTVAL(a->entries[i])) return i;
                 break;
             case N_BOOLEAN:
-                if (n->value.boolval == a->entries[i]->value.boolval) return i;
+                if (NODE_BOOLVAL(n) == NODE_BOOLVAL(a->entries[i])) return i;
                 break;
             default:
                 break;
@@ -323,9 +570,110 @@ int Node_ArrayIndex(Node *arr, Node *n, int start, int stop) {
     return -1;  // unfound
 }
 
-Node *__obj_find(t_dict *o, const char *key, int *idx) {
+/* === Dictionary hash index ===
+ * The index is an open-addressing (linear probing) table of entry positions plus one, so that 0
+ * marks an empty slot. It is sized to a power of 2 that's at least twice the dictionary's capacity
+ * and lives right after the entries in the same allocation.
+*/
+static uint32_t __dict_indexThreshold = OBJ_DICT_INDEX_THRESHOLD;
+
+void Node_DictSetIndexThreshold(uint32_t threshold) { __dict_indexThreshold = threshold; }
+
+uint32_t Node_DictGetIndexThreshold() { return __dict_indexThreshold; }
+
+#define __dict_isIndexed(n) ((n)->flags & N_F_INDEXED)
+#define __dict_index(o) ((uint32_t *)&(o)->entries[(o)->cap])
+#define __dict_key(o, i) ((o)->entries[i]->value.kvval.key)
+
+static inline uint32_t __dict_indexCap(uint32_t cap) {
+    uint32_t icap = 8;
+    while (icap < 2 * cap) icap <<= 1;
+    return icap;
+}
+
+size_t Node_DictIndexSize(const Node *obj) {
+    if (!__dict_isIndexed(obj)) return 0;
+    return __dict_indexCap(obj->value.dictval.cap) * sizeof(uint32_t);
+}
+
+/* Adds the entry at position i to the index. */
+static void __dict_indexAdd(t_dict *o, uint32_t i) {
+    uint32_t *index = __dict_index(o);
+    uint32_t mask = __dict_indexCap(o->cap) - 1;
+    uint32_t h = Intern_Hash(__dict_key(o, i)) & mask;
+    while (index[h]) h = (h + 1) & mask;
+    index[h] = i + 1;
+}
+
+/* Returns the index slot that references the entry at position i. */
+static uint32_t __dict_indexSlot(t_dict *o, uint32_t i) {
+    uint32_t *index = __dict_index(o);
+    uint32_t mask = __dict_indexCap(o->cap) - 1;
+    uint32_t h = Intern_Hash(__dict_key(o, i)) & mask;
+    while (index[h] != i + 1) h = (h + 1) & mask;
+    return h;
+}
+
+/* Empties the slot h and shifts back any following entries that can be moved into the hole. */
+static void __dict_indexDel(t_dict *o, uint32_t h) {
+    uint32_t *index = __dict_index(o);
+    uint32_t mask = __dict_indexCap(o->cap) - 1;
+    uint32_t j = h;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!index[j]) break;
+        // an entry can be moved back only if its home slot isn't cyclically in (h, j]
+        uint32_t k = Intern_Hash(__dict_key(o, index[j] - 1)) & mask;
+        if (h <= j ? (h < k && k <= j) : (h < k || k <= j)) continue;
+        index[h] = index[j];
+        h = j;
+    }
+    index[h] = 0;
+}
+
+/* (Re)allocates the entries for the dictionary's capacity, and rebuilds the index if needed. */
+static void __dict_resize(Node *obj, uint32_t cap) {
+    t_dict *o = &obj->value.dictval;
+    // a new dictionary has no entries yet, nor their sizes
+    t_sizes *sizes = o->entries ? __node_sizes(obj) : NULL;
+    size_t oldsize = sizes ? sizeof(t_sizes) + o->cap * sizeof(Node *) + Node_DictIndexSize(obj) : 0;
+    int indexed = __dict_isIndexed(obj) || (__dict_indexThreshold && cap >= __dict_indexThreshold);
+    size_t icap = indexed ? __dict_indexCap(cap) : 0;
+    size_t size = sizeof(t_sizes) + cap * sizeof(Node *) + icap * sizeof(uint32_t);
+
+    sizes = __node_reallocData(obj, sizes, oldsize, size);
+    if (!oldsize) *sizes = (t_sizes){NULL, 1, sizeof(Node)};
+    o->entries = (Node **)(sizes + 1);
+    o->cap = cap;
+    __node_grow(obj, 0, (int64_t)size - (int64_t)oldsize);
+    if (!indexed) return;
+
+    obj->flags |= N_F_INDEXED;
+    memset(__dict_index(o), 0, icap * sizeof(uint32_t));
+    for (uint32_t i = 0; i < o->len; i++) __dict_indexAdd(o, i);
+}
+
+/*
+* Looks up an interned key by its hash. As all keys are interned, they are compared by pointer. The
+* caller must hold a reference to the key.
+*/
+static Node *__obj_findInterned(Node *obj, const char *key, uint32_t hash, int *idx) {
+    t_dict *o = &obj->value.dictval;
+
+    if (__dict_isIndexed(obj)) {
+        uint32_t *index = __dict_index(o);
+        uint32_t mask = __dict_indexCap(o->cap) - 1;
+        for (uint32_t h = hash & mask; index[h]; h = (h + 1) & mask) {
+            if (key == __dict_key(o, index[h] - 1)) {
+                if (idx) *idx = index[h] - 1;
+                return o->entries[index[h] - 1];
+            }
+        }
+        return NULL;
+    }
+
     for (int i = 0; i < o->len; i++) {
-        if (!strcmp(key, o->entries[i]->value.kvval.key)) {
+        if (key == __dict_key(o, i)) {
             if (idx) *idx = i;
             return o->entries[i];
         }
@@ -334,31 +682,46 @@ Node *__obj_find(t_dict *o, const char *key, int *idx) {
     return NULL;
 }
 
-#define __obj_insert(o, n)                                                          \
-    if (o->len >= o->cap) {                                                         \
-        o->cap += o->cap ? MIN(o->cap, 1024 * 1024) : 1;                            \
-        o->entries = RedisModule_Realloc(o->entries, o->cap * sizeof(t_keyval *));  \
-    }                                                                               \
-    o->entries[o->len++] = n;
+Node *__obj_find(Node *obj, const char *key, int *idx) {
+    // a key that isn't interned isn't in any dictionary, and one that is is held until it's found,
+    // as the lazy free thread may release its other references meanwhile
+    uint32_t hash;
+    const char *ikey = Intern_Find(key, &hash);
+    if (!ikey) return NULL;
+    Node *kv = __obj_findInterned(obj, ikey, hash, idx);
+    Intern_Release(ikey);
+    return kv;
+}
 
-int Node_DictSet(Node *obj, const char *key, Node *n) {
+void __obj_insert(Node *obj, Node *n) {
     t_dict *o = &obj->value.dictval;
 
+    if (o->len >= o->cap) {
+        __dict_resize(obj, o->cap + (o->cap ? MIN(o->cap, 1024 * 1024) : 1));
+    }
+    o->entries[o->len++] = n;
+    if (__dict_isIndexed(obj)) __dict_indexAdd(o, o->len - 1);
+    __node_link(obj, n);
+}
+
+int Node_DictSet(Node *obj, const char *key, Node *n) {
     if (key == NULL) return OBJ_ERR;
 
     int idx;
-    Node *kv = __obj_find(o, key, &idx);
+    Node *kv = __obj_find(obj, key, &idx);
     // first find a replacement possiblity
     if (kv) {
         if (kv->value.kvval.val) {
+            __node_unlink(obj, kv->value.kvval.val);
             Node_Free(kv->value.kvval.val);
         }
         kv->value.kvval.val = n;
+        __node_link(obj, n);
         return OBJ_OK;
     }
 
     // append another entry
-    __obj_insert(o, NewKeyValNode(key, strlen(key), n));
+    __obj_insert(obj, NewKeyValNode(key, strlen(key), n));
 
     return OBJ_OK;
 }
@@ -369,36 +732,51 @@ int Node_DictSetKeyVal(Node *obj, Node *kv) {
     if (kv->value.kvval.key == NULL) return OBJ_ERR;
 
     int idx;
-    Node *_kv = __obj_find(o, kv->value.kvval.key, &idx);
-    // first find a replacement possiblity
+    const char *key = kv->value.kvval.key;
+    Node *_kv = __obj_findInterned(obj, key, Intern_Hash(key), &idx);
+    // first find a replacement possiblity, the index remains valid as the key is the same
     if (_kv) {
-        o->entries[idx] = kv;
+        __node_unlink(obj, _kv);
         Node_Free(_kv);
+        o->entries[idx] = kv;
+        __node_link(obj, kv);
         return OBJ_OK;
     }
 
     // append another entry
-    __obj_insert(o, kv);
+    __obj_insert(obj, kv);
 
     return OBJ_OK;
 }
 
-int Node_DictDel(Node *obj, const char *key) {
+void Node_DictAppendKeyVal(Node *obj, Node *kv) { __obj_insert(obj, kv); }
+
+int Node_DictDel(Node *obj, const char *key) { return Node_DictDetach(obj, key, NULL); }
+
+int Node_DictDetach(Node *obj, const char *key, Node **val) {
     if (key == NULL) return OBJ_ERR;
 
     t_dict *o = &obj->value.dictval;
 
     int idx = -1;
-    Node *kv = __obj_find(o, key, &idx);
+    Node *kv = __obj_find(obj, key, &idx);
 
     // tried to delete a non existing node
     if (!kv) return OBJ_ERR;
 
-    // let's delete the node's memory
-    if (kv->value.kvval.val) {
-        Node_Free(kv->value.kvval.val);
+    // remove the entry from the index, and point the top entry's slot to its new position
+    if (__dict_isIndexed(obj)) {
+        __dict_indexDel(o, __dict_indexSlot(o, idx));
+        if (idx < o->len - 1) __dict_index(o)[__dict_indexSlot(o, o->len - 1)] = idx + 1;
     }
-    RedisModule_Free((char *)kv->value.kvval.key);
+
+    // let's delete the node's memory, and the value's unless it's detached
+    __node_unlink(obj, kv);
+    if (val) {
+        *val = kv->value.kvval.val;
+        kv->value.kvval.val = NULL;
+    }
+    Node_Free(kv);
 
     // replace the deleted entry and the top entry to avoid holes
     if (idx < o->len - 1) {
@@ -412,10 +790,8 @@ int Node_DictDel(Node *obj, const char *key) {
 int Node_DictGet(Node *obj, const char *key, Node **val) {
     if (key == NULL) return OBJ_ERR;
 
-    t_dict *o = &obj->value.dictval;
-
     int idx = -1;
-    Node *kv = __obj_find(o, key, &idx);
+    Node *kv = __obj_find(obj, key, &idx);
 
     // not found!
     if (!kv) return OBJ_ERR;
@@ -424,6 +800,55 @@ int Node_DictGet(Node *obj, const char *key, Node **val) {
     return OBJ_OK;
 }
 
+int Node_DictGetInterned(Node *obj, const char *key, Node **val) {
+    Node *kv = __obj_findInterned(obj, key, Intern_Hash(key), NULL);
+    if (!kv) return OBJ_ERR;
+
+    *val = kv->value.kvval.val;
+    return OBJ_OK;
+}
+
+Node *Node_Copy(const Node *n) {
+    // NULL and tagged nodes are their own copies
+    if (!n || NODE_IS_TAGGED(n)) return (Node *)n;
+
+    Node *ret = NULL;
+    switch (n->type) {
+        case N_STRING:
+            // compressed data is copied as is
+            ret = __node_newString(n->value.strval.data, n->value.strval.len,
+                                   n->flags & N_F_COMPRESSED ? n->value.strval.clen : 0);
+            break;
+        case N_NUMBER:
+            ret = NewDoubleNode(n->value.numval);
+            break;
+        case N_INTEGER:
+            ret = NewIntNode(n->value.intval);
+            break;
+        case N_KEYVAL:
+            ret = __newNode(N_KEYVAL);
+            ret->value.kvval.key = Intern_Retain(n->value.kvval.key);
+            ret->value.kvval.val = Node_Copy(n->value.kvval.val);
+            break;
+        case N_DICT:
+            ret = NewDictNode(n->value.dictval.len);
+            for (int i = 0; i < n->value.dictval.len; i++) {
+                __obj_insert(ret, Node_Copy(n->value.dictval.entries[i]));
+            }
+            break;
+        case N_ARRAY:
+            ret = NewArrayNode(n->value.arrval.len);
+            for (int i = 0; i < n->value.arrval.len; i++) {
+                Node_ArrayAppend(ret, Node_Copy(n->value.arrval.entries[i]));
+            }
+            break;
+        default:
+            break;
+    }
+
+    return ret;
+}
+
 void __objTraverse(Node *n, NodeVisitor f, void *ctx) {
     t_dict *o = &n->value.dictval;
 
@@ -447,7 +872,7 @@ void Node_Traverse(Node *n, NodeVisitor f, void *ctx) {
         f(n, ctx);
         return;
     }
-    switch (n->type) {
+    switch (NODETYPE(n)) {
         case N_ARRAY:
             __arrTraverse(n, f, ctx);
             break;
@@ -471,7 +896,7 @@ void Node_Print(Node *n, int depth) {
         printf("null");
         return;
     }
-    switch (n->type) {
+    switch (NODETYPE(n)) {
         case N_NULL:    // stop the compiler from complaining
             break;
         case N_ARRAY: {
@@ -498,20 +923,23 @@ void Node_Print(Node *n, int depth) {
             printf("}");
         } break;
         case N_BOOLEAN:
-            printf("%s", n->value.boolval ? "true" : "false");
+            printf("%s", NODE_BOOLVAL(n) ? "true" : "false");
             break;
         case N_NUMBER:
             printf("%f", n->value.numval);
             break;
         case N_INTEGER:
-            printf("%ld", n->value.intval);
+            printf("%ld", NODE_INTVAL(n));
             break;
         case N_KEYVAL: {
             printf("\"%s\": ", n->value.kvval.key);
             Node_Print(n->value.kvval.val, depth);
         } break;
-        case N_STRING:
-            printf("\"%.*s\"", n->value.strval.len, n->value.strval.data);
+        case N_STRING: {
+            char *buf;
+            printf("\"%.*s\"", n->value.strval.len, Node_StringData(n, &buf));
+            Node_StringRelease(buf);
+        } break;
     }
 }
 
@@ -538,7 +966,7 @@ static inline void _serializerPop(NodeSerializerStack *s) {
     Vector_Pop(s->indices, NULL);
 }
 
-#define _maskenabled(n, x) ((int)(n ? n->type : N_NULL) & x)
+#define _maskenabled(n, x) ((int)NODETYPE(n) & x)
 
 // serialzer states
 typedef enum {
@@ -574,15 +1002,15 @@ void Node_Serializer(const Node *n, const NodeSerializerOpt *o, void *ctx) {
                 state = curr_node ? S_CONT_VALUE : S_END_VALUE;
                 break;
             case S_CONT_VALUE:  // container values
-                if (N_DICT == curr_node->type) {
+                if (N_DICT == NODETYPE(curr_node)) {
                     curr_len = curr_node->value.dictval.len;
                     curr_entries = curr_node->value.dictval.entries;
                     state = S_CONTAINER;
-                } else if (N_ARRAY == curr_node->type) {
+                } else if (N_ARRAY == NODETYPE(curr_node)) {
                     curr_len = curr_node->value.arrval.len;
                     curr_entries = curr_node->value.arrval.entries;
                     state = S_CONTAINER;
-                } else if (N_KEYVAL == curr_node->type) {
+                } else if (N_KEYVAL == NODETYPE(curr_node)) {
                     curr_len = 1;
                     curr_entries = &curr_node->value.kvval.val;
                     state = S_CONTAINER;
@@ -26,6 +26,7 @@
 #include <vector.h>
 #include "redismodule.h"
 #include "rmstrndup.h"
+#include "intern.h"
 
 // Return code from successful ops
 #define OBJ_OK 0
@@ -48,16 +49,19 @@ typedef enum {
     // N_BINARY = 0x200
 } NodeType;
 
-#define NODE_IS_SCALAR(n) (!n ? 1 : (int)(n->type & (N_STRING | N_NUMBER | N_INTEGER | N_BOOLEAN)))
+#define NODE_IS_SCALAR(n) ((int)(NODETYPE(n) & (N_NULL | N_STRING | N_NUMBER | N_INTEGER | N_BOOLEAN)))
 
 struct t_node;
 
 /*
-* Internal representation of a string with data and length
+* Internal representation of a string with data and length. Strings that are compressed (see
+* Node_StringSetCompressThreshold) keep their compressed data, and must be read with
+* Node_StringData.
 */
 typedef struct {
     const char *data;
-    uint32_t len;
+    uint32_t len;   // the length of the string
+    uint32_t clen;  // the size of the compressed data, 0 if it isn't compressed
 } t_string;
 
 /*
@@ -71,7 +75,7 @@ typedef struct {
 
 /*
 * Internal representation of a key-value pair in an object.
-* The key is a NULL terminated C-string, the value is another node
+* The key is a NULL terminated interned C-string (see intern.h), the value is another node
 */
 typedef struct {
     const char *key;
@@ -80,8 +84,9 @@ typedef struct {
 
 /*
 * Internal representation of a dictionary node.
-* Currently implemented as a list of key-value pairs, will be converted
-* to a hash-table on big objects in the future
+* Implemented as a list of key-value pairs. Once the dictionary's capacity reaches the index
+* threshold, an open-addressing hash index of the entries is kept in the same allocation, right
+* after the entries themselves.
 */
 typedef struct {
     struct t_node **entries;
@@ -89,6 +94,17 @@ typedef struct {
     uint32_t cap;
 } t_dict;
 
+/*
+* The running sizes of a container's subtree. Containers keep them in the same allocation as their
+* entries, right before the entries, and every mutator updates them along with those of the
+* container's ancestors. Key-value nodes account for their key in full, even though it is shared.
+*/
+typedef struct {
+    struct t_node *parent;  // the container that holds the container, NULL if there's none
+    size_t nodes;           // number of nodes in the subtree, including the container
+    size_t bytes;           // memory used by the subtree
+} t_sizes;
+
 /*
 * A node in an object can be any one of the types we support.
 * Basically an object is just a treee of nodes that can have children
@@ -108,22 +124,62 @@ typedef struct t_node {
 
     // type specifier
     NodeType type;
+
+    // internal flags and, for nodes in an arena, their offset in words from the arena's chunk
+    // (both fit in the struct's padding)
+    uint32_t flags : 8;
+    uint32_t chunkoff : 24;
 } Node;
 
+/* Node flags */
+#define N_F_INDEXED 0x1     // the dictionary has a hash index
+#define N_F_EMBSTR 0x2      // the string's data is allocated right after the node
+#define N_F_ARENA 0x4       // the node and its data are allocated from an arena (see arena.h)
+#define N_F_COMPRESSED 0x8  // the string's data is compressed (see compress.h)
+
+/*
+* Compact scalars: booleans and integers that fit in the pointer's width minus 2 bits aren't
+* allocated. Instead, the value is encoded in the node pointer itself, with the lowest bits (which
+* are always 0 in real nodes because of alignment) tagging its type. Larger integers fall back to
+* regular nodes. Tagged nodes must never be dereferenced, so a node's type and scalar values are
+* always read with the NODETYPE, NODE_BOOLVAL and NODE_INTVAL macros.
+*/
+#define N_TAG_MASK 0x3
+#define N_TAG_INTEGER 0x1
+#define N_TAG_BOOLEAN 0x2
+#define N_TAG_MIN_INT (INTPTR_MIN >> 2)
+#define N_TAG_MAX_INT (INTPTR_MAX >> 2)
+
+#define NODE_IS_TAGGED(n) ((uintptr_t)(n)&N_TAG_MASK)
+#define NODETYPE(n)                                               \
+    (!(n) ? N_NULL                                                \
+     : NODE_IS_TAGGED(n)                                          \
+         ? ((uintptr_t)(n)&N_TAG_INTEGER ? N_INTEGER : N_BOOLEAN) \
+         : (n)->type)
+#define NODE_BOOLVAL(n) (NODE_IS_TAGGED(n) ? (int)((uintptr_t)(n) >> 2) : (n)->value.boolval)
+#define NODE_INTVAL(n) (NODE_IS_TAGGED(n) ? (int64_t)((intptr_t)(n) >> 2) : (n)->value.intval)
+#define NODEVALUE_AS_DOUBLE(n) (N_INTEGER == NODETYPE(n) ? (double)NODE_INTVAL(n) : (n)->value.numval)
+
+// The default dictionary capacity from which a hash index is kept
+#define OBJ_DICT_INDEX_THRESHOLD 32
+
 typedef Node Object;
 
-/** Create a new boolean node, with 0 as false 1 as true */
+typedef struct NodeArena NodeArena;
+
+/** Create a new (tagged) boolean node, with 0 as false 1 as true */
 Node *NewBoolNode(int val);
 
 /** Create a new double node with the given value */
 Node *NewDoubleNode(double val);
 
-/** Create a new integer node with the given value */
+/** Create a new integer node with the given value, tagged if it fits */
 Node *NewIntNode(int64_t val);
 
 /**
 * Create a new string node with the given c-string and its length.
-* NOTE: The string's value will be copied to a newly allocated string
+* NOTE: The string's value is copied to the same allocation as the node, compressed if it's over
+* the compression threshold
 */
 Node *NewStringNode(const char *s, uint32_t len);
 
@@ -136,10 +192,13 @@ Node *NewCStringNode(const char *su);
 /**
 * Create a new keyval node from a C-string and its length as key and a pointer
 * to a Node as value.
-* NOTE: The string's value will be copied to a newly allocated string
+* NOTE: The key is interned, i.e. shared by all the nodes that have the same key
 */
 Node *NewKeyValNode(const char *key, uint32_t len, Node *n);
 
+/** Create a new keyval node from an interned key, of which it takes another reference. */
+Node *NewInternedKeyValNode(const char *key, Node *n);
+
 /** Create a new zero length array node with the given capacity */
 Node *NewArrayNode(uint32_t cap);
 
@@ -149,6 +208,21 @@ Node *NewDictNode(uint32_t cap);
 /** Free a node, and if needed free its allocated data and its children recursively */
 void Node_Free(Node *n);
 
+/**
+* Returns the number of nodes in a value: every value, including nulls and tagged scalars, and
+* every key-value node. Takes constant time.
+*/
+size_t Node_Count(const Node *n);
+
+/** Returns the memory used by a value and its children. Takes constant time. */
+size_t Node_MemoryUsage(const Node *n);
+
+/**
+* Accounts for a child of a container that changed its size in place, e.g. by Node_StringAppend,
+* in the sizes of the container and its ancestors. A NULL container is ignored.
+*/
+void Node_ChildResized(Node *container, int64_t bytes);
+
 /** Reports the length of the node's value if defined. Return a positive integer, and -1 otherwise.
  */
 int Node_Length(const Node *n);
@@ -156,9 +230,36 @@ int Node_Length(const Node *n);
 /** Pretty-print a node. Not JSON compliant but will produce something almost JSON-ish */
 void Node_Print(Node *n, int depth);
 
-/** Concatenates the src string node to the dst string node. */
+/**
+* Concatenates the src string node to the dst string node. The sizes of dst's containers must be
+* updated with Node_ChildResized.
+*/
 int Node_StringAppend(Node *dst, Node *src);
 
+/**
+* Returns the data of a string node. A compressed string is decompressed to a new buffer that's
+* also put in buf, and must be freed with Node_StringRelease. Otherwise buf is set to NULL.
+*/
+const char *Node_StringData(const Node *n, char **buf);
+
+/** Frees a buffer returned by Node_StringData, NULL is ignored. */
+void Node_StringRelease(char *buf);
+
+/**
+* Set the length from which new string values are stored compressed. Strings are only compressed
+* if that saves memory. 0 disables compression of new strings.
+*/
+void Node_StringSetCompressThreshold(uint32_t threshold);
+
+/** Returns the current string compression threshold. */
+uint32_t Node_StringGetCompressThreshold();
+
+/**
+* Reports the compressed strings in a value: their number and the memory that compressing them
+* saves, so the value's uncompressed size is its memory usage plus the savings.
+*/
+void Node_CompressionStats(const Node *n, size_t *strings, size_t *saved);
+
 /** Deletes (and frees) the count of nodes from an array starting at index. */
 int Node_ArrayDelRange(Node *arr, const int index, const int count);
 
@@ -205,12 +306,24 @@ int Node_DictSet(Node *obj, const char *key, Node *n);
 */
 int Node_DictSetKeyVal(Node *obj, Node *kv);
 
+/**
+* Append a keyval node to a dictionary without looking for an existing node with the same key.
+* NOTE: only for trusted sources of distinct keys, e.g. RDB loading, as duplicates corrupt the dict
+*/
+void Node_DictAppendKeyVal(Node *obj, Node *kv);
+
 /**
 * Delete an item from the dict node by key. Returns OBJ_ERR if the key was
 * not found
 */
 int Node_DictDel(Node *objm, const char *key);
 
+/**
+* Delete an item from the dict node by key without freeing its value, which is returned in `val`.
+* Returns OBJ_ERR if the key was not found
+*/
+int Node_DictDetach(Node *obj, const char *key, Node **val);
+
 /**
 * Get a dict node item by key, and put it Node val's pointer.
 * Return OBJ_ERR if the key was not found. Can put NULL into val
@@ -218,6 +331,33 @@ int Node_DictDel(Node *objm, const char *key);
 */
 int Node_DictGet(Node *obj, const char *key, Node **val);
 
+/**
+* Like Node_DictGet, with an interned key (see intern.h) that the caller holds a reference to, so
+* the key is compared by pointer without locking the table.
+*/
+int Node_DictGetInterned(Node *obj, const char *key, Node **val);
+
+/**
+* Set the dictionary capacity from which a hash index is used for lookups. Existing dictionaries
+* are indexed once they grow over it. 0 disables indexing of new dictionaries.
+*/
+void Node_DictSetIndexThreshold(uint32_t threshold);
+
+/** Returns the current dictionary index threshold. */
+uint32_t Node_DictGetIndexThreshold();
+
+/** Reports the size in bytes of a dictionary's hash index, 0 if it isn't indexed. */
+size_t Node_DictIndexSize(const Node *obj);
+
+/**
+* Set the arena that new nodes are allocated from, NULL for the heap, and return the previous one.
+* Nodes that are allocated from an arena keep using it for their data as they're modified.
+*/
+NodeArena *Node_UseArena(NodeArena *a);
+
+/** Returns a deep copy of a node, that's allocated from the current arena. */
+Node *Node_Copy(const Node *n);
+
 /* The type signature of visitor callbacks for node trees */
 typedef void (*NodeVisitor)(Node *, void *);
 void __objTraverse(Node *n, NodeVisitor f, void *ctx);
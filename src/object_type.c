@@ -15,159 +15,494 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <time.h>
 #include "object_type.h"
 
-#define Vector_Last(v) Vector_Size(v) - 1
+// the module-wide load counters
+static ObjectTypeLoadStats __loadStats;
 
-void *ObjectTypeRdbLoad(RedisModuleIO *rdb) {
-    // IMPORTANT: no encoding version check here, this is up to the calller
-    Vector *nodes = NULL;
-    Vector *indices = NULL;
-    Node *node = NULL;
-    uint64_t len = 0;
-    uint64_t type = 0;
-    size_t strlen = 0;
-    char *str = NULL;
-    enum { S_INIT, S_BEGIN_VALUE, S_END_VALUE, S_CONTAINER, S_END } state = S_INIT;
-
-    while (S_END != state) {
-        switch (state) {
-            case S_INIT:  // Initial state
-                nodes = NewVector(Node *, 1);
-                indices = NewVector(uint64_t, 1);
-                type = RedisModule_LoadUnsigned(rdb);
-                state = S_BEGIN_VALUE;
-                break;
-            case S_BEGIN_VALUE:
-                switch (type) {
-                    case N_NULL:
-                        node = NULL;
-                        state = S_END_VALUE;
-                        break;
-                    case N_BOOLEAN:
-                        str = RedisModule_LoadStringBuffer(rdb, &strlen);
-                        node = NewBoolNode('1' == str[0]);
-                        state = S_END_VALUE;
-                        break;
-                    case N_INTEGER:
-                        node = NewIntNode(RedisModule_LoadSigned(rdb));
-                        state = S_END_VALUE;
-                        break;
-                    case N_NUMBER:
-                        node = NewDoubleNode(RedisModule_LoadDouble(rdb));
-                        state = S_END_VALUE;
-                        break;
-                    case N_STRING:
-                        str = RedisModule_LoadStringBuffer(rdb, &strlen);
-                        node = NewStringNode(str, strlen);
-                        state = S_END_VALUE;
-                        break;
-                    case N_KEYVAL:
-                        str = RedisModule_LoadStringBuffer(rdb, &strlen);
-                        Vector_Push(nodes, NewKeyValNode(str, strlen, NULL));
-                        Vector_Push(indices, (uint64_t)1);
-                        state = S_CONTAINER;
-                        break;
-                    case N_DICT:
-                        len = RedisModule_LoadUnsigned(rdb);
-                        Vector_Push(nodes, NewDictNode(len));
-                        Vector_Push(indices, len);
-                        state = S_CONTAINER;
-                        break;
-                    case N_ARRAY:
-                        len = RedisModule_LoadUnsigned(rdb);
-                        Vector_Push(nodes, NewArrayNode(len));
-                        Vector_Push(indices, len);
-                        state = S_CONTAINER;
-                        break;
-                }  // switch (type)
-                break;
-            case S_END_VALUE:
-                if (Vector_Size(nodes)) {  // in case the new node has a parent
-                    Node *container;
-                    Vector_Get(nodes, Vector_Last(nodes), &container);
-                    switch (container->type) {  // add it
-                        case N_KEYVAL:
-                            container->value.kvval.val = node;
-                            break;
-                        case N_DICT:
-                            Node_DictSetKeyVal(container, node);
-                            break;
-                        case N_ARRAY:
-                            Node_ArrayAppend(container, node);
-                        default:
-                            break;
-                    }
-                    state = S_CONTAINER;
-                } else {
-                    state = S_END;
-                }
+void ObjectType_GetLoadStats(ObjectTypeLoadStats *stats) { *stats = __loadStats; }
+
+static inline uint64_t _ustime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* A container that's being loaded. */
+typedef struct {
+    Node *node;
+    uint64_t left;    // the number of entries left to load
+    const char *key;  // the key of the next entry of a dict, in the packed encoding
+} _LoadFrame;
+
+/* The containers that are being loaded, innermost last. */
+typedef struct {
+    _LoadFrame *frames;
+    size_t depth;
+    size_t cap;
+} _LoadStack;
+
+static inline void _LoadStack_Push(_LoadStack *s, Node *n, uint64_t len) {
+    if (s->depth == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->frames = RedisModule_Realloc(s->frames, s->cap * sizeof(*s->frames));
+    }
+    s->frames[s->depth++] = (_LoadFrame){.node = n, .left = len};
+}
+
+/*
+* Links a loaded value to its container, and every container that it completes to its own. Returns
+* 1 when the root is complete, in which case `n` is set to it. The saved data is trusted to have
+* distinct keys, and the containers were created with their saved lengths, so entries are
+* appended as is.
+*/
+static inline int _LoadStack_Link(_LoadStack *s, Node **n) {
+    while (s->depth) {
+        _LoadFrame *f = &s->frames[s->depth - 1];
+        switch (f->node->type) {
+            case N_KEYVAL:
+                f->node->value.kvval.val = *n;
                 break;
-            case S_CONTAINER:
-                Vector_Get(indices, Vector_Last(indices), &len);
-                if (len) {  // move to next child node
-                    Vector_Put(indices, Vector_Last(indices), len - 1);
-                    type = RedisModule_LoadUnsigned(rdb);
-                    state = S_BEGIN_VALUE;
+            case N_DICT:
+                if (f->key) {
+                    Node_DictAppendKeyVal(f->node, NewInternedKeyValNode(f->key, *n));
                 } else {
-                    Vector_Pop(indices, NULL);
-                    Vector_Pop(nodes, &node);
-                    state = S_END_VALUE;
+                    Node_DictAppendKeyVal(f->node, *n);
                 }
                 break;
-            case S_END:  // keeps the compiler from complaining
+            default:
+                Node_ArrayAppend(f->node, *n);
                 break;
-        }  // switch (state)
-    }      //    while (S_END != state)
+        }
+        *n = NULL;
+        if (--f->left) return 0;
+        *n = f->node;
+        s->depth--;
+    }
+    return 1;
+}
 
-    Vector_Free(indices);
-    Vector_Free(nodes);
-    return (void *)node;
+/* Frees the containers that weren't completely loaded, as they aren't linked to one another. */
+static void _LoadStack_Free(_LoadStack *s) {
+    for (size_t i = 0; i < s->depth; i++) Node_Free(s->frames[i].node);
+    RedisModule_Free(s->frames);
 }
 
-void _ObjectTypeSave_Begin(Node *n, void *ctx) {
-    RedisModuleIO *rdb = (RedisModuleIO *)ctx;
+int ObjectTypeRdbLoad(RedisModuleIO *rdb, Node **node) {
+    // IMPORTANT: no encoding version check here, this is up to the calller
+    uint64_t start = _ustime(), nodes = 0, len;
+    _LoadStack stack = {0};
+    Node *n = NULL;
+    size_t strlen;
+    char *str;
 
-    // type is saved as uint64, but could be compressed to 1-2 bytes.
-    if (!n) {
-        RedisModule_SaveUnsigned(rdb, N_NULL);
-    } else {
-        RedisModule_SaveUnsigned(rdb, n->type);
-        switch (n->type) {
+    while (1) {
+        uint64_t type = RedisModule_LoadUnsigned(rdb);
+        nodes++;
+        switch (type) {
+            case N_NULL:
+                n = NULL;
+                break;
             case N_BOOLEAN:
-                RedisModule_SaveStringBuffer(rdb, n->value.boolval ? "1" : "0", 1);
+                str = RedisModule_LoadStringBuffer(rdb, &strlen);
+                n = NewBoolNode('1' == str[0]);
+                RedisModule_Free(str);
                 break;
             case N_INTEGER:
-                RedisModule_SaveSigned(rdb, n->value.intval);
+                n = NewIntNode(RedisModule_LoadSigned(rdb));
                 break;
             case N_NUMBER:
-                RedisModule_SaveDouble(rdb, n->value.numval);
+                n = NewDoubleNode(RedisModule_LoadDouble(rdb));
                 break;
             case N_STRING:
-                RedisModule_SaveStringBuffer(rdb, n->value.strval.data, n->value.strval.len);
+                str = RedisModule_LoadStringBuffer(rdb, &strlen);
+                n = NewStringNode(str, strlen);
+                RedisModule_Free(str);
                 break;
             case N_KEYVAL:
-                RedisModule_SaveStringBuffer(rdb, n->value.kvval.key, strlen(n->value.kvval.key));
-                break;
+                str = RedisModule_LoadStringBuffer(rdb, &strlen);
+                _LoadStack_Push(&stack, NewKeyValNode(str, strlen, NULL), 1);
+                RedisModule_Free(str);
+                continue;
             case N_DICT:
-                RedisModule_SaveUnsigned(rdb, n->value.dictval.len);
-                break;
             case N_ARRAY:
-                RedisModule_SaveUnsigned(rdb, n->value.arrval.len);
-                break;
-            case N_NULL:  // keeps the compiler from complaining
-                break;
+                len = RedisModule_LoadUnsigned(rdb);
+                if (len > UINT32_MAX) goto error;
+                n = N_DICT == type ? NewDictNode(len) : NewArrayNode(len);
+                if (!len) break;
+                _LoadStack_Push(&stack, n, len);
+                continue;
+            default:
+                goto error;
         }
+
+        if (_LoadStack_Link(&stack, &n)) break;
     }
+
+    _LoadStack_Free(&stack);
+    *node = n;
+    __loadStats.keys++;
+    __loadStats.nodes += nodes;
+    __loadStats.usecs += _ustime() - start;
+    return OBJ_OK;
+
+error:
+    _LoadStack_Free(&stack);
+    return OBJ_ERR;
 }
 
-void ObjectTypeRdbSave(RedisModuleIO *rdb, void *value) {
-    Node *node = (Node *)value;
+/*
+* The packed encoding is a stream of bytes that's saved in blocks of string buffers, so that Redis
+* compresses them when `rdbcompression` is enabled. The stream begins with the document's key
+* dictionary, i.e. the number of distinct keys followed by each key's length and bytes. The nodes
+* follow in pre-order. Each node starts with a tag byte, whose low 3 bits are its packed type and
+* high 5 bits hold a small value inline, where 31 means that the value follows as a varint:
+*   null, false, true - no value
+*   integer           - the zigzag-encoded integer
+*   number            - no value, the double's 8 little-endian bytes follow
+*   string            - the length, the bytes follow
+*   dict              - the number of entries, each entry is the key's dictionary id (a varint)
+*                       followed by the value
+*   array             - the number of entries
+*/
+#define PACKED_NULL 0
+#define PACKED_FALSE 1
+#define PACKED_TRUE 2
+#define PACKED_INTEGER 3
+#define PACKED_NUMBER 4
+#define PACKED_STRING 5
+#define PACKED_DICT 6
+#define PACKED_ARRAY 7
+#define PACKED_INLINE_MAX 31
+
+/* Maps the interned keys of a document to their dictionary ids. */
+typedef struct {
+    const char **keys;  // open addressing table of keys
+    uint32_t *ids;      // the ids of the keys
+    uint32_t cap;       // capacity of the table, a power of 2
+    uint32_t len;       // number of keys
+    const char **order; // the keys by id
+} _PackedKeys;
+
+static uint32_t *_PackedKeys_Slot(_PackedKeys *k, const char *key) {
+    uint32_t mask = k->cap - 1;
+    uint32_t h = Intern_Hash(key) & mask;
+    while (k->keys[h] && k->keys[h] != key) h = (h + 1) & mask;
+    k->keys[h] = key;
+    return &k->ids[h];
+}
+
+static void _PackedKeys_Add(Node *n, void *ctx) {
+    _PackedKeys *k = (_PackedKeys *)ctx;
+    if (2 * (k->len + 1) > k->cap) {
+        _PackedKeys old = *k;
+        k->cap = k->cap ? k->cap * 2 : 64;
+        k->keys = RedisModule_Calloc(k->cap, sizeof(*k->keys));
+        k->ids = RedisModule_Calloc(k->cap, sizeof(*k->ids));
+        for (uint32_t i = 0; i < old.cap; i++)
+            if (old.keys[i]) *_PackedKeys_Slot(k, old.keys[i]) = old.ids[i];
+        RedisModule_Free(old.keys);
+        RedisModule_Free(old.ids);
+        k->order = RedisModule_Realloc(k->order, k->cap / 2 * sizeof(*k->order));
+    }
+    uint32_t *id = _PackedKeys_Slot(k, n->value.kvval.key);
+    if (!*id) {
+        k->order[k->len] = n->value.kvval.key;
+        *id = ++k->len;  // ids are 1-based in the table, as 0 marks new keys
+    }
+}
+
+/* Buffers the packed stream and saves it block by block, or appends it to `out` if it's set. */
+typedef struct {
+    RedisModuleIO *rdb;
+    sds out;
+    char *buf;
+    size_t len;
+    _PackedKeys keys;
+} _PackedWriter;
+
+static void _PackedWriter_Flush(_PackedWriter *w) {
+    if (w->len && w->out) w->out = sdscatlen(w->out, w->buf, w->len);
+    else if (w->len) RedisModule_SaveStringBuffer(w->rdb, w->buf, w->len);
+    w->len = 0;
+}
+
+static void _PackedWriter_Bytes(_PackedWriter *w, const char *p, size_t len) {
+    while (len) {
+        size_t n = MIN(len, OBJECT_TYPE_RDB_BLOCK_SIZE - w->len);
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p += n;
+        len -= n;
+        if (OBJECT_TYPE_RDB_BLOCK_SIZE == w->len) _PackedWriter_Flush(w);
+    }
+}
+
+static void _PackedWriter_Varint(_PackedWriter *w, uint64_t val) {
+    char b[10];
+    int len = 0;
+    while (val >= 0x80) {
+        b[len++] = (char)(val | 0x80);
+        val >>= 7;
+    }
+    b[len++] = (char)val;
+    _PackedWriter_Bytes(w, b, len);
+}
+
+static void _PackedWriter_Tag(_PackedWriter *w, int type, uint64_t val) {
+    char tag = (char)(type | MIN(val, PACKED_INLINE_MAX) << 3);
+    _PackedWriter_Bytes(w, &tag, 1);
+    if (val >= PACKED_INLINE_MAX) _PackedWriter_Varint(w, val);
+}
+
+static void _PackedWriter_Node(Node *n, void *ctx) {
+    _PackedWriter *w = (_PackedWriter *)ctx;
+    int64_t i;
+    uint64_t bits;
+    char b[8];
+
+    switch (NODETYPE(n)) {
+        case N_NULL:
+            _PackedWriter_Tag(w, PACKED_NULL, 0);
+            break;
+        case N_BOOLEAN:
+            _PackedWriter_Tag(w, NODE_BOOLVAL(n) ? PACKED_TRUE : PACKED_FALSE, 0);
+            break;
+        case N_INTEGER:
+            i = NODE_INTVAL(n);
+            _PackedWriter_Tag(w, PACKED_INTEGER, ((uint64_t)i << 1) ^ (uint64_t)(i >> 63));
+            break;
+        case N_NUMBER:
+            _PackedWriter_Tag(w, PACKED_NUMBER, 0);
+            memcpy(&bits, &n->value.numval, sizeof(bits));
+            for (int j = 0; j < 8; j++) b[j] = (char)(bits >> (8 * j));
+            _PackedWriter_Bytes(w, b, 8);
+            break;
+        case N_STRING: {
+            // strings are saved uncompressed and compressed again when they're loaded
+            char *buf;
+            _PackedWriter_Tag(w, PACKED_STRING, n->value.strval.len);
+            _PackedWriter_Bytes(w, Node_StringData(n, &buf), n->value.strval.len);
+            Node_StringRelease(buf);
+        } break;
+        case N_KEYVAL:
+            _PackedWriter_Varint(w, *_PackedKeys_Slot(&w->keys, n->value.kvval.key) - 1);
+            break;
+        case N_DICT:
+            _PackedWriter_Tag(w, PACKED_DICT, n->value.dictval.len);
+            break;
+        case N_ARRAY:
+            _PackedWriter_Tag(w, PACKED_ARRAY, n->value.arrval.len);
+            break;
+    }
+}
+
+static void _PackedWriter_Write(_PackedWriter *w, const Node *node) {
     NodeSerializerOpt nso = {0};
+    w->buf = RedisModule_Alloc(OBJECT_TYPE_RDB_BLOCK_SIZE);
+
+    // the key dictionary, in the order of first appearance
+    nso.xBegin = N_KEYVAL;
+    nso.fBegin = _PackedKeys_Add;
+    Node_Serializer(node, &nso, &w->keys);
+    _PackedWriter_Varint(w, w->keys.len);
+    for (uint32_t i = 0; i < w->keys.len; i++) {
+        _PackedWriter_Varint(w, Intern_Len(w->keys.order[i]));
+        _PackedWriter_Bytes(w, w->keys.order[i], Intern_Len(w->keys.order[i]));
+    }
 
-    nso.fBegin = _ObjectTypeSave_Begin;
+    // the nodes
     nso.xBegin = 0xff;  // mask for all basic types
-    Node_Serializer(node, &nso, rdb);
+    nso.fBegin = _PackedWriter_Node;
+    Node_Serializer(node, &nso, w);
+    _PackedWriter_Flush(w);
+
+    RedisModule_Free(w->buf);
+    RedisModule_Free(w->keys.keys);
+    RedisModule_Free(w->keys.ids);
+    RedisModule_Free(w->keys.order);
+}
+
+void ObjectTypeRdbSave(RedisModuleIO *rdb, void *value) {
+    _PackedWriter w = {.rdb = rdb};
+    _PackedWriter_Write(&w, (Node *)value);
+}
+
+sds ObjectTypePack(const Node *node) {
+    _PackedWriter w = {.out = sdsempty()};
+    _PackedWriter_Write(&w, node);
+    return w.out;
+}
+
+void ObjectTypeRdbSavePacked(RedisModuleIO *rdb, const char *buf, size_t len) {
+    for (size_t off = 0; off < len; off += OBJECT_TYPE_RDB_BLOCK_SIZE)
+        RedisModule_SaveStringBuffer(rdb, buf + off, MIN(len - off, OBJECT_TYPE_RDB_BLOCK_SIZE));
+}
+
+/* Reads the packed stream block by block, or from a single block in memory. */
+typedef struct {
+    RedisModuleIO *rdb;
+    char *buf;
+    size_t len;
+    size_t pos;
+    int memory;  // the stream is the block in buf, which isn't owned by the reader
+} _PackedReader;
+
+/* Makes sure the reader's block has unread bytes. */
+static int _PackedReader_Fill(_PackedReader *r) {
+    if (r->pos < r->len) return OBJ_OK;
+    if (r->memory) return OBJ_ERR;
+    if (r->buf) RedisModule_Free(r->buf);
+    r->buf = RedisModule_LoadStringBuffer(r->rdb, &r->len);
+    r->pos = 0;
+    return r->buf && r->len ? OBJ_OK : OBJ_ERR;
+}
+
+static int _PackedReader_Bytes(_PackedReader *r, char *p, size_t len) {
+    while (len) {
+        if (OBJ_OK != _PackedReader_Fill(r)) return OBJ_ERR;
+        size_t n = MIN(len, r->len - r->pos);
+        memcpy(p, r->buf + r->pos, n);
+        r->pos += n;
+        p += n;
+        len -= n;
+    }
+    return OBJ_OK;
+}
+
+static int _PackedReader_Varint(_PackedReader *r, uint64_t *val) {
+    *val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (OBJ_OK != _PackedReader_Fill(r)) return OBJ_ERR;
+        unsigned char b = r->buf[r->pos++];
+        *val |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return OBJ_OK;
+    }
+    return OBJ_ERR;
+}
+
+static int _PackedReader_Tag(_PackedReader *r, int *type, uint64_t *val) {
+    if (OBJ_OK != _PackedReader_Fill(r)) return OBJ_ERR;
+    unsigned char tag = r->buf[r->pos++];
+    *type = tag & 0x7;
+    *val = tag >> 3;
+    return PACKED_INLINE_MAX == *val ? _PackedReader_Varint(r, val) : OBJ_OK;
+}
+
+/* Reads a string of `len` bytes, without copying it when it's within the block. */
+static char *_PackedReader_String(_PackedReader *r, size_t len, char **tmp) {
+    if (len <= r->len - r->pos) {
+        r->pos += len;
+        return r->buf + r->pos - len;
+    }
+    *tmp = RedisModule_Alloc(len ? len : 1);
+    if (OBJ_OK == _PackedReader_Bytes(r, *tmp, len)) return *tmp;
+    RedisModule_Free(*tmp);
+    *tmp = NULL;
+    return NULL;
+}
+
+static int _PackedReader_Read(_PackedReader *r, Node **node) {
+    uint64_t start = _ustime(), nodes = 0;
+    _LoadStack stack = {0};
+    const char **keys = NULL;
+    uint64_t nkeys = 0, loaded = 0, val;
+    Node *n = NULL;
+    char *str, *tmp;
+    int type, ret = OBJ_ERR;
+
+    // the key dictionary
+    if (OBJ_OK != _PackedReader_Varint(r, &nkeys) || nkeys > UINT32_MAX) goto done;
+    keys = RedisModule_Calloc(nkeys ? nkeys : 1, sizeof(*keys));
+    for (; loaded < nkeys; loaded++) {
+        tmp = NULL;
+        if (OBJ_OK != _PackedReader_Varint(r, &val) || val > UINT32_MAX) goto done;
+        if (!(str = _PackedReader_String(r, val, &tmp))) goto done;
+        keys[loaded] = Intern_Acquire(str, val);
+        if (tmp) RedisModule_Free(tmp);
+    }
+
+    // the nodes
+    while (1) {
+        // dict entries begin with their key
+        _LoadFrame *f = stack.depth ? &stack.frames[stack.depth - 1] : NULL;
+        if (f && N_DICT == f->node->type) {
+            if (OBJ_OK != _PackedReader_Varint(r, &val) || val >= nkeys) goto done;
+            f->key = keys[val];
+        }
+
+        if (OBJ_OK != _PackedReader_Tag(r, &type, &val)) goto done;
+        nodes++;
+        switch (type) {
+            case PACKED_NULL:
+                n = NULL;
+                break;
+            case PACKED_FALSE:
+            case PACKED_TRUE:
+                n = NewBoolNode(PACKED_TRUE == type);
+                break;
+            case PACKED_INTEGER:
+                n = NewIntNode((int64_t)(val >> 1) ^ -(int64_t)(val & 1));
+                break;
+            case PACKED_NUMBER: {
+                unsigned char b[8];
+                uint64_t bits = 0;
+                double d;
+                if (OBJ_OK != _PackedReader_Bytes(r, (char *)b, 8)) goto done;
+                for (int j = 0; j < 8; j++) bits |= (uint64_t)b[j] << (8 * j);
+                memcpy(&d, &bits, sizeof(d));
+                n = NewDoubleNode(d);
+            } break;
+            case PACKED_STRING:
+                tmp = NULL;
+                if (val > UINT32_MAX || !(str = _PackedReader_String(r, val, &tmp))) goto done;
+                n = NewStringNode(str, val);
+                if (tmp) RedisModule_Free(tmp);
+                break;
+            case PACKED_DICT:
+            case PACKED_ARRAY:
+                if (val > UINT32_MAX) goto done;
+                n = PACKED_DICT == type ? NewDictNode(val) : NewArrayNode(val);
+                if (!val) break;
+                // load the entries before linking the container to its parent
+                _LoadStack_Push(&stack, n, val);
+                n = NULL;
+                continue;
+        }
+
+        if (_LoadStack_Link(&stack, &n)) {
+            *node = n;
+            n = NULL;
+            ret = OBJ_OK;
+            break;
+        }
+    }
+
+    if (!r->memory) {
+        __loadStats.keys++;
+        __loadStats.nodes += nodes;
+        __loadStats.usecs += _ustime() - start;
+    }
+
+done:
+    Node_Free(n);
+    _LoadStack_Free(&stack);
+    for (uint64_t i = 0; i < loaded; i++) Intern_Release(keys[i]);
+    RedisModule_Free(keys);
+    if (!r->memory && r->buf) RedisModule_Free(r->buf);
+    return ret;
+}
+
+int ObjectTypeRdbLoadPacked(RedisModuleIO *rdb, Node **node) {
+    // IMPORTANT: no encoding version check here, this is up to the calller
+    _PackedReader r = {.rdb = rdb};
+    return _PackedReader_Read(&r, node);
+}
+
+int ObjectTypeUnpack(const char *buf, size_t len, Node **node) {
+    _PackedReader r = {.buf = (char *)buf, .len = len, .memory = 1};
+    return _PackedReader_Read(&r, node);
 }
 
 void ObjectTypeFree(void *value) {
@@ -180,22 +515,25 @@ void _ObjectTypeToResp_Begin(Node *n, void *ctx) {
     if (!n) {
         RedisModule_ReplyWithNull(rctx);
     } else {
-        switch (n->type) {
+        switch (NODETYPE(n)) {
             case N_BOOLEAN:
-                RedisModule_ReplyWithSimpleString(rctx, n->value.boolval ? "true" : "false");
+                RedisModule_ReplyWithSimpleString(rctx, NODE_BOOLVAL(n) ? "true" : "false");
                 break;
             case N_INTEGER:
-                RedisModule_ReplyWithLongLong(rctx, n->value.intval);
+                RedisModule_ReplyWithLongLong(rctx, NODE_INTVAL(n));
                 break;
             case N_NUMBER:
                 RedisModule_ReplyWithDouble(rctx, n->value.numval);
                 break;
-            case N_STRING:
-                RedisModule_ReplyWithStringBuffer(rctx, n->value.strval.data, n->value.strval.len);
-                break;
+            case N_STRING: {
+                char *buf;
+                RedisModule_ReplyWithStringBuffer(rctx, Node_StringData(n, &buf),
+                                                  n->value.strval.len);
+                Node_StringRelease(buf);
+            } break;
             case N_KEYVAL:
                 RedisModule_ReplyWithArray(rctx, 2);
-                RedisModule_ReplyWithStringBuffer(rctx, n->value.kvval.key, strlen(n->value.kvval.key));
+                RedisModule_ReplyWithStringBuffer(rctx, n->value.kvval.key, Intern_Len(n->value.kvval.key));
                 break;
             case N_DICT:
                 RedisModule_ReplyWithArray(rctx, n->value.dictval.len + 1);
@@ -219,46 +557,4 @@ void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node) {
     Node_Serializer(node, &nso, ctx);
 }
 
-void _ObjectTypeMemoryUsage(Node *n, void *ctx) {
-    size_t *memory = (size_t *)ctx;
-
-    if (!n) {
-        // the null node takes no memory
-        return;
-    } else {
-        // account for the struct's size
-        *memory += sizeof(Node);
-        switch (n->type) {
-            case N_BOOLEAN:
-            case N_INTEGER:
-            case N_NUMBER:
-            case N_NULL:  // keeps the compiler from complaining
-                // these are stored in the node itself
-                return;
-            case N_STRING:
-                *memory += n->value.strval.len;
-                return;
-            case N_KEYVAL:
-                *memory += strlen(n->value.kvval.key);
-                return;
-            case N_DICT:
-                *memory += n->value.dictval.cap * sizeof(Node *);
-                return;
-            case N_ARRAY:
-                *memory += n->value.arrval.cap * sizeof(Node *);
-                return;
-        }
-    }
-}
-
-size_t ObjectTypeMemoryUsage(const void *value) {
-    const Node *node = value;
-    NodeSerializerOpt nso = {0};
-    size_t memory = 0;
-
-    nso.fBegin = _ObjectTypeMemoryUsage;
-    nso.xBegin = 0xff;  // mask for all basic types
-    Node_Serializer(node, &nso, &memory);
-
-    return memory;
-}
\ No newline at end of file
+size_t ObjectTypeMemoryUsage(const void *value) { return Node_MemoryUsage(value); }
\ No newline at end of file
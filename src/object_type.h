@@ -20,14 +20,51 @@
 
 #include <string.h>
 #include <vector.h>
+#include <sds.h>
 #include "object.h"
 #include "redismodule.h"
 
+// The size of the blocks of the packed encoding
+#define OBJECT_TYPE_RDB_BLOCK_SIZE (64 * 1024)
+
 /* Custom Redis data type API. */
-void *ObjectTypeRdbLoad(RedisModuleIO *rdb);
+
+/*
+* Loads a node of the RDB's original encoding, in which every value is saved separately. Returns
+* OBJ_ERR if the encoding is corrupt.
+*/
+int ObjectTypeRdbLoad(RedisModuleIO *rdb, Node **node);
+
+/* Saves a node in the packed encoding. */
 void ObjectTypeRdbSave(RedisModuleIO *rdb, void *value);
+
+/* Loads a node of the packed encoding. Returns OBJ_ERR if the encoding is corrupt. */
+int ObjectTypeRdbLoadPacked(RedisModuleIO *rdb, Node **node);
+
+/* Encodes a node in the packed encoding to a new buffer. */
+sds ObjectTypePack(const Node *node);
+
+/* Saves a node that's already in the packed encoding, as ObjectTypeRdbSave would save it. */
+void ObjectTypeRdbSavePacked(RedisModuleIO *rdb, const char *buf, size_t len);
+
+/*
+* Decodes a node of the packed encoding from a buffer. Returns OBJ_ERR if the encoding is corrupt.
+* Unlike loading from RDB, decoding isn't counted in the load stats.
+*/
+int ObjectTypeUnpack(const char *buf, size_t len, Node **node);
+
 void ObjectTypeFree(void *value);
 
+/* The counters of the nodes loaded from RDB. */
+typedef struct {
+    size_t keys;   // loaded keys
+    size_t nodes;  // loaded nodes
+    size_t usecs;  // time spent loading them
+} ObjectTypeLoadStats;
+
+/* Fills the counters of the nodes loaded from RDB. */
+void ObjectType_GetLoadStats(ObjectTypeLoadStats *stats);
+
 /* Replies with a RESP representation of the node. */
 void ObjectTypeToRespReply(RedisModuleCtx *ctx, const Node *node);
 
@@ -16,16 +16,24 @@
 */
 
 #include "path.h"
+#include "path_filter.h"
+#include "intern.h"
 
 Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err) {
     *err = E_OK;
+    if (NT_DESCENT == pn->type) {
+        *err = E_MULTI;
+        return NULL;
+    }
     if (!n) {
         goto badtype;
     }
 
-    if (n->type == N_ARRAY) {
+    if (NODETYPE(n) == N_ARRAY) {
         Node *rn = NULL;
-        if (NT_INDEX == pn->type) {
+        if (NT_SLICE == pn->type || NT_WILDCARD == pn->type || NT_FILTER == pn->type) {
+            *err = E_MULTI;
+        } else if (NT_INDEX == pn->type) {
             int index = pn->value.index;
             // translate negative values
             if (index < 0) index = n->value.arrval.len + index;            
@@ -39,12 +47,16 @@ Node *__pathNode_eval(PathNode *pn, Node *n, PathError *err) {
         return rn;
     }
 
-    if (n->type == N_DICT) {
+    if (NODETYPE(n) == N_DICT) {
+        if (NT_WILDCARD == pn->type || NT_FILTER == pn->type) {
+            *err = E_MULTI;
+            return NULL;
+        }
         if (pn->type != NT_KEY) {
             goto badtype;
         }
         Node *rn = NULL;
-        int rc = Node_DictGet(n, pn->value.key, &rn);
+        int rc = Node_DictGetInterned(n, pn->value.key, &rn);
         if (rc != OBJ_OK) {
             *err = E_NOKEY;
         }
@@ -90,6 +102,113 @@ PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, in
     return E_OK;
 }
 
+int SearchPath_IsMulti(const SearchPath *path) {
+    for (size_t i = 0; i < path->len; i++) {
+        PathNodeType t = path->nodes[i].type;
+        if (NT_SLICE == t || NT_WILDCARD == t || NT_DESCENT == t || NT_FILTER == t) return 1;
+    }
+    return 0;
+}
+
+/* Resolves a slice against an array's length, returning the number of elements it selects and
+ * setting the first one's index. */
+static size_t __pathSlice_range(const PathSlice *s, int len, int *first) {
+    long long start, stop, step = s->step;
+    if (step > 0) {
+        start = s->flags & PATH_SLICE_START ? s->start : 0;
+        stop = s->flags & PATH_SLICE_STOP ? s->stop : len;
+        start = start < 0 ? MAX(start + len, 0) : MIN(start, len);
+        stop = stop < 0 ? MAX(stop + len, 0) : MIN(stop, len);
+        *first = (int)start;
+        return start < stop ? (stop - start + step - 1) / step : 0;
+    }
+
+    // going backwards, -1 stands for before the first element
+    start = s->flags & PATH_SLICE_START ? s->start : len - 1;
+    stop = s->flags & PATH_SLICE_STOP ? s->stop : -1 - len;
+    start = start < 0 ? MAX(start + len, -1) : MIN(start, len - 1);
+    stop = stop < 0 ? MAX(stop + len, -1) : MIN(stop, len - 1);
+    *first = (int)start;
+    return start > stop ? (start - stop - step - 1) / -step : 0;
+}
+
+static void __searchPathResults_append(SearchPathResults *res, Node *n) {
+    if (res->len == res->cap) {
+        res->cap = res->cap ? res->cap * 2 : 16;
+        res->nodes = RedisModule_Realloc(res->nodes, res->cap * sizeof(Node *));
+    }
+    res->nodes[res->len++] = n;
+}
+
+/* Adds the nodes under n that match the path from a level on, skipping the ones that don't. */
+static void __searchPath_collect(SearchPath *path, size_t level, Node *n, SearchPathResults *res) {
+    PathError err;
+    for (; level < path->len; level++) {
+        PathNode *pn = &path->nodes[level];
+        if (NT_SLICE == pn->type) {
+            if (N_ARRAY != NODETYPE(n)) return;
+            int idx;
+            size_t count = __pathSlice_range(&pn->value.slice, n->value.arrval.len, &idx);
+            for (size_t i = 0; i < count; i++, idx += pn->value.slice.step) {
+                __searchPath_collect(path, level + 1, n->value.arrval.entries[idx], res);
+            }
+            return;
+        }
+        if (NT_WILDCARD == pn->type || NT_DESCENT == pn->type || NT_FILTER == pn->type) {
+            // a descent goes on with the rest of the path from the node, and with itself from its
+            // children
+            if (NT_DESCENT == pn->type) __searchPath_collect(path, level + 1, n, res);
+            size_t next = NT_DESCENT == pn->type ? level : level + 1;
+            uint32_t len = N_ARRAY == NODETYPE(n) || N_DICT == NODETYPE(n) ? Node_Length(n) : 0;
+            for (uint32_t i = 0; i < len; i++) {
+                Node *c = N_ARRAY == NODETYPE(n) ? n->value.arrval.entries[i]
+                                                 : n->value.dictval.entries[i]->value.kvval.val;
+                if (NT_FILTER == pn->type && !PathFilter_Match(pn->value.filter, c)) continue;
+                __searchPath_collect(path, next, c, res);
+            }
+            return;
+        }
+        n = __pathNode_eval(pn, n, &err);
+        if (E_OK != err) return;
+    }
+    __searchPathResults_append(res, n);
+}
+
+PathError SearchPath_FindAll(SearchPath *path, Node *root, SearchPathResults *res, int *errnode) {
+    *res = (SearchPathResults){0};
+
+    // the nodes up to the first with multiple results must match
+    Node *n, *p;
+    PathError err = SearchPath_FindEx(path, root, &n, &p, errnode);
+    if (E_MULTI != err) {
+        if (E_OK == err) __searchPathResults_append(res, n);
+        return err;
+    }
+
+    // consecutive array elements at the end of the path are the array's entries themselves
+    PathNode *pn = &path->nodes[*errnode];
+    if (*errnode == path->len - 1 && N_ARRAY == NODETYPE(p)) {
+        int first = 0;
+        if (NT_WILDCARD == pn->type) {
+            res->len = p->value.arrval.len;
+        } else if (NT_SLICE == pn->type && 1 == pn->value.slice.step) {
+            res->len = __pathSlice_range(&pn->value.slice, p->value.arrval.len, &first);
+        }
+        if (res->len) {
+            res->nodes = p->value.arrval.entries + first;
+            return E_OK;
+        }
+    }
+
+    __searchPath_collect(path, *errnode, p, res);
+    return E_OK;
+}
+
+void SearchPathResults_Free(SearchPathResults *res) {
+    if (res->cap) RedisModule_Free(res->nodes);
+    *res = (SearchPathResults){0};
+}
+
 SearchPath NewSearchPath(size_t cap) { 
     return (SearchPath){RedisModule_Calloc(cap, sizeof(PathNode)), 0, cap};
 }
@@ -110,10 +229,36 @@ void SearchPath_AppendIndex(SearchPath *p, int idx) {
     __searchPath_append(p, pn);
 }
 
+void SearchPath_AppendSlice(SearchPath *p, int start, int stop, int step, int flags) {
+    PathNode pn;
+    pn.type = NT_SLICE;
+    pn.value.slice = (PathSlice){start, stop, step, flags};
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendWildcard(SearchPath *p) {
+    PathNode pn;
+    pn.type = NT_WILDCARD;
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendDescent(SearchPath *p) {
+    PathNode pn;
+    pn.type = NT_DESCENT;
+    __searchPath_append(p, pn);
+}
+
+void SearchPath_AppendFilter(SearchPath *p, struct PathFilter *filter) {
+    PathNode pn;
+    pn.type = NT_FILTER;
+    pn.value.filter = filter;
+    __searchPath_append(p, pn);
+}
+
 void SearchPath_AppendKey(SearchPath *p, const char *key, const size_t len) {
     PathNode pn;
     pn.type = NT_KEY;
-    pn.value.key = rmstrndup(key, len);
+    pn.value.key = Intern_Acquire(key, len);
     __searchPath_append(p, pn);
 }
 
@@ -127,7 +272,9 @@ void SearchPath_Free(SearchPath *p) {
     if (p->nodes) {
         for (int i = 0; i < p->len; i++) {
             if (p->nodes[i].type == NT_KEY) {
-                RedisModule_Free((char *)p->nodes[i].value.key);
+                Intern_Release(p->nodes[i].value.key);
+            } else if (p->nodes[i].type == NT_FILTER) {
+                PathFilter_Free(p->nodes[i].value.filter);
             }
         }
     }
@@ -29,8 +29,16 @@ typedef enum {
     NT_ROOT,
     NT_KEY,
     NT_INDEX,
+    NT_SLICE,     // a range of array elements, which makes the path match multiple nodes
+    NT_WILDCARD,  // all of a container's children
+    NT_DESCENT,   // a node and all its descendants, which the path's next node is applied to
+    NT_FILTER,    // the children of a container that satisfy a predicate (see path_filter.h)
 } PathNodeType;
 
+// The bounds that a slice specifies, the others default by the step's sign
+#define PATH_SLICE_START 0x1
+#define PATH_SLICE_STOP 0x2
+
 /* Error codes returned from path lookups */
 typedef enum {
     // OK
@@ -43,14 +51,29 @@ typedef enum {
 
     // the path predicate does not match the node type
     E_BADTYPE,
+
+    // the path matches multiple nodes where a single one is expected
+    E_MULTI,
 } PathError;
 
+/* An array slice, [start:stop:step] */
+typedef struct {
+    int start;
+    int stop;
+    int step;
+    int flags;  // PATH_SLICE_START and PATH_SLICE_STOP for the bounds that are specified
+} PathSlice;
+
+struct PathFilter;
+
 /* A single lookup node in a lookup path. A lookup path is just a list of nodes */
 typedef struct {
     PathNodeType type;
     union {
         int index;
-        const char *key;
+        const char *key;  // interned (see intern.h), so it is looked up without locking
+        PathSlice slice;
+        struct PathFilter *filter;
     } value;
 } PathNode;
 
@@ -73,6 +96,18 @@ SearchPath NewSearchPath(size_t cap);
 /* Append an array index selection node to the path */
 void SearchPath_AppendIndex(SearchPath *p, int idx);
 
+/* Append an array slice node to the search path, step must not be 0 */
+void SearchPath_AppendSlice(SearchPath *p, int start, int stop, int step, int flags);
+
+/* Append a wildcard node, that selects all of a container's children, to the search path */
+void SearchPath_AppendWildcard(SearchPath *p);
+
+/* Append a recursive descent node to the search path, the path's next node selects from it */
+void SearchPath_AppendDescent(SearchPath *p);
+
+/* Append a filter node to the search path, which takes ownership of the filter */
+void SearchPath_AppendFilter(SearchPath *p, struct PathFilter *filter);
+
 /* Append a string key lookup node to the search path */
 void SearchPath_AppendKey(SearchPath *p, const char *key, const size_t len);
 
@@ -97,4 +132,30 @@ PathError SearchPath_Find(SearchPath *path, Node *root, Node **n);
 */
 PathError SearchPath_FindEx(SearchPath *path, Node *root, Node **n, Node **p, int *errnode);
 
+/* Returns true if the path can match multiple nodes, i.e. has slices, wildcards, recursive descents
+ * or filters, which SearchPath_Find reports as E_MULTI. */
+int SearchPath_IsMulti(const SearchPath *path);
+
+/**
+* The nodes matched by a path. The nodes may be the entries of a matched array rather than a copy of
+* them, in which case `cap` is 0.
+*/
+typedef struct {
+    Node **nodes;
+    size_t len;
+    size_t cap;
+} SearchPathResults;
+
+/**
+* Finds all the nodes in an object tree that match a path. The path's nodes up to its first one
+* with multiple results must match as with SearchPath_FindEx, and their error is returned with its
+* level in errnode. From there on nodes that don't match are skipped, so the results may be empty.
+* The results are in document order, and a recursive descent lists a node before its descendants.
+* The results are valid until the tree is modified, and must be freed with SearchPathResults_Free.
+*/
+PathError SearchPath_FindAll(SearchPath *path, Node *root, SearchPathResults *res, int *errnode);
+
+/* Frees the results of SearchPath_FindAll. */
+void SearchPathResults_Free(SearchPathResults *res);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "intern.h"
+#include "path_cache.h"
+
+/* A cached path. Entries are both in the hash table and in the LRU list, unless evicted. */
+typedef struct pathEntry {
+    struct pathEntry *hnext;  // next entry in the bucket
+    struct pathEntry *prev;   // more recently used entry
+    struct pathEntry *next;   // less recently used entry
+    uint32_t refcount;        // references held by commands
+    uint32_t hash;            // hash of the path string
+    int cached;               // the entry is in the cache
+    SearchPath sp;            // the compiled path
+    size_t len;               // length of the path string
+    char path[];              // the path string
+} pathEntry;
+
+static struct {
+    pathEntry **buckets;  // hash table of entries
+    size_t nbuckets;      // number of buckets, a power of 2
+    pathEntry *head;      // the most recently used entry
+    pathEntry *tail;      // the least recently used entry
+    PathCacheStats stats;
+} __path_cache = {.stats = {.capacity = PATH_CACHE_DEFAULT_CAPACITY}};
+
+#define __entryOf(sp) ((pathEntry *)((char *)(sp)-offsetof(pathEntry, sp)))
+
+static void __lru_unlink(pathEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else __path_cache.head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else __path_cache.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void __lru_push(pathEntry *e) {
+    e->prev = NULL;
+    e->next = __path_cache.head;
+    if (__path_cache.head) __path_cache.head->prev = e;
+    __path_cache.head = e;
+    if (!__path_cache.tail) __path_cache.tail = e;
+}
+
+static void __entry_free(pathEntry *e) {
+    SearchPath_Free(&e->sp);
+    RedisModule_Free(e);
+}
+
+/* Removes an entry from the cache, freeing it unless it is referenced. */
+static void __entry_evict(pathEntry *e) {
+    pathEntry **pe = &__path_cache.buckets[e->hash & (__path_cache.nbuckets - 1)];
+    while (*pe != e) pe = &(*pe)->hnext;
+    *pe = e->hnext;
+    __lru_unlink(e);
+    e->cached = 0;
+    __path_cache.stats.size--;
+    if (!e->refcount) __entry_free(e);
+}
+
+void PathCache_Clear() {
+    while (__path_cache.tail) __entry_evict(__path_cache.tail);
+}
+
+void PathCache_SetCapacity(size_t capacity) {
+    PathCache_Clear();
+    RedisModule_Free(__path_cache.buckets);
+    __path_cache.buckets = NULL;
+    __path_cache.nbuckets = 0;
+    __path_cache.stats.capacity = capacity;
+}
+
+size_t PathCache_GetCapacity() { return __path_cache.stats.capacity; }
+
+SearchPath *PathCache_Acquire(const char *path, size_t len, JSONSearchPathError_t *err) {
+    uint32_t hash = Intern_HashBuffer(path, len);
+    pathEntry *e;
+
+    // buckets are allocated lazily, for about one entry each
+    if (__path_cache.stats.capacity && !__path_cache.buckets) {
+        __path_cache.nbuckets = 16;
+        while (__path_cache.nbuckets < __path_cache.stats.capacity) __path_cache.nbuckets *= 2;
+        __path_cache.buckets = RedisModule_Calloc(__path_cache.nbuckets, sizeof(pathEntry *));
+    }
+
+    if (__path_cache.buckets) {
+        for (e = __path_cache.buckets[hash & (__path_cache.nbuckets - 1)]; e; e = e->hnext) {
+            if (e->hash == hash && e->len == len && !memcmp(e->path, path, len)) {
+                __path_cache.stats.hits++;
+                if (e != __path_cache.head) {
+                    __lru_unlink(e);
+                    __lru_push(e);
+                }
+                e->refcount++;
+                return &e->sp;
+            }
+        }
+    }
+
+    // parse it
+    __path_cache.stats.misses++;
+    e = RedisModule_Calloc(1, sizeof(pathEntry) + len);
+    e->sp = NewSearchPath(0);
+    if (PARSE_OK != ParseJSONPath(path, len, &e->sp, err)) {
+        __entry_free(e);
+        return NULL;
+    }
+    e->hash = hash;
+    e->len = len;
+    memcpy(e->path, path, len);
+    e->refcount = 1;
+
+    // and cache it
+    if (__path_cache.stats.capacity) {
+        if (__path_cache.stats.size >= __path_cache.stats.capacity) {
+            __path_cache.stats.evictions++;
+            __entry_evict(__path_cache.tail);
+        }
+        pathEntry **bucket = &__path_cache.buckets[hash & (__path_cache.nbuckets - 1)];
+        e->hnext = *bucket;
+        *bucket = e;
+        __lru_push(e);
+        e->cached = 1;
+        __path_cache.stats.size++;
+    }
+
+    return &e->sp;
+}
+
+void PathCache_Release(SearchPath *sp) {
+    pathEntry *e = __entryOf(sp);
+    if (!--e->refcount && !e->cached) __entry_free(e);
+}
+
+void PathCache_GetStats(PathCacheStats *stats) { *stats = __path_cache.stats; }
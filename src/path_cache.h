@@ -0,0 +1,64 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PATH_CACHE_H__
+#define __PATH_CACHE_H__
+
+#include <stddef.h>
+#include "json_path.h"
+
+// The default number of compiled paths in the cache
+#define PATH_CACHE_DEFAULT_CAPACITY 1024
+
+/*
+* A module-wide cache of compiled search paths keyed by their strings. Clients tend to use the same
+* few paths over and over, so commands get their paths from the cache instead of parsing them anew.
+* Cached search paths are shared and must never be modified. They are reference counted, so the
+* least recently used path can be evicted while a command still holds it.
+*/
+
+/* The cache's counters. */
+typedef struct {
+    size_t hits;       // lookups that found the path in the cache
+    size_t misses;     // lookups that had to parse the path
+    size_t evictions;  // paths that were evicted from the cache
+    size_t size;       // paths in the cache
+    size_t capacity;   // maximal number of paths in the cache
+} PathCacheStats;
+
+/** Sets the maximal number of paths in the cache, 0 disables caching. Empties the cache. */
+void PathCache_SetCapacity(size_t capacity);
+
+/** Returns the maximal number of paths in the cache. */
+size_t PathCache_GetCapacity();
+
+/**
+* Returns the compiled search path of a path string, taking a reference to it. On syntax errors
+* NULL is returned and the optional `err` is set.
+*/
+SearchPath *PathCache_Acquire(const char *path, size_t len, JSONSearchPathError_t *err);
+
+/** Drops a reference to a search path returned by PathCache_Acquire. */
+void PathCache_Release(SearchPath *sp);
+
+/** Evicts all the paths from the cache. */
+void PathCache_Clear();
+
+/** Fills the cache's counters. */
+void PathCache_GetStats(PathCacheStats *stats);
+
+#endif
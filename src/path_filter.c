@@ -0,0 +1,463 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "path_filter.h"
+#include <ctype.h>
+#include <errno.h>
+#include "json_path.h"
+
+/* The VM's instructions. */
+typedef enum {
+    PF_EXISTS,     // sets whether the path exists
+    PF_CMP_NUM,    // compares the path's value to a number constant
+    PF_CMP_STR,    // compares the path's value to a string constant
+    PF_CMP_CONST,  // compares the path's value to a boolean or a null constant
+    PF_CMP_PATHS,  // compares the values of two paths
+    PF_NOT,        // negates the register
+    PF_AND,        // jumps to the target if the register is false
+    PF_OR,         // jumps to the target if the register is true
+} _PathFilterOp;
+
+/* Comparison operators. */
+typedef enum { PF_EQ, PF_NE, PF_LT, PF_LE, PF_GT, PF_GE } _PathFilterCmp;
+
+/* The operator that gives the same result with the operands swapped. */
+static const uint8_t _PathFilterMirror[] = {PF_EQ, PF_NE, PF_GT, PF_GE, PF_LT, PF_LE};
+
+typedef struct {
+    uint8_t op;
+    uint8_t cmp;
+    uint32_t path;  // the path operand
+    uint32_t arg;   // the constant or the second path operand, or the jump target
+} _PathFilterInstr;
+
+struct PathFilter {
+    _PathFilterInstr *code;
+    uint32_t len;
+    SearchPath *paths;  // relative to the filtered node
+    uint32_t npaths;
+    Node *consts;       // stand-alone nodes, null is a node of type N_NULL
+    uint32_t nconsts;
+};
+
+/* === Compiler === */
+
+typedef struct {
+    const char *s;
+    size_t len;
+    size_t pos;
+    int depth;
+    char *err;
+    PathFilter *f;
+} _PathFilterCompiler;
+
+/* An operand of a comparison, either a path or a constant. */
+typedef struct {
+    int isPath;
+    uint32_t index;
+} _PathFilterOperand;
+
+static void __pf_skipSpace(_PathFilterCompiler *c) {
+    while (c->pos < c->len && isspace(c->s[c->pos])) c->pos++;
+}
+
+/* Consumes a token if it's next. */
+static int __pf_match(_PathFilterCompiler *c, const char *tok) {
+    __pf_skipSpace(c);
+    size_t n = strlen(tok);
+    if (c->pos + n > c->len || strncmp(c->s + c->pos, tok, n)) return 0;
+    c->pos += n;
+    return 1;
+}
+
+/* Consumes a keyword if it's next and isn't the beginning of a longer word. */
+static int __pf_matchWord(_PathFilterCompiler *c, const char *word) {
+    size_t n = strlen(word), end = c->pos + n;
+    if (end > c->len || strncmp(c->s + c->pos, word, n)) return 0;
+    if (end < c->len && (isalnum(c->s[end]) || '_' == c->s[end])) return 0;
+    c->pos = end;
+    return 1;
+}
+
+static uint32_t __pf_emit(PathFilter *f, int op, int cmp, uint32_t path, uint32_t arg) {
+    f->code = RedisModule_Realloc(f->code, (f->len + 1) * sizeof(*f->code));
+    f->code[f->len] = (_PathFilterInstr){op, cmp, path, arg};
+    return f->len++;
+}
+
+static Node *__pf_newConst(PathFilter *f, NodeType type, _PathFilterOperand *o) {
+    f->consts = RedisModule_Realloc(f->consts, (f->nconsts + 1) * sizeof(*f->consts));
+    *o = (_PathFilterOperand){0, f->nconsts};
+    Node *k = &f->consts[f->nconsts++];
+    *k = (Node){.type = type};
+    return k;
+}
+
+/* Compiles a relative path, `@` followed by keys and indices, as an operand. */
+static int __pf_path(_PathFilterCompiler *c, _PathFilterOperand *o) {
+    size_t start = c->pos;
+    while (c->pos < c->len) {
+        char ch = c->s[c->pos];
+        if (isalnum(ch) || '_' == ch || '$' == ch || '.' == ch) {
+            c->pos++;
+        } else if ('[' == ch) {
+            // up to the closing bracket, which may be in a key
+            char quote = 0;
+            for (c->pos++; c->pos < c->len && (quote || ']' != c->s[c->pos]); c->pos++) {
+                ch = c->s[c->pos];
+                if (quote && ch == quote) {
+                    quote = 0;
+                } else if (!quote && ('"' == ch || '\'' == ch)) {
+                    quote = ch;
+                }
+            }
+            if (c->pos == c->len) break;
+            c->pos++;
+        } else {
+            break;
+        }
+    }
+
+    SearchPath sp = NewSearchPath(0);
+    if ((c->pos > start && PARSE_OK != ParseJSONPath(c->s + start, c->pos - start, &sp, NULL)) ||
+        (sp.len && NT_ROOT == sp.nodes[0].type) || SearchPath_IsMulti(&sp)) {
+        SearchPath_Free(&sp);
+        c->err = PATH_FILTER_PATH_ERR;
+        return 0;
+    }
+    PathFilter *f = c->f;
+    f->paths = RedisModule_Realloc(f->paths, (f->npaths + 1) * sizeof(*f->paths));
+    f->paths[f->npaths] = sp;
+    *o = (_PathFilterOperand){1, f->npaths++};
+    return 1;
+}
+
+/* Compiles a number constant, which is an integer unless it has a fraction or an exponent. */
+static int __pf_number(_PathFilterCompiler *c, _PathFilterOperand *o) {
+    char buf[64];
+    size_t n = 0;
+    while (c->pos + n < c->len && n < sizeof(buf) - 1 &&
+           strchr("0123456789+-.eE", c->s[c->pos + n])) {
+        buf[n] = c->s[c->pos + n];
+        n++;
+    }
+    buf[n] = '\0';
+
+    char *end;
+    double d = strtod(buf, &end);
+    if (end == buf) {
+        c->err = PATH_FILTER_OPERAND_ERR;
+        return 0;
+    }
+    n = end - buf;
+    buf[n] = '\0';
+    int isint = !strpbrk(buf, ".eE");
+    errno = 0;
+    int64_t i = isint ? strtoll(buf, NULL, 10) : 0;
+    if (isint && ERANGE != errno) {
+        __pf_newConst(c->f, N_INTEGER, o)->value.intval = i;
+    } else {
+        __pf_newConst(c->f, N_NUMBER, o)->value.numval = d;
+    }
+    c->pos += n;
+    return 1;
+}
+
+/* Compiles a single- or double-quoted string constant, backslashes escape any character in it. */
+static int __pf_string(_PathFilterCompiler *c, _PathFilterOperand *o) {
+    char quote = c->s[c->pos++];
+    char *str = RedisModule_Alloc(c->len - c->pos + 1);
+    uint32_t n = 0;
+    while (c->pos < c->len && quote != c->s[c->pos]) {
+        if ('\\' == c->s[c->pos] && c->pos + 1 < c->len) c->pos++;
+        str[n++] = c->s[c->pos++];
+    }
+    if (c->pos == c->len) {
+        RedisModule_Free(str);
+        c->err = PATH_FILTER_STRING_ERR;
+        return 0;
+    }
+    c->pos++;
+    __pf_newConst(c->f, N_STRING, o)->value.strval = (t_string){str, n};
+    return 1;
+}
+
+static int __pf_operand(_PathFilterCompiler *c, _PathFilterOperand *o) {
+    __pf_skipSpace(c);
+    if (c->pos == c->len) {
+        c->err = PATH_FILTER_OPERAND_ERR;
+        return 0;
+    }
+    char ch = c->s[c->pos];
+    if ('@' == ch) {
+        c->pos++;
+        return __pf_path(c, o);
+    } else if (isdigit(ch) || '-' == ch) {
+        return __pf_number(c, o);
+    } else if ('"' == ch || '\'' == ch) {
+        return __pf_string(c, o);
+    } else if (__pf_matchWord(c, "true")) {
+        __pf_newConst(c->f, N_BOOLEAN, o)->value.boolval = 1;
+        return 1;
+    } else if (__pf_matchWord(c, "false")) {
+        __pf_newConst(c->f, N_BOOLEAN, o)->value.boolval = 0;
+        return 1;
+    } else if (__pf_matchWord(c, "null")) {
+        __pf_newConst(c->f, N_NULL, o);
+        return 1;
+    }
+    c->err = PATH_FILTER_OPERAND_ERR;
+    return 0;
+}
+
+/* Compiles a comparison, or an existence test of a single path. */
+static int __pf_comparison(_PathFilterCompiler *c) {
+    static const struct {
+        const char *tok;
+        int cmp;
+    } ops[] = {{"==", PF_EQ}, {"!=", PF_NE}, {"<=", PF_LE},
+               {">=", PF_GE}, {"<", PF_LT},  {">", PF_GT}};
+    _PathFilterOperand a, b;
+    if (!__pf_operand(c, &a)) return 0;
+    int cmp = -1;
+    for (int i = 0; i < sizeof(ops) / sizeof(ops[0]) && cmp < 0; i++) {
+        if (__pf_match(c, ops[i].tok)) cmp = ops[i].cmp;
+    }
+    if (cmp < 0) {
+        if (!a.isPath) {
+            c->err = PATH_FILTER_EXISTS_ERR;
+            return 0;
+        }
+        __pf_emit(c->f, PF_EXISTS, 0, a.index, 0);
+        return 1;
+    }
+    if (!__pf_operand(c, &b)) return 0;
+
+    // the path goes first
+    if (!a.isPath) {
+        _PathFilterOperand t = a;
+        a = b;
+        b = t;
+        cmp = _PathFilterMirror[cmp];
+    }
+    if (!a.isPath) {
+        c->err = PATH_FILTER_COMPARE_ERR;
+        return 0;
+    }
+    if (b.isPath) {
+        __pf_emit(c->f, PF_CMP_PATHS, cmp, a.index, b.index);
+        return 1;
+    }
+    switch (c->f->consts[b.index].type) {
+        case N_INTEGER:
+        case N_NUMBER:
+            __pf_emit(c->f, PF_CMP_NUM, cmp, a.index, b.index);
+            break;
+        case N_STRING:
+            __pf_emit(c->f, PF_CMP_STR, cmp, a.index, b.index);
+            break;
+        default:
+            if (PF_EQ != cmp && PF_NE != cmp) {
+                c->err = PATH_FILTER_COMPARE_ERR;
+                return 0;
+            }
+            __pf_emit(c->f, PF_CMP_CONST, cmp, a.index, b.index);
+            break;
+    }
+    return 1;
+}
+
+static int __pf_or(_PathFilterCompiler *c);
+
+static int __pf_unary(_PathFilterCompiler *c) {
+    if (++c->depth > PATH_FILTER_MAX_DEPTH) {
+        c->err = PATH_FILTER_DEPTH_ERR;
+        return 0;
+    }
+    int ok;
+    if (__pf_match(c, "!")) {
+        ok = __pf_unary(c);
+        if (ok) __pf_emit(c->f, PF_NOT, 0, 0, 0);
+    } else if (__pf_match(c, "(")) {
+        ok = __pf_or(c);
+        if (ok && !__pf_match(c, ")")) {
+            c->err = PATH_FILTER_CLOSE_ERR;
+            ok = 0;
+        }
+    } else {
+        ok = __pf_comparison(c);
+    }
+    c->depth--;
+    return ok;
+}
+
+/* Compiles a chain of operands with the same short-circuiting operator. The jump after each operand
+ * goes to the end of the next one, from which a chain of jumps with the same result goes on. */
+static int __pf_and(_PathFilterCompiler *c) {
+    if (!__pf_unary(c)) return 0;
+    while (__pf_match(c, "&&")) {
+        uint32_t jmp = __pf_emit(c->f, PF_AND, 0, 0, 0);
+        if (!__pf_unary(c)) return 0;
+        c->f->code[jmp].arg = c->f->len;
+    }
+    return 1;
+}
+
+static int __pf_or(_PathFilterCompiler *c) {
+    if (!__pf_and(c)) return 0;
+    while (__pf_match(c, "||")) {
+        uint32_t jmp = __pf_emit(c->f, PF_OR, 0, 0, 0);
+        if (!__pf_and(c)) return 0;
+        c->f->code[jmp].arg = c->f->len;
+    }
+    return 1;
+}
+
+PathFilter *PathFilter_Compile(const char *expr, size_t len, size_t *consumed, char **errmsg,
+                               size_t *erroffset) {
+    _PathFilterCompiler c = {.s = expr, .len = len};
+    c.f = RedisModule_Calloc(1, sizeof(PathFilter));
+    if (!__pf_match(&c, "(")) {
+        c.err = PATH_FILTER_OPEN_ERR;
+    } else if (__pf_or(&c) && !__pf_match(&c, ")")) {
+        c.err = PATH_FILTER_CLOSE_ERR;
+    }
+    if (c.err) {
+        *errmsg = c.err;
+        *erroffset = c.pos;
+        PathFilter_Free(c.f);
+        return NULL;
+    }
+    *consumed = c.pos;
+    return c.f;
+}
+
+void PathFilter_Free(PathFilter *f) {
+    for (uint32_t i = 0; i < f->npaths; i++) SearchPath_Free(&f->paths[i]);
+    for (uint32_t i = 0; i < f->nconsts; i++) {
+        if (N_STRING == f->consts[i].type) RedisModule_Free((char *)f->consts[i].value.strval.data);
+    }
+    RedisModule_Free(f->code);
+    RedisModule_Free(f->paths);
+    RedisModule_Free(f->consts);
+    RedisModule_Free(f);
+}
+
+/* === VM === */
+
+static inline int __pf_result(int cmp, int order) {
+    switch (cmp) {
+        case PF_EQ:
+            return !order;
+        case PF_NE:
+            return !!order;
+        case PF_LT:
+            return order < 0;
+        case PF_LE:
+            return order <= 0;
+        case PF_GT:
+            return order > 0;
+        default:
+            return order >= 0;
+    }
+}
+
+static inline int __pf_compareNumbers(Node *a, Node *b, int cmp) {
+    if (N_INTEGER == NODETYPE(a) && N_INTEGER == NODETYPE(b)) {
+        int64_t x = NODE_INTVAL(a), y = NODE_INTVAL(b);
+        return __pf_result(cmp, (x > y) - (x < y));
+    }
+    double x = NODEVALUE_AS_DOUBLE(a), y = NODEVALUE_AS_DOUBLE(b);
+    return __pf_result(cmp, (x > y) - (x < y));
+}
+
+static inline int __pf_compareStrings(Node *a, Node *b, int cmp) {
+    const t_string *x = &a->value.strval, *y = &b->value.strval;
+    char *xbuf, *ybuf;
+    int order = memcmp(Node_StringData(a, &xbuf), Node_StringData(b, &ybuf), MIN(x->len, y->len));
+    if (!order) order = (x->len > y->len) - (x->len < y->len);
+    Node_StringRelease(xbuf);
+    Node_StringRelease(ybuf);
+    return __pf_result(cmp, order);
+}
+
+/* Compares values of any types. Values of different types are only unequal, and only numbers and
+ * strings are ordered. Containers are equal only to themselves. */
+static int __pf_compare(Node *a, Node *b, int cmp) {
+    NodeType ta = NODETYPE(a), tb = NODETYPE(b);
+    if ((ta & (N_INTEGER | N_NUMBER)) && (tb & (N_INTEGER | N_NUMBER)))
+        return __pf_compareNumbers(a, b, cmp);
+    if (ta != tb) return PF_NE == cmp;
+    if (N_STRING == ta) return __pf_compareStrings(a, b, cmp);
+    if (PF_EQ != cmp && PF_NE != cmp) return 0;
+    int equal = N_NULL == ta || (N_BOOLEAN == ta ? NODE_BOOLVAL(a) == NODE_BOOLVAL(b) : a == b);
+    return (PF_EQ == cmp) == equal;
+}
+
+int PathFilter_Match(const PathFilter *f, Node *n) {
+    int reg = 0;
+    for (uint32_t pc = 0; pc < f->len; pc++) {
+        const _PathFilterInstr *in = &f->code[pc];
+        Node *v, *w;
+        switch (in->op) {
+            case PF_EXISTS:
+                reg = E_OK == SearchPath_Find(&f->paths[in->path], n, &v);
+                break;
+            case PF_CMP_NUM:
+                if (E_OK != SearchPath_Find(&f->paths[in->path], n, &v) ||
+                    !(NODETYPE(v) & (N_INTEGER | N_NUMBER))) {
+                    reg = PF_NE == in->cmp;
+                } else {
+                    reg = __pf_compareNumbers(v, &f->consts[in->arg], in->cmp);
+                }
+                break;
+            case PF_CMP_STR:
+                if (E_OK != SearchPath_Find(&f->paths[in->path], n, &v) ||
+                    N_STRING != NODETYPE(v)) {
+                    reg = PF_NE == in->cmp;
+                } else {
+                    reg = __pf_compareStrings(v, &f->consts[in->arg], in->cmp);
+                }
+                break;
+            case PF_CMP_CONST:
+                if (E_OK != SearchPath_Find(&f->paths[in->path], n, &v)) {
+                    reg = PF_NE == in->cmp;
+                } else {
+                    reg = __pf_compare(v, &f->consts[in->arg], in->cmp);
+                }
+                break;
+            case PF_CMP_PATHS:
+                if (E_OK != SearchPath_Find(&f->paths[in->path], n, &v) ||
+                    E_OK != SearchPath_Find(&f->paths[in->arg], n, &w)) {
+                    reg = PF_NE == in->cmp;
+                } else {
+                    reg = __pf_compare(v, w, in->cmp);
+                }
+                break;
+            case PF_NOT:
+                reg = !reg;
+                break;
+            case PF_AND:
+                if (!reg) pc = in->arg - 1;
+                break;
+            case PF_OR:
+                if (reg) pc = in->arg - 1;
+                break;
+        }
+    }
+    return reg;
+}
@@ -0,0 +1,60 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PATH_FILTER_H__
+#define __PATH_FILTER_H__
+
+#include <stddef.h>
+#include "object.h"
+#include "path.h"
+
+#define PATH_FILTER_OPEN_ERR "a filter's expression must be in parentheses"
+#define PATH_FILTER_CLOSE_ERR "expecting a right parenthesis in a filter"
+#define PATH_FILTER_OPERAND_ERR "expecting a relative path, a number, a string, true, false or null in a filter"
+#define PATH_FILTER_STRING_ERR "expecting a closing quote after a string in a filter"
+#define PATH_FILTER_PATH_ERR "a filter's paths must be valid and have a single result"
+#define PATH_FILTER_COMPARE_ERR "a filter's comparison must have a relative path, and only equality for booleans and nulls"
+#define PATH_FILTER_EXISTS_ERR "expecting a comparison after a value in a filter"
+#define PATH_FILTER_DEPTH_ERR "a filter's expression is nested too deeply"
+
+// The deepest nesting of parentheses and negations in a filter's expression
+#define PATH_FILTER_MAX_DEPTH 32
+
+/*
+* A filter selects the children of a container for which a predicate holds, e.g. `[?(@.price < 10
+* && @.tag == "x")]`. The predicate's expression is compiled once, when the path is parsed, into a
+* short program for a small VM. The program has a single boolean register: every comparison sets it,
+* `!` negates it, and `&&` and `||` are jumps that skip their right operand when the register
+* already has the result. Comparisons are specialized by the type of their constant operand.
+*/
+typedef struct PathFilter PathFilter;
+
+/**
+* Compiles a filter's parenthesized expression at the beginning of `expr`, which is `len` long. The
+* length of the expression, parentheses included, is set in `consumed`. On syntax errors NULL is
+* returned, and `errmsg` and `erroffset` are set.
+*/
+PathFilter *PathFilter_Compile(const char *expr, size_t len, size_t *consumed, char **errmsg,
+                               size_t *erroffset);
+
+/** Returns true if a node satisfies the filter. Safe to call concurrently on a shared filter. */
+int PathFilter_Match(const PathFilter *f, Node *n);
+
+/** Frees a compiled filter. */
+void PathFilter_Free(PathFilter *f);
+
+#endif
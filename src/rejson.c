@@ -19,8 +19,6 @@
 #include "rejson.h"
 
 // == Helpers ==
-#define NODEVALUE_AS_DOUBLE(n) (N_INTEGER == n->type ? (double)n->value.intval : n->value.numval)
-#define NODETYPE(n) (n ? n->type : N_NULL)
 
 /* Returns the string representation of a the node's type. */
 static inline char *NodeTypeStr(const NodeType nt) {
@@ -57,7 +55,7 @@ typedef struct {
     size_t spathlen;    // the path's string length
     Node *n;            // the referenced node
     Node *p;            // its parent
-    SearchPath sp;      // the search path
+    SearchPath *sp;     // the search path, shared with the path cache
     char *sperrmsg;     // the search path error message
     size_t sperroffset; // the search path error offset
     PathError err;      // set in case of path error
@@ -65,7 +63,9 @@ typedef struct {
 } JSONPathNode_t;
 
 /* Call this to free the struct's contents. */
-void JSONPathNode_Free(JSONPathNode_t *jpn) { SearchPath_Free(&jpn->sp); }
+void JSONPathNode_Free(JSONPathNode_t *jpn) {
+    if (jpn->sp) PathCache_Release(jpn->sp);
+}
 
 /* Sets n to the target node by path.
  * p is n's parent, errors are set into err and level is the error's depth
@@ -78,19 +78,17 @@ int NodeFromJSONPath(Node *root, const RedisModuleString *path, JSONPathNode_t *
     JSONSearchPathError_t jsperr = { 0 };
 
     // path must be valid from the root or it's an error
-    jpn->sp = NewSearchPath(0);
     jpn->spath = RedisModule_StringPtrLen(path, &jpn->spathlen);
-    if (PARSE_ERR == ParseJSONPath(jpn->spath, jpn->spathlen, &jpn->sp, &jsperr)) {
-        SearchPath_Free(&jpn->sp);
-        jpn->sp.nodes = NULL;   // in case someone tries to free it later
+    jpn->sp = PathCache_Acquire(jpn->spath, jpn->spathlen, &jsperr);
+    if (!jpn->sp) {
         jpn->sperrmsg = jsperr.errmsg;
         jpn->sperroffset = jsperr.offset;
         return PARSE_ERR;
     }
 
     // if there are any errors return them
-    if (!SearchPath_IsRootPath(&jpn->sp)) {
-        jpn->err = SearchPath_FindEx(&jpn->sp, root, &jpn->n, &jpn->p, &jpn->errlevel);
+    if (!SearchPath_IsRootPath(jpn->sp)) {
+        jpn->err = SearchPath_FindEx(jpn->sp, root, &jpn->n, &jpn->p, &jpn->errlevel);
     } else {
         // deal with edge case of setting root's parent
         jpn->n = root;
@@ -118,7 +116,7 @@ void ReplyWithPathTypeError(RedisModuleCtx *ctx, NodeType expected, NodeType act
 /* Generic path error reply handler */
 void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
     // TODO: report actual position in path & literal token
-    PathNode *epn = &jpn->sp.nodes[jpn->errlevel];
+    PathNode *epn = &jpn->sp->nodes[jpn->errlevel];
     sds err = sdsempty();
     switch (jpn->err) {
         case E_OK:
@@ -128,6 +126,12 @@ void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
             if (NT_KEY == epn->type) {
                 err = sdscatfmt(err, "ERR invalid key '[\"%s\"]' at level %i in path",
                                 epn->value.key, jpn->errlevel);
+            } else if (NT_SLICE == epn->type) {
+                err = sdscatfmt(err, "ERR invalid slice at level %i in path", jpn->errlevel);
+            } else if (NT_WILDCARD == epn->type) {
+                err = sdscatfmt(err, "ERR invalid wildcard at level %i in path", jpn->errlevel);
+            } else if (NT_FILTER == epn->type) {
+                err = sdscatfmt(err, "ERR invalid filter at level %i in path", jpn->errlevel);
             } else {
                 err = sdscatfmt(err, "ERR invalid index '[%i]' at level %i in path", epn->value.index,
                                 jpn->errlevel);
@@ -141,6 +145,10 @@ void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
             err = sdscatfmt(err, "ERR key '%s' does not exist at level %i in path", epn->value.key,
                             jpn->errlevel);
             break;
+        case E_MULTI:
+            err = sdscatfmt(err, "ERR path has multiple results from level %i - only JSON.GET and "
+                                 "JSON.MGET support it", jpn->errlevel);
+            break;
         default:
             err = sdscatfmt(err, "ERR unknown path error at level %i in path", jpn->errlevel);
             break;
@@ -149,8 +157,401 @@ void ReplyWithPathError(RedisModuleCtx *ctx, const JSONPathNode_t *jpn) {
     sdsfree(err);
 }
 
+/* Replicates a write command, including one that was called again after a background parse. */
+void ReplicateCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // a blocked client's arguments may be gone by the time it's unblocked
+    if (RedisModule_IsBlockedReplyRequest(ctx)) {
+        RedisModule_Replicate(ctx, RedisModule_StringPtrLen(argv[0], NULL), "v", argv + 1,
+                              (size_t)(argc - 1));
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
+}
+
+/* Updates the secondary indexes after a command modified a JSON value. */
+void UpdateIndexes(RedisModuleCtx *ctx, RedisModuleString *keyname, JSONType_t *jt) {
+    if (!SIndex_Any()) return;
+    size_t len;
+    const char *key = RedisModule_StringPtrLen(keyname, &len);
+    SIndex_Update(RedisModule_GetSelectedDb(ctx), key, len, jt);
+}
+
+/* Returns the schema that the writes to a JSON key are checked against, NULL if there's none. */
+const Schema *SchemaOfKey(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+    size_t len;
+    const char *key = RedisModule_StringPtrLen(keyname, &len);
+    return KeySchema_Find(RedisModule_GetSelectedDb(ctx), key, len);
+}
+
+/* Replies with a schema violation, if there's one, and frees it. Returns REDISMODULE_ERR if so. */
+int ReplyWithSchemaViolation(RedisModuleCtx *ctx, int rc, sds err) {
+    if (OBJ_OK == rc) return REDISMODULE_OK;
+    sds msg = sdscatfmt(sdsempty(), REJSON_ERROR_SCHEMA_VIOLATION, err);
+    RedisModule_ReplyWithError(ctx, msg);
+    sdsfree(msg);
+    sdsfree(err);
+    return REDISMODULE_ERR;
+}
+
+/* Returns the key of a request in the serialized-value cache, i.e. its options and paths. */
+sds SerialCacheRequest(const JSONSerializeOpt *jsopt, RedisModuleString **paths, int npaths) {
+    // each part is prefixed by its length to keep the key unambiguous
+    sds req = sdscatfmt(sdsempty(), "%u:%s%u:%s%u:%s", strlen(jsopt->indentstr), jsopt->indentstr,
+                        strlen(jsopt->newlinestr), jsopt->newlinestr, strlen(jsopt->spacestr),
+                        jsopt->spacestr);
+    for (int i = 0; i < npaths; i++) {
+        size_t len;
+        const char *path = RedisModule_StringPtrLen(paths[i], &len);
+        req = sdscatfmt(req, "%u:", len);
+        req = sdscatlen(req, path, len);
+    }
+    return req;
+}
+
 /* The custom Redis data type. */
 static RedisModuleType *JSONType;
+static RedisModuleType *SIndexType;
+static RedisModuleType *SchemaType;
+
+/**
+* Deletes the value at a path, other than the root, from its parent container and frees it lazily.
+* Returns an error message on failure, NULL otherwise.
+*/
+static const char *DeleteFromParent(JSONPathNode_t *jpn) {
+    if (N_DICT == NODETYPE(jpn->p)) {
+        const char *dictkey = jpn->sp->nodes[jpn->sp->len - 1].value.key;
+        Node *val;
+        if (OBJ_OK != Node_DictDetach(jpn->p, dictkey, &val)) return REJSON_ERROR_DICT_DEL;
+        LazyFree_Value(val, NULL);
+    } else {  // container must be an array
+        int index = jpn->sp->nodes[jpn->sp->len - 1].value.index;
+        if (index < 0) index = Node_Length(jpn->p) + index;
+        // detach the value before deleting its entry, so it can be freed lazily
+        Node *val = jpn->n;
+        if (OBJ_OK != Node_ArraySet(jpn->p, index, NULL) ||
+            OBJ_OK != Node_ArrayDelRange(jpn->p, index, 1)) {
+            return REJSON_ERROR_ARRAY_DEL;
+        }
+        LazyFree_Value(val, NULL);
+    }
+    return NULL;
+}
+
+/* Clears the TTLs of a path that's replaced or deleted, and of its descendants. */
+static void ClearExpiries(JSONType_t *jt, const JSONPathNode_t *jpn) {
+    if (!jt->expiries) return;
+    sds path = Expiry_FormatPath(jpn->sp, jt->root);
+    if (path) Expiry_Clear(jt, path);
+    sdsfree(path);
+}
+
+/* Adjusts the TTLs of the array at a path to a splice of its elements, see Expiry_Splice. */
+static void SpliceExpiries(JSONType_t *jt, const SearchPath *sp, long index, long deleted,
+                           long inserted) {
+    if (!jt->expiries) return;
+    sds path = Expiry_FormatPath(sp, jt->root);
+    if (path) Expiry_Splice(jt, path, index, deleted, inserted);
+    sdsfree(path);
+}
+
+/**
+* Clears the TTLs of a value that's deleted from its parent, and shifts those of the array elements
+* that follow it. Called before the deletion, as the paths' negative indices count the value.
+*/
+static void DeleteExpiries(JSONType_t *jt, const JSONPathNode_t *jpn) {
+    if (!jt->expiries) return;
+    if (N_ARRAY != NODETYPE(jpn->p)) {
+        ClearExpiries(jt, jpn);
+        return;
+    }
+    SearchPath array = *jpn->sp;
+    array.len--;
+    long index = array.nodes[array.len].value.index;
+    if (index < 0) index += Node_Length(jpn->p);
+    SpliceExpiries(jt, &array, index, 1, 0);
+}
+
+typedef void (*ScanJSONKeysFunc)(void *arg, int db, RedisModuleString *name, JSONType_t *jt);
+
+/* Calls a function for the JSON keys of the selected database that match a pattern. */
+static void ScanJSONKeys(RedisModuleCtx *ctx, const char *pattern, size_t len,
+                         ScanJSONKeysFunc fn, void *arg) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    sds cursor = sdsnew("0");
+    do {
+        RedisModuleCallReply *r =
+            RedisModule_Call(ctx, "SCAN", "ccbcl", cursor, "MATCH", pattern, len, "COUNT",
+                             (long long)JSONINDEX_SCAN_COUNT);
+        if (!r) break;
+        if (REDISMODULE_REPLY_ARRAY != RedisModule_CallReplyType(r) ||
+            2 != RedisModule_CallReplyLength(r)) {
+            RedisModule_FreeCallReply(r);
+            break;
+        }
+        size_t curlen;
+        const char *next = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0),
+                                                          &curlen);
+        cursor = sdscpylen(cursor, next, curlen);
+
+        RedisModuleCallReply *keys = RedisModule_CallReplyArrayElement(r, 1);
+        for (size_t i = 0; i < RedisModule_CallReplyLength(keys); i++) {
+            RedisModuleString *name =
+                RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(keys, i));
+            RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ);
+            if (JSONType == RedisModule_ModuleTypeGetType(key)) {
+                fn(arg, db, name, RedisModule_ModuleTypeGetValue(key));
+            }
+            RedisModule_CloseKey(key);
+            RedisModule_FreeString(ctx, name);
+        }
+        RedisModule_FreeCallReply(r);
+    } while (strcmp("0", cursor));
+    sdsfree(cursor);
+}
+
+// whether the server was a replica when its role was last checked, and when that was
+static int __isReplica = 0;
+static long long __roleChecked = -1;
+
+/* Returns true if the server is a replica, which leaves deleting expired values to its master. */
+static int IsReplica(RedisModuleCtx *ctx) {
+    long long now = RedisModule_Milliseconds();
+    if (__roleChecked >= 0 && now - __roleChecked < JSONEXPIRY_ROLE_INTERVAL) return __isReplica;
+    __roleChecked = now;
+
+    RedisModuleCallReply *r = RedisModule_Call(ctx, "ROLE", "");
+    if (r && REDISMODULE_REPLY_ARRAY == RedisModule_CallReplyType(r) &&
+        RedisModule_CallReplyLength(r)) {
+        size_t len;
+        const char *role =
+            RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0), &len);
+        __isReplica = role && 5 == len && !memcmp("slave", role, len);
+    }
+    if (r) RedisModule_FreeCallReply(r);
+    return __isReplica;
+}
+
+/**
+* Deletes the expired value of a TTL from its key, and replicates the deletion. The TTL is cleared.
+* Returns 0, leaving the TTL, if the value isn't in the key that it's bound to.
+*/
+static int ExpireEntry(RedisModuleCtx *ctx, ExpiryEntry *e) {
+    ExpiryDoc *doc = e->doc;
+    JSONType_t *jt = doc->jt;
+    if (!doc->key || REDISMODULE_OK != RedisModule_SelectDb(ctx, doc->db)) return 0;
+
+    RedisModuleString *name = RedisModule_CreateString(ctx, doc->key, sdslen(doc->key));
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ | REDISMODULE_WRITE);
+    int bound = JSONType == RedisModule_ModuleTypeGetType(key) &&
+                jt == RedisModule_ModuleTypeGetValue(key);
+    if (bound) {
+        JSONTypeThaw(jt);
+        sds path = sdsdup(e->path);
+        RedisModuleString *spath = RedisModule_CreateString(ctx, path, sdslen(path));
+        JSONPathNode_t jpn;
+        int deleted = 0;
+        if (PARSE_OK == NodeFromJSONPath(jt->root, spath, &jpn)) {
+            if (E_OK == jpn.err && !SearchPath_IsRootPath(jpn.sp)) {
+                JSONTypeTouch(jt);
+                // the TTL is cleared with the value's, shifting its following elements' TTLs
+                DeleteExpiries(jt, &jpn);
+                deleted = 1;
+                const char *err = DeleteFromParent(&jpn);
+                if (err) {
+                    RM_LOG_WARNING(ctx, "%s", err);
+                } else {
+                    JSONTypeCompact(jt);
+                    UpdateIndexes(ctx, name, jt);
+                    RedisModule_Replicate(ctx, "JSON.DEL", "sc", name, path);
+                }
+            }
+            JSONPathNode_Free(&jpn);
+        }
+        if (!deleted) Expiry_Clear(jt, path);
+        RedisModule_FreeString(ctx, spath);
+        sdsfree(path);
+    }
+    RedisModule_CloseKey(key);
+    RedisModule_FreeString(ctx, name);
+    return bound;
+}
+
+/**
+* Deletes the values whose TTLs passed. Commands call it before they access JSON values, which makes
+* the module's timer wheel advance, so expired values are reclaimed without scanning the keyspace.
+* The TTLs of values that aren't in the keys they're bound to, e.g. after they're loaded or renamed,
+* are parked until a command accesses them by their keys' names.
+*/
+static void ExpireDue(RedisModuleCtx *ctx) {
+    if (!Expiry_Count() || RedisModule_IsBlockedReplyRequest(ctx)) return;
+    uint64_t now = (uint64_t)RedisModule_Milliseconds();
+    if (!Expiry_Pending(now) || IsReplica(ctx)) return;
+
+    int db = RedisModule_GetSelectedDb(ctx);
+    Expiry_Advance(now);
+    ExpiryEntry *e;
+    while ((e = Expiry_NextDue())) {
+        if (!ExpireEntry(ctx, e)) Expiry_Park(e);
+    }
+    RedisModule_SelectDb(ctx, db);
+}
+
+/**
+* Orders the paths of values so that deleting them in order doesn't move the others: descendants
+* before their ancestors, and the later elements of an array before the earlier ones.
+*/
+static int _cmpDeletions(const void *a, const void *b) {
+    const SearchPath *x = ((const JSONPathNode_t *)a)->sp, *y = ((const JSONPathNode_t *)b)->sp;
+    for (size_t i = 0; i < x->len && i < y->len; i++) {
+        const PathNode *m = &x->nodes[i], *n = &y->nodes[i];
+        if (m->type != n->type) return m->type < n->type ? -1 : 1;
+        if (NT_INDEX == m->type && m->value.index != n->value.index) {
+            return m->value.index > n->value.index ? -1 : 1;
+        }
+        if (NT_KEY == m->type) {
+            int cmp = strcmp(m->value.key, n->value.key);
+            if (cmp) return cmp;
+        }
+    }
+    return x->len == y->len ? 0 : x->len > y->len ? -1 : 1;
+}
+
+/* A view of a JSON value, see ViewJSON. */
+typedef struct {
+    JSONType_t jt;
+    sds *hidden;  // the canonical paths of the values that the view doesn't have
+    size_t nhidden;
+} _JSONView;
+
+// the views of JSON values that read-only commands accessed, freed before the next command
+static _JSONView **__views = NULL;
+static size_t __nviews = 0, __cviews = 0;
+
+static void FreeViews() {
+    for (size_t i = 0; i < __nviews; i++) {
+        Node_Free(__views[i]->jt.root);
+        for (size_t j = 0; j < __views[i]->nhidden; j++) sdsfree(__views[i]->hidden[j]);
+        RedisModule_Free(__views[i]->hidden);
+        RedisModule_Free(__views[i]);
+    }
+    __nviews = 0;
+}
+
+/**
+* Returns a view of a JSON value for read-only commands, without the values whose TTLs passed, so
+* they're absent before they're expired, which read-only commands can't do as it's a write. The
+* view is a copy that shares the value's TTLs (see ViewPath), and is freed before the next command.
+* A frozen value is decoded, not thawed. Returns the value itself if none of its TTLs passed.
+*/
+static JSONType_t *ViewJSON(RedisModuleCtx *ctx, JSONType_t *jt) {
+    uint64_t now = (uint64_t)RedisModule_Milliseconds();
+    if (!jt->expiries || !Expiry_Passed(jt, now)) return jt;
+
+    const ExpiryDoc *doc = jt->expiries;
+    _JSONView *view = RedisModule_Calloc(1, sizeof(_JSONView));
+    NodeArena *prev = Node_UseArena(NULL);
+    view->jt.root = jt->frozen ? JSONTypeDecode(jt) : Node_Copy(jt->root);
+    Node_UseArena(prev);
+    view->jt.expiries = jt->expiries;
+    JSONTypeTouch(&view->jt);
+    view->hidden = RedisModule_Calloc(doc->len, sizeof(sds));
+    if (__nviews == __cviews) {
+        __cviews = __cviews ? __cviews * 2 : 4;
+        __views = RedisModule_Realloc(__views, __cviews * sizeof(_JSONView *));
+    }
+    __views[__nviews++] = view;
+
+    JSONPathNode_t *jpns = RedisModule_Calloc(doc->len, sizeof(JSONPathNode_t));
+    RedisModuleString **spaths = RedisModule_Calloc(doc->len, sizeof(RedisModuleString *));
+    size_t len = 0;
+    for (uint32_t i = 0; i < doc->len; i++) {
+        const ExpiryEntry *e = doc->entries[i];
+        if (e->when > now) continue;
+        spaths[len] = RedisModule_CreateString(ctx, e->path, sdslen(e->path));
+        if (PARSE_OK != NodeFromJSONPath(view->jt.root, spaths[len], &jpns[len])) {
+            RedisModule_FreeString(ctx, spaths[len]);
+            continue;
+        }
+        len++;
+    }
+    qsort(jpns, len, sizeof(JSONPathNode_t), _cmpDeletions);
+    for (size_t i = 0; i < len; i++) {
+        if (E_OK != jpns[i].err || SearchPath_IsRootPath(jpns[i].sp)) continue;
+        DeleteFromParent(&jpns[i]);
+        view->hidden[view->nhidden++] = sdsnewlen(jpns[i].spath, jpns[i].spathlen);
+    }
+    for (size_t i = 0; i < len; i++) {
+        JSONPathNode_Free(&jpns[i]);
+        RedisModule_FreeString(ctx, spaths[i]);
+    }
+    RedisModule_Free(jpns);
+    RedisModule_Free(spaths);
+    return &view->jt;
+}
+
+/**
+* Returns the canonical path in a JSON value of a canonical path in the value or in its view, whose
+* array elements shifted where values are hidden. The path is freed.
+*/
+static sds ViewPath(JSONType_t *jt, sds path) {
+    for (size_t i = 0; i < __nviews; i++) {
+        if (jt != &__views[i]->jt) continue;
+        sds unshifted = Expiry_UnshiftPath(path, __views[i]->hidden, __views[i]->nhidden);
+        sdsfree(path);
+        return unshifted;
+    }
+    return path;
+}
+
+/*
+* Prepares for a command's access to JSON values: frees the values that the server freed in the
+* background and the views of the previous command, and freezes idle ones. Write commands also
+* expire values, which read-only commands can't do as it's a write too (see ViewJSON).
+*/
+static void BeforeCommand(RedisModuleCtx *ctx, int write) {
+    JSONTypeReap();
+    FreeViews();
+    if (write) ExpireDue(ctx);
+    JSONTypeFreezeIdle(JSONTYPE_FREEZE_BATCH);
+}
+
+static void BeforeAccess(RedisModuleCtx *ctx) { BeforeCommand(ctx, 0); }
+
+static void BeforeWrite(RedisModuleCtx *ctx) { BeforeCommand(ctx, 1); }
+
+/**
+* Accesses the JSON value of an open key (see JSONTypeAccess). The value's TTLs are bound to the
+* key's name, which the module otherwise doesn't know after the value is loaded or renamed. Returns
+* the number of TTLs that were parked and are due again.
+*/
+static uint32_t BindJSON(RedisModuleCtx *ctx, JSONType_t *jt, RedisModuleString *name) {
+    if (!jt->expiries) return 0;
+    size_t len;
+    const char *s = RedisModule_StringPtrLen(name, &len);
+    return Expiry_Bind(jt, RedisModule_GetSelectedDb(ctx), s, len);
+}
+
+/**
+* Accesses the JSON value of an open key for a read-only command, see BindJSON. Returns a view of
+* the value if it has TTLs that passed (see ViewJSON).
+*/
+static JSONType_t *AccessJSON(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *name) {
+    JSONType_t *jt = JSONTypeAccess(RedisModule_ModuleTypeGetValue(key));
+    if (!jt) return NULL;
+    BindJSON(ctx, jt, name);
+    return ViewJSON(ctx, jt);
+}
+
+/**
+* Accesses the JSON value of an open key for a write command, see BindJSON. The TTLs that are due
+* again are expired before the command modifies the value.
+*/
+static JSONType_t *AccessJSONForWrite(RedisModuleCtx *ctx, RedisModuleKey *key,
+                                      RedisModuleString *name) {
+    JSONType_t *jt = JSONTypeAccess(RedisModule_ModuleTypeGetValue(key));
+    if (jt && BindJSON(ctx, jt, name)) ExpireDue(ctx);
+    return jt;
+}
 
 // == Module JSON commands ==
 
@@ -177,6 +578,7 @@ int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // key must be empty (reply with null) or a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -192,7 +594,7 @@ int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -220,10 +622,23 @@ int JSONResp_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
  * Supported subcommands are:
  *   `MEMORY <key> [path]` - report the memory usage in bytes of a value. `path` defaults to root if
  *   not provided.
+ *  `COMPRESSION <key> [path]` - report the memory usage of a value, its logical (uncompressed)
+ *   size and the number of its compressed strings
+ *  `PATHCACHE` - report the counters of the path cache
+ *  `SERIALCACHE` - report the counters of the serialized-value cache
+ *  `LOADSTATS` - report the number of keys and nodes loaded from RDB and the time it took
+ *  `LAZYFREE` - report the counters of values freed in the background
+ *  `ASYNCPARSE` - report the counters of payloads parsed in the background
+ *  `FREEZE <key>` - freeze a value, as if it was idle
+ *  `FREEZER` - report the counters of frozen values
  *  `HELP` - replies with a helpful message
  *
  * Reply: depends on the subcommand used:
  *   `MEMORY` returns an integer, specifically the size in bytes of the value
+ *   `COMPRESSION` returns an array of sizes in bytes and the count of strings
+ *   `FREEZE` returns an integer, 1 if the value was frozen and 0 if it already was
+ *   `PATHCACHE`, `SERIALCACHE`, `LOADSTATS`, `LAZYFREE`, `ASYNCPARSE` and `FREEZER` return an
+ *   array of counter names and their integer values
  *   `HELP` returns an array, specifically with the help message
 */
 int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
@@ -236,7 +651,8 @@ int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
 
     size_t subcmdlen;
     const char *subcmd = RedisModule_StringPtrLen(argv[1], &subcmdlen);
-    if (!strncasecmp("memory", subcmd, subcmdlen)) {
+    int compression = !strncasecmp("compression", subcmd, subcmdlen);
+    if (compression || !strncasecmp("memory", subcmd, subcmdlen)) {
         // verify we have enough arguments
         if ((argc < 3) || (argc > 4)) {
             RedisModule_WrongArity(ctx);
@@ -260,27 +676,215 @@ int JSONDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
             return REDISMODULE_ERR;
         }
 
-        // validate path
+        // the value isn't accessed, so measuring a frozen value neither thaws it nor makes it recent
         JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        Node *root = jt->frozen ? JSONTypeDecode(jt) : jt->root;
         JSONPathNode_t jpn;
         RedisModuleString *spath =
             (4 == argc ? argv[3] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
-        if (PARSE_OK != NodeFromJSONPath(jt->root, spath, &jpn)) {
+        int ret = REDISMODULE_OK;
+        if (PARSE_OK != NodeFromJSONPath(root, spath, &jpn)) {
             ReplyWithSearchPathError(ctx, &jpn);
+            if (jt->frozen) Node_Free(root);
             return REDISMODULE_ERR;
         }
 
         if (E_OK == jpn.err) {
-            RedisModule_ReplyWithLongLong(ctx, (long long)ObjectTypeMemoryUsage(jpn.n));
-            JSONPathNode_Free(&jpn);
-            return REDISMODULE_OK;
+            // a frozen value's memory is that of its compressed data, its paths' are as if thawed
+            size_t strings = 0, saved = 0;
+            size_t memory = jt->frozen && SearchPath_IsRootPath(jpn.sp)
+                                ? sizeof(JSONFrozen) + jt->frozen->clen
+                                : ObjectTypeMemoryUsage(jpn.n);
+            if (compression) {
+                Node_CompressionStats(jpn.n, &strings, &saved);
+                size_t logical = jt->frozen ? ObjectTypeMemoryUsage(jpn.n) + saved : memory + saved;
+                RedisModule_ReplyWithArray(ctx, 6);
+                RedisModule_ReplyWithSimpleString(ctx, "memory");
+                RedisModule_ReplyWithLongLong(ctx, memory);
+                RedisModule_ReplyWithSimpleString(ctx, "logical");
+                RedisModule_ReplyWithLongLong(ctx, logical);
+                RedisModule_ReplyWithSimpleString(ctx, "strings");
+                RedisModule_ReplyWithLongLong(ctx, strings);
+            } else {
+                RedisModule_ReplyWithLongLong(ctx, (long long)memory);
+            }
         } else {
             ReplyWithPathError(ctx, &jpn);
-            JSONPathNode_Free(&jpn);
+            ret = REDISMODULE_ERR;
+        }
+        JSONPathNode_Free(&jpn);
+        if (jt->frozen) Node_Free(root);
+        return ret;
+    } else if (!strncasecmp("pathcache", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        PathCacheStats stats;
+        PathCache_GetStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 10);
+        RedisModule_ReplyWithSimpleString(ctx, "hits");
+        RedisModule_ReplyWithLongLong(ctx, stats.hits);
+        RedisModule_ReplyWithSimpleString(ctx, "misses");
+        RedisModule_ReplyWithLongLong(ctx, stats.misses);
+        RedisModule_ReplyWithSimpleString(ctx, "evictions");
+        RedisModule_ReplyWithLongLong(ctx, stats.evictions);
+        RedisModule_ReplyWithSimpleString(ctx, "size");
+        RedisModule_ReplyWithLongLong(ctx, stats.size);
+        RedisModule_ReplyWithSimpleString(ctx, "capacity");
+        RedisModule_ReplyWithLongLong(ctx, stats.capacity);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("serialcache", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        JSONCacheStats stats;
+        JSONCache_GetStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 12);
+        RedisModule_ReplyWithSimpleString(ctx, "hits");
+        RedisModule_ReplyWithLongLong(ctx, stats.hits);
+        RedisModule_ReplyWithSimpleString(ctx, "misses");
+        RedisModule_ReplyWithLongLong(ctx, stats.misses);
+        RedisModule_ReplyWithSimpleString(ctx, "evictions");
+        RedisModule_ReplyWithLongLong(ctx, stats.evictions);
+        RedisModule_ReplyWithSimpleString(ctx, "entries");
+        RedisModule_ReplyWithLongLong(ctx, stats.entries);
+        RedisModule_ReplyWithSimpleString(ctx, "memory");
+        RedisModule_ReplyWithLongLong(ctx, stats.memory);
+        RedisModule_ReplyWithSimpleString(ctx, "maxmemory");
+        RedisModule_ReplyWithLongLong(ctx, stats.maxmemory);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("loadstats", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        ObjectTypeLoadStats stats;
+        ObjectType_GetLoadStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 8);
+        RedisModule_ReplyWithSimpleString(ctx, "keys");
+        RedisModule_ReplyWithLongLong(ctx, stats.keys);
+        RedisModule_ReplyWithSimpleString(ctx, "nodes");
+        RedisModule_ReplyWithLongLong(ctx, stats.nodes);
+        RedisModule_ReplyWithSimpleString(ctx, "usecs");
+        RedisModule_ReplyWithLongLong(ctx, stats.usecs);
+        RedisModule_ReplyWithSimpleString(ctx, "nodes_per_sec");
+        RedisModule_ReplyWithLongLong(ctx, stats.usecs ? stats.nodes * 1000000 / stats.usecs : 0);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("lazyfree", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        LazyFreeStats stats;
+        LazyFree_GetStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 6);
+        RedisModule_ReplyWithSimpleString(ctx, "pending");
+        RedisModule_ReplyWithLongLong(ctx, stats.pending);
+        RedisModule_ReplyWithSimpleString(ctx, "freed");
+        RedisModule_ReplyWithLongLong(ctx, stats.freed);
+        RedisModule_ReplyWithSimpleString(ctx, "threshold");
+        RedisModule_ReplyWithLongLong(ctx, stats.threshold);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("asyncparse", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        AsyncParseStats stats;
+        AsyncParse_GetStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 6);
+        RedisModule_ReplyWithSimpleString(ctx, "pending");
+        RedisModule_ReplyWithLongLong(ctx, stats.pending);
+        RedisModule_ReplyWithSimpleString(ctx, "parsed");
+        RedisModule_ReplyWithLongLong(ctx, stats.parsed);
+        RedisModule_ReplyWithSimpleString(ctx, "threshold");
+        RedisModule_ReplyWithLongLong(ctx, stats.threshold);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("freeze", subcmd, subcmdlen)) {
+        if (argc != 3) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        // reply to getkeys-api requests
+        if (RedisModule_IsKeysPositionRequest(ctx)) {
+            RedisModule_KeyAtPos(ctx, 2);
+            return REDISMODULE_OK;
+        }
+
+        // key must be empty (reply with null) or a JSON type
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ);
+        int type = RedisModule_KeyType(key);
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+
+        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+        RedisModule_ReplyWithLongLong(ctx, OBJ_OK == JSONTypeFreeze(jt));
+        return REDISMODULE_OK;
+    } else if (!strncasecmp("freezer", subcmd, subcmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
             return REDISMODULE_ERR;
         }
+
+        // no keys are involved
+        if (RedisModule_IsKeysPositionRequest(ctx)) return REDISMODULE_OK;
+
+        JSONTypeFreezeStats stats;
+        JSONTypeGetFreezeStats(&stats);
+        RedisModule_ReplyWithArray(ctx, 14);
+        RedisModule_ReplyWithSimpleString(ctx, "frozen");
+        RedisModule_ReplyWithLongLong(ctx, stats.frozen);
+        RedisModule_ReplyWithSimpleString(ctx, "freezes");
+        RedisModule_ReplyWithLongLong(ctx, stats.freezes);
+        RedisModule_ReplyWithSimpleString(ctx, "thaws");
+        RedisModule_ReplyWithLongLong(ctx, stats.thaws);
+        RedisModule_ReplyWithSimpleString(ctx, "memory");
+        RedisModule_ReplyWithLongLong(ctx, stats.memory);
+        RedisModule_ReplyWithSimpleString(ctx, "packed");
+        RedisModule_ReplyWithLongLong(ctx, stats.packed);
+        RedisModule_ReplyWithSimpleString(ctx, "dictionary");
+        RedisModule_ReplyWithLongLong(ctx, stats.dictionary);
+        RedisModule_ReplyWithSimpleString(ctx, "idle_time");
+        RedisModule_ReplyWithLongLong(ctx, JSONTypeGetFreezeIdleTime() / 1000);
+        return REDISMODULE_OK;
     } else if (!strncasecmp("help", subcmd, subcmdlen)) {
         const char *help[] = {"MEMORY <key> [path] - reports memory usage",
+                              "COMPRESSION <key> [path] - reports compressed and logical sizes",
+                              "PATHCACHE           - reports path cache counters",
+                              "SERIALCACHE         - reports serialized-value cache counters",
+                              "LOADSTATS           - reports RDB load counters",
+                              "LAZYFREE            - reports background free counters",
+                              "ASYNCPARSE          - reports background parse counters",
+                              "FREEZE <key>        - freezes a value",
+                              "FREEZER             - reports frozen value counters",
                               "HELP                - this message", NULL};
 
         RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
@@ -311,6 +915,7 @@ int JSONType_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // key must be empty or a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -325,7 +930,7 @@ int JSONType_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -337,6 +942,8 @@ int JSONType_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     // make the type-specifc reply, or deal with path errors
     if (E_OK == jpn.err) {
         RedisModule_ReplyWithSimpleString(ctx, NodeTypeStr(NODETYPE(jpn.n)));
+    } else if (E_MULTI == jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
     } else {
         // reply with null if there are **any** non-existing elements along the path
         RedisModule_ReplyWithNull(ctx);
@@ -363,6 +970,7 @@ int JSONLen_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // the actual command
     const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
@@ -380,7 +988,7 @@ int JSONLen_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -436,6 +1044,7 @@ int JSONObjKeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // key must be empty or a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -450,7 +1059,7 @@ int JSONObjKeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -492,6 +1101,163 @@ error:
     return REDISMODULE_ERR;
 }
 
+/**
+ * JSON.ARRSCAN <key> <path> <cursor> [COUNT count]
+ * JSON.OBJSCAN <key> <path> <cursor> [COUNT count]
+ * Iterate over the elements of the array, or the keys and values of the object, at `path` a batch
+ * at a time.
+ *
+ * A call with a `cursor` of 0 starts an iteration, and every call replies with the cursor for the
+ * next one, which is 0 once the iteration is done. `COUNT` is the maximal number of elements in a
+ * batch, and defaults to JSONSCAN_DEFAULT_COUNT.
+ *
+ * An array's cursor is the index of the next element. An object is iterated from its last entry to
+ * its first, as deleting a key moves the last entry to the deleted one's place, so every key that
+ * is in the object throughout the iteration is returned (possibly more than once).
+ *
+ * Reply: Array, specifically the next cursor as an Integer, and an Array of the batch's elements in
+ * JSON serialized form, or of their keys followed by their serialized values for objects. Null if
+ * either `key` or `path` do not exist.
+*/
+int JSONScan_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 4 && argc != 6) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
+
+    // the actual command
+    const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    NodeType expected = !strcasecmp("json.arrscan", cmd) ? N_ARRAY : N_DICT;
+
+    // the cursor and the count
+    long long cursor, count = JSONSCAN_DEFAULT_COUNT;
+    if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &cursor) || cursor < 0) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_CURSOR_INVALID);
+        return REDISMODULE_ERR;
+    }
+    if (6 == argc && (strcasecmp("count", RedisModule_StringPtrLen(argv[4], NULL)) ||
+                      REDISMODULE_OK != RedisModule_StringToLongLong(argv[5], &count) ||
+                      count < 1)) {
+        RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    // key must be empty (reply with null) or a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // validate path
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
+    JSONPathNode_t jpn;
+    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+
+    // deal with path errors
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        RedisModule_ReplyWithNull(ctx);
+        goto ok;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    }
+    if (NODETYPE(jpn.n) != expected) {
+        ReplyWithPathTypeError(ctx, expected, NODETYPE(jpn.n));
+        goto error;
+    }
+
+    // the batch's entries, [start, end)
+    long long len = Node_Length(jpn.n), start, end, next;
+    if (N_ARRAY == expected) {
+        start = MIN(cursor, len);
+        end = count > len - start ? len : start + count;  // start + count may overflow
+        next = end < len ? end : 0;
+    } else {
+        end = cursor ? MIN(cursor, len) : len;
+        start = MAX(end - count, 0);
+        next = start;
+    }
+
+    JSONSerializeOpt jsopt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    sds json = sdsempty();
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithLongLong(ctx, next);
+    RedisModule_ReplyWithArray(ctx, (end - start) * (N_ARRAY == expected ? 1 : 2));
+    for (long long i = start; i < end; i++) {
+        Node *val;
+        if (N_ARRAY == expected) {
+            val = jpn.n->value.arrval.entries[i];
+        } else {
+            Node *kv = jpn.n->value.dictval.entries[i];
+            const char *k = kv->value.kvval.key;
+            RedisModule_ReplyWithStringBuffer(ctx, k, Intern_Len(k));
+            val = kv->value.kvval.val;
+        }
+        sdsclear(json);
+        SerializeNodeToJSON(val, &jsopt, &json);
+        RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    }
+    sdsfree(json);
+
+ok:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+/**
+ * Checks a value that JSON.SET writes at a path against the key's schema, including the size of
+ * an object that it's added to. Replies with an error and returns REDISMODULE_ERR on violations.
+*/
+static int CheckSchemaSet(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                          const JSONPathNode_t *jpn, const Node *n) {
+    const Schema *s = SchemaOfKey(ctx, keyname);
+    if (!s) return REDISMODULE_OK;
+    sds err = NULL;
+    int rc = OBJ_OK;
+    if (E_NOKEY == jpn->err) {
+        SchemaRef parent = Schema_At(s, jpn->sp, jpn->sp->len - 1);
+        rc = Schema_ValidateLength(s, parent, N_DICT, Node_Length(jpn->p) + 1, jpn->spath, &err);
+    }
+    if (OBJ_OK == rc) {
+        rc = Schema_Validate(s, Schema_At(s, jpn->sp, jpn->sp->len), n, jpn->spath, &err);
+    }
+    return ReplyWithSchemaViolation(ctx, rc, err);
+}
+
+/**
+ * Checks the removal of the value at a path, other than the root, from its parent container against
+ * the key's schema. Replies with an error and returns REDISMODULE_ERR on violations.
+*/
+static int CheckSchemaRemove(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                             const JSONPathNode_t *jpn) {
+    const Schema *s = SchemaOfKey(ctx, keyname);
+    if (!s) return REDISMODULE_OK;
+    sds err = NULL;
+    SchemaRef parent = Schema_At(s, jpn->sp, jpn->sp->len - 1);
+    int rc = N_DICT == NODETYPE(jpn->p)
+                 ? Schema_ValidateRemove(s, parent, jpn->p,
+                                         jpn->sp->nodes[jpn->sp->len - 1].value.key, jpn->spath,
+                                         &err)
+                 : Schema_ValidateLength(s, parent, N_ARRAY, Node_Length(jpn->p) - 1, jpn->spath,
+                                         &err);
+    return ReplyWithSchemaViolation(ctx, rc, err);
+}
+
 /**
  * JSON.SET <key> <path> <json> [NX|XX]
  * Sets the JSON value at `path` in `key`
@@ -509,12 +1275,20 @@ error:
  * conditions were not met.
 */
 int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // a blocked call is called again with the parsed value (see async_parse.h)
+    AsyncParseJob *job = AsyncParse_GetJob(ctx);
+    if (job) {
+        argv = job->argv;
+        argc = job->argc;
+    }
+
     // check args
     if ((argc < 4) || (argc > 5)) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key must be empty or a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -532,10 +1306,31 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         return REDISMODULE_ERR;
     }
 
-    // Create object from json
+    // Create object from json, in an arena of its own
     Object *jo = NULL;
     char *jerr = NULL;
-    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
+    NodeArena *arena;
+    int rc;
+    if (job) {
+        // take the value parsed in the background
+        AsyncParseValue *v = &job->values[0];
+        jo = v->value;
+        arena = v->arena;
+        rc = v->rc;
+        jerr = v->err;
+        v->value = NULL;
+        v->arena = NULL;
+        v->err = NULL;
+    } else if (AsyncParse_Wanted(ctx, jsonlen)) {
+        return AsyncParse_Block(ctx, argv, argc, 3, 4, JSONSet_RedisCommand);
+    } else {
+        arena = NewNodeArena(jsonlen);
+        NodeArena *prev = Node_UseArena(arena);
+        rc = CreateNodeFromJSON(json, jsonlen, &jo, &jerr);
+        Node_UseArena(prev);
+    }
+    if (JSONOBJECT_OK != rc) {
+        NodeArena_Release(arena);
         if (jerr) {
             RedisModule_ReplyWithError(ctx, jerr);
             RedisModule_Free(jerr);
@@ -549,11 +1344,11 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
     // initialize or get JSON type container
     JSONType_t *jt;
     if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        jt = RedisModule_Calloc(1, sizeof(JSONType_t));
-        jt->root = jo;
+        jt = NewJSONType(jo, NULL);
     }
     else {
-        jt = RedisModule_ModuleTypeGetValue(key);
+        jt = AccessJSONForWrite(ctx, key, argv[1]);
+        JSONTypeTouch(jt);
     }
 
     /* Validate path against the existing object root, and pretend that the new object is the root
@@ -565,7 +1360,7 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         ReplyWithSearchPathError(ctx, &jpn);
         goto error;
     }
-    int isRootPath = SearchPath_IsRootPath(&jpn.sp);
+    int isRootPath = SearchPath_IsRootPath(jpn.sp);
 
     // subcommand for key creation behavior modifiers NX and XX
     int subnx = 0, subxx = 0;
@@ -591,7 +1386,10 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
 
         // new keys can be created only if the XX flag is off
         if (subxx) goto null;
+        if (REDISMODULE_OK != CheckSchemaSet(ctx, argv[1], &jpn, jo)) goto error;
 
+        jt->arena = arena;
+        arena = NULL;
         RedisModule_ModuleTypeSetValue(key, JSONType, jt);
         goto ok;
     }
@@ -603,7 +1401,7 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
     }
 
     // verify that we're dealing with the last child in case of an object
-    if (E_NOKEY == jpn.err && jpn.errlevel != jpn.sp.len - 1) {
+    if (E_NOKEY == jpn.err && jpn.errlevel != jpn.sp->len - 1) {
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_PATH_NONTERMINAL_KEY);
         goto error;
     }
@@ -622,22 +1420,31 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
             RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
             goto error;
         }
+        if (REDISMODULE_OK != CheckSchemaSet(ctx, argv[1], &jpn, jo)) goto error;
 
         if (isRootPath) {
             // replacing the root is easy
             RedisModule_DeleteKey(key);
-            jt = RedisModule_Calloc(1, sizeof(JSONType_t));
-            jt->root = jo;
+            jt = NewJSONType(jo, arena);
+            arena = NULL;
             RedisModule_ModuleTypeSetValue(key, JSONType, jt);
         } else if (N_DICT == NODETYPE(jpn.p)) {
-            if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, jo)) {
+            jo = JSONTypeAdopt(jt, jo, arena);
+            arena = NULL;
+            // the key's node is allocated in the value's arena too
+            NodeArena *prev = Node_UseArena(jt->arena);
+            int rc = Node_DictSet(jpn.p, jpn.sp->nodes[jpn.sp->len - 1].value.key, jo);
+            Node_UseArena(prev);
+            if (OBJ_OK != rc) {
                 RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
                 RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
                 goto error;
             }
         } else {  // must be an array
-            int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
+            int index = jpn.sp->nodes[jpn.sp->len - 1].value.index;
             if (index < 0) index = Node_Length(jpn.p) + index;
+            jo = JSONTypeAdopt(jt, jo, arena);
+            arena = NULL;
             if (OBJ_OK != Node_ArraySet(jpn.p, index, jo)) {
                 RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
                 RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_SET);
@@ -646,26 +1453,42 @@ int JSONSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
             // unlike DictSet, ArraySet does not free so we need to call it explicitly
             Node_Free(jpn.n);
         }
+        ClearExpiries(jt, &jpn);
+        JSONTypeCompact(jt);
     } else {  // must be E_NOKEY
         // new keys in the dictionary can be created only if the XX flag is off
         if (subxx) goto null;
-
-        if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, jo)) {
+        if (REDISMODULE_OK != CheckSchemaSet(ctx, argv[1], &jpn, jo)) goto error;
+
+        jo = JSONTypeAdopt(jt, jo, arena);
+        arena = NULL;
+        // the key's node is allocated in the value's arena too
+        NodeArena *prev = Node_UseArena(jt->arena);
+        int rc = Node_DictSet(jpn.p, jpn.sp->nodes[jpn.sp->len - 1].value.key, jo);
+        Node_UseArena(prev);
+        if (OBJ_OK != rc) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
             RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
             goto error;
         }
+        ClearExpiries(jt, &jpn);
     }
 
 ok:
     RedisModule_ReplyWithSimpleString(ctx, "OK");
     JSONPathNode_Free(&jpn);
-    RedisModule_ReplicateVerbatim(ctx);
+    UpdateIndexes(ctx, argv[1], jt);
+    ReplicateCommand(ctx, argv, argc);
     return REDISMODULE_OK;
 
 null:
     RedisModule_ReplyWithNull(ctx);
     JSONPathNode_Free(&jpn);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_Free(jt);
+    }
+    if (arena) NodeArena_Release(arena);
+    else if (jo) Node_Free(jo);
     return REDISMODULE_OK;
 
 error:
@@ -673,13 +1496,27 @@ error:
     if (REDISMODULE_KEYTYPE_EMPTY == type) {
         RedisModule_Free(jt);
     }
-    if (jo) Node_Free(jo);
+    if (arena) NodeArena_Release(arena);
+    else if (jo) Node_Free(jo);
     return REDISMODULE_ERR;
 }
 
+/* The chunks of a JSON.GET CHUNKED reply. */
+typedef struct {
+    RedisModuleCtx *ctx;
+    long long count;
+} _JSONGetChunks;
+
+/* Replies with a chunk of a serialization as it's produced. */
+static void _JSONGetChunk(void *arg, const char *buf, size_t len) {
+    _JSONGetChunks *chunks = arg;
+    RedisModule_ReplyWithStringBuffer(chunks->ctx, buf, len);
+    chunks->count++;
+}
+
 /**
  * JSON.GET <key> [INDENT indentation-string] [NEWLINE newline-string] [SPACE space-string]
- *                [path ...]
+ *                [CHUNKED] [path ...]
  * Return the value at `path` in JSON serialized form.
  *
  * This command accepts multiple `path`s, and defaults to the value's root when none are given.
@@ -689,7 +1526,11 @@ error:
  *   - `NEWLINE` sets the string that's printed at the end of each line
  *   - `SPACE` sets the string that's put between a key and a value
  *
- * Reply: Bulk String, specifically the JSON serialization.
+ * `CHUNKED` replies with the serialization split in chunks of JSONGET_CHUNK_SIZE bytes, which are
+ * replied as they're produced instead of serializing the entire value to a buffer first.
+ *
+ * Reply: Bulk String, specifically the JSON serialization, or an Array of Bulk Strings with
+ * `CHUNKED`, specifically the serialization's chunks.
  * The reply's structure depends on the on the number of paths. A single path results in the value
  * being itself is returned, whereas multiple paths are returned as a JSON object in which each path
  * is a key.
@@ -700,6 +1541,7 @@ int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // key must be empty (reply with null) or an object type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -739,15 +1581,43 @@ int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
             jsopt.spacestr = "";
         }
     }
+    int chunked = 0;
+    if (pathpos < argc && RMUtil_ArgIndex("chunked", &argv[2], argc - 2) >= 0) {
+        chunked = 1;
+        pathpos++;
+    }
+
+    // reply with a cached serialization if the value hadn't changed since
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
+    int npaths = argc - pathpos;
+    size_t cachedlen;
+    sds req = SerialCacheRequest(&jsopt, &argv[pathpos], npaths);
+    const char *cached = JSONCache_Get(jt->version, req, sdslen(req), &cachedlen);
+    if (cached) {
+        if (chunked) {
+            long long nchunks = 0;
+            RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+            for (size_t off = 0; off < cachedlen; off += JSONGET_CHUNK_SIZE, nchunks++) {
+                RedisModule_ReplyWithStringBuffer(ctx, cached + off, MIN(JSONGET_CHUNK_SIZE, cachedlen - off));
+            }
+            RedisModule_ReplySetArrayLength(ctx, nchunks);
+        } else {
+            RedisModule_ReplyWithStringBuffer(ctx, cached, cachedlen);
+        }
+        sdsfree(req);
+        return REDISMODULE_OK;
+    }
 
     // initialize the reply
     sds json = sdsempty();
 
     // validate paths, if none provided default to root
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-    int npaths = argc - pathpos;
     int jpnslen = 0;
     JSONPathNode_t jpns[MAX(npaths, 1)];  // if no paths then the root
+    Node *entries[MAX(npaths, 1)], kvs[MAX(npaths, 1)];  // the reply object's, with multiple paths
+    SearchPathResults results[MAX(npaths, 1)];  // the matches of paths with multiple results
+    Node views[MAX(npaths, 1)];                 // and the arrays that they're replied with
+    memset(results, 0, sizeof(results));
     if (!npaths) {  // default to root
         NodeFromJSONPath(jt->root, RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1), &jpns[0]);
         jpnslen = 1;
@@ -759,9 +1629,20 @@ int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
                 goto error;
             }
 
+            // a path with multiple results is replied with as an array of its matches
+            if (E_MULTI == jpns[jpnslen].err) {
+                SearchPathResults *res = &results[jpnslen];
+                jpns[jpnslen].err =
+                    SearchPath_FindAll(jpns[jpnslen].sp, jt->root, res, &jpns[jpnslen].errlevel);
+                views[jpnslen] = (Node){.type = N_ARRAY,
+                                        .value.arrval = {res->nodes, res->len, res->len}};
+                jpns[jpnslen].n = &views[jpnslen];
+            }
+
             // deal with path errors
             if (E_OK != jpns[jpnslen].err) {
                 ReplyWithPathError(ctx, &jpns[jpnslen]);
+                JSONPathNode_Free(&jpns[jpnslen]);
                 goto error;
             }
 
@@ -770,27 +1651,40 @@ int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
     }
 
     // return the single path's JSON value, or wrap all paths-values as an object
-    if (1 == jpnslen) {
-        SerializeNodeToJSON(jpns[0].n, &jsopt, &json);
-    } else {
-        Node *objReply = NewDictNode(jpnslen);
+    /* The reply object is made of stack nodes that reference the values, rather than with the
+     * Node_Dict functions, as linking the values to another container would change their parent
+     * (see t_sizes). */
+    Node objReply = {.type = N_DICT, .value.dictval = {entries, 0, jpnslen}};
+    t_dict *o = &objReply.value.dictval;
+    Node *target = jpns[0].n;
+    if (jpnslen > 1) {
+        target = &objReply;
         for (int i = 0; i < jpnslen; i++) {
             // add the path to the reply only if it isn't there already
-            Node *target;
-            int ret = Node_DictGet(objReply, jpns[i].spath, &target);
-            if (OBJ_ERR == ret)
-                Node_DictSet(objReply, jpns[i].spath, jpns[i].n);
-        }
-        SerializeNodeToJSON(objReply, &jsopt, &json);
-
-        // avoid removing the actual data by resetting the reply dict
-        // TODO: need a non-freeing Del
-        for (int i = 0; i < objReply->value.dictval.len; i++) {
-            objReply->value.dictval.entries[i]->value.kvval.val = NULL;
+            const char *key = Intern_Acquire(jpns[i].spath, jpns[i].spathlen);
+            int j = 0;
+            while (j < o->len && key != entries[j]->value.kvval.key) j++;
+            if (j < o->len) {
+                Intern_Release(key);
+                continue;
+            }
+            kvs[j] = (Node){.type = N_KEYVAL, .value.kvval = {key, jpns[i].n}};
+            entries[o->len++] = &kvs[j];
         }
-        Node_Free(objReply);
     }
 
+    // a chunked reply is passed on as it's serialized, so it isn't cached
+    if (chunked) {
+        _JSONGetChunks chunks = {ctx, 0};
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        SerializeNodeToJSONChunked(target, &jsopt, JSONGET_CHUNK_SIZE, _JSONGetChunk, &chunks);
+        RedisModule_ReplySetArrayLength(ctx, chunks.count);
+    } else {
+        SerializeNodeToJSON(target, &jsopt, &json);
+    }
+    for (int j = 0; j < o->len; j++) Intern_Release(kvs[j].value.kvval.key);
+    if (chunked) goto ok;
+
     // check whether serialization had succeeded
     if (!sdslen(json)) {
         RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
@@ -799,25 +1693,72 @@ int JSONGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
     }
 
     RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
+    JSONCache_Put(jt->version, req, sdslen(req), json, sdslen(json));
 
+ok:
     for (int i = 0; i < jpnslen; i++) {
         JSONPathNode_Free(&jpns[i]);
+        SearchPathResults_Free(&results[i]);
     }
+    sdsfree(req);
     sdsfree(json);
     return REDISMODULE_OK;
 
 error:
     for (int i = 0; i < jpnslen; i++) {
         JSONPathNode_Free(&jpns[i]);
+        SearchPathResults_Free(&results[i]);
     }
+    sdsfree(req);
     sdsfree(json);
     return REDISMODULE_ERR;
 }
 
+/* A key of a JSON.MGET. */
+typedef struct {
+    JSONType_t *jt;      // the key's value, NULL if it isn't a JSON value
+    const char *cached;  // the cached serialization of the path, if there's one
+    size_t cachedlen;
+    sds json;            // the serialization of the path, NULL if it doesn't exist in the value
+} _JSONMGetKey;
+
+typedef struct {
+    SearchPath *sp;
+    int isRootPath;
+    const JSONSerializeOpt *jsopt;
+    _JSONMGetKey *keys;
+} _JSONMGetCtx;
+
+/* Follows the path in a key's value and serializes its target, runs on the worker threads. */
+static void _JSONMGetSerialize(void *arg, size_t i) {
+    _JSONMGetCtx *mctx = arg;
+    _JSONMGetKey *k = &mctx->keys[i];
+    if (!k->jt || k->cached) return;
+
+    Node *n = k->jt->root, *p, view;
+    SearchPathResults res = {0};
+    int errlevel;
+    if (!mctx->isRootPath) {
+        PathError err = SearchPath_FindEx(mctx->sp, k->jt->root, &n, &p, &errlevel);
+        if (E_MULTI == err) {
+            // replied with as an array of the matches, like JSON.GET does
+            SearchPath_FindAll(mctx->sp, k->jt->root, &res, &errlevel);
+            view = (Node){.type = N_ARRAY, .value.arrval = {res.nodes, res.len, res.len}};
+            n = &view;
+        } else if (E_OK != err) {
+            return;
+        }
+    }
+    k->json = sdsempty();
+    SerializeNodeToJSON(n, mctx->jsopt, &k->json);
+    SearchPathResults_Free(&res);
+}
+
 /**
  * JSON.MGET <key> [<key> ...] <path>
  * Returns the values at `path` from multiple `key`s. Non-existing keys and non-existing paths are
- * reported as null.
+ * reported as null. The values of many keys are serialized on the worker threads, see the
+ * `WORKER_THREADS` module argument.
  * Reply: Array of Bulk Strings, specifically the JSON serialization of the value at each key's
  * path.
 */
@@ -831,71 +1772,70 @@ int JSONMGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
         return REDISMODULE_OK;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // validate search path
     size_t spathlen;
     const char *spath = RedisModule_StringPtrLen(argv[argc-1], &spathlen);
     JSONPathNode_t jpn = { 0 };
     JSONSearchPathError_t jsperr = { 0 };
-    jpn.sp = NewSearchPath(0);
-    if (PARSE_ERR == ParseJSONPath(spath, spathlen, &jpn.sp, &jsperr)) {
+    jpn.sp = PathCache_Acquire(spath, spathlen, &jsperr);
+    if (!jpn.sp) {
         jpn.sperrmsg = jsperr.errmsg;
         jpn.sperroffset = jsperr.offset;
         ReplyWithSearchPathError(ctx, &jpn);
-        goto error;
+        JSONPathNode_Free(&jpn);
+        return REDISMODULE_ERR;
     }
 
-    // iterate keys
-    RedisModule_ReplyWithArray(ctx, argc - 2);
-    int isRootPath = SearchPath_IsRootPath(&jpn.sp);
-    JSONSerializeOpt jsopt = {0};
-    for (int i = 1; i < argc - 1; i++) {
-        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
-
-        // key must an object type, empties and others return null like Redis' MGET
-        int type = RedisModule_KeyType(key);
-        if (REDISMODULE_KEYTYPE_EMPTY == type) goto null;
-        if (RedisModule_ModuleTypeGetType(key) != JSONType) goto null;
-
-        // follow the path to the target node in the key
-        JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
-        if (isRootPath) {
-            jpn.err = E_OK;
-            jpn.n = jt->root;
-        } else {
-            jpn.err = SearchPath_FindEx(&jpn.sp, jt->root, &jpn.n, &jpn.p, &jpn.errlevel);
-        }
-
-        // deal with path errors by returning null
-        if (E_OK != jpn.err) goto null;
+    // open the keys and look up their cached serializations, empties and others reply with null
+    JSONSerializeOpt jsopt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    sds req = SerialCacheRequest(&jsopt, &argv[argc - 1], 1);  // same as JSON.GET's with the path
+    size_t nkeys = argc - 2;
+    _JSONMGetKey *keys = RedisModule_Calloc(nkeys, sizeof(*keys));
+    for (size_t i = 0; i < nkeys; i++) {
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i + 1], REDISMODULE_READ);
+        if (REDISMODULE_KEYTYPE_EMPTY == RedisModule_KeyType(key) ||
+            RedisModule_ModuleTypeGetType(key) != JSONType)
+            continue;
+        keys[i].jt = AccessJSON(ctx, key, argv[i + 1]);
+        keys[i].cached = JSONCache_Get(keys[i].jt->version, req, sdslen(req), &keys[i].cachedlen);
+    }
 
-        // serialize it
-        sds json = sdsempty();
-        SerializeNodeToJSON(jpn.n, &jsopt, &json);
+    // serialize the rest, on the worker threads when there are enough of them
+    _JSONMGetCtx mctx = {jpn.sp, SearchPath_IsRootPath(jpn.sp), &jsopt, keys};
+    if (nkeys >= JSONMGET_PARALLEL_MIN_KEYS) {
+        ThreadPool_Run(_JSONMGetSerialize, &mctx, nkeys);
+    } else {
+        for (size_t i = 0; i < nkeys; i++) _JSONMGetSerialize(&mctx, i);
+    }
 
-        // check whether serialization had succeeded
-        if (!sdslen(json)) {
-            sdsfree(json);
+    // reply in the keys' order, and only then cache the new serializations as that may evict the
+    // cached ones
+    RedisModule_ReplyWithArray(ctx, nkeys);
+    for (size_t i = 0; i < nkeys; i++) {
+        if (keys[i].cached) {
+            RedisModule_ReplyWithStringBuffer(ctx, keys[i].cached, keys[i].cachedlen);
+        } else if (!keys[i].json) {
+            RedisModule_ReplyWithNull(ctx);
+        } else if (!sdslen(keys[i].json)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_SERIALIZE);
             RedisModule_ReplyWithError(ctx, REJSON_ERROR_SERIALIZE);
-            goto error;
+        } else {
+            RedisModule_ReplyWithStringBuffer(ctx, keys[i].json, sdslen(keys[i].json));
         }
-
-        // add the serialization of object for that key's path
-        RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
-        sdsfree(json);
-        continue;
-
-    null:  // reply with null for keys that the path mismatches
-        RedisModule_ReplyWithNull(ctx);
+    }
+    for (size_t i = 0; i < nkeys; i++) {
+        if (!keys[i].json) continue;
+        if (sdslen(keys[i].json))
+            JSONCache_Put(keys[i].jt->version, req, sdslen(req), keys[i].json, sdslen(keys[i].json));
+        sdsfree(keys[i].json);
     }
 
-    SearchPath_Free(&jpn.sp);
+    RedisModule_Free(keys);
+    sdsfree(req);
+    JSONPathNode_Free(&jpn);
     return REDISMODULE_OK;
-
-error:
-    SearchPath_Free(&jpn.sp);
-    return REDISMODULE_ERR;
 }
 
 /**
@@ -914,6 +1854,7 @@ int JSONDel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key must be empty or a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -927,7 +1868,8 @@ int JSONDel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (3 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -946,24 +1888,25 @@ int JSONDel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         goto error;
     }
 
+    // the value must satisfy the key's schema without the target
+    if (!SearchPath_IsRootPath(jpn.sp) && REDISMODULE_OK != CheckSchemaRemove(ctx, argv[1], &jpn)) {
+        goto error;
+    }
+
     // if it is the root then delete the key, otherwise delete the target from parent container
-    if (SearchPath_IsRootPath(&jpn.sp)) {
+    if (SearchPath_IsRootPath(jpn.sp)) {
         RedisModule_DeleteKey(key);
-    } else if (N_DICT == NODETYPE(jpn.p)) {  // delete from a dict
-        const char *dictkey = jpn.sp.nodes[jpn.sp.len - 1].value.key;
-        if (OBJ_OK != Node_DictDel(jpn.p, dictkey)) {
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_DEL);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_DEL);
-            goto error;
-        }
-    } else {  // container must be an array
-        int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
-        if (OBJ_OK != Node_ArrayDelRange(jpn.p, index, 1)) {
-            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_DEL);
-            RedisModule_ReplyWithError(ctx, REJSON_ERROR_ARRAY_DEL);
+    } else {
+        DeleteExpiries(jt, &jpn);
+        const char *err = DeleteFromParent(&jpn);
+        if (err) {
+            RM_LOG_WARNING(ctx, "%s", err);
+            RedisModule_ReplyWithError(ctx, err);
             goto error;
         }
-    }  // if (N_DICT)
+        JSONTypeCompact(jt);
+        UpdateIndexes(ctx, argv[1], jt);
+    }
 
     RedisModule_ReplyWithLongLong(ctx, (long long)argc - 2);
 
@@ -990,6 +1933,7 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
     double oval, bval, rz;  // original value, by value and the result
@@ -1007,7 +1951,8 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (4 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -1068,6 +2013,7 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
 
     // make an object out of the result per its type
     Object *orz;
+    NodeArena *prev = Node_UseArena(jt->arena);
     // the result is an integer only if both values were, and providing an int64 can hold it
     if (N_INTEGER == NODETYPE(jpn.n) && N_INTEGER == NODETYPE(joval) && 
         rz <= (double)INT64_MAX && rz >= (double)INT64_MIN) {
@@ -1075,21 +2021,33 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     } else {
         orz = NewDoubleNode(rz);
     }
+    Node_UseArena(prev);
+
+    // the result must satisfy the key's schema
+    const Schema *schema = SchemaOfKey(ctx, argv[1]);
+    if (schema) {
+        sds err = NULL;
+        int rc = Schema_Validate(schema, Schema_At(schema, jpn.sp, jpn.sp->len), orz, jpn.spath,
+                                 &err);
+        if (REDISMODULE_OK != ReplyWithSchemaViolation(ctx, rc, err)) {
+            Node_Free(orz);
+            goto error;
+        }
+    }
 
     // replace the original value with the result depending on the parent container's type
-    if (SearchPath_IsRootPath(&jpn.sp)) {
-        RedisModule_DeleteKey(key);
-        jt = RedisModule_Calloc(1, sizeof(JSONType_t));
+    if (SearchPath_IsRootPath(jpn.sp)) {
+        // the result is in the value's arena, so the root is replaced in place
+        Node_Free(jt->root);
         jt->root = orz;
-        RedisModule_ModuleTypeSetValue(key, JSONType, jt);
     } else if (N_DICT == NODETYPE(jpn.p)) {
-        if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp.nodes[jpn.sp.len - 1].value.key, orz)) {
+        if (OBJ_OK != Node_DictSet(jpn.p, jpn.sp->nodes[jpn.sp->len - 1].value.key, orz)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_DICT_SET);
             RedisModule_ReplyWithError(ctx, REJSON_ERROR_DICT_SET);
             goto error;
         }
     } else {  // container must be an array
-        int index = jpn.sp.nodes[jpn.sp.len - 1].value.index;
+        int index = jpn.sp->nodes[jpn.sp->len - 1].value.index;
         if (index < 0) index = Node_Length(jpn.p) + index;
         if (OBJ_OK != Node_ArraySet(jpn.p, index, orz)) {
             RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_ARRAY_SET);
@@ -1107,10 +2065,12 @@ int JSONNum_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     SerializeNodeToJSON(jpn.n, &jsopt, &json);
     RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
     sdsfree(json);
+    JSONTypeCompact(jt);
 
     Node_Free(joval);
     JSONPathNode_Free(&jpn);
 
+    UpdateIndexes(ctx, argv[1], jt);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
 
@@ -1133,6 +2093,7 @@ int JSONStrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -1143,7 +2104,8 @@ int JSONStrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (4 == argc ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -1189,16 +2151,40 @@ int JSONStrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     // the value must be a string
     if (N_STRING != NODETYPE(jo)) {
         sds err = sdscatfmt(sdsempty(), "ERR wrong type of value - expected %s but found %s",
-                            NodeTypeStr(N_STRING), NodeTypeStr(NODETYPE(jpn.n)));
+                            NodeTypeStr(N_STRING), NodeTypeStr(NODETYPE(jo)));
         RedisModule_ReplyWithError(ctx, err);
         sdsfree(err);
+        Node_Free(jo);
+        goto error;
     }
 
-    // actually concatenate the strings
+    // the concatenation must satisfy the key's schema
+    const Schema *schema = SchemaOfKey(ctx, argv[1]);
+    if (schema) {
+        sds err = NULL;
+        char *dbuf, *sbuf;
+        size_t len = Schema_StringLength(Node_StringData(jpn.n, &dbuf), jpn.n->value.strval.len) +
+                     Schema_StringLength(Node_StringData(jo, &sbuf), jo->value.strval.len);
+        Node_StringRelease(dbuf);
+        Node_StringRelease(sbuf);
+        int rc = Schema_ValidateLength(schema, Schema_At(schema, jpn.sp, jpn.sp->len), N_STRING,
+                                       len, jpn.spath, &err);
+        if (REDISMODULE_OK != ReplyWithSchemaViolation(ctx, rc, err)) {
+            Node_Free(jo);
+            goto error;
+        }
+    }
+
+    // actually concatenate the strings, which may change how well the result compresses
+    size_t before = Node_MemoryUsage(jpn.n);
     Node_StringAppend(jpn.n, jo);
+    Node_Free(jo);
+    Node_ChildResized(jpn.p, (int64_t)Node_MemoryUsage(jpn.n) - (int64_t)before);
     RedisModule_ReplyWithLongLong(ctx, (long long)Node_Length(jpn.n));
+    JSONTypeCompact(jt);
     JSONPathNode_Free(&jpn);
     
+    UpdateIndexes(ctx, argv[1], jt);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
 
@@ -1207,6 +2193,31 @@ error:
     return REDISMODULE_ERR;
 }
 
+/**
+ * Checks the elements that are inserted at an index of the array at a path against the key's
+ * schema. Replies with an error and returns REDISMODULE_ERR on violations.
+*/
+static int CheckSchemaInsert(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                             const JSONPathNode_t *jpn, const Node *sub, long long index) {
+    const Schema *s = SchemaOfKey(ctx, keyname);
+    if (!s) return REDISMODULE_OK;
+    sds err = NULL;
+    int rc = Schema_ValidateInsert(s, Schema_At(s, jpn->sp, jpn->sp->len), jpn->n, sub,
+                                   (size_t)index, jpn->spath, &err);
+    return ReplyWithSchemaViolation(ctx, rc, err);
+}
+
+/* Checks the new length of the array at a path against the key's schema, like CheckSchemaInsert. */
+static int CheckSchemaArrayLength(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                                  const JSONPathNode_t *jpn, long long len) {
+    const Schema *s = SchemaOfKey(ctx, keyname);
+    if (!s) return REDISMODULE_OK;
+    sds err = NULL;
+    int rc = Schema_ValidateLength(s, Schema_At(s, jpn->sp, jpn->sp->len), N_ARRAY, (size_t)len,
+                                   jpn->spath, &err);
+    return ReplyWithSchemaViolation(ctx, rc, err);
+}
+
 /**
  * JSON.ARRINSERT <key> <path> <index> <json> [<json> ...]
  * Insert the `json` value(s) into the array at `path` before the `index` (shifts to the right).
@@ -1223,6 +2234,7 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -1233,7 +2245,8 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
@@ -1280,10 +2293,13 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
             goto error;
         }
 
-        // create object from json
+        // create object from json, in the value's arena
         Object *jo = NULL;
         char *jerr = NULL;
-        if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
+        NodeArena *prev = Node_UseArena(jt->arena);
+        int rc = CreateNodeFromJSON(json, jsonlen, &jo, &jerr);
+        Node_UseArena(prev);
+        if (JSONOBJECT_OK != rc) {
             Node_Free(sub);
             if (jerr) {
                 RedisModule_ReplyWithError(ctx, jerr);
@@ -1305,6 +2321,12 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         }
     }
 
+    // the new elements must satisfy the key's schema
+    if (REDISMODULE_OK != CheckSchemaInsert(ctx, argv[1], &jpn, sub, index)) {
+        Node_Free(sub);
+        goto error;
+    }
+
     // insert the sub array to the target array
     if (OBJ_OK != Node_ArrayInsert(jpn.n, index, sub)) {
         Node_Free(sub);
@@ -1312,10 +2334,12 @@ int JSONArrInsert_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         RedisModule_ReplyWithError(ctx, REJSON_ERROR_INSERT);
         goto error;
     }
+    SpliceExpiries(jt, jpn.sp, index, 0, argc - 4);
 
     RedisModule_ReplyWithLongLong(ctx, Node_Length(jpn.n));
     JSONPathNode_Free(&jpn);
 
+    UpdateIndexes(ctx, argv[1], jt);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
 
@@ -1329,12 +2353,20 @@ error:
  * Reply: Integer, specifically the array's new size
 */
 int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // a blocked call is called again with the parsed values (see async_parse.h)
+    AsyncParseJob *job = AsyncParse_GetJob(ctx);
+    if (job) {
+        argv = job->argv;
+        argc = job->argc;
+    }
+
     // check args
     if (argc < 4) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -1344,8 +2376,22 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_ERR;
     }
 
+    // large payloads are parsed in the background
+    if (!job) {
+        size_t total = 0;
+        for (int i = 3; i < argc; i++) {
+            size_t jsonlen;
+            RedisModule_StringPtrLen(argv[i], &jsonlen);
+            total += jsonlen;
+        }
+        if (AsyncParse_Wanted(ctx, total)) {
+            return AsyncParse_Block(ctx, argv, argc, 3, argc, JSONArrAppend_RedisCommand);
+        }
+    }
+
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
@@ -1376,10 +2422,25 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
             goto error;
         }
 
-        // create object from json
+        // create object from json, in the value's arena
         Object *jo = NULL;
         char *jerr = NULL;
-        if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
+        int rc;
+        if (job) {
+            // take the value parsed in the background
+            AsyncParseValue *v = &job->values[i - 3];
+            rc = v->rc;
+            jerr = v->err;
+            v->err = NULL;
+            if (JSONOBJECT_OK == rc) jo = JSONTypeAdopt(jt, v->value, v->arena);
+            v->value = NULL;
+            v->arena = NULL;
+        } else {
+            NodeArena *prev = Node_UseArena(jt->arena);
+            rc = CreateNodeFromJSON(json, jsonlen, &jo, &jerr);
+            Node_UseArena(prev);
+        }
+        if (JSONOBJECT_OK != rc) {
             Node_Free(sub);
             if (jerr) {
                 RedisModule_ReplyWithError(ctx, jerr);
@@ -1401,6 +2462,12 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         }
     }
 
+    // the new elements must satisfy the key's schema
+    if (REDISMODULE_OK != CheckSchemaInsert(ctx, argv[1], &jpn, sub, Node_Length(jpn.n))) {
+        Node_Free(sub);
+        goto error;
+    }
+
     // insert the sub array to the target array
     if (OBJ_OK != Node_ArrayInsert(jpn.n, Node_Length(jpn.n), sub)) {
         Node_Free(sub);
@@ -1412,7 +2479,8 @@ int JSONArrAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     RedisModule_ReplyWithLongLong(ctx, Node_Length(jpn.n));
     JSONPathNode_Free(&jpn);
 
-    RedisModule_ReplicateVerbatim(ctx);
+    UpdateIndexes(ctx, argv[1], jt);
+    ReplicateCommand(ctx, argv, argc);
     return REDISMODULE_OK;
 
 error:
@@ -1439,6 +2507,7 @@ int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -1449,7 +2518,7 @@ int JSONArrIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
     JSONPathNode_t jpn;
     if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
@@ -1532,6 +2601,7 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -1542,7 +2612,8 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     RedisModuleString *spath =
         (argc > 2 ? argv[2] : RedisModule_CreateString(ctx, OBJECT_ROOT_PATH, 1));
@@ -1582,6 +2653,9 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
     if (index < 0) index = 0;
     if (index >= len) index = len - 1;
 
+    // the array must satisfy the key's schema without the item
+    if (REDISMODULE_OK != CheckSchemaArrayLength(ctx, argv[1], &jpn, len - 1)) goto error;
+
     // get and serialize the popped array item
     JSONSerializeOpt jsopt = {0};
     sds json = sdsempty();
@@ -1597,15 +2671,18 @@ int JSONArrPop_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
         goto error;
     }
 
-    // delete the item from the array
+    // delete the item from the array, and its TTLs
+    SpliceExpiries(jt, jpn.sp, index, 1, 0);
     Node_ArrayDelRange(jpn.n, index, 1);
 
     // reply with the serialization
     RedisModule_ReplyWithStringBuffer(ctx, json, sdslen(json));
     sdsfree(json);
+    JSONTypeCompact(jt);
 
 ok:
     JSONPathNode_Free(&jpn);
+    UpdateIndexes(ctx, argv[1], jt);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
 
@@ -1632,6 +2709,7 @@ int JSONArrTrim_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return REDISMODULE_ERR;
     }
     RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
 
     // key can't be empty and must be a JSON type
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
@@ -1642,7 +2720,8 @@ int JSONArrTrim_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     // validate path
-    JSONType_t *jt = RedisModule_ModuleTypeGetValue(key);
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONTypeTouch(jt);
     JSONPathNode_t jpn;
     if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
         ReplyWithSearchPathError(ctx, &jpn);
@@ -1687,13 +2766,22 @@ int JSONArrTrim_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
         right = len - stop - 1;
     }
 
-    // trim the array
+    // the trimmed array must satisfy the key's schema
+    if (REDISMODULE_OK != CheckSchemaArrayLength(ctx, argv[1], &jpn, len - left - right)) {
+        goto error;
+    }
+
+    // trim the array, and the TTLs of its elements
+    SpliceExpiries(jt, jpn.sp, len - right, right, 0);
+    SpliceExpiries(jt, jpn.sp, 0, left, 0);
     Node_ArrayDelRange(jpn.n, 0, left);
     Node_ArrayDelRange(jpn.n, -right, right);
 
     RedisModule_ReplyWithLongLong(ctx, (long long)Node_Length(jpn.n));
+    JSONTypeCompact(jt);
     JSONPathNode_Free(&jpn);
     
+    UpdateIndexes(ctx, argv[1], jt);
     RedisModule_ReplicateVerbatim(ctx);
     return REDISMODULE_OK;
 
@@ -1702,11 +2790,615 @@ error:
     return REDISMODULE_ERR;
 }
 
-int RedisModule_OnLoad(RedisModuleCtx *ctx) {
+static void _BuildIndex(void *arg, int db, RedisModuleString *name, JSONType_t *jt) {
+    size_t len;
+    const char *key = RedisModule_StringPtrLen(name, &len);
+    SIndex_AddDoc(arg, key, len, jt);
+}
+
+/* Indexes the existing JSON keys that an index covers, scanning its database. */
+static void BuildIndex(RedisModuleCtx *ctx, SIndex *ix) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    RedisModule_SelectDb(ctx, ix->db);
+
+    // match the prefix literally
+    sds pattern = sdsempty();
+    for (size_t i = 0; i < sdslen(ix->prefix); i++) {
+        if (strchr("*?[]\\", ix->prefix[i])) pattern = sdscatlen(pattern, "\\", 1);
+        pattern = sdscatlen(pattern, &ix->prefix[i], 1);
+    }
+    pattern = sdscatlen(pattern, "*", 1);
+    ScanJSONKeys(ctx, pattern, sdslen(pattern), _BuildIndex, ix);
+
+    sdsfree(pattern);
+    RedisModule_SelectDb(ctx, db);
+    ix->built = 1;
+}
+
+/**
+ * JSON.INDEX CREATE <index> <prefix> <path> NUMERIC|TAG
+ * JSON.INDEX DROP <index>
+ * JSON.INDEX INFO <index>
+ * Manage a secondary index of the values at `path` in the JSON keys whose names start with `prefix`
+ * in the current database. The index is stored in the key `index`, and is kept up to date by the
+ * commands that modify JSON values.
+ *
+ * A NUMERIC index keeps integers and numbers, and a TAG index keeps strings, including those in
+ * arrays. Every value that `path` matches is indexed. Only an index's definition is persisted, an
+ * index is built again on its first use after it's loaded.
+ *
+ * Reply: Simple String `OK` for CREATE, Integer 1 for DROP or 0 if `index` doesn't exist, and for
+ * INFO an Array of field names and values, or Null if `index` doesn't exist.
+*/
+int JSONIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc < 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // the key must be empty or an index
+    const char *subcmd = RedisModule_StringPtrLen(argv[1], NULL);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != SIndexType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (!strcasecmp("create", subcmd)) {
+        if (6 != argc) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_ERR;
+        }
+        if (REDISMODULE_KEYTYPE_EMPTY != type) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_SINDEX_EXISTS);
+            return REDISMODULE_ERR;
+        }
+        size_t prefixlen, pathlen, kindlen;
+        const char *prefix = RedisModule_StringPtrLen(argv[3], &prefixlen);
+        const char *path = RedisModule_StringPtrLen(argv[4], &pathlen);
+        const char *skind = RedisModule_StringPtrLen(argv[5], &kindlen);
+        SIndexKind kind;
+        if (OBJ_OK != SIndex_ParseKind(skind, kindlen, &kind)) {
+            RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+
+        JSONSearchPathError_t jsperr = { 0 };
+        SIndex *ix = NewSIndex(prefix, prefixlen, path, pathlen, kind,
+                               RedisModule_GetSelectedDb(ctx), &jsperr);
+        if (!ix) {
+            JSONPathNode_t jpn = {.sperrmsg = jsperr.errmsg, .sperroffset = jsperr.offset};
+            ReplyWithSearchPathError(ctx, &jpn);
+            return REDISMODULE_ERR;
+        }
+        BuildIndex(ctx, ix);
+        RedisModule_ModuleTypeSetValue(key, SIndexType, ix);
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        RedisModule_ReplicateVerbatim(ctx);
+        return REDISMODULE_OK;
+    }
+
+    if (3 != argc) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+
+    if (!strcasecmp("drop", subcmd)) {
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithLongLong(ctx, 0);
+            return REDISMODULE_OK;
+        }
+        RedisModule_DeleteKey(key);
+        RedisModule_ReplyWithLongLong(ctx, 1);
+        RedisModule_ReplicateVerbatim(ctx);
+        return REDISMODULE_OK;
+    }
+
+    if (!strcasecmp("info", subcmd)) {
+        if (REDISMODULE_KEYTYPE_EMPTY == type) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        }
+        SIndex *ix = RedisModule_ModuleTypeGetValue(key);
+        if (!ix->built) BuildIndex(ctx, ix);
+        RedisModule_ReplyWithArray(ctx, 10);
+        RedisModule_ReplyWithSimpleString(ctx, "prefix");
+        RedisModule_ReplyWithStringBuffer(ctx, ix->prefix, sdslen(ix->prefix));
+        RedisModule_ReplyWithSimpleString(ctx, "path");
+        RedisModule_ReplyWithStringBuffer(ctx, ix->path, sdslen(ix->path));
+        RedisModule_ReplyWithSimpleString(ctx, "type");
+        RedisModule_ReplyWithSimpleString(ctx, SIndex_KindStr(ix->kind));
+        RedisModule_ReplyWithSimpleString(ctx, "docs");
+        RedisModule_ReplyWithLongLong(ctx, (long long)ix->ndocs);
+        RedisModule_ReplyWithSimpleString(ctx, "entries");
+        RedisModule_ReplyWithLongLong(ctx, (long long)ix->nentries);
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+    return REDISMODULE_ERR;
+}
+
+/* Parses a bound of a numeric query, which is exclusive when prefixed by '('. */
+static int ParseIndexBound(RedisModuleString *s, double *val, int *exclusive) {
+    size_t len;
+    const char *p = RedisModule_StringPtrLen(s, &len);
+    *exclusive = (len && '(' == *p);
+    sds buf = sdsnewlen(p + *exclusive, len - *exclusive);
+    char *end;
+    *val = strtod(buf, &end);
+    int ok = sdslen(buf) && end == buf + sdslen(buf) && !isnan(*val);
+    sdsfree(buf);
+    return ok ? REDISMODULE_OK : REDISMODULE_ERR;
+}
+
+/* The state of a JSON.QUERY reply. */
+typedef struct {
+    RedisModuleCtx *ctx;
+    long long offset;
+    long long count;  // the maximal number of keys in the reply, negative for no limit
+    long long len;
+    SIndexQuery query;  // matched again against the documents whose TTLs passed
+} _JSONQueryReply;
+
+/* Replies with the key name of a document that a query matched. */
+static int _JSONQueryReplyDoc(void *arg, const SIndexDoc *doc) {
+    _JSONQueryReply *q = (_JSONQueryReply *)arg;
+
+    // the name is stale if the value was renamed
+    RedisModuleString *name = RedisModule_CreateString(q->ctx, doc->key, sdslen(doc->key));
+    RedisModuleKey *key = RedisModule_OpenKey(q->ctx, name, REDISMODULE_READ);
+    int valid = JSONType == RedisModule_ModuleTypeGetType(key) &&
+                doc->jt == RedisModule_ModuleTypeGetValue(key);
+    RedisModule_CloseKey(key);
+
+    // the index still has the values whose TTLs passed until they're expired
+    if (valid && doc->jt->expiries) {
+        JSONType_t *view = ViewJSON(q->ctx, doc->jt);
+        if (view != doc->jt) valid = SIndex_QueryMatches(doc->ix, &q->query, view->root);
+    }
+
+    if (valid && q->offset) {
+        q->offset--;
+    } else if (valid) {
+        RedisModule_ReplyWithString(q->ctx, name);
+        q->len++;
+    }
+    RedisModule_FreeString(q->ctx, name);
+    return q->count < 0 || q->len < q->count;
+}
+
+/**
+ * JSON.QUERY <index> <min> <max> [LIMIT offset count]
+ * JSON.QUERY <index> <tag> [LIMIT offset count]
+ * Query a secondary index (see JSON.INDEX) for the keys with values between `min` and `max` in a
+ * NUMERIC index, or equal to `tag` in a TAG index.
+ *
+ * The bounds are inclusive unless prefixed by `(`, and can be `-inf` and `+inf`. Keys are ordered
+ * by their first matching value, then by name. `LIMIT` skips `offset` keys and replies with
+ * `count` keys at most.
+ *
+ * Reply: Array of key names, or Null if `index` doesn't exist.
+*/
+int JSONQuery_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc < 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
+
+    // key must be empty (reply with null) or an index
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != SIndexType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+    SIndex *ix = RedisModule_ModuleTypeGetValue(key);
+
+    // the value arguments and the limit
+    int nvals = SINDEX_NUMERIC == ix->kind ? 2 : 1;
+    _JSONQueryReply q = {.ctx = ctx, .offset = 0, .count = -1, .len = 0};
+    if (argc != 2 + nvals && argc != 5 + nvals) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    if (argc == 5 + nvals &&
+        (strcasecmp("limit", RedisModule_StringPtrLen(argv[2 + nvals], NULL)) ||
+         REDISMODULE_OK != RedisModule_StringToLongLong(argv[3 + nvals], &q.offset) ||
+         REDISMODULE_OK != RedisModule_StringToLongLong(argv[4 + nvals], &q.count) ||
+         q.offset < 0)) {
+        RedisModule_ReplyWithError(ctx, RM_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    SIndexQuery *iq = &q.query;
+    if (SINDEX_NUMERIC == ix->kind &&
+        (REDISMODULE_OK != ParseIndexBound(argv[2], &iq->min, &iq->minex) ||
+         REDISMODULE_OK != ParseIndexBound(argv[3], &iq->max, &iq->maxex))) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_SINDEX_BOUND);
+        return REDISMODULE_ERR;
+    }
+
+    if (!ix->built) BuildIndex(ctx, ix);
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    if (q.count) {
+        if (SINDEX_NUMERIC == ix->kind) {
+            SIndex_QueryRange(ix, iq->min, iq->minex, iq->max, iq->maxex, _JSONQueryReplyDoc, &q);
+        } else {
+            iq->tag = RedisModule_StringPtrLen(argv[2], &iq->len);
+            SIndex_QueryTag(ix, iq->tag, iq->len, _JSONQueryReplyDoc, &q);
+        }
+    }
+    RedisModule_ReplySetArrayLength(ctx, q.len);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.SETSCHEMA <schema> <prefix> <json>
+ * Set the JSON Schema `json` of the JSON keys whose names start with `prefix`, in the current
+ * database. The schema is stored in the key `schema`, replacing the one it has, and is dropped with
+ * DEL.
+ *
+ * The schema is compiled once (see schema.h for the supported subset), and the commands that write
+ * to a key check the values they write against it. Writes that violate it fail, but existing values
+ * aren't validated. A key's schema is the one with the longest matching prefix.
+ *
+ * Reply: Simple String `OK` if executed correctly.
+*/
+int JSONSetSchema_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 4) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be empty or a schema
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != SchemaType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    size_t prefixlen, jsonlen;
+    const char *prefix = RedisModule_StringPtrLen(argv[2], &prefixlen);
+    const char *json = RedisModule_StringPtrLen(argv[3], &jsonlen);
+    sds err = NULL;
+    KeySchema *ks =
+        NewKeySchema(prefix, prefixlen, json, jsonlen, RedisModule_GetSelectedDb(ctx), &err);
+    if (!ks) {
+        sds msg = sdscatfmt(sdsempty(), REJSON_ERROR_SCHEMA_INVALID, err);
+        RedisModule_ReplyWithError(ctx, msg);
+        sdsfree(msg);
+        sdsfree(err);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModule_ModuleTypeSetValue(key, SchemaType, ks);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    RedisModule_ReplicateVerbatim(ctx);
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.VALIDATE <schema> <json>
+ * Validate `json` against the schema in the key `schema` (see JSON.SETSCHEMA), without writing it.
+ *
+ * Reply: Simple String `OK` if `json` is valid, or an error that describes the violation.
+*/
+int JSONValidate_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // key must be a schema
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_KEY_REQUIRED);
+        return REDISMODULE_ERR;
+    } else if (RedisModule_ModuleTypeGetType(key) != SchemaType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+    const Schema *schema = ((KeySchema *)RedisModule_ModuleTypeGetValue(key))->schema;
+
+    // JSON must be valid
+    size_t jsonlen;
+    const char *json = RedisModule_StringPtrLen(argv[2], &jsonlen);
+    if (!jsonlen) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EMPTY_STRING);
+        return REDISMODULE_ERR;
+    }
+    Node *jo = NULL;
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &jo, &jerr)) {
+        if (jerr) {
+            RedisModule_ReplyWithError(ctx, jerr);
+            RedisModule_Free(jerr);
+        } else {
+            RM_LOG_WARNING(ctx, "%s", REJSON_ERROR_JSONOBJECT_ERROR);
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_JSONOBJECT_ERROR);
+        }
+        return REDISMODULE_ERR;
+    }
+
+    sds err = NULL;
+    int rc = Schema_Validate(schema, Schema_Root(schema), jo, OBJECT_ROOT_PATH, &err);
+    Node_Free(jo);
+    if (REDISMODULE_OK != ReplyWithSchemaViolation(ctx, rc, err)) return REDISMODULE_ERR;
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/**
+ * JSON.EXPIRE <key> <path> <ttl>
+ * Set a timeout of `ttl` seconds on the value at `path`, other than the root, after which the value
+ * is deleted from its container. Setting it again replaces the timeout.
+ *
+ * The timeout is cleared when the value, or one of its ancestors, is replaced by JSON.SET or
+ * deleted by JSON.DEL. Other modifications keep it. Timeouts belong to paths, so after array
+ * elements shift an index's timeout applies to the element at that index. Expired values are
+ * deleted with JSON.DEL commands that are replicated, and replicas wait for them rather than expire
+ * values themselves.
+ *
+ * Reply: Integer, specifically 1 if the timeout was set, and 0 if `key` or `path` don't exist.
+ *
+ * JSON.PEXPIREAT <key> <path> <timestamp>
+ * Like JSON.EXPIRE, with the Unix time in milliseconds at which the value expires. JSON.EXPIRE is
+ * replicated, and rewritten to the AOF, as JSON.PEXPIREAT, so that timeouts don't restart when
+ * they're replayed.
+*/
+int JSONExpire_GenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 4) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+    BeforeWrite(ctx);
+
+    // the expiry time is absolute or relative to now
+    const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    long long t;
+    uint64_t when;
+    if (!strcasecmp("json.pexpireat", cmd)) {
+        if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &t) || t <= 0) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_TIME);
+            return REDISMODULE_ERR;
+        }
+        when = (uint64_t)t;
+    } else {
+        if (REDISMODULE_OK != RedisModule_StringToLongLong(argv[3], &t) || t <= 0 ||
+            t > (long long)(EXPIRY_WHEEL_SPAN / 1000)) {
+            RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_TTL);
+            return REDISMODULE_ERR;
+        }
+        when = (uint64_t)RedisModule_Milliseconds() + (uint64_t)t * 1000;
+    }
+
+    // key must be a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // validate path
+    JSONType_t *jt = AccessJSONForWrite(ctx, key, argv[1]);
+    JSONPathNode_t jpn;
+    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+    sds path = NULL;
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        goto ok;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        goto error;
+    } else if (SearchPath_IsRootPath(jpn.sp)) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_ROOT);
+        goto error;
+    }
+    path = Expiry_FormatPath(jpn.sp, jt->root);
+    if (!path) {
+        RedisModule_ReplyWithError(ctx, REJSON_ERROR_EXPIRE_PATH);
+        goto error;
+    }
+
+    // the value must be removable according to the key's schema
+    if (REDISMODULE_OK != CheckSchemaRemove(ctx, argv[1], &jpn)) goto error;
+
+    size_t len;
+    const char *keyname = RedisModule_StringPtrLen(argv[1], &len);
+    Expiry_Set(jt, RedisModule_GetSelectedDb(ctx), keyname, len, path, sdslen(path), when);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModule_Replicate(ctx, "JSON.PEXPIREAT", "sbl", argv[1], path, sdslen(path),
+                          (long long)when);
+
+ok:
+    sdsfree(path);
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+
+error:
+    sdsfree(path);
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_ERR;
+}
+
+/**
+ * JSON.TTL <key> <path>
+ * Report the remaining time in seconds until the value at `path` expires (see JSON.EXPIRE).
+ *
+ * Reply: Integer, specifically the remaining time, -1 if the value has no timeout, and -2 if `key`
+ * or `path` don't exist.
+*/
+int JSONTtl_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // check args
+    if (argc != 3) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_AutoMemory(ctx);
+    BeforeAccess(ctx);
+
+    // key must be a JSON type
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
+        RedisModule_ReplyWithLongLong(ctx, -2);
+        return REDISMODULE_OK;
+    } else if (RedisModule_ModuleTypeGetType(key) != JSONType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    // validate path
+    JSONType_t *jt = AccessJSON(ctx, key, argv[1]);
+    JSONPathNode_t jpn;
+    if (PARSE_OK != NodeFromJSONPath(jt->root, argv[2], &jpn)) {
+        ReplyWithSearchPathError(ctx, &jpn);
+        return REDISMODULE_ERR;
+    }
+    if (E_NOINDEX == jpn.err || E_NOKEY == jpn.err) {
+        RedisModule_ReplyWithLongLong(ctx, -2);
+        goto ok;
+    } else if (E_OK != jpn.err) {
+        ReplyWithPathError(ctx, &jpn);
+        JSONPathNode_Free(&jpn);
+        return REDISMODULE_ERR;
+    }
+
+    // the remaining time is rounded like TTL's
+    uint64_t when = 0;
+    sds path = jt->expiries ? Expiry_FormatPath(jpn.sp, jt->root) : NULL;
+    if (path) {
+        path = ViewPath(jt, path);
+        when = Expiry_Get(jt, path);
+    }
+    sdsfree(path);
+    uint64_t now = (uint64_t)RedisModule_Milliseconds();
+    RedisModule_ReplyWithLongLong(ctx, !when ? -1 : when > now ? (when - now + 500) / 1000 : 0);
+
+ok:
+    JSONPathNode_Free(&jpn);
+    return REDISMODULE_OK;
+}
+
+/* Gets the value of an optional integer module argument that follows its name, e.g.:
+ *   loadmodule rejson.so DICT_INDEX_THRESHOLD 64
+ * `val` is left untouched when the argument isn't given. Returns REDISMODULE_ERR if the value is
+ * missing or isn't in the [min, max] range.
+*/
+static int GetModuleArgLongLong(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+                                const char *name, long long min, long long max, long long *val) {
+    if (RMUtil_ArgIndex(name, argv, argc) < 0) return REDISMODULE_OK;
+
+    long long lval;
+    if (REDISMODULE_OK != RMUtil_ParseArgsAfter(name, argv, argc, "l", &lval) || lval < min ||
+        lval > max) {
+        RM_LOG_WARNING(ctx, REJSON_ERROR_MODULE_ARG, name, min, max);
+        return REDISMODULE_ERR;
+    }
+
+    *val = lval;
+    return REDISMODULE_OK;
+}
+
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     // Register the module
     if (RedisModule_Init(ctx, RLMODULE_NAME, 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    // values that the server frees in the background are reaped by this thread
+    JSONTypeSetMainThread();
+
+    // Module arguments
+    long long dictIndexThreshold = Node_DictGetIndexThreshold();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "DICT_INDEX_THRESHOLD", 0,
+                                               UINT32_MAX, &dictIndexThreshold))
+        return REDISMODULE_ERR;
+    Node_DictSetIndexThreshold((uint32_t)dictIndexThreshold);
+    long long arenaChunkSize = NodeArena_GetChunkSize();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "ARENA_CHUNK_SIZE", 0,
+                                               NODE_ARENA_MAX_CHUNK_SIZE, &arenaChunkSize))
+        return REDISMODULE_ERR;
+    NodeArena_SetChunkSize((size_t)arenaChunkSize);
+    long long indexedParser = JSONOBJECT_PARSER_INDEXED == GetJSONParser();
+    if (REDISMODULE_OK !=
+        GetModuleArgLongLong(ctx, argv, argc, "INDEXED_PARSER", 0, 1, &indexedParser))
+        return REDISMODULE_ERR;
+    SetJSONParser(indexedParser ? JSONOBJECT_PARSER_INDEXED : JSONOBJECT_PARSER_JSONSL);
+    long long pathCacheSize = PathCache_GetCapacity();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "PATH_CACHE_SIZE", 0, UINT32_MAX,
+                                               &pathCacheSize))
+        return REDISMODULE_ERR;
+    PathCache_SetCapacity((size_t)pathCacheSize);
+    long long serialCacheSize = JSONCache_GetMaxMemory();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "SERIAL_CACHE_SIZE", 0,
+                                               LLONG_MAX, &serialCacheSize))
+        return REDISMODULE_ERR;
+    JSONCache_SetMaxMemory((size_t)serialCacheSize);
+    long long aofChunkSize = JSONTypeGetAofChunkSize();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "AOF_CHUNK_SIZE", 0, UINT32_MAX,
+                                               &aofChunkSize))
+        return REDISMODULE_ERR;
+    JSONTypeSetAofChunkSize((size_t)aofChunkSize);
+    long long compressThreshold = Node_StringGetCompressThreshold();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "COMPRESS_THRESHOLD", 0,
+                                               UINT32_MAX, &compressThreshold))
+        return REDISMODULE_ERR;
+    Node_StringSetCompressThreshold((uint32_t)compressThreshold);
+    long long lazyfreeThreshold = LazyFree_GetThreshold();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "LAZYFREE_THRESHOLD", 0, LLONG_MAX,
+                                               &lazyfreeThreshold))
+        return REDISMODULE_ERR;
+    LazyFree_SetThreshold((size_t)lazyfreeThreshold);
+    if (OBJ_OK != LazyFree_Start()) {
+        RM_LOG_WARNING(ctx, "Can't start the lazy free thread, values are freed synchronously");
+    }
+    long long freezeIdleTime = JSONTypeGetFreezeIdleTime() / 1000;
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "FREEZE_IDLE_TIME", 0,
+                                               LLONG_MAX / 1000, &freezeIdleTime))
+        return REDISMODULE_ERR;
+    JSONTypeSetFreezeIdleTime((uint64_t)freezeIdleTime * 1000);
+    long long asyncParseThreshold = AsyncParse_GetThreshold();
+    if (REDISMODULE_OK != GetModuleArgLongLong(ctx, argv, argc, "ASYNC_PARSE_THRESHOLD", 0,
+                                               LLONG_MAX, &asyncParseThreshold))
+        return REDISMODULE_ERR;
+    AsyncParse_SetThreshold((size_t)asyncParseThreshold);
+    if (asyncParseThreshold && OBJ_OK != AsyncParse_Start()) {
+        RM_LOG_WARNING(ctx, "Can't start the parser thread, payloads are parsed synchronously");
+    }
+    long long workerThreads = 0;
+    if (REDISMODULE_OK !=
+        GetModuleArgLongLong(ctx, argv, argc, "WORKER_THREADS", 0, 1024, &workerThreads))
+        return REDISMODULE_ERR;
+    if (OBJ_OK != ThreadPool_Start((size_t)workerThreads)) {
+        RM_LOG_WARNING(ctx, "Started only %zu of %lld worker threads", ThreadPool_Size(),
+                       workerThreads);
+    }
+
     // Register the JSON data type
     RedisModuleTypeMethods tm = { .version = REDISMODULE_TYPE_METHOD_VERSION,
                                   .rdb_load = JSONTypeRdbLoad,
@@ -1717,6 +3409,28 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
     JSONType = RedisModule_CreateDataType(ctx, JSONTYPE_NAME, JSONTYPE_ENCODING_VERSION, &tm);
     if (NULL == JSONType) return REDISMODULE_ERR;
 
+    // Register the secondary index type
+    RedisModuleTypeMethods itm = { .version = REDISMODULE_TYPE_METHOD_VERSION,
+                                   .rdb_load = SIndexTypeRdbLoad,
+                                   .rdb_save = SIndexTypeRdbSave,
+                                   .aof_rewrite = SIndexTypeAofRewrite,
+                                   .mem_usage = SIndexTypeMemoryUsage,
+                                   .free = SIndexTypeFree };
+    SIndexType =
+        RedisModule_CreateDataType(ctx, SINDEXTYPE_NAME, SINDEXTYPE_ENCODING_VERSION, &itm);
+    if (NULL == SIndexType) return REDISMODULE_ERR;
+
+    // Register the schema type
+    RedisModuleTypeMethods stm = { .version = REDISMODULE_TYPE_METHOD_VERSION,
+                                   .rdb_load = SchemaTypeRdbLoad,
+                                   .rdb_save = SchemaTypeRdbSave,
+                                   .aof_rewrite = SchemaTypeAofRewrite,
+                                   .mem_usage = SchemaTypeMemoryUsage,
+                                   .free = SchemaTypeFree };
+    SchemaType =
+        RedisModule_CreateDataType(ctx, SCHEMATYPE_NAME, SCHEMATYPE_ENCODING_VERSION, &stm);
+    if (NULL == SchemaType) return REDISMODULE_ERR;
+
     /* Module commands. */
     /* Generic JSON type commands. */
     if (RedisModule_CreateCommand(ctx, "json.resp", JSONResp_RedisCommand, "readonly", 1, 1, 1) ==
@@ -1794,6 +3508,10 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.arrscan", JSONScan_GenericCommand, "readonly", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     /* JSON object commands. */
     if (RedisModule_CreateCommand(ctx, "json.objlen", JSONLen_GenericCommand, "readonly", 1, 1,
                                   1) == REDISMODULE_ERR)
@@ -1803,6 +3521,41 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                   1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx, "json.objscan", JSONScan_GenericCommand, "readonly", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    /* Secondary index commands. */
+    if (RedisModule_CreateCommand(ctx, "json.index", JSONIndex_RedisCommand, "write deny-oom", 2,
+                                  2, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.query", JSONQuery_RedisCommand, "readonly", 1, 1,
+                                  1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    /* Schema commands. */
+    if (RedisModule_CreateCommand(ctx, "json.setschema", JSONSetSchema_RedisCommand,
+                                  "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.validate", JSONValidate_RedisCommand, "readonly", 1,
+                                  1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    /* Expiry commands. */
+    if (RedisModule_CreateCommand(ctx, "json.expire", JSONExpire_GenericCommand, "write deny-oom", 1,
+                                  1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.pexpireat", JSONExpire_GenericCommand,
+                                  "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "json.ttl", JSONTtl_RedisCommand, "readonly", 1, 1, 1) ==
+        REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     RM_LOG_WARNING(ctx, "%s - %s v%d.%d.%d [encver %d]", RLMODULE_DESC, PROJECT_BUILD_TYPE,
                    PROJECT_VERSION_MAJOR, PROJECT_VERSION_MINOR, PROJECT_VERSION_PATCH,
                    JSONTYPE_ENCODING_VERSION);
@@ -25,8 +25,15 @@
 #include "config.h"
 #include "json_object.h"
 #include "json_path.h"
+#include "path_cache.h"
+#include "json_cache.h"
+#include "thread_pool.h"
+#include "async_parse.h"
 #include "object.h"
 #include "json_type.h"
+#include "sindex.h"
+#include "schema.h"
+#include "expiry.h"
 #include "redismodule.h"
 
 #define RLMODULE_NAME "ReJSON"
@@ -34,6 +41,21 @@
 
 #define RM_ERRORMSG_SYNTAX "ERR syntax error"
 
+// The number of keys from which JSON.MGET serializes the values on the worker threads
+#define JSONMGET_PARALLEL_MIN_KEYS 16
+
+// The size of the chunks of a JSON.GET CHUNKED reply
+#define JSONGET_CHUNK_SIZE (64 * 1024)
+
+// The default number of elements in a batch of JSON.ARRSCAN and JSON.OBJSCAN
+#define JSONSCAN_DEFAULT_COUNT 10
+
+// The COUNT of the SCAN calls that build a secondary index, or that find the keys of TTLs
+#define JSONINDEX_SCAN_COUNT 1000
+
+// How often in milliseconds the server's role is checked, when TTLs expire
+#define JSONEXPIRY_ROLE_INTERVAL 1000
+
 #define REJSON_ERROR_EMPTY_STRING "ERR the empty string is not a valid JSON value"
 #define REJSON_ERROR_JSONOBJECT_ERROR "ERR unspecified json_object error (probably OOM)"
 #define REJSON_ERROR_SERIALIZE "ERR object serialization to JSON failed"
@@ -52,6 +74,16 @@
 #define REJSON_ERROR_ARRAY_DEL "ERR could not delete from array"
 #define REJSON_ERROR_INSERT "ERR could not insert into array"
 #define REJSON_ERROR_INSERT_SUBARRY "ERR could not prepare the insert operation"
+#define REJSON_ERROR_MODULE_ARG "module argument %s must be an integer between %lld and %lld"
+#define REJSON_ERROR_CURSOR_INVALID "ERR invalid cursor"
+#define REJSON_ERROR_SINDEX_EXISTS "ERR index already exists"
+#define REJSON_ERROR_SINDEX_BOUND "ERR min or max is not a number"
+#define REJSON_ERROR_SCHEMA_INVALID "ERR invalid schema: %S"
+#define REJSON_ERROR_SCHEMA_VIOLATION "ERR schema violation at %S"
+#define REJSON_ERROR_EXPIRE_TTL "ERR ttl is not a positive integer or is too large"
+#define REJSON_ERROR_EXPIRE_TIME "ERR timestamp is not a positive integer"
+#define REJSON_ERROR_EXPIRE_ROOT "ERR the root can't expire, use EXPIRE for the key"
+#define REJSON_ERROR_EXPIRE_PATH "ERR the path's keys can't have both kinds of quotes"
 #define REJSON_ERROR_KEY_REQUIRED "ERR could not perform this operation on a key that doesn't exist"
 
 #endif
\ No newline at end of file
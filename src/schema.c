@@ -0,0 +1,768 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema.h"
+#include "json_object.h"
+#include "json_type.h"
+
+// the flags of a rule's numeric bounds
+#define SCHEMA_MIN 0x1
+#define SCHEMA_XMIN 0x2
+#define SCHEMA_MAX 0x4
+#define SCHEMA_XMAX 0x8
+
+/* A property of an object rule */
+typedef struct {
+    sds key;
+    SchemaRef schema;
+    int required;
+} SchemaProp;
+
+/* A scalar of an `enum` or a `const` */
+typedef struct {
+    NodeType type;  // N_INTEGER and N_NUMBER are both kept as N_NUMBER
+    double num;
+    int boolval;
+    sds str;
+} SchemaConst;
+
+/* The rule of a subschema */
+typedef struct {
+    int types;  // the mask of allowed NodeTypes, 0 for any, N_INTEGER alone for integers
+    int flags;  // the numeric bounds that are set
+    double minimum, xminimum, maximum, xmaximum;
+    uint32_t minLength, maxLength, minItems, maxItems, minProps, maxProps;
+    uint32_t constStart, nconsts;
+    uint32_t propStart, nprops, nrequired;
+    SchemaRef items, additional;
+} SchemaRule;
+
+struct Schema {
+    SchemaRule *rules;
+    uint32_t nrules;
+    SchemaProp *props;  // the properties of every rule, sorted by key in each
+    uint32_t nprops;
+    SchemaConst *consts;
+    uint32_t nconsts;
+    SchemaRef root;
+};
+
+// the keywords that are accepted and ignored
+static const char *_SchemaAnnotations[] = {"$schema", "$id", "$comment", "title", "description",
+                                           "default", "examples", NULL};
+
+// the names of the types, in the order that they're reported
+static const struct {
+    const char *name;
+    int types;
+} _SchemaTypes[] = {{"null", N_NULL},
+                    {"boolean", N_BOOLEAN},
+                    {"number", N_NUMBER | N_INTEGER},
+                    {"integer", N_INTEGER},
+                    {"string", N_STRING},
+                    {"array", N_ARRAY},
+                    {"object", N_DICT},
+                    {NULL, 0}};
+
+// the registered key schemas
+static KeySchema *__keySchemas = NULL;
+
+/* Appends the segment of an object's key to a location, as `.key` or `["key"]`. */
+static sds __schema_catKey(sds loc, const char *key) {
+    int ident = *key != '\0' && !isdigit((unsigned char)*key);
+    for (const char *k = key; *k && ident; k++) ident = isalnum((unsigned char)*k) || '_' == *k;
+    return ident ? sdscatfmt(loc, ".%s", key) : sdscatfmt(loc, "[\"%s\"]", key);
+}
+
+/* Prepends a segment to the location of an error. */
+static void __schema_prepend(sds *loc, sds seg) {
+    seg = sdscatsds(seg, *loc);
+    sdsfree(*loc);
+    *loc = seg;
+}
+
+/* Returns a rule's property of a key, or NULL. */
+static const SchemaProp *__schema_findProp(const Schema *s, const SchemaRule *rule,
+                                           const char *key) {
+    uint32_t lo = 0, hi = rule->nprops;
+    const SchemaProp *props = s->props + rule->propStart;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int c = strcmp(props[mid].key, key);
+        if (!c) return &props[mid];
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/* ================================================================================================
+ * Compilation
+ * ============================================================================================== */
+
+typedef struct {
+    Schema *s;
+    sds reason;  // set on errors
+    sds loc;     // the JSON pointer of the error, built as the compiler unwinds
+    int depth;
+} _SchemaCompiler;
+
+static int __schema_fail(_SchemaCompiler *c, const char *reason, const char *keyword) {
+    c->reason = sdscatfmt(sdsempty(), reason, keyword);
+    return OBJ_ERR;
+}
+
+static int __schema_cmpProps(const void *a, const void *b) {
+    return strcmp(((const SchemaProp *)a)->key, ((const SchemaProp *)b)->key);
+}
+
+/* Returns the index of a key in a rule's temporary properties, adding it if it's missing. */
+static uint32_t __schema_tempProp(SchemaProp **props, uint32_t *len, const char *key) {
+    for (uint32_t i = 0; i < *len; i++) {
+        if (!strcmp((*props)[i].key, key)) return i;
+    }
+    if (0 == (*len & (*len - 1))) {
+        *props = RedisModule_Realloc(*props, (*len ? *len * 2 : 1) * sizeof(SchemaProp));
+    }
+    (*props)[*len] = (SchemaProp){.key = sdsnew(key), .schema = SCHEMA_ANY, .required = 0};
+    return (*len)++;
+}
+
+/* Parses the value of a length keyword. */
+static int __schema_lengthKeyword(_SchemaCompiler *c, const char *keyword, const Node *n,
+                                  uint32_t *val) {
+    double v = N_INTEGER == NODETYPE(n) || N_NUMBER == NODETYPE(n) ? NODEVALUE_AS_DOUBLE(n) : -1;
+    if (v < 0 || floor(v) != v) {
+        return __schema_fail(c, "`%s` must be a non-negative integer", keyword);
+    }
+    *val = v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+    return OBJ_OK;
+}
+
+/* Parses the value of a numeric bound keyword. */
+static int __schema_bound(_SchemaCompiler *c, const char *keyword, const Node *n, SchemaRule *rule,
+                          double *val, int flag) {
+    if (N_INTEGER != NODETYPE(n) && N_NUMBER != NODETYPE(n)) {
+        return __schema_fail(c, "`%s` must be a number", keyword);
+    }
+    *val = NODEVALUE_AS_DOUBLE(n);
+    rule->flags |= flag;
+    return OBJ_OK;
+}
+
+/* Parses the value of `type`, a name or an array of names. */
+static int __schema_types(_SchemaCompiler *c, const Node *n, int *types) {
+    int count = N_ARRAY == NODETYPE(n) ? n->value.arrval.len : 1;
+    for (int i = 0; i < count; i++) {
+        const Node *e = N_ARRAY == NODETYPE(n) ? n->value.arrval.entries[i] : n;
+        int found = 0;
+        for (int t = 0; N_STRING == NODETYPE(e) && _SchemaTypes[t].name && !found; t++) {
+            const char *name = _SchemaTypes[t].name;
+            if (strlen(name) == e->value.strval.len) {
+                char *buf;
+                found = !memcmp(name, Node_StringData(e, &buf), e->value.strval.len);
+                Node_StringRelease(buf);
+                if (found) *types |= _SchemaTypes[t].types;
+            }
+        }
+        if (!found) return __schema_fail(c, "`%s` must be type names", "type");
+    }
+    return OBJ_OK;
+}
+
+/* Adds the scalar of an `enum` or a `const` to a rule's temporary constants. */
+static int __schema_const(_SchemaCompiler *c, const char *keyword, const Node *n,
+                          SchemaConst **consts, uint32_t *len) {
+    SchemaConst k = {.type = NODETYPE(n)};
+    switch (k.type) {
+        case N_NULL:
+            break;
+        case N_BOOLEAN:
+            k.boolval = NODE_BOOLVAL(n);
+            break;
+        case N_INTEGER:
+        case N_NUMBER:
+            k.type = N_NUMBER;
+            k.num = NODEVALUE_AS_DOUBLE(n);
+            break;
+        case N_STRING: {
+            char *buf;
+            k.str = sdsnewlen(Node_StringData(n, &buf), n->value.strval.len);
+            Node_StringRelease(buf);
+        } break;
+        default:
+            return __schema_fail(c, "`%s` supports only scalars", keyword);
+    }
+    if (0 == (*len & (*len - 1))) {
+        *consts = RedisModule_Realloc(*consts, (*len ? *len * 2 : 1) * sizeof(SchemaConst));
+    }
+    (*consts)[(*len)++] = k;
+    return OBJ_OK;
+}
+
+static int __schema_compile(_SchemaCompiler *c, const Node *n, SchemaRef *ref);
+
+/* Compiles a subschema of a keyword, prepending the keyword to the location of errors. */
+static int __schema_sub(_SchemaCompiler *c, const char *keyword, const char *key, const Node *n,
+                        SchemaRef *ref) {
+    if (OBJ_OK == __schema_compile(c, n, ref)) return OBJ_OK;
+    sds seg = sdscatfmt(sdsempty(), "/%s", keyword);
+    if (key) seg = sdscatfmt(seg, "/%s", key);
+    __schema_prepend(&c->loc, seg);
+    return OBJ_ERR;
+}
+
+/* Adds a rule, returning its reference. */
+static SchemaRef __schema_newRule(Schema *s) {
+    if (0 == (s->nrules & (s->nrules - 1))) {
+        size_t cap = s->nrules ? s->nrules * 2 : 1;
+        s->rules = RedisModule_Realloc(s->rules, cap * sizeof(SchemaRule));
+    }
+    s->rules[s->nrules] = (SchemaRule){.maxLength = UINT32_MAX,
+                                       .maxItems = UINT32_MAX,
+                                       .maxProps = UINT32_MAX,
+                                       .items = SCHEMA_ANY,
+                                       .additional = SCHEMA_ANY};
+    return s->nrules++;
+}
+
+/* Compiles the keywords of a schema object into a rule. */
+static int __schema_compileRule(_SchemaCompiler *c, const Node *n, SchemaRef r) {
+    Schema *s = c->s;
+    SchemaRule rule = s->rules[r];
+    SchemaProp *props = NULL;
+    uint32_t nprops = 0;
+    SchemaConst *consts = NULL;
+    uint32_t nconsts = 0;
+    int rc = OBJ_OK;
+
+    for (uint32_t i = 0; OBJ_OK == rc && i < n->value.dictval.len; i++) {
+        const char *kw = n->value.dictval.entries[i]->value.kvval.key;
+        const Node *v = n->value.dictval.entries[i]->value.kvval.val;
+        if (!strcmp("type", kw)) {
+            rc = __schema_types(c, v, &rule.types);
+        } else if (!strcmp("enum", kw)) {
+            if (N_ARRAY != NODETYPE(v)) {
+                rc = __schema_fail(c, "`%s` must be an array", kw);
+            }
+            for (uint32_t j = 0; OBJ_OK == rc && j < v->value.arrval.len; j++) {
+                rc = __schema_const(c, kw, v->value.arrval.entries[j], &consts, &nconsts);
+            }
+        } else if (!strcmp("const", kw)) {
+            rc = __schema_const(c, kw, v, &consts, &nconsts);
+        } else if (!strcmp("minimum", kw)) {
+            rc = __schema_bound(c, kw, v, &rule, &rule.minimum, SCHEMA_MIN);
+        } else if (!strcmp("exclusiveMinimum", kw)) {
+            rc = __schema_bound(c, kw, v, &rule, &rule.xminimum, SCHEMA_XMIN);
+        } else if (!strcmp("maximum", kw)) {
+            rc = __schema_bound(c, kw, v, &rule, &rule.maximum, SCHEMA_MAX);
+        } else if (!strcmp("exclusiveMaximum", kw)) {
+            rc = __schema_bound(c, kw, v, &rule, &rule.xmaximum, SCHEMA_XMAX);
+        } else if (!strcmp("minLength", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.minLength);
+        } else if (!strcmp("maxLength", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.maxLength);
+        } else if (!strcmp("minItems", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.minItems);
+        } else if (!strcmp("maxItems", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.maxItems);
+        } else if (!strcmp("minProperties", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.minProps);
+        } else if (!strcmp("maxProperties", kw)) {
+            rc = __schema_lengthKeyword(c, kw, v, &rule.maxProps);
+        } else if (!strcmp("items", kw)) {
+            rc = N_ARRAY == NODETYPE(v) ? __schema_fail(c, "`%s` supports only a single schema", kw)
+                                        : __schema_sub(c, kw, NULL, v, &rule.items);
+        } else if (!strcmp("additionalProperties", kw)) {
+            rc = __schema_sub(c, kw, NULL, v, &rule.additional);
+        } else if (!strcmp("properties", kw)) {
+            if (N_DICT != NODETYPE(v)) rc = __schema_fail(c, "`%s` must be an object", kw);
+            for (uint32_t j = 0; OBJ_OK == rc && j < v->value.dictval.len; j++) {
+                const char *key = v->value.dictval.entries[j]->value.kvval.key;
+                uint32_t p = __schema_tempProp(&props, &nprops, key);
+                rc = __schema_sub(c, kw, key, v->value.dictval.entries[j]->value.kvval.val,
+                                  &props[p].schema);
+            }
+        } else if (!strcmp("required", kw)) {
+            if (N_ARRAY != NODETYPE(v)) rc = __schema_fail(c, "`%s` must be an array", kw);
+            for (uint32_t j = 0; OBJ_OK == rc && j < v->value.arrval.len; j++) {
+                const Node *e = v->value.arrval.entries[j];
+                if (N_STRING != NODETYPE(e)) {
+                    rc = __schema_fail(c, "`%s` must be an array of strings", kw);
+                    break;
+                }
+                char *buf;
+                sds key = sdsnewlen(Node_StringData(e, &buf), e->value.strval.len);
+                Node_StringRelease(buf);
+                uint32_t p = __schema_tempProp(&props, &nprops, key);
+                props[p].required = 1;
+                sdsfree(key);
+            }
+        } else {
+            int annotation = 0;
+            for (int j = 0; _SchemaAnnotations[j] && !annotation; j++) {
+                annotation = !strcmp(_SchemaAnnotations[j], kw);
+            }
+            if (!annotation) rc = __schema_fail(c, "unsupported keyword `%s`", kw);
+        }
+    }
+
+    // the constants and properties are appended once the subschemas are compiled, so that
+    // those of a rule are contiguous
+    rule.constStart = s->nconsts;
+    rule.nconsts = nconsts;
+    if (nconsts) {
+        s->consts = RedisModule_Realloc(s->consts, (s->nconsts + nconsts) * sizeof(SchemaConst));
+        memcpy(s->consts + s->nconsts, consts, nconsts * sizeof(SchemaConst));
+        s->nconsts += nconsts;
+    }
+    RedisModule_Free(consts);
+    rule.propStart = s->nprops;
+    rule.nprops = nprops;
+    if (nprops) {
+        qsort(props, nprops, sizeof(SchemaProp), __schema_cmpProps);
+        s->props = RedisModule_Realloc(s->props, (s->nprops + nprops) * sizeof(SchemaProp));
+        memcpy(s->props + s->nprops, props, nprops * sizeof(SchemaProp));
+        s->nprops += nprops;
+        for (uint32_t i = 0; i < nprops; i++) rule.nrequired += props[i].required;
+    }
+    RedisModule_Free(props);
+    s->rules[r] = rule;
+    return rc;
+}
+
+/* Compiles a schema, an object or a boolean, returning its reference. */
+static int __schema_compile(_SchemaCompiler *c, const Node *n, SchemaRef *ref) {
+    if (N_BOOLEAN == NODETYPE(n)) {
+        *ref = NODE_BOOLVAL(n) ? SCHEMA_ANY : SCHEMA_NONE;
+        return OBJ_OK;
+    }
+    if (N_DICT != NODETYPE(n)) {
+        return __schema_fail(c, "a schema must be an object or a boolean%s", "");
+    }
+    if (c->depth >= SCHEMA_MAX_DEPTH) {
+        return __schema_fail(c, "the schema is nested too deeply%s", "");
+    }
+
+    c->depth++;
+    *ref = __schema_newRule(c->s);
+    int rc = __schema_compileRule(c, n, *ref);
+    c->depth--;
+    return rc;
+}
+
+Schema *Schema_Compile(const Node *doc, sds *err) {
+    Schema *s = RedisModule_Calloc(1, sizeof(Schema));
+    __schema_newRule(s);  // SCHEMA_ANY
+    __schema_newRule(s);  // SCHEMA_NONE
+
+    _SchemaCompiler c = {.s = s, .loc = sdsempty()};
+    if (OBJ_OK != __schema_compile(&c, doc, &s->root)) {
+        *err = sdscatfmt(sdsempty(), "#%S: %S", c.loc, c.reason);
+        sdsfree(c.loc);
+        sdsfree(c.reason);
+        Schema_Free(s);
+        return NULL;
+    }
+    sdsfree(c.loc);
+    return s;
+}
+
+void Schema_Free(Schema *s) {
+    for (uint32_t i = 0; i < s->nprops; i++) sdsfree(s->props[i].key);
+    for (uint32_t i = 0; i < s->nconsts; i++) sdsfree(s->consts[i].str);
+    RedisModule_Free(s->rules);
+    RedisModule_Free(s->props);
+    RedisModule_Free(s->consts);
+    RedisModule_Free(s);
+}
+
+/* ================================================================================================
+ * Validation
+ * ============================================================================================== */
+
+SchemaRef Schema_Root(const Schema *s) { return s->root; }
+
+SchemaRef Schema_Property(const Schema *s, SchemaRef r, const char *key) {
+    if (SCHEMA_ANY == r || SCHEMA_NONE == r) return r;
+    const SchemaProp *p = __schema_findProp(s, &s->rules[r], key);
+    return p ? p->schema : s->rules[r].additional;
+}
+
+SchemaRef Schema_Items(const Schema *s, SchemaRef r) {
+    if (SCHEMA_ANY == r || SCHEMA_NONE == r) return r;
+    return s->rules[r].items;
+}
+
+SchemaRef Schema_At(const Schema *s, const SearchPath *sp, size_t len) {
+    SchemaRef r = s->root;
+    for (size_t i = 0; i < len && SCHEMA_ANY != r; i++) {
+        switch (sp->nodes[i].type) {
+            case NT_ROOT:
+                break;
+            case NT_KEY:
+                r = Schema_Property(s, r, sp->nodes[i].value.key);
+                break;
+            case NT_INDEX:
+                r = Schema_Items(s, r);
+                break;
+            default:  // paths with multiple results aren't written to
+                r = SCHEMA_ANY;
+                break;
+        }
+    }
+    return r;
+}
+
+size_t Schema_StringLength(const char *str, size_t len) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) count += (0x80 != (str[i] & 0xC0));
+    return count;
+}
+
+/* Returns true if a scalar equals a constant. */
+static int __schema_equals(const SchemaConst *k, const Node *n) {
+    NodeType t = NODETYPE(n);
+    if (N_INTEGER == t) t = N_NUMBER;
+    if (t != k->type) return 0;
+    switch (t) {
+        case N_BOOLEAN:
+            return k->boolval == NODE_BOOLVAL(n);
+        case N_NUMBER:
+            return k->num == NODEVALUE_AS_DOUBLE(n);
+        case N_STRING: {
+            if (sdslen(k->str) != n->value.strval.len) return 0;
+            char *buf;
+            int eq = !memcmp(k->str, Node_StringData(n, &buf), n->value.strval.len);
+            Node_StringRelease(buf);
+            return eq;
+        }
+        default:
+            return 1;
+    }
+}
+
+/* Checks a length against its bounds, setting the reason of a violation. */
+static int __schema_checkLength(size_t len, uint32_t min, uint32_t max, const char *what,
+                                sds *reason) {
+    if (len < min) {
+        *reason = sdscatprintf(sdsempty(), "has %zu %s, fewer than %u", len, what, min);
+    } else if (len > max) {
+        *reason = sdscatprintf(sdsempty(), "has %zu %s, more than %u", len, what, max);
+    } else {
+        return OBJ_OK;
+    }
+    return OBJ_ERR;
+}
+
+static int __schema_length(const SchemaRule *rule, NodeType type, size_t len, sds *reason) {
+    switch (type) {
+        case N_STRING:
+            return __schema_checkLength(len, rule->minLength, rule->maxLength, "characters",
+                                        reason);
+        case N_ARRAY:
+            return __schema_checkLength(len, rule->minItems, rule->maxItems, "items", reason);
+        case N_DICT:
+            return __schema_checkLength(len, rule->minProps, rule->maxProps, "properties",
+                                        reason);
+        default:
+            return OBJ_OK;
+    }
+}
+
+/* Checks a number against a rule's bounds. */
+static int __schema_number(const SchemaRule *rule, double v, sds *reason) {
+    const char *op = NULL;
+    double bound = 0;
+    if ((rule->flags & SCHEMA_MIN) && v < rule->minimum) {
+        op = ">=", bound = rule->minimum;
+    } else if ((rule->flags & SCHEMA_XMIN) && v <= rule->xminimum) {
+        op = ">", bound = rule->xminimum;
+    } else if ((rule->flags & SCHEMA_MAX) && v > rule->maximum) {
+        op = "<=", bound = rule->maximum;
+    } else if ((rule->flags & SCHEMA_XMAX) && v >= rule->xmaximum) {
+        op = "<", bound = rule->xmaximum;
+    }
+    if (!op) return OBJ_OK;
+    *reason = sdscatprintf(sdsempty(), "must be %s %.17g", op, bound);
+    return OBJ_ERR;
+}
+
+/* Sets the reason of a type violation. */
+static sds __schema_typeError(int types) {
+    sds reason = sdsnew("expected ");
+    const char *sep = "";
+    for (int t = 0; _SchemaTypes[t].name; t++) {
+        int mask = _SchemaTypes[t].types;
+        if ((types & mask) != mask || (N_INTEGER == mask && (types & N_NUMBER))) continue;
+        reason = sdscatfmt(reason, "%s%s", sep, _SchemaTypes[t].name);
+        sep = " or ";
+    }
+    return reason;
+}
+
+/**
+* Validates a node against a rule. On violations the reason is set, and the location of the
+* offending value is built in `loc` as the recursion unwinds.
+*/
+static int __schema_validate(const Schema *s, SchemaRef r, const Node *n, sds *reason, sds *loc) {
+    if (SCHEMA_ANY == r) return OBJ_OK;
+    if (SCHEMA_NONE == r) {
+        *reason = sdsnew("no value is allowed");
+        return OBJ_ERR;
+    }
+    const SchemaRule *rule = &s->rules[r];
+    NodeType t = NODETYPE(n);
+
+    if (rule->types && !(rule->types & t)) {
+        int integral = N_NUMBER == t && (rule->types & N_INTEGER) &&
+                       floor(n->value.numval) == n->value.numval;
+        if (!integral) {
+            *reason = __schema_typeError(rule->types);
+            return OBJ_ERR;
+        }
+    }
+    if (rule->nconsts) {
+        uint32_t i = 0;
+        while (i < rule->nconsts && !__schema_equals(&s->consts[rule->constStart + i], n)) i++;
+        if (i == rule->nconsts) {
+            *reason = sdsnew("isn't one of the allowed values");
+            return OBJ_ERR;
+        }
+    }
+
+    switch (t) {
+        case N_INTEGER:
+        case N_NUMBER:
+            return __schema_number(rule, NODEVALUE_AS_DOUBLE(n), reason);
+        case N_STRING: {
+            char *buf;
+            size_t len = Schema_StringLength(Node_StringData(n, &buf), n->value.strval.len);
+            Node_StringRelease(buf);
+            return __schema_length(rule, t, len, reason);
+        }
+        case N_ARRAY:
+            if (OBJ_OK != __schema_length(rule, t, n->value.arrval.len, reason)) return OBJ_ERR;
+            if (SCHEMA_ANY == rule->items) return OBJ_OK;
+            for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+                if (OBJ_OK != __schema_validate(s, rule->items, n->value.arrval.entries[i], reason,
+                                                loc)) {
+                    __schema_prepend(loc, sdscatfmt(sdsempty(), "[%u]", i));
+                    return OBJ_ERR;
+                }
+            }
+            return OBJ_OK;
+        case N_DICT: {
+            if (OBJ_OK != __schema_length(rule, t, n->value.dictval.len, reason)) return OBJ_ERR;
+            uint32_t required = 0;
+            for (uint32_t i = 0; i < n->value.dictval.len; i++) {
+                const char *key = n->value.dictval.entries[i]->value.kvval.key;
+                const SchemaProp *p = __schema_findProp(s, rule, key);
+                if (!p && SCHEMA_NONE == rule->additional) {
+                    *reason = sdscatfmt(sdsempty(), "has the unexpected property `%s`", key);
+                    return OBJ_ERR;
+                }
+                if (p) required += p->required;
+                if (OBJ_OK != __schema_validate(s, p ? p->schema : rule->additional,
+                                                n->value.dictval.entries[i]->value.kvval.val,
+                                                reason, loc)) {
+                    __schema_prepend(loc, __schema_catKey(sdsempty(), key));
+                    return OBJ_ERR;
+                }
+            }
+            if (required == rule->nrequired) return OBJ_OK;
+            for (uint32_t i = 0; i < rule->nprops; i++) {
+                const SchemaProp *p = &s->props[rule->propStart + i];
+                Node *val;
+                if (p->required && OBJ_OK != Node_DictGet((Node *)n, p->key, &val)) {
+                    *reason = sdscatfmt(sdsempty(), "lacks the required property `%S`", p->key);
+                    break;
+                }
+            }
+            return OBJ_ERR;
+        }
+        default:
+            return OBJ_OK;
+    }
+}
+
+/* Sets the error of a violation: the location relative to a path, and the reason. */
+static int __schema_error(const char *path, sds loc, sds reason, sds *err) {
+    if (!sdslen(loc)) {
+        *err = sdscatfmt(sdsempty(), "%s: %S", path, reason);
+    } else if (!strcmp(".", path) || !*path) {
+        *err = sdscatfmt(sdsempty(), "%S: %S", loc, reason);
+    } else {
+        *err = sdscatfmt(sdsempty(), "%s%S: %S", path, loc, reason);
+    }
+    sdsfree(loc);
+    sdsfree(reason);
+    return OBJ_ERR;
+}
+
+int Schema_Validate(const Schema *s, SchemaRef r, const Node *n, const char *path, sds *err) {
+    sds reason = NULL, loc = sdsempty();
+    if (OBJ_OK == __schema_validate(s, r, n, &reason, &loc)) {
+        sdsfree(loc);
+        return OBJ_OK;
+    }
+    return __schema_error(path, loc, reason, err);
+}
+
+int Schema_ValidateLength(const Schema *s, SchemaRef r, NodeType type, size_t len,
+                          const char *path, sds *err) {
+    if (SCHEMA_ANY == r || SCHEMA_NONE == r) return OBJ_OK;
+    sds reason = NULL;
+    if (OBJ_OK == __schema_length(&s->rules[r], type, len, &reason)) return OBJ_OK;
+    return __schema_error(path, sdsempty(), reason, err);
+}
+
+int Schema_ValidateInsert(const Schema *s, SchemaRef r, const Node *arr, const Node *sub,
+                          size_t index, const char *path, sds *err) {
+    size_t len = sub->value.arrval.len;
+    if (OBJ_OK != Schema_ValidateLength(s, r, N_ARRAY, arr->value.arrval.len + len, path, err)) {
+        return OBJ_ERR;
+    }
+    SchemaRef items = Schema_Items(s, r);
+    for (size_t i = 0; i < len && SCHEMA_ANY != items; i++) {
+        sds reason = NULL, loc = sdsempty();
+        if (OBJ_OK != __schema_validate(s, items, sub->value.arrval.entries[i], &reason, &loc)) {
+            __schema_prepend(&loc, sdscatfmt(sdsempty(), "[%U]", (unsigned long long)(index + i)));
+            return __schema_error(path, loc, reason, err);
+        }
+        sdsfree(loc);
+    }
+    return OBJ_OK;
+}
+
+int Schema_ValidateRemove(const Schema *s, SchemaRef r, const Node *obj, const char *key,
+                          const char *path, sds *err) {
+    if (SCHEMA_ANY == r || SCHEMA_NONE == r) return OBJ_OK;
+    const SchemaProp *p = __schema_findProp(s, &s->rules[r], key);
+    if (p && p->required) {
+        return __schema_error(path, sdsempty(),
+                              sdscatfmt(sdsempty(), "`%s` is a required property", key), err);
+    }
+    return Schema_ValidateLength(s, r, N_DICT, obj->value.dictval.len - 1, path, err);
+}
+
+/* ================================================================================================
+ * Key schemas
+ * ============================================================================================== */
+
+KeySchema *NewKeySchema(const char *prefix, size_t prefixlen, const char *json, size_t jsonlen,
+                        int db, sds *err) {
+    Node *doc = NULL;
+    char *jerr = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, jsonlen, &doc, &jerr)) {
+        *err = sdsnew(jerr ? jerr : "can't parse the schema");
+        if (jerr) RedisModule_Free(jerr);
+        return NULL;
+    }
+    Schema *schema = Schema_Compile(doc, err);
+    Node_Free(doc);
+    if (!schema) return NULL;
+
+    KeySchema *ks = RedisModule_Calloc(1, sizeof(KeySchema));
+    ks->prefix = sdsnewlen(prefix, prefixlen);
+    ks->json = sdsnewlen(json, jsonlen);
+    ks->schema = schema;
+    ks->db = db;
+
+    ks->next = __keySchemas;
+    if (__keySchemas) __keySchemas->prev = ks;
+    __keySchemas = ks;
+    return ks;
+}
+
+void KeySchema_Free(KeySchema *ks) {
+    if (ks->prev) {
+        ks->prev->next = ks->next;
+    } else {
+        __keySchemas = ks->next;
+    }
+    if (ks->next) ks->next->prev = ks->prev;
+    Schema_Free(ks->schema);
+    sdsfree(ks->prefix);
+    sdsfree(ks->json);
+    RedisModule_Free(ks);
+}
+
+const Schema *KeySchema_Find(int db, const char *key, size_t len) {
+    const KeySchema *found = NULL;
+    for (const KeySchema *ks = __keySchemas; ks; ks = ks->next) {
+        size_t plen = sdslen(ks->prefix);
+        if (db != ks->db || plen > len || memcmp(ks->prefix, key, plen)) continue;
+        if (!found || plen > sdslen(found->prefix)) found = ks;
+    }
+    return found ? found->schema : NULL;
+}
+
+void *SchemaTypeRdbLoad(RedisModuleIO *rdb, int encver) {
+    if (encver < 0 || encver > SCHEMATYPE_ENCODING_VERSION) {
+        RedisModule_LogIOError(
+            rdb, RM_LOGLEVEL_WARNING,
+            "Can't load schema from RDB due to unknown encoding version %d, expecting %d at most",
+            encver, SCHEMATYPE_ENCODING_VERSION);
+        return NULL;
+    }
+
+    size_t prefixlen, jsonlen;
+    char *prefix = RedisModule_LoadStringBuffer(rdb, &prefixlen);
+    char *json = RedisModule_LoadStringBuffer(rdb, &jsonlen);
+    int db = (int)RedisModule_LoadUnsigned(rdb);
+
+    sds err = NULL;
+    KeySchema *ks = NewKeySchema(prefix, prefixlen, json, jsonlen, db, &err);
+    if (!ks) {
+        RedisModule_LogIOError(rdb, RM_LOGLEVEL_WARNING, "Can't load schema from RDB: %s", err);
+        sdsfree(err);
+    }
+    RedisModule_Free(prefix);
+    RedisModule_Free(json);
+    return ks;
+}
+
+void SchemaTypeRdbSave(RedisModuleIO *rdb, void *value) {
+    KeySchema *ks = (KeySchema *)value;
+    RedisModule_SaveStringBuffer(rdb, ks->prefix, sdslen(ks->prefix));
+    RedisModule_SaveStringBuffer(rdb, ks->json, sdslen(ks->json));
+    RedisModule_SaveUnsigned(rdb, ks->db);
+}
+
+void SchemaTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+    KeySchema *ks = (KeySchema *)value;
+    RedisModule_EmitAOF(aof, "JSON.SETSCHEMA", "sbb", key, ks->prefix, sdslen(ks->prefix),
+                        ks->json, sdslen(ks->json));
+}
+
+void SchemaTypeFree(void *value) { KeySchema_Free((KeySchema *)value); }
+
+size_t SchemaTypeMemoryUsage(const void *value) {
+    const KeySchema *ks = (const KeySchema *)value;
+    const Schema *s = ks->schema;
+    return sizeof(KeySchema) + sdsalloc(ks->prefix) + sdsalloc(ks->json) + sizeof(Schema) +
+           s->nrules * sizeof(SchemaRule) + s->nprops * sizeof(SchemaProp) +
+           s->nconsts * sizeof(SchemaConst);
+}
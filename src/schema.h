@@ -0,0 +1,123 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SCHEMA_H__
+#define __SCHEMA_H__
+
+#include <stdint.h>
+#include <sds.h>
+#include "object.h"
+#include "path.h"
+#include "redismodule.h"
+
+// The module type of schemas, which are stored as keys
+#define SCHEMATYPE_NAME "ReJSON-SC"
+#define SCHEMATYPE_ENCODING_VERSION 0
+
+// The deepest nesting of subschemas
+#define SCHEMA_MAX_DEPTH 64
+
+/*
+* A compiled subset of JSON Schema (draft 6): boolean schemas, and the keywords type, enum, const,
+* minimum, maximum, exclusiveMinimum, exclusiveMaximum, minLength, maxLength, items (a single
+* schema), minItems, maxItems, properties, required, additionalProperties, minProperties and
+* maxProperties. Annotations are ignored and other keywords are rejected.
+*
+* A schema is compiled once into a flat table of rules, one per subschema, which reference their
+* subschemas by index and keep their properties in a sorted table. Values are validated by walking
+* their nodes along with the rules, so writes are checked right after they're parsed.
+*/
+typedef struct Schema Schema;
+
+/* A reference to a subschema of a compiled schema */
+typedef uint32_t SchemaRef;
+#define SCHEMA_ANY 0   // the `true` schema, that every value satisfies
+#define SCHEMA_NONE 1  // the `false` schema, that no value satisfies
+
+/**
+* Compiles a JSON Schema document. Returns NULL on invalid or unsupported schemas, and sets err to
+* the reason, prefixed by the location in the document.
+*/
+Schema *Schema_Compile(const Node *doc, sds *err);
+
+void Schema_Free(Schema *s);
+
+/* Returns the root schema. */
+SchemaRef Schema_Root(const Schema *s);
+
+/* Returns the subschema of an object's property. */
+SchemaRef Schema_Property(const Schema *s, SchemaRef r, const char *key);
+
+/* Returns the subschema of an array's items. */
+SchemaRef Schema_Items(const Schema *s, SchemaRef r);
+
+/* Returns the subschema of the values at the first `len` nodes of a path, from the root. */
+SchemaRef Schema_At(const Schema *s, const SearchPath *sp, size_t len);
+
+/**
+* Validates a value against a subschema. On violations OBJ_ERR is returned and err is set to the
+* location of the offending value, relative to `path` which is the value's, and the reason.
+*/
+int Schema_Validate(const Schema *s, SchemaRef r, const Node *n, const char *path, sds *err);
+
+/* Validates the length of an array or a string, or the number of properties of an object. */
+int Schema_ValidateLength(const Schema *s, SchemaRef r, NodeType type, size_t len,
+                          const char *path, sds *err);
+
+/* Validates the elements of `sub` that are inserted at `index` of an array. */
+int Schema_ValidateInsert(const Schema *s, SchemaRef r, const Node *arr, const Node *sub,
+                          size_t index, const char *path, sds *err);
+
+/* Validates removing a property from an object. */
+int Schema_ValidateRemove(const Schema *s, SchemaRef r, const Node *obj, const char *key,
+                          const char *path, sds *err);
+
+/* Returns the number of characters, i.e. code points, in a UTF-8 string. */
+size_t Schema_StringLength(const char *str, size_t len);
+
+/**
+* A schema that the writes to the JSON keys whose names start with a prefix, in a database, are
+* checked against. The document is kept for persistence, and the schema is recompiled on load.
+*/
+typedef struct KeySchema {
+    sds prefix;
+    sds json;
+    Schema *schema;
+    int db;
+    struct KeySchema *prev, *next;  // the registry of key schemas
+} KeySchema;
+
+/**
+* Compiles a schema from its JSON and registers it. Returns NULL and sets err to the reason if the
+* JSON or the schema is invalid.
+*/
+KeySchema *NewKeySchema(const char *prefix, size_t prefixlen, const char *json, size_t jsonlen,
+                        int db, sds *err);
+
+/* Unregisters a key schema and frees it. */
+void KeySchema_Free(KeySchema *ks);
+
+/* Returns the schema of a key, the one with the longest matching prefix, or NULL if none. */
+const Schema *KeySchema_Find(int db, const char *key, size_t len);
+
+void *SchemaTypeRdbLoad(RedisModuleIO *rdb, int encver);
+void SchemaTypeRdbSave(RedisModuleIO *rdb, void *value);
+void SchemaTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+void SchemaTypeFree(void *value);
+size_t SchemaTypeMemoryUsage(const void *value);
+
+#endif
@@ -0,0 +1,394 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include "sindex.h"
+
+/* An entry of an index, a value of a document in a skiplist */
+typedef struct sindexEntry {
+    double score;  // the value of numeric entries, 0 in tag indexes
+    sds tag;       // the value of tag entries, NULL in numeric indexes
+    SIndexDoc *doc;
+    int level;
+    struct sindexEntry *next[];
+} sindexEntry;
+
+// the registered indexes
+static SIndex *__sindexes = NULL;
+
+// the last query, stamped on the documents it matched
+static uint64_t __sindexQuery = 0;
+
+// the state of the skiplists' level generator
+static uint32_t __sindexSeed = 2463534242u;
+
+/* Returns a random level for a new entry, where every level is 4 times less likely. */
+static int __sindex_randomLevel() {
+    int level = 1;
+    for (;;) {
+        __sindexSeed ^= __sindexSeed << 13;
+        __sindexSeed ^= __sindexSeed >> 17;
+        __sindexSeed ^= __sindexSeed << 5;
+        if ((__sindexSeed & 3) || SINDEX_MAX_LEVEL == level) break;
+        level++;
+    }
+    return level;
+}
+
+/**
+* Compares an entry to a value of a document. A NULL document precedes the entries of all
+* documents, and tag is NULL in numeric indexes.
+*/
+static int __sindex_cmp(const sindexEntry *e, double score, const char *tag, size_t taglen,
+                        const SIndexDoc *doc) {
+    if (e->score != score) return e->score < score ? -1 : 1;
+    if (tag) {
+        size_t len = sdslen(e->tag);
+        int c = memcmp(e->tag, tag, len < taglen ? len : taglen);
+        if (c) return c;
+        if (len != taglen) return len < taglen ? -1 : 1;
+    }
+    if (!doc) return 1;
+    int c = sdscmp(e->doc->key, doc->key);
+    if (c) return c;
+    if (e->doc != doc) return (uintptr_t)e->doc < (uintptr_t)doc ? -1 : 1;
+    return 0;
+}
+
+/* Sets the last entry before a value at every level of an index. Returns the one at level 0. */
+static sindexEntry *__sindex_seek(SIndex *ix, double score, const char *tag, size_t taglen,
+                                  const SIndexDoc *doc, sindexEntry **update) {
+    sindexEntry *x = ix->head;
+    for (int i = ix->level - 1; i >= 0; i--) {
+        while (x->next[i] && __sindex_cmp(x->next[i], score, tag, taglen, doc) < 0) x = x->next[i];
+        if (update) update[i] = x;
+    }
+    return x;
+}
+
+/* Adds a value of a document to its index, unless the document already has it. */
+static void __sindexDoc_addEntry(SIndexDoc *doc, double score, const char *tag, size_t taglen) {
+    SIndex *ix = doc->ix;
+    sindexEntry *update[SINDEX_MAX_LEVEL];
+    sindexEntry *x = __sindex_seek(ix, score, tag, taglen, doc, update);
+    if (x->next[0] && !__sindex_cmp(x->next[0], score, tag, taglen, doc)) return;
+
+    int level = __sindex_randomLevel();
+    for (; ix->level < level; ix->level++) update[ix->level] = ix->head;
+    sindexEntry *e = RedisModule_Alloc(sizeof(sindexEntry) + level * sizeof(sindexEntry *));
+    e->score = score;
+    e->tag = tag ? sdsnewlen(tag, taglen) : NULL;
+    e->doc = doc;
+    e->level = level;
+    for (int i = 0; i < level; i++) {
+        e->next[i] = update[i]->next[i];
+        update[i]->next[i] = e;
+    }
+    ix->nentries++;
+
+    if (0 == (doc->nentries & (doc->nentries - 1))) {
+        size_t cap = doc->nentries ? doc->nentries * 2 : 1;
+        doc->entries = RedisModule_Realloc(doc->entries, cap * sizeof(sindexEntry *));
+    }
+    doc->entries[doc->nentries++] = e;
+}
+
+/* Unlinks an entry from its index and frees it. */
+static void __sindex_deleteEntry(SIndex *ix, sindexEntry *e) {
+    sindexEntry *update[SINDEX_MAX_LEVEL];
+    __sindex_seek(ix, e->score, e->tag, e->tag ? sdslen(e->tag) : 0, e->doc, update);
+    for (int i = 0; i < e->level; i++) update[i]->next[i] = e->next[i];
+    while (ix->level > 1 && !ix->head->next[ix->level - 1]) ix->level--;
+    ix->nentries--;
+    sdsfree(e->tag);
+    RedisModule_Free(e);
+}
+
+/* Adds a scalar to a document if it's of the kind its index keeps. */
+static void __sindexDoc_addScalar(SIndexDoc *doc, const Node *n) {
+    NodeType t = NODETYPE(n);
+    if (SINDEX_NUMERIC == doc->ix->kind && (N_INTEGER == t || N_NUMBER == t)) {
+        __sindexDoc_addEntry(doc, NODEVALUE_AS_DOUBLE(n), NULL, 0);
+    } else if (SINDEX_TAG == doc->ix->kind && N_STRING == t) {
+        char *buf;
+        __sindexDoc_addEntry(doc, 0, Node_StringData(n, &buf), n->value.strval.len);
+        Node_StringRelease(buf);
+    }
+}
+
+/* Adds the values of a node matched by an index's path to a document, arrays add their scalars. */
+static void __sindexDoc_addNode(SIndexDoc *doc, const Node *n) {
+    if (N_ARRAY != NODETYPE(n)) {
+        __sindexDoc_addScalar(doc, n);
+        return;
+    }
+    for (uint32_t i = 0; i < n->value.arrval.len; i++)
+        __sindexDoc_addScalar(doc, n->value.arrval.entries[i]);
+}
+
+/* Removes a document's entries from its index, unlinks it from its value and frees it. */
+static void __sindexDoc_free(SIndexDoc *doc) {
+    for (size_t i = 0; i < doc->nentries; i++) __sindex_deleteEntry(doc->ix, doc->entries[i]);
+    if (doc->prev) {
+        doc->prev->next = doc->next;
+    } else {
+        doc->jt->indexed = doc->next;
+    }
+    if (doc->next) doc->next->prev = doc->prev;
+    doc->ix->ndocs--;
+    RedisModule_Free(doc->entries);
+    sdsfree(doc->key);
+    RedisModule_Free(doc);
+}
+
+SIndex *NewSIndex(const char *prefix, size_t prefixlen, const char *path, size_t pathlen,
+                  SIndexKind kind, int db, JSONSearchPathError_t *err) {
+    SIndex *ix = RedisModule_Calloc(1, sizeof(SIndex));
+    ix->sp = NewSearchPath(0);
+    if (PARSE_OK != ParseJSONPath(path, pathlen, &ix->sp, err)) {
+        SearchPath_Free(&ix->sp);
+        RedisModule_Free(ix);
+        return NULL;
+    }
+    ix->prefix = sdsnewlen(prefix, prefixlen);
+    ix->path = sdsnewlen(path, pathlen);
+    ix->kind = kind;
+    ix->db = db;
+    ix->head =
+        RedisModule_Calloc(1, sizeof(sindexEntry) + SINDEX_MAX_LEVEL * sizeof(sindexEntry *));
+    ix->level = 1;
+
+    ix->next = __sindexes;
+    if (__sindexes) __sindexes->prev = ix;
+    __sindexes = ix;
+    return ix;
+}
+
+void SIndex_Free(SIndex *ix) {
+    while (ix->head->next[0]) __sindexDoc_free(ix->head->next[0]->doc);
+    if (ix->prev) {
+        ix->prev->next = ix->next;
+    } else {
+        __sindexes = ix->next;
+    }
+    if (ix->next) ix->next->prev = ix->prev;
+    RedisModule_Free(ix->head);
+    SearchPath_Free(&ix->sp);
+    sdsfree(ix->prefix);
+    sdsfree(ix->path);
+    RedisModule_Free(ix);
+}
+
+/* Returns true if a string is an upper case word, case insensitive. */
+static int __sindex_isWord(const char *s, size_t len, const char *word) {
+    if (len != strlen(word)) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (toupper((unsigned char)s[i]) != word[i]) return 0;
+    }
+    return 1;
+}
+
+int SIndex_ParseKind(const char *s, size_t len, SIndexKind *kind) {
+    if (__sindex_isWord(s, len, "NUMERIC")) {
+        *kind = SINDEX_NUMERIC;
+    } else if (__sindex_isWord(s, len, "TAG")) {
+        *kind = SINDEX_TAG;
+    } else {
+        return OBJ_ERR;
+    }
+    return OBJ_OK;
+}
+
+const char *SIndex_KindStr(SIndexKind kind) {
+    return SINDEX_NUMERIC == kind ? "NUMERIC" : "TAG";
+}
+
+int SIndex_Matches(const SIndex *ix, const char *key, size_t len) {
+    size_t plen = sdslen(ix->prefix);
+    return plen <= len && !memcmp(ix->prefix, key, plen);
+}
+
+void SIndex_RemoveDoc(SIndex *ix, JSONType_t *jt) {
+    for (SIndexDoc *doc = jt->indexed; doc; doc = doc->next) {
+        if (ix == doc->ix) {
+            __sindexDoc_free(doc);
+            return;
+        }
+    }
+}
+
+void SIndex_AddDoc(SIndex *ix, const char *key, size_t len, JSONType_t *jt) {
+    SIndex_RemoveDoc(ix, jt);
+
+    SIndexDoc *doc = RedisModule_Calloc(1, sizeof(SIndexDoc));
+    doc->ix = ix;
+    doc->jt = jt;
+    doc->key = sdsnewlen(key, len);
+    // frozen values are indexed without thawing them, as indexes are built over whole databases
+    Node *root = jt->frozen ? JSONTypeDecode(jt) : jt->root;
+    if (1 == ix->sp.len && NT_ROOT == ix->sp.nodes[0].type) {
+        __sindexDoc_addNode(doc, root);
+    } else {
+        SearchPathResults res;
+        int errnode;
+        if (E_OK == SearchPath_FindAll(&ix->sp, root, &res, &errnode)) {
+            for (size_t i = 0; i < res.len; i++) __sindexDoc_addNode(doc, res.nodes[i]);
+            SearchPathResults_Free(&res);
+        }
+    }
+    if (jt->frozen) Node_Free(root);
+
+    if (!doc->nentries) {
+        sdsfree(doc->key);
+        RedisModule_Free(doc);
+        return;
+    }
+    doc->next = jt->indexed;
+    if (jt->indexed) jt->indexed->prev = doc;
+    jt->indexed = doc;
+    ix->ndocs++;
+}
+
+void SIndex_Update(int db, const char *key, size_t len, JSONType_t *jt) {
+    for (SIndex *ix = __sindexes; ix; ix = ix->next) {
+        if (!ix->built || db != ix->db) continue;
+        if (SIndex_Matches(ix, key, len)) {
+            SIndex_AddDoc(ix, key, len, jt);
+        } else {
+            SIndex_RemoveDoc(ix, jt);
+        }
+    }
+}
+
+void SIndex_Forget(JSONType_t *jt) {
+    while (jt->indexed) __sindexDoc_free(jt->indexed);
+}
+
+int SIndex_Any() { return NULL != __sindexes; }
+
+void SIndex_QueryRange(SIndex *ix, double min, int minex, double max, int maxex,
+                       SIndexQueryFunc fn, void *arg) {
+    if (SINDEX_NUMERIC != ix->kind) return;
+    uint64_t query = ++__sindexQuery;
+    for (sindexEntry *e = __sindex_seek(ix, min, NULL, 0, NULL, NULL)->next[0]; e; e = e->next[0]) {
+        if (minex && e->score == min) continue;
+        if (e->score > max || (maxex && e->score == max)) break;
+        if (query == e->doc->seen) continue;
+        e->doc->seen = query;
+        if (!fn(arg, e->doc)) break;
+    }
+}
+
+void SIndex_QueryTag(SIndex *ix, const char *tag, size_t len, SIndexQueryFunc fn, void *arg) {
+    if (SINDEX_TAG != ix->kind) return;
+    for (sindexEntry *e = __sindex_seek(ix, 0, tag, len, NULL, NULL)->next[0]; e; e = e->next[0]) {
+        if (len != sdslen(e->tag) || memcmp(e->tag, tag, len)) break;
+        if (!fn(arg, e->doc)) break;
+    }
+}
+
+/* Returns true if a query matches a scalar. */
+static int __sindex_matchScalar(const SIndex *ix, const SIndexQuery *q, const Node *n) {
+    NodeType t = NODETYPE(n);
+    if (SINDEX_NUMERIC == ix->kind && (N_INTEGER == t || N_NUMBER == t)) {
+        double v = NODEVALUE_AS_DOUBLE(n);
+        return (v > q->min || (!q->minex && v == q->min)) &&
+               (v < q->max || (!q->maxex && v == q->max));
+    }
+    if (SINDEX_TAG == ix->kind && N_STRING == t && q->len == n->value.strval.len) {
+        char *buf;
+        int match = !memcmp(Node_StringData(n, &buf), q->tag, q->len);
+        Node_StringRelease(buf);
+        return match;
+    }
+    return 0;
+}
+
+/* Returns true if a query matches a node matched by an index's path, or one of its scalars. */
+static int __sindex_matchNode(const SIndex *ix, const SIndexQuery *q, const Node *n) {
+    if (N_ARRAY != NODETYPE(n)) return __sindex_matchScalar(ix, q, n);
+    for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+        if (__sindex_matchScalar(ix, q, n->value.arrval.entries[i])) return 1;
+    }
+    return 0;
+}
+
+int SIndex_QueryMatches(const SIndex *ix, const SIndexQuery *q, const Node *root) {
+    if (1 == ix->sp.len && NT_ROOT == ix->sp.nodes[0].type) return __sindex_matchNode(ix, q, root);
+    SearchPathResults res;
+    int errnode, match = 0;
+    if (E_OK == SearchPath_FindAll((SearchPath *)&ix->sp, (Node *)root, &res, &errnode)) {
+        for (size_t i = 0; !match && i < res.len; i++) {
+            match = __sindex_matchNode(ix, q, res.nodes[i]);
+        }
+        SearchPathResults_Free(&res);
+    }
+    return match;
+}
+
+void *SIndexTypeRdbLoad(RedisModuleIO *rdb, int encver) {
+    if (encver < 0 || encver > SINDEXTYPE_ENCODING_VERSION) {
+        RedisModule_LogIOError(
+            rdb, RM_LOGLEVEL_WARNING,
+            "Can't load index from RDB due to unknown encoding version %d, expecting %d at most",
+            encver, SINDEXTYPE_ENCODING_VERSION);
+        return NULL;
+    }
+
+    size_t prefixlen, pathlen;
+    char *prefix = RedisModule_LoadStringBuffer(rdb, &prefixlen);
+    char *path = RedisModule_LoadStringBuffer(rdb, &pathlen);
+    SIndexKind kind = (SIndexKind)RedisModule_LoadUnsigned(rdb);
+    int db = (int)RedisModule_LoadUnsigned(rdb);
+
+    JSONSearchPathError_t err = { 0 };
+    SIndex *ix = NewSIndex(prefix, prefixlen, path, pathlen, kind, db, &err);
+    if (!ix) {
+        RedisModule_LogIOError(rdb, RM_LOGLEVEL_WARNING,
+                               "Can't load index from RDB due to an invalid path: %s", err.errmsg);
+    }
+    RedisModule_Free(prefix);
+    RedisModule_Free(path);
+    return ix;
+}
+
+void SIndexTypeRdbSave(RedisModuleIO *rdb, void *value) {
+    SIndex *ix = (SIndex *)value;
+    RedisModule_SaveStringBuffer(rdb, ix->prefix, sdslen(ix->prefix));
+    RedisModule_SaveStringBuffer(rdb, ix->path, sdslen(ix->path));
+    RedisModule_SaveUnsigned(rdb, ix->kind);
+    RedisModule_SaveUnsigned(rdb, ix->db);
+}
+
+void SIndexTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+    SIndex *ix = (SIndex *)value;
+    RedisModule_EmitAOF(aof, "JSON.INDEX", "csbbc", "CREATE", key, ix->prefix,
+                        sdslen(ix->prefix), ix->path, sdslen(ix->path), SIndex_KindStr(ix->kind));
+}
+
+void SIndexTypeFree(void *value) {
+    // the list of indexes and the values' documents are only changed by the main thread
+    if (!JSONTypeDeferFree(SIndexTypeFree, value)) SIndex_Free((SIndex *)value);
+}
+
+size_t SIndexTypeMemoryUsage(const void *value) {
+    const SIndex *ix = (const SIndex *)value;
+    // entries have 4/3 levels on average, and are referenced by their documents
+    return sizeof(SIndex) + sdsalloc(ix->prefix) + sdsalloc(ix->path) +
+           ix->nentries * (sizeof(sindexEntry) + 3 * sizeof(sindexEntry *)) +
+           ix->ndocs * sizeof(SIndexDoc);
+}
@@ -0,0 +1,146 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SINDEX_H__
+#define __SINDEX_H__
+
+#include <stdint.h>
+#include <sds.h>
+#include "json_type.h"
+#include "json_path.h"
+#include "path.h"
+#include "redismodule.h"
+
+// The module type of secondary indexes, which are stored as keys
+#define SINDEXTYPE_NAME "ReJSON-IX"
+#define SINDEXTYPE_ENCODING_VERSION 0
+
+// The maximal level of an index's skiplist, enough for 4^16 entries
+#define SINDEX_MAX_LEVEL 16
+
+/* The kinds of values that an index keeps */
+typedef enum {
+    SINDEX_NUMERIC,  // integers and numbers, queried by range
+    SINDEX_TAG,      // strings, queried by equality
+} SIndexKind;
+
+struct sindexEntry;
+struct SIndexDoc;
+
+/**
+* A secondary index of the values at a path in the JSON keys whose names start with a prefix, in a
+* database, including the scalars of matched arrays. Indexes are kept up to date by SIndex_Update and
+* SIndex_Forget. Only the definition is persisted, a loaded index is built by scanning the keys on
+* first use.
+*/
+typedef struct SIndex {
+    sds prefix;
+    sds path;
+    SearchPath sp;
+    SIndexKind kind;
+    int db;
+    int built;                  // set once the keys that existed when it was created are indexed
+    size_t ndocs;               // the number of values with entries
+    size_t nentries;
+    struct sindexEntry *head;   // the skiplist of entries, ordered by value, key name and document
+    int level;
+    struct SIndex *prev, *next;  // the registry of indexes
+} SIndex;
+
+/* The entries of a JSON value in an index, linked to the value's other indexes' documents */
+typedef struct SIndexDoc {
+    SIndex *ix;
+    JSONType_t *jt;
+    sds key;
+    struct sindexEntry **entries;
+    size_t nentries;
+    uint64_t seen;  // the last query that matched the document
+    struct SIndexDoc *prev, *next;
+} SIndexDoc;
+
+/**
+* Creates an empty index and registers it. Returns NULL and sets err if the path is invalid. The
+* kind is parsed from a string with SIndex_ParseKind.
+*/
+SIndex *NewSIndex(const char *prefix, size_t prefixlen, const char *path, size_t pathlen,
+                  SIndexKind kind, int db, JSONSearchPathError_t *err);
+
+/* Unregisters an index and frees it, removing it from the values it has indexed. */
+void SIndex_Free(SIndex *ix);
+
+/* Parses NUMERIC or TAG, case insensitive. Returns OBJ_ERR for anything else. */
+int SIndex_ParseKind(const char *s, size_t len, SIndexKind *kind);
+const char *SIndex_KindStr(SIndexKind kind);
+
+/* Returns true if a key name is covered by an index. */
+int SIndex_Matches(const SIndex *ix, const char *key, size_t len);
+
+/**
+* (Re)indexes a JSON value under its key name, replacing its previous entries. Values without
+* anything to index at the path are removed from the index. Frozen values stay frozen.
+*/
+void SIndex_AddDoc(SIndex *ix, const char *key, size_t len, JSONType_t *jt);
+
+/* Removes a JSON value from an index. */
+void SIndex_RemoveDoc(SIndex *ix, JSONType_t *jt);
+
+/**
+* Updates the built indexes of a database after a JSON value was set or modified. Must be called by
+* every command that modifies a value, after the modification.
+*/
+void SIndex_Update(int db, const char *key, size_t len, JSONType_t *jt);
+
+/* Removes a JSON value from all the indexes, called when it is freed. */
+void SIndex_Forget(JSONType_t *jt);
+
+/* Returns true if there are any indexes, so callers can skip the work of updating them. */
+int SIndex_Any();
+
+/**
+* A callback of a query, called once with every matching document, in the order of its first
+* matching value. Returns 0 to stop the query.
+*/
+typedef int (*SIndexQueryFunc)(void *arg, const SIndexDoc *doc);
+
+/* Queries a numeric index for the values between min and max, exclusive bounds are flagged. */
+void SIndex_QueryRange(SIndex *ix, double min, int minex, double max, int maxex,
+                      SIndexQueryFunc fn, void *arg);
+
+/* Queries a tag index for a string. */
+void SIndex_QueryTag(SIndex *ix, const char *tag, size_t len, SIndexQueryFunc fn, void *arg);
+
+/* The arguments of a query, the bounds of a numeric index's or the string of a tag index's. */
+typedef struct SIndexQuery {
+    double min, max;
+    int minex, maxex;
+    const char *tag;
+    size_t len;
+} SIndexQuery;
+
+/**
+* Returns true if a query matches a JSON value's root, e.g. a copy of an indexed value, without
+* its index's entries.
+*/
+int SIndex_QueryMatches(const SIndex *ix, const SIndexQuery *q, const Node *root);
+
+void *SIndexTypeRdbLoad(RedisModuleIO *rdb, int encver);
+void SIndexTypeRdbSave(RedisModuleIO *rdb, void *value);
+void SIndexTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+void SIndexTypeFree(void *value);
+size_t SIndexTypeMemoryUsage(const void *value);
+
+#endif
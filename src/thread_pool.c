@@ -0,0 +1,103 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include "object.h"
+#include "thread_pool.h"
+
+static struct {
+    pthread_mutex_t lock;  // guards the job and the counters
+    pthread_cond_t start;  // signalled when a job starts
+    pthread_cond_t done;   // signalled when the last worker finishes its share of a job
+    size_t size;           // number of workers
+    uint64_t generation;   // incremented by every job
+    size_t busy;           // workers that are still running the current job
+    ThreadPoolTask task;
+    void *arg;
+    size_t n;
+    size_t next;           // the next item of the job, claimed atomically
+} __pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/* Runs items of the current job until none are left. */
+static void _ThreadPool_Work(ThreadPoolTask task, void *arg, size_t n) {
+    size_t i;
+    while ((i = __atomic_fetch_add(&__pool.next, 1, __ATOMIC_RELAXED)) < n) task(arg, i);
+}
+
+static void *_ThreadPool_Main(void *unused) {
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&__pool.lock);
+    while (1) {
+        while (__pool.generation == generation) pthread_cond_wait(&__pool.start, &__pool.lock);
+        generation = __pool.generation;
+        ThreadPoolTask task = __pool.task;
+        void *arg = __pool.arg;
+        size_t n = __pool.n;
+        pthread_mutex_unlock(&__pool.lock);
+
+        _ThreadPool_Work(task, arg, n);
+
+        pthread_mutex_lock(&__pool.lock);
+        if (!--__pool.busy) pthread_cond_signal(&__pool.done);
+    }
+    return NULL;
+}
+
+int ThreadPool_Start(size_t size) {
+    if (__pool.size) return OBJ_ERR;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_mutex_lock(&__pool.lock);
+    for (size_t i = 0; i < size; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, _ThreadPool_Main, NULL)) break;
+        __pool.size++;
+    }
+    pthread_mutex_unlock(&__pool.lock);
+    pthread_attr_destroy(&attr);
+
+    return __pool.size == size ? OBJ_OK : OBJ_ERR;
+}
+
+size_t ThreadPool_Size() { return __pool.size; }
+
+void ThreadPool_Run(ThreadPoolTask task, void *arg, size_t n) {
+    if (!__pool.size || n < 2) {
+        for (size_t i = 0; i < n; i++) task(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&__pool.lock);
+    __pool.task = task;
+    __pool.arg = arg;
+    __pool.n = n;
+    __pool.next = 0;
+    __pool.busy = __pool.size;
+    __pool.generation++;
+    pthread_cond_broadcast(&__pool.start);
+    pthread_mutex_unlock(&__pool.lock);
+
+    _ThreadPool_Work(task, arg, n);
+
+    pthread_mutex_lock(&__pool.lock);
+    while (__pool.busy) pthread_cond_wait(&__pool.done, &__pool.lock);
+    pthread_mutex_unlock(&__pool.lock);
+}
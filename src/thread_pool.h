@@ -0,0 +1,42 @@
+/*
+* Copyright (C) 2016 Redis Labs
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <stddef.h>
+
+/*
+* A module-owned pool of worker threads for splitting a command's read-only work. A job is a task
+* that's run for every item in a range, by the workers and by the calling thread together, and it
+* returns once all the items are done. As the calling thread is blocked meanwhile, the keyspace
+* doesn't change under the workers. Only the main thread runs jobs, one at a time.
+*/
+
+/* A job's task, that's called with the job's argument and an item's index. */
+typedef void (*ThreadPoolTask)(void *arg, size_t i);
+
+/** Starts the pool's workers. Returns OBJ_ERR if it had been started or a worker can't start. */
+int ThreadPool_Start(size_t size);
+
+/** Returns the number of workers in the pool. */
+size_t ThreadPool_Size();
+
+/** Runs a task for items 0 to n - 1, on the calling thread alone if the pool has no workers. */
+void ThreadPool_Run(ThreadPoolTask task, void *arg, size_t n);
+
+#endif
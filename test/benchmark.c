@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../src/object.h"
+#include "../src/json_object.h"
+#include "../src/json_index.h"
+#include "../src/sindex.h"
+#include "../src/schema.h"
+#include "../src/expiry.h"
+#include <alloc.h>
+
+/* Micro-benchmarks for the object's internals. Run with `make benchmark`. */
+
+#define BENCH_LOOKUPS 1000000
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* Reports the average time of a dictionary lookup as the number of fields grows. */
+static void bench_dict_lookup(uint32_t threshold) {
+    static const int sizes[] = {8, 32, 128, 512, 2048, 8192, 32768, 0};
+    char key[32];
+
+    Node_DictSetIndexThreshold(threshold);
+    printf("dict lookup (index threshold %u)\n", threshold);
+    for (int s = 0; sizes[s]; s++) {
+        int size = sizes[s];
+        Node *n, *dict = NewDictNode(1);
+        for (int i = 0; i < size; i++) {
+            sprintf(key, "field%d", i);
+            Node_DictSet(dict, key, NULL);
+        }
+
+        // unindexed lookups are slow so the number of lookups is scaled down
+        int lookups = threshold ? BENCH_LOOKUPS : BENCH_LOOKUPS / (size / 8);
+        double start = now_ns();
+        for (int i = 0; i < lookups; i++) {
+            sprintf(key, "field%u", (i * 7919u) % size);
+            Node_DictGet(dict, key, &n);
+        }
+        double elapsed = now_ns() - start;
+        printf("  %6d fields: %8.1f ns/lookup\n", size, elapsed / lookups);
+
+        Node_Free(dict);
+    }
+    Node_DictSetIndexThreshold(OBJ_DICT_INDEX_THRESHOLD);
+}
+
+/* Reports the serialization throughput of a few typical values. */
+static void bench_serialize() {
+    const size_t strsize = 4 * 1024 * 1024;
+    const int count = 100000;
+    JSONSerializeOpt opt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    Node *values[4];
+    const char *names[] = {"long string", "array of numbers", "array of integers", "object"};
+    char key[32];
+
+    // a long string with an escape every 100 characters
+    char *str = malloc(strsize);
+    for (size_t i = 0; i < strsize; i++) str[i] = i % 100 ? 'a' + i % 26 : '"';
+    values[0] = NewStringNode(str, strsize);
+    free(str);
+
+    values[1] = NewArrayNode(count);
+    values[2] = NewArrayNode(count);
+    values[3] = NewDictNode(count);
+    for (int i = 0; i < count; i++) {
+        Node_ArrayAppend(values[1], NewDoubleNode(i * 1.1));
+        Node_ArrayAppend(values[2], NewIntNode(i * 7919));
+        sprintf(key, "key%d", i);
+        Node_DictSet(values[3], key, NewCStringNode(key));
+    }
+
+    printf("serialize\n");
+    for (int v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+        int reps = 10;
+        size_t len = 0;
+        double start = now_ns();
+        for (int i = 0; i < reps; i++) {
+            sds json = sdsempty();
+            SerializeNodeToJSON(values[v], &opt, &json);
+            len = sdslen(json);
+            sdsfree(json);
+        }
+        double elapsed = now_ns() - start;
+        printf("  %-18s %8.1f MB/s\n", names[v], (double)len * reps / (elapsed / 1e9) / 1e6);
+        Node_Free(values[v]);
+    }
+}
+
+/* Reports the parsing throughput of a few typical documents with every parser. */
+static void bench_parse() {
+    const int count = 100000;
+    JSONSerializeOpt opt = {.indentstr = "  ", .newlinestr = "\n", .spacestr = " "};
+    const char *names[] = {"long string", "array of numbers", "array of objects"};
+    const char *parsers[] = {"jsonsl", "indexed"};
+    sds docs[3];
+    char str[32];
+
+    // a long string with an escape every 100 characters
+    docs[0] = sdsnew("\"");
+    for (int i = 0; i < count; i++) docs[0] = sdscat(docs[0], i % 2 ? "abcdefghijklmnopqrstuvwxyz" : "0123456789abcdefghijklmnopqrstuvwx\\\\");
+    docs[0] = sdscat(docs[0], "\"");
+
+    Node *numbers = NewArrayNode(count), *objects = NewArrayNode(count);
+    for (int i = 0; i < count; i++) {
+        Node_ArrayAppend(numbers, i % 2 ? NewDoubleNode(i * 1.1) : NewIntNode(i * 7919));
+        Node *obj = NewDictNode(5), *tags = NewArrayNode(2);
+        sprintf(str, "user%d", i);
+        Node_DictSet(obj, "id", NewIntNode(i));
+        Node_DictSet(obj, "name", NewCStringNode(str));
+        Node_DictSet(obj, "score", NewDoubleNode(i * 1.1));
+        Node_DictSet(obj, "active", NewBoolNode(i % 2));
+        Node_ArrayAppend(tags, NewCStringNode("redis"));
+        Node_ArrayAppend(tags, NewCStringNode("json"));
+        Node_DictSet(obj, "tags", tags);
+        Node_ArrayAppend(objects, obj);
+    }
+    docs[1] = sdsempty();
+    SerializeNodeToJSON(numbers, &opt, &docs[1]);
+    docs[2] = sdsempty();
+    SerializeNodeToJSON(objects, &opt, &docs[2]);
+    Node_Free(numbers);
+    Node_Free(objects);
+
+    printf("parse (index implementation %s)\n", JSONIndex_GetImplementation());
+    for (int d = 0; d < sizeof(docs) / sizeof(docs[0]); d++) {
+        for (int p = 0; p < sizeof(parsers) / sizeof(parsers[0]); p++) {
+            int reps = 10;
+            SetJSONParser(p ? JSONOBJECT_PARSER_INDEXED : JSONOBJECT_PARSER_JSONSL);
+            double start = now_ns();
+            for (int i = 0; i < reps; i++) {
+                Node *n;
+                CreateNodeFromJSON(docs[d], sdslen(docs[d]), &n, NULL);
+                Node_Free(n);
+            }
+            double elapsed = now_ns() - start;
+            printf("  %-18s %-8s %8.1f MB/s\n", names[d], parsers[p],
+                   (double)sdslen(docs[d]) * reps / (elapsed / 1e9) / 1e6);
+        }
+        sdsfree(docs[d]);
+    }
+    SetJSONParser(JSONOBJECT_PARSER_JSONSL);
+}
+
+/* Counts the documents that a query matched. */
+static int _countDocs(void *arg, const SIndexDoc *doc) {
+    (*(long *)arg)++;
+    return 1;
+}
+
+/* Reports the time of a range query of a secondary index vs. that of scanning the documents. */
+static void bench_sindex() {
+    const int count = 100000, queries = 1000, width = 100;
+    JSONType_t **jts = RedisModule_Alloc(count * sizeof(JSONType_t *));
+    SIndex *ix = NewSIndex("doc:", 4, "score", 5, SINDEX_NUMERIC, 0, NULL);
+    SearchPath sp = NewSearchPath(0);
+    ParseJSONPath("score", 5, &sp, NULL);
+    char key[32];
+
+    for (int i = 0; i < count; i++) {
+        Node *obj = NewDictNode(2);
+        Node_DictSet(obj, "id", NewIntNode(i));
+        Node_DictSet(obj, "score", NewIntNode((i * 7919) % count));
+        jts[i] = NewJSONType(obj, NULL);
+        sprintf(key, "doc:%d", i);
+        SIndex_AddDoc(ix, key, strlen(key), jts[i]);
+    }
+
+    printf("secondary index (%d documents, %d matches per query)\n", count, width);
+    long matches = 0;
+    double start = now_ns();
+    for (int q = 0; q < queries; q++) {
+        double min = (q * 97) % (count - width);
+        SIndex_QueryRange(ix, min, 0, min + width - 1, 0, _countDocs, &matches);
+    }
+    double indexed = (now_ns() - start) / queries;
+
+    // scanning is slow so the number of queries is scaled down
+    long scanned = 0;
+    start = now_ns();
+    for (int q = 0; q < queries / 100; q++) {
+        double min = (q * 97) % (count - width);
+        for (int i = 0; i < count; i++) {
+            Node *n;
+            if (E_OK != SearchPath_Find(&sp, jts[i]->root, &n)) continue;
+            double v = NODEVALUE_AS_DOUBLE(n);
+            if (v >= min && v <= min + width - 1) scanned++;
+        }
+    }
+    double scan = (now_ns() - start) / (queries / 100);
+    printf("  %-8s %10.1f us/query (%ld matches)\n", "index", indexed / 1e3, matches / queries);
+    printf("  %-8s %10.1f us/query (%ld matches)\n", "scan", scan / 1e3, scanned / (queries / 100));
+
+    SIndex_Free(ix);
+    for (int i = 0; i < count; i++) JSONTypeFree(jts[i]);
+    RedisModule_Free(jts);
+    SearchPath_Free(&sp);
+}
+
+/* Compares parsing documents with parsing and validating them against a schema. */
+static void bench_schema() {
+    const int count = 100000, reps = 10;
+    JSONSerializeOpt opt = {0};
+    Node *objects = NewArrayNode(count);
+    char str[32];
+    for (int i = 0; i < count; i++) {
+        Node *obj = NewDictNode(4), *tags = NewArrayNode(2);
+        sprintf(str, "user%d", i);
+        Node_DictSet(obj, "id", NewIntNode(i));
+        Node_DictSet(obj, "name", NewCStringNode(str));
+        Node_DictSet(obj, "score", NewDoubleNode(i * 1.1));
+        Node_ArrayAppend(tags, NewCStringNode("redis"));
+        Node_ArrayAppend(tags, NewCStringNode("json"));
+        Node_DictSet(obj, "tags", tags);
+        Node_ArrayAppend(objects, obj);
+    }
+    sds doc = sdsempty();
+    SerializeNodeToJSON(objects, &opt, &doc);
+    Node_Free(objects);
+
+    const char *json =
+        "{\"type\":\"array\",\"items\":{\"type\":\"object\",\"required\":[\"id\",\"name\"],"
+        "\"additionalProperties\":false,\"properties\":{\"id\":{\"type\":\"integer\","
+        "\"minimum\":0},\"name\":{\"type\":\"string\",\"maxLength\":32},\"score\":"
+        "{\"type\":\"number\"},\"tags\":{\"type\":\"array\",\"items\":{\"enum\":"
+        "[\"redis\",\"json\"]}}}}}";
+    Node *n;
+    CreateNodeFromJSON(json, strlen(json), &n, NULL);
+    Schema *s = Schema_Compile(n, NULL);
+    Node_Free(n);
+
+    printf("schema validation (%d objects)\n", count);
+    for (int v = 0; v < 2; v++) {
+        double start = now_ns();
+        for (int i = 0; i < reps; i++) {
+            sds err = NULL;
+            CreateNodeFromJSON(doc, sdslen(doc), &n, NULL);
+            if (v) Schema_Validate(s, Schema_Root(s), n, ".", &err);
+            Node_Free(n);
+            sdsfree(err);
+        }
+        double elapsed = now_ns() - start;
+        printf("  %-18s %8.1f MB/s\n", v ? "parse and validate" : "parse",
+               (double)sdslen(doc) * reps / (elapsed / 1e9) / 1e6);
+    }
+
+    Schema_Free(s);
+    sdsfree(doc);
+}
+
+/**
+* Compares expiring the sessions of documents with the timer wheel, to a sweep of every session
+* each second, over an hour.
+*/
+static void bench_expiry() {
+    const int docs = 1000, sessions = 100, seconds = 3600;
+    const uint64_t base = 1000000;
+    JSONType_t **jts = RedisModule_Alloc(docs * sizeof(JSONType_t *));
+    char key[32];
+    for (int i = 0; i < docs; i++) {
+        Node *root = NewDictNode(sessions);
+        for (int j = 0; j < sessions; j++) {
+            Node *session = NewDictNode(1);
+            long exp = base + ((i * sessions + j) * 7919L) % (seconds * 1000L);
+            Node_DictSet(session, "exp", NewIntNode(exp));
+            sprintf(key, "s%d", j);
+            Node_DictSet(root, key, session);
+        }
+        jts[i] = NewJSONType(root, NULL);
+    }
+
+    printf("expiry (%d sessions over %d seconds)\n", docs * sessions, seconds);
+    Expiry_Advance(base);
+    double start = now_ns();
+    for (int i = 0; i < docs; i++) {
+        for (int j = 0; j < sessions; j++) {
+            sprintf(key, "[\"s%d\"]", j);
+            Expiry_Set(jts[i], 0, "doc", 3, key, strlen(key),
+                       base + ((i * sessions + j) * 7919L) % (seconds * 1000L));
+        }
+    }
+    long expired = 0;
+    for (int t = 1; t <= seconds; t++) {
+        Expiry_Advance(base + t * 1000);
+        ExpiryEntry *e;
+        while ((e = Expiry_NextDue())) {
+            Expiry_Remove(e);
+            expired++;
+        }
+    }
+    double wheel = (now_ns() - start) / seconds;
+
+    // sweeping is slow so the number of sweeps is scaled down
+    long swept = 0;
+    start = now_ns();
+    for (int t = 1; t <= seconds / 100; t++) {
+        for (int i = 0; i < docs; i++) {
+            Node *root = jts[i]->root;
+            for (uint32_t j = 0; j < root->value.dictval.len; j++) {
+                Node *exp;
+                Node_DictGet(root->value.dictval.entries[j]->value.kvval.val, "exp", &exp);
+                if (NODE_INTVAL(exp) <= base + t * 1000) swept++;
+            }
+        }
+    }
+    double sweep = (now_ns() - start) / (seconds / 100);
+    printf("  %-8s %10.1f us/second (%ld expired)\n", "wheel", wheel / 1e3, expired);
+    printf("  %-8s %10.1f us/second (%ld past due per sweep)\n", "sweep", sweep / 1e3,
+           swept / (seconds / 100));
+
+    for (int i = 0; i < docs; i++) JSONTypeFree(jts[i]);
+    RedisModule_Free(jts);
+}
+
+/**
+* Compares the memory and the serialization throughput of HTML strings that are stored as is, to
+* that of compressed ones.
+*/
+static void bench_compress() {
+    const int count = 1000, size = 16384, reps = 10;
+    JSONSerializeOpt opt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    char *html = RedisModule_Alloc(size), row[64];
+    for (int i = 0, len = 0; i < size; i += len) {
+        len = snprintf(row, sizeof(row), "<tr><td class=\"id\">%d</td><td>item</td></tr>", i);
+        memcpy(html + i, row, i + len < size ? len : size - i);
+    }
+
+    printf("string compression (%d strings of %d bytes)\n", count, size);
+    for (int v = 0; v < 2; v++) {
+        Node_StringSetCompressThreshold(v ? 1024 : 0);
+        Node *arr = NewArrayNode(count);
+        for (int i = 0; i < count; i++) Node_ArrayAppend(arr, NewStringNode(html, size));
+
+        double start = now_ns();
+        for (int i = 0; i < reps; i++) {
+            sds json = sdsempty();
+            SerializeNodeToJSON(arr, &opt, &json);
+            sdsfree(json);
+        }
+        double elapsed = now_ns() - start;
+        printf("  %-12s %8.1f MB memory %8.1f MB/s serialized\n", v ? "compressed" : "plain",
+               (double)Node_MemoryUsage(arr) / 1e6,
+               (double)count * size * reps / (elapsed / 1e9) / 1e6);
+        Node_Free(arr);
+    }
+
+    Node_StringSetCompressThreshold(0);
+    RedisModule_Free(html);
+}
+
+static void bench_freeze() {
+    const int docs = 10000, untrained = JSONTYPE_FREEZE_SAMPLES - 1;
+    JSONType_t **jts = RedisModule_Alloc(docs * sizeof(JSONType_t *));
+    char json[256];
+    size_t plain = 0, cold = 0, trained = 0;
+    for (int i = 0; i < docs; i++) {
+        Node *root;
+        snprintf(json, sizeof(json),
+                 "{\"id\":%d,\"name\":\"user %d\",\"email\":\"user%d@example.com\","
+                 "\"active\":%s,\"address\":{\"city\":\"city %d\",\"zip\":\"%05d\"}}",
+                 i, i, i, i % 2 ? "true" : "false", i % 100, i * 7 % 100000);
+        CreateNodeFromJSON(json, strlen(json), &root, NULL);
+        jts[i] = NewJSONType(root, NULL);
+        plain += JSONTypeMemoryUsage(jts[i]);
+    }
+
+    // the first values are frozen before the dictionary is trained on them
+    printf("cold documents (%d small documents)\n", docs);
+    JSONTypeFreezeReset();
+    double start = now_ns();
+    for (int i = 0; i < docs; i++) {
+        JSONTypeFreeze(jts[i]);
+        if (i < untrained)
+            cold += JSONTypeMemoryUsage(jts[i]);
+        else
+            trained += JSONTypeMemoryUsage(jts[i]);
+    }
+    double freeze = (now_ns() - start) / docs;
+    start = now_ns();
+    for (int i = 0; i < docs; i++) JSONTypeThaw(jts[i]);
+    double thaw = (now_ns() - start) / docs;
+
+    JSONTypeFreezeStats stats;
+    JSONTypeGetFreezeStats(&stats);
+    printf("  %-12s %8.1f bytes/document\n", "plain", (double)plain / docs);
+    printf("  %-12s %8.1f bytes/document\n", "frozen", (double)cold / untrained);
+    printf("  %-12s %8.1f bytes/document (%zu bytes dictionary)\n", "dictionary",
+           (double)trained / (docs - untrained), stats.dictionary);
+    printf("  %8.0f ns/freeze %8.0f ns/thaw\n", freeze, thaw);
+
+    for (int i = 0; i < docs; i++) JSONTypeFree(jts[i]);
+    JSONTypeFreezeReset();
+    RedisModule_Free(jts);
+}
+
+int main(int argc, char *argv[]) {
+    RMUtil_InitAlloc();
+
+    bench_dict_lookup(0);
+    bench_dict_lookup(OBJ_DICT_INDEX_THRESHOLD);
+    bench_serialize();
+    bench_parse();
+    bench_sindex();
+    bench_schema();
+    bench_expiry();
+    bench_compress();
+    bench_freeze();
+
+    return 0;
+}
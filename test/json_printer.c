@@ -1,10 +1,17 @@
 #include <stdio.h>
+#include <string.h>
 #include <alloc.h>
 #include "../src/json_object.h"
 
 int main(int argc, char **argv) {
+    // -i selects the indexed parser
+    if (3 == argc && !strcmp(argv[1], "-i")) {
+        SetJSONParser(JSONOBJECT_PARSER_INDEXED);
+        argv++;
+        argc--;
+    }
     if (argc != 2) {
-        printf("usage: %s filename\n", argv[0]);
+        printf("usage: %s [-i] filename\n", argv[0]);
         exit(1);
     }
     RMUtil_InitAlloc();
@@ -3,6 +3,7 @@ import redis
 import unittest
 import json
 import os
+import time
 
 # Path to JSON test case files
 json_path = os.path.abspath(os.path.join(os.getcwd(), '../files'))
@@ -205,6 +206,104 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
             data = json.loads(r.execute_command('JSON.GET', 'test', *docs['values'].keys()))
             self.assertDictEqual(data, docs['values'])
 
+    def testGetChunked(self):
+        """Test that JSON.GET CHUNKED replies with the serialization in chunks"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'key{}'.format(i): ['x' * 100, i] for i in range(1000)}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            for _ in range(2):  # the second time from the serialized-value cache
+                whole = r.execute_command('JSON.GET', 'test', 'INDENT', '\t')
+                chunks = r.execute_command('JSON.GET', 'test', 'INDENT', '\t', 'CHUNKED')
+                self.assertGreater(len(chunks), 1)
+                self.assertTrue(all(len(c) == 65536 for c in chunks[:-1]))
+                self.assertEqual(whole, ''.join(chunks))
+                self.assertEqual(doc, json.loads(''.join(chunks)))
+            chunks = r.execute_command('JSON.GET', 'test', 'CHUNKED', '.key1', '.key2')
+            self.assertEqual({'.key1': doc['key1'], '.key2': doc['key2']}, json.loads(''.join(chunks)))
+            self.assertIsNone(r.execute_command('JSON.GET', 'missing', 'CHUNKED'))
+
+    def testGetSlices(self):
+        """Test that array slices in paths select ranges of elements"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'arr': [{'x': i} for i in range(10)], 'str': 'foo'}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            for path, expected in [('.arr[2:5]', doc['arr'][2:5]),
+                                   ('.arr[:-8]', doc['arr'][:-8]),
+                                   ('.arr[::3]', doc['arr'][::3]),
+                                   ('.arr[::-4]', doc['arr'][::-4]),
+                                   ('.arr[7:100]', doc['arr'][7:100]),
+                                   ('.arr[5:2]', []),
+                                   ('.arr[1::2].x', [1, 3, 5, 7, 9]),
+                                   ('.arr[-2:].y', [])]:
+                self.assertEqual(expected, json.loads(r.execute_command('JSON.GET', 'test', path)))
+            res = json.loads(r.execute_command('JSON.GET', 'test', '.arr[:2]', '.str'))
+            self.assertEqual({'.arr[:2]': doc['arr'][:2], '.str': 'foo'}, res)
+            self.assertEqual(['[3,4]', None], r.execute_command('JSON.MGET', 'test', 'missing', '.arr[3:5].x'))
+
+            # slices are only for arrays, and other commands don't take them
+            for args in [('JSON.GET', 'test', '.str[1:]'), ('JSON.GET', 'test', '.arr[1:2:0]'),
+                         ('JSON.GET', 'test', '.nope[1:]'), ('JSON.TYPE', 'test', '.arr[1:]'),
+                         ('JSON.SET', 'test', '.arr[1:]', '1'), ('JSON.DEL', 'test', '.arr[:]')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+
+    def testGetWildcards(self):
+        """Test that wildcards and recursive descents in paths select all the matching values"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'orders': [{'total': 10, 'items': [{'total': 3}]}, {'total': 20}, {'id': 3}],
+                   'meta': {'a': 1, 'b': [2]}}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            for path, expected in [('.orders[*].total', [10, 20]),
+                                   ('.orders.*.total', [10, 20]),
+                                   ('.meta.*', [1, [2]]),
+                                   ('.meta[*]', [1, [2]]),
+                                   ('..total', [10, 3, 20]),
+                                   ('.orders..items[*].total', [3]),
+                                   ('..b[0]', [2]),
+                                   ('.orders[*].nope', [])]:
+                self.assertEqual(expected, json.loads(r.execute_command('JSON.GET', 'test', path)))
+            res = json.loads(r.execute_command('JSON.GET', 'test', '..id', '.orders[1:][*]'))
+            self.assertEqual({'..id': [3], '.orders[1:][*]': []}, res)
+            self.assertEqual(['[1,[2]]'], r.execute_command('JSON.MGET', 'test', '.meta.*'))
+
+            # wildcards are only for containers, and other commands don't take them
+            for args in [('JSON.GET', 'test', '.meta.a.*'), ('JSON.GET', 'test', '.orders..'),
+                         ('JSON.GET', 'test', '.orders[*'), ('JSON.ARRLEN', 'test', '..items'),
+                         ('JSON.SET', 'test', '.orders[*]', '1'), ('JSON.DEL', 'test', '..total')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+
+    def testGetFilters(self):
+        """Test that filters in paths select the elements that satisfy their expressions"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'items': [{'price': 5, 'tag': 'x'}, {'price': 15, 'tag': 'x'},
+                             {'price': 7.5, 'tag': 'y', 'sale': True}, {'tag': 'x'}, 3]}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            items = doc['items']
+            for path, expected in [('.items[?(@.price < 10 && @.tag == "x")]', [items[0]]),
+                                   ('.items[?(@.price < 10 || @.tag == "x")].tag', ['x', 'x', 'y', 'x']),
+                                   ('.items[?(!@.price)]', items[3:]),
+                                   ('.items[?(@.sale == true)].price', [7.5]),
+                                   ("..[?(@.tag != 'x')].price", [7.5]),
+                                   ('.items[?(@ >= 3)]', [3]),
+                                   ('.items[?(@.price > 100)]', [])]:
+                self.assertEqual(expected, json.loads(r.execute_command('JSON.GET', 'test', path)))
+
+            for args in [('JSON.GET', 'test', '.items[?(@.price < )]'), ('JSON.GET', 'test', '.items[?(1 < 2)]'),
+                         ('JSON.GET', 'test', '.items[0][?(@)]'), ('JSON.SET', 'test', '.items[?(@)]', '1')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+
     def testMgetCommand(self):
         """Test REJSON.MGET command"""
 
@@ -231,6 +330,21 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
             self.assertTrue(json.loads(raw[1]))
             self.assertEqual(raw[2], None)
 
+            # Test an MGET over enough keys for the worker threads, replies are in the keys' order
+            keys = []
+            for d in range(100):
+                key = 'many:{}'.format(d)
+                keys.append(key)
+                r.delete(key)
+                if d % 10 == 3:
+                    r.set(key, 'not json')
+                elif d % 10 != 7:
+                    self.assertOk(r.execute_command('JSON.SET', key, '.', json.dumps({'n': d})))
+            raw = r.execute_command('JSON.MGET', *keys + ['.n'])
+            self.assertEqual(len(raw), 100)
+            for d in range(100):
+                self.assertEqual(None if d % 10 in (3, 7) else str(d), raw[d])
+
     def testDelCommand(self):
         """Test REJSON.DEL command"""
 
@@ -507,6 +621,51 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
             with self.assertRaises(redis.exceptions.ResponseError) as cm:
                 r.execute_command('JSON.OBJKEYS', 'test', '.null')
 
+    def testScanCommands(self):
+        """Test JSON.ARRSCAN and JSON.OBJSCAN commands"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'arr': list(range(95)), 'obj': {'key{}'.format(i): [i] for i in range(95)}}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+
+            # arrays are iterated in order
+            cursor, items = r.execute_command('JSON.ARRSCAN', 'test', '.arr', 0)
+            self.assertEqual(10, cursor)
+            self.assertEqual([str(i) for i in range(10)], items)
+            values = []
+            cursor = 0
+            while True:
+                cursor, items = r.execute_command('JSON.ARRSCAN', 'test', '.arr', cursor, 'COUNT', 20)
+                values.extend(json.loads(i) for i in items)
+                if not cursor:
+                    break
+            self.assertEqual(doc['arr'], values)
+            cursor, items = r.execute_command('JSON.ARRSCAN', 'test', '.arr', 5, 'COUNT', 2**63 - 1)
+            self.assertEqual([0, doc['arr'][5:]], [cursor, [json.loads(i) for i in items]])
+
+            # every key that's there throughout the iteration is returned, despite deletions
+            obj = {}
+            cursor = 0
+            while True:
+                cursor, items = r.execute_command('JSON.OBJSCAN', 'test', '.obj', cursor, 'COUNT', 7)
+                self.assertLessEqual(len(items), 14)
+                obj.update((k, json.loads(v)) for k, v in zip(items[::2], items[1::2]))
+                if not cursor:
+                    break
+                r.execute_command('JSON.DEL', 'test', '.obj.{}'.format(items[0]))
+            self.assertEqual(doc['obj'], obj)
+
+            # missing values, wrong types and bad arguments
+            self.assertIsNone(r.execute_command('JSON.ARRSCAN', 'missing', '.', 0))
+            self.assertIsNone(r.execute_command('JSON.OBJSCAN', 'test', '.foo', 0))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.ARRSCAN', 'test', '.obj', 0)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.OBJSCAN', 'test', '.obj', -1)
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.ARRSCAN', 'test', '.arr', 0, 'COUNT', 0)
+
     def testNumIncrCommand(self):
         """Test JSON.NUMINCRBY command"""
 
@@ -542,6 +701,30 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
             self.assertEqual(6, r.execute_command('JSON.STRAPPEND', 'test', '.', '"bar"'))
             self.assertEqual('"foobar"', r.execute_command('JSON.GET', 'test', '.'))
 
+            # values that aren't strings are rejected
+            for value in ['1', 'true', 'null', '[]']:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command('JSON.STRAPPEND', 'test', '.', value)
+            self.assertEqual('"foobar"', r.execute_command('JSON.GET', 'test', '.'))
+
+    def testCompactScalars(self):
+        """Test scalars around the limits of their compact encoding"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = [True, False, 0, -1, 2**61 - 1, -2**61, 2**61, -2**61 - 1, 2**63 - 1, -2**63, 'foo']
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            for _ in r.retry_with_rdb_reload():
+                self.assertListEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+                self.assertEqual('boolean', r.execute_command('JSON.TYPE', 'test', '[0]'))
+                self.assertEqual('integer', r.execute_command('JSON.TYPE', 'test', '[4]'))
+                self.assertEqual(2, r.execute_command('JSON.ARRINDEX', 'test', '.', 0))
+                self.assertEqual(7, r.execute_command('JSON.ARRINDEX', 'test', '.', -2**61 - 1))
+            self.assertEqual(str(2**61), r.execute_command('JSON.NUMINCRBY', 'test', '[4]', 1))
+            self.assertEqual('integer', r.execute_command('JSON.TYPE', 'test', '[4]'))
+            self.assertEqual(6, r.execute_command('JSON.STRAPPEND', 'test', '[10]', '"bar"'))
+            self.assertEqual('"foobar"', r.execute_command('JSON.GET', 'test', '[10]'))
+
     def testRespCommand(self):
         """Test JSON.RESP command"""
 
@@ -612,6 +795,338 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
                             else:
                                 self.assertEqual(d1, d2, path)
 
+    def testLargeObjectCommands(self):
+        """Test operations on an object that's big enough to be indexed"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'key{}'.format(i): i for i in range(1000)}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            for i in range(0, 1000, 2):
+                self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '.key{}'.format(i)))
+                del doc['key{}'.format(i)]
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.new', '"value"'))
+            doc['new'] = 'value'
+            for _ in r.retry_with_rdb_reload():
+                self.assertEqual(501, r.execute_command('JSON.OBJLEN', 'test'))
+                self.assertEqual(999, json.loads(r.execute_command('JSON.GET', 'test', '.key999')))
+                self.assertIsNone(r.execute_command('JSON.TYPE', 'test', '.key998'))
+                self.assertDictEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+                # the entries and their index take at least 12 bytes per key
+                self.assertGreater(r.execute_command('JSON.DEBUG', 'MEMORY', 'test'), 501 * 12)
+
+            # every value loaded from RDB is counted
+            stats = r.execute_command('JSON.DEBUG', 'LOADSTATS')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            self.assertGreaterEqual(stats['keys'], 1)
+            self.assertGreaterEqual(stats['nodes'], 502)
+
+    def testMemoryUsage(self):
+        """Test that the memory usage of values follows their modifications"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{"a":["x"],"b":{"c":"d"}}'))
+            before = r.execute_command('JSON.DEBUG', 'MEMORY', 'test')
+            item = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.a[0]')
+            self.assertEqual(3, r.execute_command('JSON.STRAPPEND', 'test', '.a[0]', '"yz"'))
+            self.assertEqual(item + 2, r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.a[0]'))
+            self.assertEqual(before + 2, r.execute_command('JSON.DEBUG', 'MEMORY', 'test'))
+            inner = r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.b')
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '.b'))
+            self.assertGreater(before + 2, r.execute_command('JSON.DEBUG', 'MEMORY', 'test') + inner)
+
+    def testLazyFree(self):
+        """Test that large values are freed in the background"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'key{}'.format(i): [i, str(i)] for i in range(10000)}
+            before = r.execute_command('JSON.DEBUG', 'LAZYFREE')
+            before = dict(zip(before[::2], before[1::2]))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps({'a': doc, 'b': 1})))
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '.a'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '{}'))
+            for _ in range(100):
+                after = r.execute_command('JSON.DEBUG', 'LAZYFREE')
+                after = dict(zip(after[::2], after[1::2]))
+                if not after['pending']:
+                    break
+                time.sleep(0.01)
+            self.assertEqual(0, after['pending'])
+            self.assertEqual(before['freed'] + 2, after['freed'])
+            self.assertEqual('{}', r.execute_command('JSON.GET', 'test'))
+
+    def testPathCache(self):
+        """Test that repeated paths are served from the path cache"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['simple'])))
+            before = r.execute_command('JSON.DEBUG', 'PATHCACHE')
+            before = dict(zip(before[::2], before[1::2]))
+            for _ in range(10):
+                self.assertEqual('string', r.execute_command('JSON.TYPE', 'test', '.foo'))
+            after = r.execute_command('JSON.DEBUG', 'PATHCACHE')
+            after = dict(zip(after[::2], after[1::2]))
+            self.assertGreaterEqual(after['hits'] - before['hits'], 9)
+            self.assertLessEqual(after['size'], after['capacity'])
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.GET', 'test', '.foo[x]')
+            self.assertIn('Search path error', str(cm.exception))
+
+    def testSerialCache(self):
+        """Test that repeated reads are served from the serialized-value cache until a write"""
+
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(docs['simple'])))
+            before = r.execute_command('JSON.DEBUG', 'SERIALCACHE')
+            before = dict(zip(before[::2], before[1::2]))
+            for _ in range(10):
+                self.assertEqual('"bar"', r.execute_command('JSON.GET', 'test', '.foo'))
+            self.assertEqual(['"bar"'], r.execute_command('JSON.MGET', 'test', '.foo'))
+            after = r.execute_command('JSON.DEBUG', 'SERIALCACHE')
+            after = dict(zip(after[::2], after[1::2]))
+            self.assertGreaterEqual(after['hits'] - before['hits'], 10)
+            self.assertLessEqual(after['memory'], after['maxmemory'])
+
+            # formatting options are part of the request
+            self.assertEqual('{\n"foo":"bar"\n}',
+                             r.execute_command('JSON.GET', 'test', 'NEWLINE', '\n'))
+            self.assertEqual('{"foo":"bar"}', r.execute_command('JSON.GET', 'test'))
+
+            # every write invalidates the cached serializations
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.foo', '"baz"'))
+            self.assertEqual('"baz"', r.execute_command('JSON.GET', 'test', '.foo'))
+            self.assertEqual(4, r.execute_command('JSON.STRAPPEND', 'test', '.foo', '"z"'))
+            self.assertEqual('"bazz"', r.execute_command('JSON.GET', 'test', '.foo'))
+            self.assertEqual(['"bazz"'], r.execute_command('JSON.MGET', 'test', '.foo'))
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'test', '.foo'))
+            self.assertEqual('{}', r.execute_command('JSON.GET', 'test'))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', '[1]'))
+            self.assertEqual('[1]', r.execute_command('JSON.GET', 'test'))
+            self.assertEqual(2, r.execute_command('JSON.ARRAPPEND', 'test', '.', '2'))
+            self.assertEqual('[1,2]', r.execute_command('JSON.GET', 'test'))
+            self.assertEqual('2', r.execute_command('JSON.ARRPOP', 'test'))
+            self.assertEqual('[1]', r.execute_command('JSON.GET', 'test'))
+            self.assertEqual('3', r.execute_command('JSON.NUMINCRBY', 'test', '[0]', 2))
+            self.assertEqual('[3]', r.execute_command('JSON.GET', 'test'))
+
+    def testAofRewrite(self):
+        """Test that large documents survive an AOF rewrite in chunks"""
+
+        doc = {
+            'array': [{'id': i, 'name': 'item %d' % i, 'tags': ['a', 'b']} for i in range(5000)],
+            'string': 'x' * 200000,
+            "quote's": {'nested': [list(range(1000)) for _ in range(100)]},
+            'small': 1,
+        }
+        with self.redis() as r:
+            r.delete('test')
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('CONFIG', 'SET', 'appendonly', 'yes'))
+            while True:
+                info = r.execute_command('INFO', 'persistence')
+                if not info['aof_rewrite_in_progress'] and not info['aof_rewrite_scheduled']:
+                    break
+                time.sleep(0.1)
+            self.assertOk(r.execute_command('DEBUG', 'LOADAOF'))
+            self.assertOk(r.execute_command('CONFIG', 'SET', 'appendonly', 'no'))
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+
+    def testIndexQuery(self):
+        """Test that secondary indexes follow the JSON keys they cover and survive a reload"""
+
+        with self.redis() as r:
+            r.flushdb()
+            for i in range(10):
+                doc = {'price': i, 'tags': ['even' if i % 2 == 0 else 'odd']}
+                self.assertOk(r.execute_command('JSON.SET', 'item:%d' % i, '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '{"price": 5}'))
+            self.assertOk(r.execute_command('JSON.INDEX', 'CREATE', 'prices', 'item:', '.price', 'NUMERIC'))
+            self.assertOk(r.execute_command('JSON.INDEX', 'CREATE', 'tags', 'item:', '.tags', 'TAG'))
+            self.assertEqual(['item:3', 'item:4'], r.execute_command('JSON.QUERY', 'prices', 3, 4))
+            self.assertEqual(['item:4'], r.execute_command('JSON.QUERY', 'prices', '(3', '(5'))
+            self.assertEqual(['item:2', 'item:3'],
+                             r.execute_command('JSON.QUERY', 'prices', '-inf', '+inf', 'LIMIT', 2, 2))
+            self.assertEqual(5, len(r.execute_command('JSON.QUERY', 'tags', 'odd')))
+
+            # writes update the indexes, and deleted keys leave them
+            self.assertEqual('103', r.execute_command('JSON.NUMINCRBY', 'item:3', '.price', 100))
+            self.assertEqual(2, r.execute_command('JSON.ARRAPPEND', 'item:4', '.tags', '"odd"'))
+            self.assertEqual(1, r.execute_command('DEL', 'item:5'))
+            self.assertOk(r.execute_command('JSON.SET', 'item:9', '.', '{"price": 3.5}'))
+            self.assertEqual(['item:9', 'item:4'], r.execute_command('JSON.QUERY', 'prices', 3, 4))
+            self.assertEqual(['item:1', 'item:3', 'item:4', 'item:7'],
+                             r.execute_command('JSON.QUERY', 'tags', 'odd'))
+
+            # indexes are rebuilt after a reload
+            self.assertOk(r.execute_command('DEBUG', 'RELOAD'))
+            self.assertEqual(['item:9', 'item:4'], r.execute_command('JSON.QUERY', 'prices', 3, 4))
+            info = r.execute_command('JSON.INDEX', 'INFO', 'prices')
+            info = dict(zip(info[::2], info[1::2]))
+            self.assertEqual(9, info['docs'])
+            self.assertEqual(1, r.execute_command('JSON.INDEX', 'DROP', 'prices'))
+            self.assertIsNone(r.execute_command('JSON.QUERY', 'prices', 3, 4))
+
+            for args in [('JSON.INDEX', 'CREATE', 'tags', 'item:', '.price', 'NUMERIC'),
+                         ('JSON.INDEX', 'CREATE', 'x', 'item:', '.price', 'TEXT'),
+                         ('JSON.INDEX', 'CREATE', 'x', 'item:', '.price[', 'NUMERIC'),
+                         ('JSON.QUERY', 'tags', 'odd', 'even'), ('JSON.QUERY', 'other', 1)]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+
+    def testSchema(self):
+        """Test that writes to the keys of a schema are validated against it"""
+
+        with self.redis() as r:
+            r.flushdb()
+            schema = {'type': 'object', 'required': ['id'], 'properties': {
+                'id': {'type': 'integer', 'minimum': 1},
+                'tags': {'type': 'array', 'items': {'type': 'string'}, 'maxItems': 2}}}
+            self.assertOk(r.execute_command('JSON.SETSCHEMA', 'items', 'item:', json.dumps(schema)))
+            self.assertOk(r.execute_command('JSON.SET', 'item:1', '.', '{"id": 1, "tags": ["a"]}'))
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '{"id": 0}'))
+            for args in [('JSON.SET', 'item:2', '.', '{"tags": []}'),
+                         ('JSON.SET', 'item:1', '.id', '0'),
+                         ('JSON.SET', 'item:1', '.tags', '[1]'),
+                         ('JSON.NUMINCRBY', 'item:1', '.id', -1),
+                         ('JSON.ARRAPPEND', 'item:1', '.tags', '"b"', '"c"'),
+                         ('JSON.DEL', 'item:1', '.id')]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+                self.assertIn('schema violation', str(cm.exception))
+            self.assertEqual(2, r.execute_command('JSON.ARRAPPEND', 'item:1', '.tags', '"b"'))
+            self.assertEqual('{"id":1,"tags":["a","b"]}', r.execute_command('JSON.GET', 'item:1'))
+
+            # the schema is persisted, and validates values without writing them
+            self.assertOk(r.execute_command('DEBUG', 'RELOAD'))
+            self.assertOk(r.execute_command('JSON.VALIDATE', 'items', '{"id": 2}'))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.VALIDATE', 'items', '{"id": 2, "tags": [1]}')
+            self.assertIn('.tags[0]', str(cm.exception))
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'item:3', '.', '{"id": 0}')
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SETSCHEMA', 'items', 'item:', '{"pattern": "x"}')
+
+            # dropping the schema stops the validation
+            self.assertEqual(1, r.execute_command('DEL', 'items'))
+            self.assertOk(r.execute_command('JSON.SET', 'item:3', '.', '{"id": 0}'))
+
+    def testExpire(self):
+        """Test that values at paths expire, and that writes and reloads keep or clear their TTLs"""
+
+        with self.redis() as r:
+            r.flushdb()
+            doc = {'sessions': {'a': {'user': 1}, 'b': {'user': 2}, 'c': {'user': 3}}, 'list': [1, 2]}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.sessions.a', 1))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', 'sessions["b"]', 1))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.sessions.c', 100))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.list[0]', 1))
+            self.assertEqual(0, r.execute_command('JSON.EXPIRE', 'test', '.sessions.x', 1))
+            self.assertEqual(0, r.execute_command('JSON.EXPIRE', 'missing', '.a', 1))
+            self.assertEqual(1, r.execute_command('JSON.TTL', 'test', '.sessions.a'))
+            self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'test', '.sessions.c',
+                                                  int(time.time() * 1000) + 100000))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'test', '.sessions.c'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'test', '.sessions'))
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'test', '.sessions.x'))
+
+            # replacing a value clears its TTL, modifying it doesn't
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.sessions.b', '{"user": 4}'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'test', '.sessions.b'))
+            self.assertEqual('2', r.execute_command('JSON.NUMINCRBY', 'test', '.sessions.a.user', 1))
+            self.assertEqual(1, r.execute_command('JSON.TTL', 'test', '.sessions.a'))
+
+            # read-only commands answer as if expired values were deleted, with no write in between
+            time.sleep(1.1)
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'test', '.sessions.a'))
+            self.assertEqual(['b', 'c'], r.execute_command('JSON.OBJKEYS', 'test', '.sessions'))
+            self.assertEqual('object', r.execute_command('JSON.TYPE', 'test', '.sessions'))
+            self.assertEqual('[2]', r.execute_command('JSON.GET', 'test', '.list'))
+            self.assertEqual(['[2]', None], r.execute_command('JSON.MGET', 'test', 'missing', '.list'))
+
+            # expired values are deleted by write commands, as read-only commands can't delete
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '1'))
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'test', '.sessions.a'))
+            self.assertEqual({'sessions': {'b': {'user': 4}, 'c': {'user': 3}}, 'list': [2]},
+                             json.loads(r.execute_command('JSON.GET', 'test')))
+
+            # TTLs are persisted
+            self.assertOk(r.execute_command('DEBUG', 'RELOAD'))
+            self.assertLessEqual(98, r.execute_command('JSON.TTL', 'test', '.sessions.c'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.sessions.c', 1))
+            self.assertOk(r.execute_command('DEBUG', 'RELOAD'))
+            time.sleep(1.1)
+
+            # the TTLs of loaded values wait for a command to access them by their keys' names, and
+            # write commands expire them before they modify the values
+            self.assertEqual('5', r.execute_command('JSON.NUMINCRBY', 'test', '.sessions.b.user', 1))
+            self.assertEqual(['b'], r.execute_command('JSON.OBJKEYS', 'test', '.sessions'))
+
+            for args in [('JSON.EXPIRE', 'test', '.', 1), ('JSON.EXPIRE', 'test', '.list', 0),
+                         ('JSON.EXPIRE', 'test', '.list', 'x'), ('JSON.EXPIRE', 'test', '.list[*]', 1),
+                         ('JSON.PEXPIREAT', 'test', '.list', -1)]:
+                with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                    r.execute_command(*args)
+
+            # and so do those of renamed values
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'test', '.list[0]', 1))
+            r.rename('test', 'renamed')
+            time.sleep(1.1)
+            self.assertEqual(1, r.execute_command('JSON.ARRAPPEND', 'renamed', '.list', '3'))
+            self.assertEqual('[3]', r.execute_command('JSON.GET', 'renamed', '.list'))
+
+            # absolute timeouts in the past expire before the next write
+            self.assertEqual(1, r.execute_command('JSON.PEXPIREAT', 'renamed', '.list[0]', 1))
+            self.assertEqual(-2, r.execute_command('JSON.TTL', 'renamed', '.list[0]'))
+            self.assertEqual('[]', r.execute_command('JSON.GET', 'renamed', '.list'))
+            self.assertEqual(1, r.execute_command('JSON.ARRAPPEND', 'renamed', '.list', '4'))
+            self.assertEqual('[4]', r.execute_command('JSON.GET', 'renamed', '.list'))
+
+            # negative indices address the same TTLs as the elements' indices
+            self.assertEqual(3, r.execute_command('JSON.ARRAPPEND', 'renamed', '.list', '5', '6'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'renamed', '.list[-1]', 100))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'renamed', '.list[2]'))
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'renamed', '.list[2]'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'renamed', '.list[-1]'))
+
+            # the TTLs of array elements move with them when elements before them are inserted or
+            # deleted, and are cleared with them
+            self.assertOk(r.execute_command('JSON.SET', 'arr', '.', '{"a": [0, 1, 2, 3, 4, 5]}'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'arr', '.a[3]', 100))
+            self.assertEqual(8, r.execute_command('JSON.ARRINSERT', 'arr', '.a', 0, '-2', '-1'))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'arr', '.a[5]'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'arr', '.a[3]'))
+            self.assertEqual('-2', r.execute_command('JSON.ARRPOP', 'arr', '.a', 0))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'arr', '.a[4]'))
+            self.assertEqual(1, r.execute_command('JSON.DEL', 'arr', '.a[0]'))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'arr', '.a[3]'))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'arr', '.a[4]'))
+            self.assertEqual(3, r.execute_command('JSON.ARRTRIM', 'arr', '.a', 2, 4))
+            self.assertLessEqual(99, r.execute_command('JSON.TTL', 'arr', '.a[1]'))
+            self.assertEqual('3', r.execute_command('JSON.ARRPOP', 'arr', '.a', 1))
+            self.assertEqual(-1, r.execute_command('JSON.TTL', 'arr', '.a[1]'))
+
+            # and queries don't match values by their expired values, which their indexes still have
+            self.assertOk(r.execute_command('JSON.INDEX', 'CREATE', 'ttls', 'ttl:', '.n', 'NUMERIC'))
+            self.assertOk(r.execute_command('JSON.SET', 'ttl:a', '.', '{"n": 1}'))
+            self.assertOk(r.execute_command('JSON.SET', 'ttl:b', '.', '{"n": [2, 3]}'))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'ttl:a', '.n', 1))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'ttl:b', '.n[0]', 1))
+            self.assertEqual(1, r.execute_command('JSON.EXPIRE', 'ttl:b', '.n[1]', 100))
+            time.sleep(1.1)
+            self.assertEqual(['ttl:b'], r.execute_command('JSON.QUERY', 'ttls', '-inf', '+inf'))
+            self.assertEqual([], r.execute_command('JSON.QUERY', 'ttls', '-inf', 2))
+
+            # the TTLs of the elements that follow expired ones shift with them
+            self.assertEqual('[3]', r.execute_command('JSON.GET', 'ttl:b', '.n'))
+            self.assertLessEqual(98, r.execute_command('JSON.TTL', 'ttl:b', '.n[0]'))
+
     def testIssue_13(self):
         """https://github.com/RedisLabsModules/rejson/issues/13"""
 
@@ -622,5 +1137,124 @@ class ReJSONTestCase(ModuleTestCase(module_path='../../src/rejson.so')):
             r.execute_command('JSON.GET', 'test', 'foo', 'foo')
 
 
+class ReJSONAsyncParseTestCase(ModuleTestCase(module_path='../../src/rejson.so',
+                                              module_args=['ASYNC_PARSE_THRESHOLD', '1024'])):
+    """Tests ReJSON with large payloads parsed in the background"""
+
+    def testAsyncParse(self):
+        """Test that large payloads are parsed in the background and applied like small ones"""
+
+        with self.redis() as r:
+            r.delete('test')
+            doc = {'key{}'.format(i): [i, str(i)] for i in range(1000)}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.sub', json.dumps(doc)))
+            self.assertIsNone(r.execute_command('JSON.SET', 'test', '.sub', json.dumps(doc), 'NX'))
+            self.assertEqual(4, r.execute_command('JSON.ARRAPPEND', 'test', '.key1', json.dumps(doc), '1'))
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test', '.sub')))
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test', '.key1[2]')))
+            stats = r.execute_command('JSON.DEBUG', 'ASYNCPARSE')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            self.assertEqual(0, stats['pending'])
+            self.assertEqual(4, stats['parsed'])
+            self.assertEqual(1024, stats['threshold'])
+
+            # errors are reported once the payload is parsed
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)[:-1])
+            with self.assertRaises(redis.exceptions.ResponseError) as cm:
+                r.execute_command('JSON.ARRAPPEND', 'test', '.sub', json.dumps(doc))
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test', '.sub')))
+
+
+
+class ReJSONCompressionTestCase(ModuleTestCase(module_path='../../src/rejson.so',
+                                               module_args=['COMPRESS_THRESHOLD', '256'])):
+    """Tests ReJSON with large strings stored compressed"""
+
+    def testCompression(self):
+        """Test that compressed strings read, append, persist and report like plain ones"""
+
+        with self.redis() as r:
+            r.delete('test')
+            html = '<li class="item">entry</li>' * 100
+            doc = {'html': html, 'short': 'x', 'list': [html, 'y']}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+            self.assertEqual(len(html), r.execute_command('JSON.STRLEN', 'test', '.html'))
+            self.assertEqual(html, r.execute_command('JSON.RESP', 'test', '.html'))
+            self.assertEqual(1, r.execute_command('JSON.ARRINDEX', 'test', '.list', json.dumps(html)))
+
+            stats = r.execute_command('JSON.DEBUG', 'COMPRESSION', 'test')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            self.assertEqual(2, stats['strings'])
+            self.assertEqual(stats['memory'], r.execute_command('JSON.DEBUG', 'MEMORY', 'test'))
+            self.assertGreater(stats['logical'] - stats['memory'], len(html))
+
+            # appending decompresses the string and compresses it again
+            self.assertEqual(len(html) * 2, r.execute_command('JSON.STRAPPEND', 'test', '.html',
+                                                              json.dumps(html)))
+            self.assertEqual(html * 2, json.loads(r.execute_command('JSON.GET', 'test', '.html')))
+            stats = r.execute_command('JSON.DEBUG', 'COMPRESSION', 'test', '.html')
+            stats = dict(zip(stats[::2], stats[1::2]))
+            self.assertEqual(1, stats['strings'])
+            self.assertLess(stats['memory'], len(html))
+
+            # strings are compressed again when they're loaded
+            for _ in r.retry_with_rdb_reload():
+                self.assertEqual(html * 2, json.loads(r.execute_command('JSON.GET', 'test', '.html')))
+                stats = r.execute_command('JSON.DEBUG', 'COMPRESSION', 'test')
+                self.assertEqual(2, dict(zip(stats[::2], stats[1::2]))['strings'])
+
+
+class ReJSONFreezeTestCase(ModuleTestCase(module_path='../../src/rejson.so',
+                                          module_args=['FREEZE_IDLE_TIME', '1'])):
+    """Tests ReJSON with idle values frozen"""
+
+    def freezer(self, r):
+        stats = r.execute_command('JSON.DEBUG', 'FREEZER')
+        return dict(zip(stats[::2], stats[1::2]))
+
+    def testFreeze(self):
+        """Test that frozen values are thawed by access, and persist like values that aren't"""
+
+        with self.redis() as r:
+            r.delete('test', 'other', 'str')
+            doc = {'name': 'someone', 'tags': ['a', 'b'], 'n': 1.5, 'nested': {'x': None}}
+            self.assertOk(r.execute_command('JSON.SET', 'test', '.', json.dumps(doc)))
+            r.set('str', 'x')
+            self.assertIsNone(r.execute_command('JSON.DEBUG', 'FREEZE', 'missing'))
+            self.assertRaises(redis.exceptions.ResponseError,
+                              r.execute_command, 'JSON.DEBUG', 'FREEZE', 'str')
+            before = self.freezer(r)
+            self.assertEqual(1, before['idle_time'])
+            self.assertEqual(1, r.execute_command('JSON.DEBUG', 'FREEZE', 'test'))
+            self.assertEqual(0, r.execute_command('JSON.DEBUG', 'FREEZE', 'test'))
+            stats = self.freezer(r)
+            self.assertEqual(before['frozen'] + 1, stats['frozen'])
+            self.assertGreater(stats['memory'], 0)
+
+            # measuring a frozen value doesn't thaw it
+            self.assertGreater(r.execute_command('JSON.DEBUG', 'MEMORY', 'test'), 0)
+            self.assertGreater(r.execute_command('JSON.DEBUG', 'MEMORY', 'test', '.tags'), 0)
+            r.execute_command('JSON.DEBUG', 'COMPRESSION', 'test')
+            self.assertEqual(stats, self.freezer(r))
+
+            # accessing a frozen value thaws it
+            self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+            stats = self.freezer(r)
+            self.assertEqual(before['frozen'], stats['frozen'])
+            self.assertEqual(before['thaws'] + 1, stats['thaws'])
+            self.assertEqual(3, r.execute_command('JSON.ARRAPPEND', 'test', '.tags', '"c"'))
+
+            # idle values are frozen by later commands, and are saved and loaded like others
+            time.sleep(1.5)
+            self.assertOk(r.execute_command('JSON.SET', 'other', '.', '1'))
+            self.assertEqual(before['frozen'] + 1, self.freezer(r)['frozen'])
+            doc['tags'].append('c')
+            for _ in r.retry_with_rdb_reload():
+                self.assertEqual(doc, json.loads(r.execute_command('JSON.GET', 'test')))
+                r.execute_command('JSON.DEBUG', 'FREEZE', 'test')
+
 if __name__ == '__main__':
     unittest.main()
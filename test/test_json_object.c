@@ -4,6 +4,10 @@
 #include <dirent.h>
 #include "minunit.h"
 #include "../src/json_object.h"
+#include "../src/json_index.h"
+#include "../src/json_cache.h"
+#include "../src/async_parse.h"
+#include <unistd.h>
 #include <alloc.h>
 
 #define _JSTR(e) "\"" #e "\""
@@ -21,8 +25,8 @@ MU_TEST(test_jo_create_literal_true) {
     const char *json = "true";
 
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
-    mu_check(N_BOOLEAN == n->type);
-    mu_check(n->value.boolval);
+    mu_check(N_BOOLEAN == NODETYPE(n));
+    mu_check(NODE_BOOLVAL(n));
     Node_Free(n);
 }
 
@@ -31,8 +35,8 @@ MU_TEST(test_jo_create_literal_false) {
     const char *json = "false";
 
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
-    mu_check(N_BOOLEAN == n->type);
-    mu_check(!n->value.boolval);
+    mu_check(N_BOOLEAN == NODETYPE(n));
+    mu_check(!NODE_BOOLVAL(n));
     Node_Free(n);
 }
 
@@ -43,29 +47,29 @@ MU_TEST(test_jo_create_literal_integer) {
     json = "0";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
-    mu_assert_int_eq(0, n->value.intval);
+    mu_check(N_INTEGER == NODETYPE(n));
+    mu_assert_int_eq(0, NODE_INTVAL(n));
     Node_Free(n);
 
     json = "-0";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
-    mu_assert_int_eq(0, n->value.intval);
+    mu_check(N_INTEGER == NODETYPE(n));
+    mu_assert_int_eq(0, NODE_INTVAL(n));
     Node_Free(n);
 
     json = "6379";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
-    mu_assert_int_eq(6379, n->value.intval);
+    mu_check(N_INTEGER == NODETYPE(n));
+    mu_assert_int_eq(6379, NODE_INTVAL(n));
     Node_Free(n);
 
     json = "-42";
     mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &n, NULL));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
-    mu_assert_int_eq(-42, n->value.intval);
+    mu_check(N_INTEGER == NODETYPE(n));
+    mu_assert_int_eq(-42, NODE_INTVAL(n));
     Node_Free(n);
 }
 
@@ -213,6 +217,123 @@ MU_TEST(test_jo_create_object) {
     Node_Free(n1);
 }
 
+/* Checks that two objects are identical, types included. */
+static int _jo_same_node(const Node *a, const Node *b) {
+    if (NODETYPE(a) != NODETYPE(b)) return 0;
+    switch (NODETYPE(a)) {
+        case N_NULL:
+            return 1;
+        case N_BOOLEAN:
+            return NODE_BOOLVAL(a) == NODE_BOOLVAL(b);
+        case N_INTEGER:
+            return NODE_INTVAL(a) == NODE_INTVAL(b);
+        case N_NUMBER:
+            return !memcmp(&a->value.numval, &b->value.numval, sizeof(double));
+        case N_STRING:
+            return a->value.strval.len == b->value.strval.len &&
+                   !memcmp(a->value.strval.data, b->value.strval.data, a->value.strval.len);
+        case N_KEYVAL:
+            return !strcmp(a->value.kvval.key, b->value.kvval.key) &&
+                   _jo_same_node(a->value.kvval.val, b->value.kvval.val);
+        case N_DICT:
+        case N_ARRAY:
+            if (Node_Length(a) != Node_Length(b)) return 0;
+            for (uint32_t i = 0; i < Node_Length(a); i++)
+                if (!_jo_same_node(a->value.arrval.entries[i], b->value.arrval.entries[i])) return 0;
+            return 1;
+    }
+    return 0;
+}
+
+/* Parses a buffer with both parsers and checks that they agree on the object or the error. */
+static int _jo_same_parse(const char *json, size_t len) {
+    Node *n[2] = {NULL, NULL};
+    char *err[2] = {NULL, NULL};
+    int rc[2], same;
+
+    for (int p = 0; p < 2; p++) {
+        SetJSONParser(p ? JSONOBJECT_PARSER_INDEXED : JSONOBJECT_PARSER_JSONSL);
+        rc[p] = CreateNodeFromJSON(json, len, &n[p], &err[p]);
+    }
+    SetJSONParser(JSONOBJECT_PARSER_JSONSL);
+
+    same = rc[0] == rc[1];
+    if (same && JSONOBJECT_OK == rc[0]) same = _jo_same_node(n[0], n[1]);
+    if (same && JSONOBJECT_OK != rc[0]) same = !strcmp(err[0], err[1]);
+    for (int p = 0; p < 2; p++) {
+        if (n[p]) Node_Free(n[p]);
+        if (err[p]) free(err[p]);
+    }
+    return same;
+}
+
+MU_TEST(test_jo_indexed_parser) {
+    const char *cases[] = {
+        "null", "true ", "  \"x\"  ", "-0", "6379", "-4.2", "1E+2", "1.5e-400", "1e999", "[01]",
+        "[-01]", "[1.]", "[1.e5]", "[.5]", "[-]", "[0x10]", "[9223372036854775807]",
+        "[9223372036854775808]", "[-9223372036854775808]", "[123456789012345678]", "[tru]",
+        "[truex]", "nullx", "{\"a\":1,}", "[1,]", "[1,,2]", "[]]", "{} x", "{}  \t\n", "\"a\" \"b\"",
+        "1 2", "[true false]", "{\"a\" \"b\"}", "{\"a\":}", "{:1}", "{\"a\":1}{}", "[\"a\x01b\"]",
+        "[\"a\x7f\xff\"]", "[\"\\u0041\\/\\b\"]", "[\"\\u0000\"]", "[\"\\udc00\"]",
+        "[\"\\ud83d\\ude00\"]", "[\"\\u00e9\\uffff\\ue000\\u0001\\ud800\\udc00\\udbff\\udfff\"]",
+        "[\"\\b\\f\\n\\r\\t\\\"\\\\\\/\\u007f\\u0080\\u07ff\\u0800\"]", "[\"\\ud83d\"]",
+        "[\"\\ud83dx\"]", "[\"\\u00\"]", "[\"\\x\"]", "[\"\\\"]", "[\"a\\\\\"]",
+        "{\"k\\\"ey\":{\"a\":[1,{\"b\":null}]},\"k\\\"ey\":2}", "[1]\\", "", "  ", "[", "{\"a\"",
+    };
+    const char *impls[] = {"scalar", "sse2", "avx2"};
+    const char *impl = JSONIndex_GetImplementation();
+    char buf[1100];
+    int diffs = 0;
+
+    for (int m = 0; m < sizeof(impls) / sizeof(impls[0]); m++) {
+        if (JSONINDEX_OK != JSONIndex_SetImplementation(impls[m])) continue;
+
+        for (int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+            diffs += !_jo_same_parse(cases[c], strlen(cases[c]));
+
+        // nesting around the maximal depth
+        for (int depth = JSONSL_MAX_LEVELS - 4; depth <= JSONSL_MAX_LEVELS; depth++) {
+            memset(buf, '[', depth);
+            memset(&buf[depth], ']', depth);
+            diffs += !_jo_same_parse(buf, 2 * depth);
+        }
+
+        // mutations of the valid files
+        DIR *dir = opendir("files");
+        struct dirent *ent;
+        uint32_t seed = 6379;
+        mu_check(dir);
+        while (dir && (ent = readdir(dir))) {
+            char path[512], *json;
+            if (strncmp(ent->d_name, "pass", 4)) continue;
+            snprintf(path, sizeof(path), "files/%s", ent->d_name);
+            FILE *f = fopen(path, "rb");
+            fseek(f, 0, SEEK_END);
+            long len = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            json = malloc(len + 1);
+            mu_check(len == fread(json, 1, len, f));
+            fclose(f);
+
+            diffs += !_jo_same_parse(json, len);
+            for (int i = 0; i < 100 && len; i++) {
+                static const char bytes[] = "{}[]:,\"\\ \t\n\x01\x80-+.0123456789eEtfnu";
+                seed = seed * 1103515245 + 12345;
+                long at = (seed >> 8) % len;
+                char orig = json[at];
+                json[at] = bytes[(seed >> 4) % (sizeof(bytes) - 1)];
+                diffs += !_jo_same_parse(json, len);
+                diffs += !_jo_same_parse(json, at);
+                json[at] = orig;
+            }
+            free(json);
+        }
+        if (dir) closedir(dir);
+    }
+    mu_assert_int_eq(0, diffs);
+    JSONIndex_SetImplementation(impl);
+}
+
 MU_TEST(test_oj_null) {
     Node *n;
     sds str = sdsempty();
@@ -370,6 +491,202 @@ MU_TEST(test_oj_special_characters) {
     Node_Free(n);
 }
 
+MU_TEST(test_oj_estimate) {
+    JSONSerializeOpt opt = {0};
+    Node *arr = NewArrayNode(0), *dict = NewDictNode(1);
+    char str[16];
+
+    // without escapes the estimate bounds the serialization
+    Node_DictSet(dict, "key", NewCStringNode("value"));
+    Node_ArrayAppend(arr, dict);
+    for (int i = 0; i < 1000; i++) {
+        sprintf(str, "str%d", i);
+        Node_ArrayAppend(arr, NewCStringNode(str));
+        Node_ArrayAppend(arr, NewIntNode(i));
+        Node_ArrayAppend(arr, NewDoubleNode(i * 1.1));
+        Node_ArrayAppend(arr, NewBoolNode(i % 2));
+        Node_ArrayAppend(arr, NULL);
+    }
+    sds json = sdsempty();
+    SerializeNodeToJSON(arr, &opt, &json);
+    size_t size = EstimateNodeJSONSize(arr, SIZE_MAX);
+    mu_check(size >= sdslen(json));
+    mu_check(size < 2 * sdslen(json));
+    sdsfree(json);
+
+    // the estimate stops once it exceeds the limit
+    mu_check(EstimateNodeJSONSize(dict, 100) <= 100);
+    mu_check(EstimateNodeJSONSize(arr, 10000) > 10000);
+    mu_check(EstimateNodeJSONSize(arr, 10000) < size);
+
+    Node_Free(arr);
+}
+
+MU_TEST(test_oj_cache) {
+    JSONCacheStats stats;
+    size_t len, size;
+    const char *json;
+    char big[64];
+    memset(big, 'x', sizeof(big));
+
+    // size the cache to hold exactly four big entries
+    JSONCache_SetMaxMemory(1024);
+    JSONCache_Put(1, "", 0, big, sizeof(big));
+    JSONCache_GetStats(&stats);
+    size = stats.memory;
+    JSONCache_SetMaxMemory(4 * size);
+
+    // serializations are looked up by both the version and the request
+    JSONCache_Put(1, "1:.", 3, "[1]", 3);
+    json = JSONCache_Get(1, "1:.", 3, &len);
+    mu_check(NULL != json);
+    mu_assert_int_eq(3, len);
+    mu_check(!strncmp("[1]", json, len));
+    mu_check(NULL == JSONCache_Get(2, "1:.", 3, &len));
+    mu_check(NULL == JSONCache_Get(1, "1:a", 3, &len));
+    JSONCache_GetStats(&stats);
+    mu_assert_int_eq(1, stats.hits);
+    mu_assert_int_eq(2, stats.misses);
+    mu_assert_int_eq(1, stats.entries);
+
+    // serializations larger than a quarter of the cache aren't cached
+    JSONCache_Put(2, "", 0, big, sizeof(big) + 1);
+    mu_check(NULL == JSONCache_Get(2, "", 0, &len));
+
+    // the least recently used serialization is evicted to make room
+    JSONCache_Clear();
+    for (int i = 1; i <= 4; i++) JSONCache_Put(i, "", 0, big, sizeof(big));
+    JSONCache_GetStats(&stats);
+    mu_assert_int_eq(4, stats.entries);
+    mu_assert_int_eq(4 * size, stats.memory);
+    mu_check(NULL != JSONCache_Get(1, "", 0, &len));
+    JSONCache_Put(5, "", 0, big, sizeof(big));
+    JSONCache_GetStats(&stats);
+    mu_assert_int_eq(1, stats.evictions);
+    mu_assert_int_eq(4, stats.entries);
+    mu_check(NULL != JSONCache_Get(1, "", 0, &len));
+    mu_check(NULL == JSONCache_Get(2, "", 0, &len));
+
+    // a disabled cache caches nothing
+    JSONCache_SetMaxMemory(0);
+    JSONCache_Put(1, "", 0, "1", 1);
+    mu_check(NULL == JSONCache_Get(1, "", 0, &len));
+    JSONCache_GetStats(&stats);
+    mu_assert_int_eq(0, stats.entries);
+    mu_assert_int_eq(0, stats.memory);
+
+    JSONCache_SetMaxMemory(JSON_CACHE_DEFAULT_MAX_MEMORY);
+}
+
+/* Collects the chunks of a serialization, checking that all but the last are full. */
+typedef struct {
+    sds json;
+    size_t chunk;
+    int count;
+    int partial;  // the number of chunks shorter than a full one
+} _ojChunks;
+
+static void _ojChunk(void *arg, const char *buf, size_t len) {
+    _ojChunks *c = arg;
+    c->json = sdscatlen(c->json, buf, len);
+    c->count++;
+    if (len != c->chunk) c->partial++;
+}
+
+MU_TEST(test_oj_chunked) {
+    JSONSerializeOpt opt = {.indentstr = "  ", .newlinestr = "\n", .spacestr = " "};
+    Node *arr = NewArrayNode(0), *dict = NewDictNode(1);
+    char str[16];
+
+    // a long string with escapes, and many small values
+    char *big = malloc(10000);
+    for (int i = 0; i < 10000; i++) big[i] = i % 100 ? 'a' + i % 26 : '"';
+    Node_DictSet(dict, "big", NewStringNode(big, 10000));
+    free(big);
+    Node_ArrayAppend(arr, dict);
+    for (int i = 0; i < 1000; i++) {
+        sprintf(str, "str%d\n", i);
+        Node_ArrayAppend(arr, NewCStringNode(str));
+        Node_ArrayAppend(arr, NewIntNode(i));
+        Node_ArrayAppend(arr, NULL);
+    }
+    sds json = sdsempty();
+    SerializeNodeToJSON(arr, &opt, &json);
+
+    // the chunks make up the serialization regardless of their size
+    static const size_t sizes[] = {1, 7, 64, 4096, 1 << 20};
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        _ojChunks c = {sdsempty(), sizes[i], 0, 0};
+        SerializeNodeToJSONChunked(arr, &opt, sizes[i], _ojChunk, &c);
+        mu_assert_int_eq(sdslen(json), sdslen(c.json));
+        mu_check(!memcmp(json, c.json, sdslen(json)));
+        mu_assert_int_eq((sdslen(json) + sizes[i] - 1) / sizes[i], c.count);
+        mu_check(c.partial <= 1);
+        sdsfree(c.json);
+    }
+
+    sdsfree(json);
+    Node_Free(arr);
+}
+
+/* Stand-ins for the blocking API, module strings are C strings. */
+static void (*_blockedFree)(void *);
+static void *_unblocked;
+
+static const char *_stubStringPtrLen(const RedisModuleString *str, size_t *len) {
+    if (len) *len = strlen((const char *)str);
+    return (const char *)str;
+}
+
+static RedisModuleBlockedClient *_stubBlockClient(RedisModuleCtx *ctx, RedisModuleCmdFunc reply,
+                                                  RedisModuleCmdFunc timeout,
+                                                  void (*free_privdata)(void *), long long ms) {
+    _blockedFree = free_privdata;
+    return (RedisModuleBlockedClient *)ctx;
+}
+
+static int _stubUnblockClient(RedisModuleBlockedClient *bc, void *privdata) {
+    __atomic_store_n(&_unblocked, privdata, __ATOMIC_RELEASE);
+    return REDISMODULE_OK;
+}
+
+MU_TEST(test_oj_async_parse) {
+    RedisModule_StringPtrLen = _stubStringPtrLen;
+    RedisModule_BlockClient = _stubBlockClient;
+    RedisModule_UnblockClient = _stubUnblockClient;
+
+    const char *argv[] = {"json.arrappend", "key", ".", "{\"a\":[1,\"2\"]}", "[1,", "true"};
+    AsyncParseStats stats;
+    mu_assert_int_eq(OBJ_OK, AsyncParse_Start());
+    AsyncParse_Block(NULL, (RedisModuleString **)argv, 6, 3, 6, NULL);
+
+    AsyncParseJob *job = NULL;
+    for (int i = 0; i < 10000 && !job; i++) {
+        job = __atomic_load_n(&_unblocked, __ATOMIC_ACQUIRE);
+        if (!job) usleep(1000);
+    }
+    mu_check(NULL != job);
+    AsyncParse_GetStats(&stats);
+    mu_assert_int_eq(0, stats.pending);
+    mu_assert_int_eq(1, stats.parsed);
+
+    // the job keeps copies of the arguments, and the values are parsed up to the first error
+    mu_assert_int_eq(6, job->argc);
+    mu_check(!strcmp("key", job->args[1]) && job->args[1] != argv[1]);
+    mu_check(job->values[0].json == job->args[3]);
+    mu_assert_int_eq(3, job->nvalues);
+    mu_assert_int_eq(JSONOBJECT_OK, job->values[0].rc);
+    mu_assert_int_eq(N_DICT, NODETYPE(job->values[0].value));
+    mu_assert_int_eq(2, Node_Length(job->values[0].value->value.dictval.entries[0]->value.kvval.val));
+    mu_assert_int_eq(JSONOBJECT_ERROR, job->values[1].rc);
+    mu_check(NULL == job->values[1].value);
+    mu_check(NULL != job->values[1].err);
+    mu_check(NULL == job->values[2].value);
+
+    // freeing the job releases the values that weren't taken
+    _blockedFree(job);
+}
+
 MU_TEST_SUITE(test_json_literals) {
     MU_RUN_TEST(test_jo_create_literal_null);
     MU_RUN_TEST(test_jo_create_literal_true);
@@ -381,7 +698,10 @@ MU_TEST_SUITE(test_json_literals) {
     MU_RUN_TEST(test_jo_create_literal_array);
 }
 
-MU_TEST_SUITE(test_json_object) { MU_RUN_TEST(test_jo_create_object); }
+MU_TEST_SUITE(test_json_object) {
+    MU_RUN_TEST(test_jo_create_object);
+    MU_RUN_TEST(test_jo_indexed_parser);
+}
 
 MU_TEST_SUITE(test_object_to_json) {
     MU_RUN_TEST(test_oj_null);
@@ -392,6 +712,10 @@ MU_TEST_SUITE(test_object_to_json) {
     MU_RUN_TEST(test_oj_dict);
     MU_RUN_TEST(test_oj_array);
     MU_RUN_TEST(test_oj_special_characters);
+    MU_RUN_TEST(test_oj_estimate);
+    MU_RUN_TEST(test_oj_chunked);
+    MU_RUN_TEST(test_oj_cache);
+    MU_RUN_TEST(test_oj_async_parse);
 }
 
 int main(int argc, char *argv[]) {
@@ -50,12 +50,35 @@ echo -n "Should FAIL: "
 munch "$FAIL_FILES" 1
 FAIL_COUNT=$?
 
+# The indexed parser should produce the same output, errors included
+function compare {
+    REPLY=0
+
+    for f in $1
+    do
+        if cmp -s <(./json_validator.out $f) <(./json_validator.out -i $f)
+        then
+            echo -n "."
+        else
+            echo "E"
+            echo "$f: indexed parser output differs"
+            REPLY=$((REPLY+1))
+        fi
+    done
+    return $REPLY
+}
+
+echo
+echo -n "Indexed parser: "
+compare "$PASS_FILES $FAIL_FILES"
+INDEXED_COUNT=$?
+
 echo
 echo
 PASS_FILES=( $PASS_FILES )
 FAIL_FILES=( $FAIL_FILES )
 TOTAL_FILES=$((${#PASS_FILES[@]} + ${#FAIL_FILES[@]}))
-TOTAL_COUNT=$(($PASS_COUNT + $FAIL_COUNT))
+TOTAL_COUNT=$(($PASS_COUNT + $FAIL_COUNT + $INDEXED_COUNT))
 echo "$TOTAL_FILES JSON files validated, $TOTAL_COUNT problems detected"
 
 exit $TOTAL_COUNT
\ No newline at end of file
@@ -1,9 +1,22 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include "../src/json_object.h"
 #include "../src/json_path.h"
 #include "../src/object.h"
+#include "../src/arena.h"
 #include "../src/path.h"
+#include "../src/path_cache.h"
+#include "../src/path_filter.h"
+#include "../src/object_type.h"
+#include "../src/lazyfree.h"
+#include "../src/thread_pool.h"
+#include "../src/sindex.h"
+#include "../src/schema.h"
+#include "../src/expiry.h"
+#include "../src/compress.h"
+#include <unistd.h>
+#include <pthread.h>
 #include "minunit.h"
 #include <alloc.h>
 
@@ -33,6 +46,48 @@ MU_TEST(testNodeString) {
     mu_check(!strncmp(n1->value.strval.data, "foobar", Node_Length(n1)));
 }
 
+MU_TEST(testNodeCompact) {
+    // booleans and small integers are tagged
+    Node *n = NewBoolNode(1);
+    mu_check(NODE_IS_TAGGED(n));
+    mu_check(N_BOOLEAN == NODETYPE(n));
+    mu_check(1 == NODE_BOOLVAL(n));
+    n = NewBoolNode(0);
+    mu_check(NULL != n);
+    mu_check(N_BOOLEAN == NODETYPE(n));
+    mu_check(0 == NODE_BOOLVAL(n));
+    Node_Free(n);
+
+    const int64_t ints[] = {0, 1, -1, N_TAG_MAX_INT, N_TAG_MIN_INT};
+    for (int i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+        n = NewIntNode(ints[i]);
+        mu_check(NODE_IS_TAGGED(n));
+        mu_check(N_INTEGER == NODETYPE(n));
+        mu_check(ints[i] == NODE_INTVAL(n));
+    }
+
+    // larger integers are regular nodes
+    const int64_t bigints[] = {N_TAG_MAX_INT + 1, N_TAG_MIN_INT - 1, INT64_MAX, INT64_MIN};
+    for (int i = 0; i < sizeof(bigints) / sizeof(bigints[0]); i++) {
+        n = NewIntNode(bigints[i]);
+        mu_check(!NODE_IS_TAGGED(n));
+        mu_check(N_INTEGER == NODETYPE(n));
+        mu_check(bigints[i] == NODE_INTVAL(n));
+        Node_Free(n);
+    }
+
+    // strings are embedded until they're appended to
+    n = NewStringNode("foo", 3);
+    mu_check(n->flags & N_F_EMBSTR);
+    mu_check(n->value.strval.data == (const char *)(n + 1));
+    Node *n2 = NewStringNode("bar", 3);
+    mu_assert_int_eq(OBJ_OK, Node_StringAppend(n, n2));
+    mu_check(!(n->flags & N_F_EMBSTR));
+    mu_check(!strncmp(n->value.strval.data, "foobar", Node_Length(n)));
+    Node_Free(n2);
+    Node_Free(n);
+}
+
 MU_TEST(testNodeArray) {
     Node *arr, *n;
 
@@ -48,8 +103,8 @@ MU_TEST(testNodeArray) {
     mu_check(OBJ_ERR == Node_ArrayItem(arr, 1, &n));
     mu_check(OBJ_OK == Node_ArrayItem(arr, 0, &n));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
-    mu_check(42 == n->value.intval);
+    mu_check(N_INTEGER == NODETYPE(n));
+    mu_check(42 == NODE_INTVAL(n));
 
     // Delete the element
     mu_check(OBJ_OK == Node_ArrayDelRange(arr, 0, 1));
@@ -78,7 +133,7 @@ MU_TEST(testNodeArray) {
     mu_assert_int_eq(Node_Length(arr), 5);
     mu_check(OBJ_OK == Node_ArrayItem(arr, 0, &n));
     mu_check(NULL != n);
-    mu_check(N_BOOLEAN == n->type);
+    mu_check(N_BOOLEAN == NODETYPE(n));
     mu_check(OBJ_OK == Node_ArrayItem(arr, 1, &n));
     mu_check(NULL == n);
     // arr = [false, null, "foo", "bar", "baz"]
@@ -101,7 +156,7 @@ MU_TEST(testNodeArray) {
     mu_assert_int_eq(Node_Length(arr), 8);
     mu_check(OBJ_OK == Node_ArrayItem(arr, 5, &n));
     mu_check(NULL != n);
-    mu_check(N_INTEGER == n->type);
+    mu_check(N_INTEGER == NODETYPE(n));
     mu_check(OBJ_OK == Node_ArrayItem(arr, 6, &n));
     mu_check(NULL != n);
     mu_check(N_NUMBER == n->type);
@@ -184,6 +239,534 @@ MU_TEST(testObject) {
     Node_Free(root);
 }
 
+MU_TEST(testObjectIndex) {
+    char key[32];
+    Node *n, *root = NewDictNode(1);
+    mu_check(root != NULL);
+
+    // grow the dictionary over the index threshold
+    const int count = 10 * OBJ_DICT_INDEX_THRESHOLD;
+    for (int i = 0; i < count; i++) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictSet(root, key, NewIntNode(i)));
+    }
+    mu_assert_int_eq(count, Node_Length(root));
+    mu_check(Node_DictIndexSize(root) > 0);
+
+    // replace some values
+    for (int i = 0; i < count; i += 3) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictSet(root, key, NewIntNode(-i)));
+    }
+    mu_assert_int_eq(count, Node_Length(root));
+
+    // delete every other key, this moves the top entries around
+    for (int i = 0; i < count; i += 2) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictDel(root, key));
+        mu_check(OBJ_ERR == Node_DictDel(root, key));
+    }
+    mu_assert_int_eq(count / 2, Node_Length(root));
+
+    // verify all lookups
+    for (int i = 0; i < count; i++) {
+        sprintf(key, "key%d", i);
+        if (i % 2) {
+            mu_check(OBJ_OK == Node_DictGet(root, key, &n));
+            mu_check(N_INTEGER == NODETYPE(n));
+            mu_check((i % 3 ? i : -i) == NODE_INTVAL(n));
+        } else {
+            mu_check(OBJ_ERR == Node_DictGet(root, key, &n));
+        }
+    }
+
+    // an unindexed dictionary behaves the same
+    Node_DictSetIndexThreshold(0);
+    Node *dict = NewDictNode(count);
+    mu_check(0 == Node_DictIndexSize(dict));
+    for (int i = 0; i < count; i++) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictSet(dict, key, NULL));
+    }
+    mu_check(0 == Node_DictIndexSize(dict));
+    sprintf(key, "key%d", count - 1);
+    mu_check(OBJ_OK == Node_DictGet(dict, key, &n));
+    Node_DictSetIndexThreshold(OBJ_DICT_INDEX_THRESHOLD);
+
+    Node_Free(dict);
+    Node_Free(root);
+}
+
+MU_TEST(testObjectInternedKeys) {
+    size_t count = Intern_Count();
+    Node *n, *a = NewDictNode(1), *b = NewDictNode(1);
+
+    mu_check(NULL == Intern_Find("interned", NULL));
+    mu_check(OBJ_OK == Node_DictSet(a, "interned", NewIntNode(1)));
+    mu_check(OBJ_OK == Node_DictSet(b, "interned", NewIntNode(2)));
+    mu_check(OBJ_OK == Node_DictSet(b, "other", NULL));
+    mu_assert_int_eq(count + 2, Intern_Count());
+
+    // both dictionaries share the same key, and finding it takes a reference
+    uint32_t hash;
+    const char *key = Intern_Find("interned", &hash);
+    mu_check(key != NULL);
+    mu_check(Intern_HashBuffer("interned", 8) == hash);
+    mu_assert_int_eq(3, Intern_Refcount(key));
+    Intern_Release(key);
+    mu_check(a->value.dictval.entries[0]->value.kvval.key == key);
+    mu_check(b->value.dictval.entries[0]->value.kvval.key == key);
+    mu_assert_int_eq(2, Intern_Refcount(key));
+    mu_assert_int_eq(8, Intern_Len(key));
+
+    // replacing a value keeps the key
+    mu_check(OBJ_OK == Node_DictSet(a, "interned", NewIntNode(3)));
+    mu_assert_int_eq(2, Intern_Refcount(key));
+    mu_check(OBJ_OK == Node_DictGet(a, "interned", &n));
+    mu_assert_int_eq(3, NODE_INTVAL(n));
+
+    // keys are released along with their nodes
+    mu_check(OBJ_OK == Node_DictDel(b, "interned"));
+    mu_assert_int_eq(1, Intern_Refcount(key));
+    mu_check(OBJ_ERR == Node_DictGet(b, "interned", &n));
+
+    // paths hold their keys, which are looked up by pointer
+    SearchPath sp = NewSearchPath(0);
+    SearchPath_AppendKey(&sp, "interned", 8);
+    mu_check(key == sp.nodes[0].value.key);
+    mu_assert_int_eq(2, Intern_Refcount(key));
+    mu_assert_int_eq(E_OK, SearchPath_Find(&sp, a, &n));
+    mu_assert_int_eq(3, NODE_INTVAL(n));
+    mu_assert_int_eq(E_NOKEY, SearchPath_Find(&sp, b, &n));
+    mu_check(OBJ_OK == Node_DictGetInterned(a, key, &n));
+    Node_Free(a);
+    mu_assert_int_eq(1, Intern_Refcount(key));
+    SearchPath_Free(&sp);
+    mu_check(NULL == Intern_Find("interned", NULL));
+    Node_Free(b);
+    mu_assert_int_eq(count, Intern_Count());
+}
+
+/* Recounts the sizes of a value by walking it, like the containers' cached sizes are counted. */
+static t_sizes _walkSizes(const Node *n) {
+    if (!n || NODE_IS_TAGGED(n)) return (t_sizes){NULL, 1, 0};
+
+    t_sizes s = {NULL, 1, sizeof(Node)}, c;
+    switch (n->type) {
+        case N_STRING:
+            s.bytes += n->value.strval.len;
+            break;
+        case N_KEYVAL:
+            c = _walkSizes(n->value.kvval.val);
+            s.nodes += c.nodes;
+            s.bytes += c.bytes + Intern_Size(n->value.kvval.key);
+            break;
+        case N_DICT:
+        case N_ARRAY:
+            s.bytes += sizeof(t_sizes) + n->value.arrval.cap * sizeof(Node *) + Node_DictIndexSize(n);
+            for (uint32_t i = 0; i < n->value.arrval.len; i++) {
+                c = _walkSizes(n->value.arrval.entries[i]);
+                s.nodes += c.nodes;
+                s.bytes += c.bytes;
+            }
+            break;
+        default:
+            break;
+    }
+    return s;
+}
+
+#define _checkSizes(n)                                                 \
+    do {                                                               \
+        t_sizes _s = _walkSizes(n);                                    \
+        mu_assert_int_eq((int)_s.nodes, (int)Node_Count(n));           \
+        mu_assert_int_eq((int)_s.bytes, (int)Node_MemoryUsage(n));     \
+    } while (0)
+
+MU_TEST(testNodeSizes) {
+    Node *n, *val, *arr, *root = NewDictNode(0);
+    char key[32];
+
+    // scalars are sized as is
+    mu_assert_int_eq(1, Node_Count(NULL));
+    mu_assert_int_eq(0, Node_MemoryUsage(NewIntNode(1)));
+    n = NewCStringNode("foo");
+    mu_assert_int_eq(sizeof(Node) + 3, Node_MemoryUsage(n));
+    Node_Free(n);
+
+    // appending to containers, also past the index threshold
+    for (int i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        arr = NewArrayNode(0);
+        Node_ArrayAppend(arr, NewCStringNode(key));
+        Node_ArrayAppend(arr, NewDoubleNode(i));
+        Node_DictSet(root, key, arr);
+    }
+    _checkSizes(root);
+    mu_assert_int_eq(1 + 100 * 4, Node_Count(root));
+
+    // deep changes are accounted for by the ancestors
+    Node_DictGet(root, "key7", &arr);
+    Node_ArrayAppend(arr, NewDictNode(0));
+    Node_ArrayItem(arr, 2, &n);
+    Node_DictSet(n, "deep", NewCStringNode("value"));
+    Node_DictSet(n, "deep", NewArrayNode(4));
+    _checkSizes(root);
+    Node_DictGet(n, "deep", &val);
+    Node_ArrayAppend(val, NewCStringNode("deeper"));
+    _checkSizes(root);
+
+    // in place changes
+    Node_ArrayItem(arr, 0, &n);
+    val = NewCStringNode("bar");
+    Node_StringAppend(n, val);
+    Node_ChildResized(arr, Node_Length(val));
+    Node_Free(val);
+    _checkSizes(root);
+
+    // inserting, setting and deleting array items
+    n = NewArrayNode(2);
+    Node_ArrayAppend(n, NewArrayNode(0));
+    Node_ArrayAppend(n, NewCStringNode("inserted"));
+    Node_ArrayInsert(arr, 1, n);
+    Node_ArrayPrepend(arr, NewCStringNode("first"));
+    _checkSizes(root);
+    Node_ArrayItem(arr, 2, &n);
+    Node_ArrayAppend(n, NewCStringNode("in the inserted array"));
+    _checkSizes(root);
+    Node_ArrayItem(arr, 0, &n);
+    Node_ArraySet(arr, 0, NewArrayNode(1));
+    Node_Free(n);
+    _checkSizes(root);
+    Node_ArrayDelRange(arr, 1, 3);
+    _checkSizes(root);
+
+    // replacing, deleting and detaching dict entries
+    Node_DictSetKeyVal(root, NewKeyValNode("key8", 4, NewCStringNode("replaced")));
+    Node_DictDel(root, "key9");
+    Node_DictDetach(root, "key10", &val);
+    _checkSizes(root);
+    _checkSizes(val);
+    Node_ArrayAppend(val, NULL);
+    _checkSizes(root);
+    _checkSizes(val);
+    Node_Free(val);
+
+    // copies, also to an arena
+    n = Node_Copy(root);
+    _checkSizes(n);
+    mu_assert_int_eq(Node_Count(root), Node_Count(n));
+    Node_Free(n);
+    NodeArena_SetChunkSize(1024);
+    NodeArena *a = NewNodeArena(0);
+    Node_UseArena(a);
+    n = Node_Copy(root);
+    Node_UseArena(NULL);
+    _checkSizes(n);
+    NodeArena_Release(a);
+    NodeArena_SetChunkSize(0);
+
+    Node_Free(root);
+}
+
+MU_TEST(testStringCompression) {
+    char text[2048], out[2048], packed[2200];
+    for (int i = 0; i < sizeof(text); i++) text[i] = "<div class=\"x\">hello</div>"[i % 26];
+
+    // the codec round-trips repetitive and incompressible data, and rejects corrupt data
+    size_t clen = Compress_Encode(text, sizeof(text), packed, sizeof(packed));
+    mu_check(clen > 0 && clen < sizeof(text) / 8);
+    mu_assert_int_eq(OBJ_OK, Compress_Decode(packed, clen, out, sizeof(text)));
+    mu_check(!memcmp(text, out, sizeof(text)));
+    mu_assert_int_eq(OBJ_ERR, Compress_Decode(packed, clen, out, sizeof(text) - 1));
+    mu_assert_int_eq(OBJ_ERR, Compress_Decode(packed, clen - 1, out, sizeof(text)));
+    char noise[1000];
+    srand(42);
+    for (int i = 0; i < sizeof(noise); i++) noise[i] = (char)rand();
+    clen = Compress_Encode(noise, sizeof(noise), packed, Compress_Bound(sizeof(noise)));
+    mu_check(clen > 0);
+    mu_assert_int_eq(OBJ_OK, Compress_Decode(packed, clen, out, sizeof(noise)));
+    mu_check(!memcmp(noise, out, sizeof(noise)));
+    mu_assert_int_eq(0, Compress_Encode(noise, sizeof(noise), packed, sizeof(noise) / 2));
+
+    // only strings over the threshold that compress well are compressed
+    Node_StringSetCompressThreshold(64);
+    Node *small = NewStringNode(text, 63);
+    Node *big = NewStringNode(text, sizeof(text));
+    Node *rnd = NewStringNode(noise, sizeof(noise));
+    mu_check(!(small->flags & N_F_COMPRESSED));
+    mu_check(!(rnd->flags & N_F_COMPRESSED));
+    mu_check(big->flags & N_F_COMPRESSED);
+    mu_assert_int_eq(sizeof(text), Node_Length(big));
+    mu_check(Node_MemoryUsage(big) < sizeof(Node) + sizeof(text) / 8);
+    char *buf;
+    mu_check(!memcmp(text, Node_StringData(big, &buf), sizeof(text)));
+    mu_check(NULL != buf);
+    Node_StringRelease(buf);
+    mu_check(small->value.strval.data == Node_StringData(small, &buf));
+    mu_check(NULL == buf);
+
+    // copies and lookups see the original string
+    Node *arr = NewArrayNode(0);
+    Node_ArrayAppend(arr, small);
+    Node_ArrayAppend(arr, big);
+    Node_ArrayAppend(arr, rnd);
+    Node *copy = Node_Copy(big);
+    mu_check(copy->flags & N_F_COMPRESSED);
+    mu_assert_int_eq(1, Node_ArrayIndex(arr, copy, 0, 0));
+    size_t strings = 0, saved = 0;
+    Node_CompressionStats(arr, &strings, &saved);
+    mu_assert_int_eq(1, strings);
+    mu_assert_int_eq(sizeof(text) - big->value.strval.clen, saved);
+
+    // the serializer decompresses
+    JSONSerializeOpt opt = {.indentstr = "", .newlinestr = "", .spacestr = ""};
+    Node_StringSetCompressThreshold(0);
+    Node *plain = NewStringNode(text, sizeof(text));
+    Node_StringSetCompressThreshold(64);
+    sds json = sdsempty(), expected = sdsempty();
+    SerializeNodeToJSON(copy, &opt, &json);
+    SerializeNodeToJSON(plain, &opt, &expected);
+    mu_check(!sdscmp(expected, json));
+    sdsfree(json);
+    sdsfree(expected);
+    Node_Free(plain);
+
+    // appending keeps the string compressed, and a short string that grows over the threshold
+    // is compressed, while the container's sizes are kept up to date
+    size_t before = Node_MemoryUsage(big);
+    Node *tail = NewStringNode(text, 10);
+    Node_StringAppend(big, tail);
+    Node_ChildResized(arr, (int64_t)Node_MemoryUsage(big) - (int64_t)before);
+    mu_check(big->flags & N_F_COMPRESSED);
+    mu_assert_int_eq(sizeof(text) + 10, Node_Length(big));
+    mu_check(!memcmp(text, Node_StringData(big, &buf), sizeof(text)));
+    mu_check(!memcmp(text, buf + sizeof(text), 10));
+    Node_StringRelease(buf);
+    before = Node_MemoryUsage(small);
+    Node_StringAppend(small, copy);
+    Node_ChildResized(arr, (int64_t)Node_MemoryUsage(small) - (int64_t)before);
+    mu_check(small->flags & N_F_COMPRESSED);
+    mu_assert_int_eq(63 + sizeof(text), Node_Length(small));
+    mu_check(!memcmp(text, Node_StringData(small, &buf) + 63, sizeof(text)));
+    Node_StringRelease(buf);
+    mu_assert_int_eq(Node_MemoryUsage(small) + Node_MemoryUsage(big) + Node_MemoryUsage(rnd) +
+                         sizeof(Node) + sizeof(t_sizes) + 4 * sizeof(Node *),
+                     Node_MemoryUsage(arr));
+
+    // compressed strings can be allocated from an arena
+    NodeArena_SetChunkSize(1024);
+    NodeArena *arena = NewNodeArena(0);
+    NodeArena *prev = Node_UseArena(arena);
+    Node *astr = NewStringNode(text, sizeof(text));
+    Node_StringAppend(astr, tail);
+    Node *acopy = Node_Copy(astr);
+    Node_UseArena(prev);
+    mu_check((astr->flags & N_F_ARENA) && (acopy->flags & N_F_COMPRESSED));
+    mu_check(!memcmp(text, Node_StringData(acopy, &buf), sizeof(text)));
+    Node_StringRelease(buf);
+    Node_Free(astr);
+    Node_Free(acopy);
+    NodeArena_Release(arena);
+    NodeArena_SetChunkSize(0);
+
+    Node_StringSetCompressThreshold(0);
+    Node_Free(tail);
+    Node_Free(copy);
+    Node_Free(arr);
+}
+
+MU_TEST(testObjectArena) {
+    char key[32];
+    Node *n, *root;
+    size_t count = Intern_Count();
+    mu_assert_int_eq(24, sizeof(Node));
+
+    // arenas are disabled by default
+    mu_check(NULL == NewNodeArena(0));
+    NodeArena_SetChunkSize(1024);
+    NodeArena *a = NewNodeArena(0);
+    mu_check(a != NULL);
+
+    // build a document in the arena
+    Node_UseArena(a);
+    root = NewDictNode(1);
+    for (int i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        Node *arr = NewArrayNode(0);
+        mu_check(OBJ_OK == Node_ArrayAppend(arr, NewCStringNode(key)));
+        mu_check(OBJ_OK == Node_ArrayAppend(arr, NewDoubleNode(i / 2.0)));
+        mu_check(OBJ_OK == Node_ArrayAppend(arr, NewIntNode(INT64_MAX - i)));
+        mu_check(OBJ_OK == Node_DictSet(root, key, arr));
+    }
+    char big[1000];
+    memset(big, 'x', sizeof(big));
+    mu_check(OBJ_OK == Node_DictSet(root, "big", NewStringNode(big, sizeof(big))));
+    Node_UseArena(NULL);
+
+    mu_check(root->flags & N_F_ARENA);
+    mu_check(a == NodeArena_Of(root));
+    mu_check(OBJ_OK == Node_DictGet(root, "big", &n));
+    mu_check(a == NodeArena_Of(n));
+    size_t freed = a->freed;  // containers' entries are reallocated as they grow
+
+    // modify it
+    for (int i = 0; i < 100; i += 2) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictDel(root, key));
+    }
+    for (int i = 1; i < 100; i += 2) {
+        sprintf(key, "key%d", i);
+        mu_check(OBJ_OK == Node_DictGet(root, key, &n));
+        Node *str = NewCStringNode("suffix");
+        mu_check(OBJ_OK == Node_ArrayItem(n, 0, &n));
+        mu_check(OBJ_OK == Node_StringAppend(n, str));
+        Node_Free(str);
+    }
+    mu_check(OBJ_OK == Node_DictDel(root, "big"));
+    mu_check(a->freed > freed);
+    mu_check(a->freed <= a->used);
+    mu_assert_int_eq(count + 50, Intern_Count());
+
+    // copy it to a new arena, and release the original one
+    NodeArena *b = NewNodeArena(a->used - a->freed);
+    Node_UseArena(b);
+    Node *copy = Node_Copy(root);
+    Node_UseArena(NULL);
+    NodeArena_Release(a);
+    mu_check(a != b);
+    mu_check(b == NodeArena_Of(copy));
+    mu_check(0 == b->freed);
+    mu_assert_int_eq(50, Node_Length(copy));
+    for (int i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        if (i % 2) {
+            mu_check(OBJ_OK == Node_DictGet(copy, key, &n));
+            mu_assert_int_eq(3, Node_Length(n));
+            Node *item;
+            mu_check(OBJ_OK == Node_ArrayItem(n, 0, &item));
+            strcat(key, "suffix");
+            mu_assert_int_eq(strlen(key), Node_Length(item));
+            mu_check(!strncmp(key, item->value.strval.data, strlen(key)));
+            mu_check(OBJ_OK == Node_ArrayItem(n, 2, &item));
+            mu_check(INT64_MAX - i == NODE_INTVAL(item));
+        } else {
+            mu_check(OBJ_ERR == Node_DictGet(copy, key, &n));
+        }
+    }
+
+    // keys that are set in the arena are freed with it, like JSON.SET of a new key does
+    Node_UseArena(b);
+    mu_check(OBJ_OK == Node_DictSet(copy, "uniquenewkey", NewIntNode(1)));
+    Node_UseArena(NULL);
+    mu_assert_int_eq(count + 51, Intern_Count());
+
+    NodeArena_Release(b);
+    mu_assert_int_eq(count, Intern_Count());
+    NodeArena_SetChunkSize(0);
+}
+
+/* Waits until the lazy free thread has freed the pending values. */
+static void _lazyFreeWait() {
+    LazyFreeStats stats;
+    for (int i = 0; i < 10000; i++) {
+        LazyFree_GetStats(&stats);
+        if (!stats.pending) return;
+        usleep(1000);
+    }
+}
+
+MU_TEST(testLazyFree) {
+    LazyFreeStats before, after;
+    char key[32];
+    Node *val, *root = NewDictNode(0);
+    size_t count = Intern_Count();
+
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "lazy%d", i);
+        Node *arr = NewArrayNode(2);
+        Node_ArrayAppend(arr, NewCStringNode(key));
+        Node_ArrayAppend(arr, NewDoubleNode(i));
+        Node_DictSet(root, key, arr);
+    }
+    mu_assert_int_eq(count + 1000, Intern_Count());
+
+    // a detached value isn't freed with its entry
+    mu_assert_int_eq(OBJ_OK, Node_DictDetach(root, "lazy0", &val));
+    mu_assert_int_eq(OBJ_ERR, Node_DictDetach(root, "lazy0", &val));
+    mu_assert_int_eq(999, Node_Length(root));
+    mu_assert_int_eq(2, Node_Length(val));
+
+    // small values, and all values until the thread starts, are freed by the caller
+    LazyFree_SetThreshold(100);
+    LazyFree_GetStats(&before);
+    LazyFree_Value(val, NULL);
+    mu_assert_int_eq(OBJ_OK, LazyFree_Start());
+    mu_assert_int_eq(OBJ_OK, LazyFree_Start());
+    LazyFree_Value(NewIntNode(1), NULL);
+    LazyFree_Value(NULL, NULL);
+    LazyFree_GetStats(&after);
+    mu_assert_int_eq(before.freed, after.freed);
+    mu_assert_int_eq(100, after.threshold);
+
+    // large values are freed in the background, along with their interned keys
+    LazyFree_Value(root, NULL);
+    _lazyFreeWait();
+    LazyFree_GetStats(&after);
+    mu_assert_int_eq(0, after.pending);
+    mu_assert_int_eq(before.freed + 1, after.freed);
+    mu_assert_int_eq(count, Intern_Count());
+
+    // and so are arenas
+    NodeArena_SetChunkSize(1024);
+    NodeArena *a = NewNodeArena(0);
+    Node_UseArena(a);
+    root = NewArrayNode(0);
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "lazy%d", i);
+        Node *dict = NewDictNode(1);
+        Node_DictSet(dict, key, NewCStringNode(key));
+        Node_ArrayAppend(root, dict);
+    }
+    Node_UseArena(NULL);
+
+    // but not the subtrees of a value in an arena
+    Node_ArrayItem(root, 0, &val);
+    Node_ArraySet(root, 0, NULL);
+    Node_ArrayDelRange(root, 0, 1);
+    LazyFree_Value(val, NULL);
+    LazyFree_GetStats(&after);
+    mu_assert_int_eq(before.freed + 1, after.freed);
+
+    LazyFree_Value(root, a);
+    _lazyFreeWait();
+    LazyFree_GetStats(&after);
+    mu_assert_int_eq(before.freed + 2, after.freed);
+    mu_assert_int_eq(count, Intern_Count());
+    NodeArena_SetChunkSize(0);
+    LazyFree_SetThreshold(LAZYFREE_DEFAULT_THRESHOLD);
+}
+
+static void _poolTask(void *arg, size_t i) { __atomic_add_fetch(&((int *)arg)[i], 1, __ATOMIC_RELAXED); }
+
+MU_TEST(testThreadPool) {
+    int counts[1000] = {0};
+
+    // without workers the calling thread runs the items
+    mu_assert_int_eq(0, ThreadPool_Size());
+    ThreadPool_Run(_poolTask, counts, 10);
+    mu_assert_int_eq(1, counts[9]);
+    mu_assert_int_eq(0, counts[10]);
+
+    // every item of every job is run exactly once
+    mu_assert_int_eq(OBJ_OK, ThreadPool_Start(4));
+    mu_assert_int_eq(OBJ_ERR, ThreadPool_Start(4));
+    mu_assert_int_eq(4, ThreadPool_Size());
+    for (int j = 0; j < 100; j++) ThreadPool_Run(_poolTask, counts, 1000);
+    for (int i = 0; i < 1000; i++) mu_assert_int_eq(100 + (i < 10), counts[i]);
+    ThreadPool_Run(_poolTask, counts, 0);
+}
+
 MU_TEST(testPath) {
     Node *root = NewDictNode(1);
     mu_check(root != NULL);
@@ -292,6 +875,60 @@ MU_TEST(testPathEx) {
     Node_Free(root);
 }
 
+MU_TEST(testPathCache) {
+    PathCacheStats stats;
+    JSONSearchPathError_t err = {0};
+    SearchPath *sp1, *sp2, *sp3;
+
+    PathCache_SetCapacity(2);
+
+    // the second lookup is a hit that shares the compiled path
+    sp1 = PathCache_Acquire("foo[1]", 6, &err);
+    mu_check(NULL != sp1);
+    mu_assert_int_eq(2, sp1->len);
+    mu_check(!strcmp("foo", sp1->nodes[0].value.key));
+    mu_assert_int_eq(1, sp1->nodes[1].value.index);
+    sp2 = PathCache_Acquire("foo[1]", 6, &err);
+    mu_check(sp1 == sp2);
+    PathCache_Release(sp2);
+    PathCache_GetStats(&stats);
+    mu_assert_int_eq(1, stats.hits);
+    mu_assert_int_eq(1, stats.misses);
+    mu_assert_int_eq(1, stats.size);
+
+    // syntax errors aren't cached
+    mu_check(NULL == PathCache_Acquire("foo[x]", 6, &err));
+    mu_check(NULL != err.errmsg);
+    PathCache_GetStats(&stats);
+    mu_assert_int_eq(1, stats.size);
+
+    // the least recently used path is evicted, but stays valid while referenced
+    sp2 = PathCache_Acquire(".bar", 4, NULL);
+    sp3 = PathCache_Acquire(".baz", 4, NULL);
+    PathCache_GetStats(&stats);
+    mu_assert_int_eq(1, stats.evictions);
+    mu_assert_int_eq(2, stats.size);
+    mu_check(!strcmp("foo", sp1->nodes[0].value.key));
+    PathCache_Release(sp1);
+    sp1 = PathCache_Acquire(".bar", 4, NULL);
+    mu_check(sp1 == sp2);
+    PathCache_Release(sp1);
+    PathCache_Release(sp2);
+    PathCache_Release(sp3);
+
+    // without a cache every lookup parses
+    PathCache_SetCapacity(0);
+    sp1 = PathCache_Acquire(".bar", 4, NULL);
+    sp2 = PathCache_Acquire(".bar", 4, NULL);
+    mu_check(sp1 != sp2);
+    PathCache_GetStats(&stats);
+    mu_assert_int_eq(0, stats.size);
+    PathCache_Release(sp1);
+    PathCache_Release(sp2);
+
+    PathCache_SetCapacity(PATH_CACHE_DEFAULT_CAPACITY);
+}
+
 MU_TEST(testPathArray) {
     Node *n, *arr = NewArrayNode(0);
     SearchPath sp;
@@ -312,8 +949,8 @@ MU_TEST(testPathArray) {
         pe = SearchPath_Find(&sp, arr, &n);
         mu_check(pe == E_OK);
         mu_check(NULL != n);
-        mu_check(N_INTEGER == n->type);
-        mu_check(i == n->value.intval);
+        mu_check(N_INTEGER == NODETYPE(n));
+        mu_check(i == NODE_INTVAL(n));
         SearchPath_Free(&sp);
     }
 
@@ -324,8 +961,8 @@ MU_TEST(testPathArray) {
         pe = SearchPath_Find(&sp, arr, &n);
         mu_check(pe == E_OK);
         mu_check(NULL != n);
-        mu_check(N_INTEGER == n->type);
-        mu_check(5 + i == n->value.intval);
+        mu_check(N_INTEGER == NODETYPE(n));
+        mu_check(5 + i == NODE_INTVAL(n));
         SearchPath_Free(&sp);
     }
 
@@ -345,6 +982,632 @@ MU_TEST(testPathArray) {
     Node_Free(arr);
 }
 
+/* Checks that the results of a path are the array's elements at the given values. */
+static int _checkSliceResults(SearchPathResults *res, int *values, int len) {
+    if (res->len != len) return 0;
+    for (int i = 0; i < len; i++) {
+        if (N_INTEGER != NODETYPE(res->nodes[i]) || values[i] != NODE_INTVAL(res->nodes[i]))
+            return 0;
+    }
+    return 1;
+}
+
+MU_TEST(testPathSlice) {
+    Node *arr = NewArrayNode(0), *n;
+    for (int i = 0; i < 5; i++) mu_check(OBJ_OK == Node_ArrayAppend(arr, NewIntNode(i)));
+    SearchPathResults res;
+    int errlevel;
+
+    struct {
+        int start, stop, step, flags;
+        int values[5];
+        int len;
+    } cases[] = {
+        {1, 3, 1, PATH_SLICE_START | PATH_SLICE_STOP, {1, 2}, 2},
+        {0, -1, 1, PATH_SLICE_STOP, {0, 1, 2, 3}, 4},
+        {-2, 0, 1, PATH_SLICE_START, {3, 4}, 2},
+        {0, 0, 2, 0, {0, 2, 4}, 3},
+        {0, 0, -1, 0, {4, 3, 2, 1, 0}, 5},
+        {3, 0, -2, PATH_SLICE_START | PATH_SLICE_STOP, {3, 1}, 2},
+        {-100, 100, 1, PATH_SLICE_START | PATH_SLICE_STOP, {0, 1, 2, 3, 4}, 5},
+        {3, 1, 1, PATH_SLICE_START | PATH_SLICE_STOP, {0}, 0},
+        {7, 0, 1, PATH_SLICE_START, {0}, 0},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        SearchPath sp = NewSearchPath(1);
+        SearchPath_AppendSlice(&sp, cases[i].start, cases[i].stop, cases[i].step, cases[i].flags);
+        mu_check(E_MULTI == SearchPath_Find(&sp, arr, &n));
+        mu_check(E_OK == SearchPath_FindAll(&sp, arr, &res, &errlevel));
+        mu_check(_checkSliceResults(&res, cases[i].values, cases[i].len));
+        // a range of consecutive elements is the array's own entries
+        if (1 == cases[i].step && res.len) mu_check(!res.cap);
+        SearchPathResults_Free(&res);
+        SearchPath_Free(&sp);
+    }
+
+    // nested paths skip the elements that don't match
+    Node *doc = NewArrayNode(0), *d = NewDictNode(1);
+    mu_check(OBJ_OK == Node_DictSet(d, "x", NewIntNode(7)));
+    mu_check(OBJ_OK == Node_ArrayAppend(doc, d));
+    mu_check(OBJ_OK == Node_ArrayAppend(doc, NewIntNode(1)));
+    mu_check(OBJ_OK == Node_ArrayAppend(doc, arr));
+    const char *path = "[::-2].x";
+    SearchPath sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath(path, strlen(path), &sp, NULL), PARSE_OK);
+    mu_check(E_OK == SearchPath_FindAll(&sp, doc, &res, &errlevel));
+    mu_check(_checkSliceResults(&res, (int[]){7}, 1));
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    path = "[2][1:][0]";
+    sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath(path, strlen(path), &sp, NULL), PARSE_OK);
+    mu_check(E_OK == SearchPath_FindAll(&sp, doc, &res, &errlevel));
+    mu_assert_int_eq(res.len, 0);
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    // errors before the slice are reported
+    path = "[5][1:]";
+    sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath(path, strlen(path), &sp, NULL), PARSE_OK);
+    mu_check(E_NOINDEX == SearchPath_FindAll(&sp, doc, &res, &errlevel));
+    mu_assert_int_eq(errlevel, 0);
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    path = "[1][1:]";
+    sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath(path, strlen(path), &sp, NULL), PARSE_OK);
+    mu_check(E_BADTYPE == SearchPath_FindAll(&sp, doc, &res, &errlevel));
+    mu_assert_int_eq(errlevel, 1);
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    Node_Free(doc);
+}
+
+MU_TEST(testPathWildcard) {
+    const char *json = "{\"a\":[{\"x\":1},{\"x\":2,\"y\":{\"x\":3}},4],\"b\":{\"x\":5,\"c\":[6]}}";
+    Node *root, *n;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &root, NULL));
+    SearchPathResults res;
+    int errlevel;
+
+    struct {
+        const char *path;
+        int values[6];
+        int len;
+    } cases[] = {
+        {"a[*].x", {1, 2}, 2},       {"b.*[*]", {6}, 1},      {"b.c[*]", {6}, 1},
+        {"..x", {1, 2, 3, 5}, 4},    {"a..x", {1, 2, 3}, 3},  {"b..[0]", {6}, 1},
+        {"a[1].*.*", {3}, 1},        {"..c.*", {6}, 1},       {"a[*].z", {0}, 0},
+        {"..*..c[0]", {6}, 1},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_assert_int_eq(ParseJSONPath(cases[i].path, strlen(cases[i].path), &sp, NULL), PARSE_OK);
+        mu_check(E_MULTI == SearchPath_Find(&sp, root, &n));
+        mu_check(E_OK == SearchPath_FindAll(&sp, root, &res, &errlevel));
+        mu_check(_checkSliceResults(&res, cases[i].values, cases[i].len));
+        SearchPathResults_Free(&res);
+        SearchPath_Free(&sp);
+    }
+
+    // a wildcard at the end of the path gives the array's own entries, in order
+    SearchPath sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath("a[*]", 4, &sp, NULL), PARSE_OK);
+    mu_check(E_OK == SearchPath_FindAll(&sp, root, &res, &errlevel));
+    mu_assert_int_eq(res.len, 3);
+    mu_assert_int_eq(res.cap, 0);
+    mu_check(N_DICT == NODETYPE(res.nodes[0]) && N_INTEGER == NODETYPE(res.nodes[2]));
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    // the node itself is the first of its descendants
+    sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath("b..*", 4, &sp, NULL), PARSE_OK);
+    mu_check(E_OK == SearchPath_FindAll(&sp, root, &res, &errlevel));
+    mu_assert_int_eq(res.len, 3);
+    mu_check(N_INTEGER == NODETYPE(res.nodes[0]) && N_ARRAY == NODETYPE(res.nodes[1]));
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    // wildcards are for containers only
+    sp = NewSearchPath(0);
+    mu_assert_int_eq(ParseJSONPath("a[2][*]", 7, &sp, NULL), PARSE_OK);
+    mu_check(E_BADTYPE == SearchPath_FindAll(&sp, root, &res, &errlevel));
+    mu_assert_int_eq(errlevel, 2);
+    SearchPathResults_Free(&res);
+    SearchPath_Free(&sp);
+
+    Node_Free(root);
+}
+
+MU_TEST(testPathFilter) {
+    const char *json =
+        "[{\"p\":5,\"t\":\"x\"},{\"p\":15,\"t\":\"x\"},{\"p\":7,\"t\":\"y\",\"n\":null},"
+        "{\"p\":2,\"t\":\"x\",\"b\":true},3,null,\"x\"]";
+    Node *root;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &root, NULL));
+    SearchPathResults res;
+    int errlevel;
+
+    // the values are the `p`s of the matches, or the matches themselves
+    struct {
+        const char *path;
+        int values[6];
+        int len;
+    } cases[] = {
+        {"[?(@.p < 10 && @.t == \"x\")].p", {5, 2}, 2},
+        {"[?(@.p > 10 || @.t == 'y' && @.n == null)].p", {15, 7}, 2},
+        {"[?(!(@.p >= 5))].p", {2}, 1},
+        {"[?(@.p == 7.0 || @.p == 2)].p", {7, 2}, 2},
+        {"[?(@.p <= 5.0)].p", {5, 2}, 2},
+        {"[?(10 < @.p)].p", {15}, 1},
+        {"[?(@.t != \"x\")].p", {7}, 1},
+        {"[?(@.b)].p", {2}, 1},
+        {"[?(@.b == true && !@.n)].p", {2}, 1},
+        {"[?(@ == 3 || @ == null)]", {3}, 1},
+        {"[?(@.t < 'y' && @.p != @.t)].p", {5, 15, 2}, 3},
+        {"[?(@.p == -1 || (((@.p == 15))))].p", {15}, 1},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_assert_int_eq(ParseJSONPath(cases[i].path, strlen(cases[i].path), &sp, NULL), PARSE_OK);
+        mu_check(E_OK == SearchPath_FindAll(&sp, root, &res, &errlevel));
+        if (9 == i) {
+            mu_assert_int_eq(res.len, 2);  // the second is a null
+            mu_check(!res.nodes[1]);
+            res.len = 1;
+        }
+        mu_check(_checkSliceResults(&res, cases[i].values, cases[i].len));
+        SearchPathResults_Free(&res);
+        SearchPath_Free(&sp);
+    }
+
+    const char *badpaths[] = {"[?(@.p)",     "[?@.p]",        "[?(@.p <)]",      "[?(1 == 1)]",
+                              "[?(@.p > true)]", "[?(@[*])]",  "[?(@.t == 'x)]", "[?(@.p @.t)]",
+                              "[?(.)]",      "[?((@.p)]",     "[?(@.p && )]",    NULL};
+    for (int i = 0; badpaths[i]; i++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_check(PARSE_ERR == ParseJSONPath(badpaths[i], strlen(badpaths[i]), &sp, NULL));
+        SearchPath_Free(&sp);
+    }
+
+    // nesting is limited
+    char deep[3 * PATH_FILTER_MAX_DEPTH + 16] = "[?(";
+    for (int i = 0; i < PATH_FILTER_MAX_DEPTH; i++) strcat(deep, "!");
+    strcat(deep, "@)]");
+    SearchPath sp = NewSearchPath(0);
+    mu_check(PARSE_ERR == ParseJSONPath(deep, strlen(deep), &sp, NULL));
+    SearchPath_Free(&sp);
+
+    Node_Free(root);
+}
+
+/* Collects the key names of the documents that a query matched. */
+static int _collectDocKeys(void *arg, const SIndexDoc *doc) {
+    sds *keys = (sds *)arg;
+    *keys = sdscatfmt(*keys, "%S ", doc->key);
+    return 1;
+}
+
+typedef struct {
+    void (*free)(void *);
+    void *value;
+} _freeJob;
+
+static void *_freeJobMain(void *arg) {
+    _freeJob *job = arg;
+    job->free(job->value);
+    return NULL;
+}
+
+/* Frees a value by another thread than the main one, like the server's background thread. */
+static void _freeInThread(void (*free)(void *), void *value) {
+    _freeJob job = {free, value};
+    pthread_t thread;
+    pthread_create(&thread, NULL, _freeJobMain, &job);
+    pthread_join(thread, NULL);
+}
+
+MU_TEST(testSIndex) {
+    const char *jsons[] = {"{\"p\":5,\"t\":[\"a\",\"b\",\"a\"]}", "{\"p\":[2,7,2]}",
+                           "{\"p\":7.5,\"t\":\"b\"}", "{\"p\":\"x\",\"t\":3}"};
+    const char *names[] = {"doc:a", "doc:b", "doc:c", "doc:d"};
+    JSONType_t *jts[4];
+
+    JSONSearchPathError_t err = {0};
+    mu_check(!NewSIndex("doc:", 4, "p[", 2, SINDEX_NUMERIC, 0, &err));
+    SIndex *num = NewSIndex("doc:", 4, "p", 1, SINDEX_NUMERIC, 0, NULL);
+    SIndex *tag = NewSIndex("doc:", 4, "t", 1, SINDEX_TAG, 0, NULL);
+    SIndex *other = NewSIndex("other:", 6, "p", 1, SINDEX_NUMERIC, 0, NULL);
+    mu_check(num && tag && other);
+    mu_check(SIndex_Any());
+    for (int i = 0; i < 4; i++) {
+        Node *root;
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(jsons[i], strlen(jsons[i]), &root, NULL));
+        jts[i] = NewJSONType(root, NULL);
+        mu_check(SIndex_Matches(num, names[i], 5));
+        SIndex_AddDoc(num, names[i], 5, jts[i]);
+        SIndex_AddDoc(tag, names[i], 5, jts[i]);
+    }
+    // duplicate values are indexed once, and values of other types not at all
+    mu_assert_int_eq(3, num->ndocs);
+    mu_assert_int_eq(4, num->nentries);
+    mu_assert_int_eq(2, tag->ndocs);
+    mu_assert_int_eq(3, tag->nentries);
+
+    // documents are matched once, by their first value
+    sds keys = sdsempty();
+    SIndex_QueryRange(num, 2, 0, 7, 0, _collectDocKeys, &keys);
+    mu_check(!strcmp("doc:b doc:a ", keys));
+    sdsclear(keys);
+    SIndex_QueryRange(num, 5, 1, INFINITY, 0, _collectDocKeys, &keys);
+    mu_check(!strcmp("doc:b doc:c ", keys));
+    sdsclear(keys);
+    SIndex_QueryRange(num, 2, 1, 5, 1, _collectDocKeys, &keys);
+    mu_check(!strcmp("", keys));
+    SIndex_QueryTag(tag, "b", 1, _collectDocKeys, &keys);
+    mu_check(!strcmp("doc:a doc:c ", keys));
+    sdsclear(keys);
+    SIndex_QueryTag(tag, "c", 1, _collectDocKeys, &keys);
+    SIndex_QueryRange(tag, -INFINITY, 0, INFINITY, 0, _collectDocKeys, &keys);
+    mu_check(!strcmp("", keys));
+
+    // queries are matched against values like they're indexed, e.g. ones with expired values
+    SIndexQuery q = {.min = 7, .max = INFINITY, .minex = 1};
+    mu_check(SIndex_QueryMatches(num, &q, jts[2]->root));
+    mu_check(!SIndex_QueryMatches(num, &q, jts[1]->root));
+    q = (SIndexQuery){.tag = "b", .len = 1};
+    mu_check(SIndex_QueryMatches(tag, &q, jts[0]->root));
+    mu_check(SIndex_QueryMatches(tag, &q, jts[2]->root));
+    mu_check(!SIndex_QueryMatches(tag, &q, jts[3]->root));
+
+    // updates reindex the built indexes of the value's database under its current name
+    num->built = tag->built = other->built = 1;
+    mu_assert_int_eq(OBJ_OK, Node_DictSet(jts[2]->root, "p", NewIntNode(1)));
+    SIndex_Update(0, names[2], 5, jts[2]);
+    SIndex_QueryRange(num, -INFINITY, 0, 2, 0, _collectDocKeys, &keys);
+    mu_check(!strcmp("doc:c doc:b ", keys));
+    SIndex_Update(0, "renamed:c", 9, jts[2]);
+    mu_assert_int_eq(2, num->ndocs);
+    mu_assert_int_eq(1, tag->ndocs);
+    SIndex_Update(1, names[2], 5, jts[2]);
+    mu_assert_int_eq(2, num->ndocs);
+
+    // freed values and indexes are unlinked, by the main thread if another one frees them
+    JSONTypeSetMainThread();
+    _freeInThread(JSONTypeFree, jts[0]);
+    mu_assert_int_eq(2, num->ndocs);
+    mu_assert_int_eq(1, JSONTypeReap());
+    mu_assert_int_eq(0, JSONTypeReap());
+    mu_assert_int_eq(1, num->ndocs);
+    mu_assert_int_eq(2, num->nentries);
+    mu_assert_int_eq(0, tag->ndocs);
+    mu_assert_int_eq(0, tag->nentries);
+    _freeInThread(SIndexTypeFree, num);
+    mu_check(jts[1]->indexed);
+    mu_assert_int_eq(1, JSONTypeReap());
+    mu_check(!jts[1]->indexed);
+    SIndex_Free(tag);
+    SIndex_Free(other);
+    mu_check(!SIndex_Any());
+    for (int i = 1; i < 4; i++) JSONTypeFree(jts[i]);
+    sdsfree(keys);
+}
+
+/* Compiles a schema from JSON, returning NULL and setting err on errors. */
+static Schema *_compileSchema(const char *json, sds *err) {
+    Node *doc;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, strlen(json), &doc, NULL)) return NULL;
+    Schema *s = Schema_Compile(doc, err);
+    Node_Free(doc);
+    return s;
+}
+
+/* Validates JSON against a schema, returning the violation or NULL. */
+static sds _validateJSON(const Schema *s, const char *json) {
+    Node *n;
+    sds err = NULL;
+    if (JSONOBJECT_OK != CreateNodeFromJSON(json, strlen(json), &n, NULL)) return sdsnew("parse");
+    Schema_Validate(s, Schema_Root(s), n, ".", &err);
+    Node_Free(n);
+    return err;
+}
+
+MU_TEST(testSchema) {
+    sds err = NULL;
+    Schema *s = _compileSchema(
+        "{\"type\":\"object\",\"required\":[\"id\",\"name\"],\"additionalProperties\":false,"
+        "\"title\":\"item\",\"properties\":{\"id\":{\"type\":\"integer\",\"minimum\":1},"
+        "\"name\":{\"type\":\"string\",\"minLength\":1,\"maxLength\":4},"
+        "\"tags\":{\"type\":\"array\",\"items\":{\"enum\":[\"a\",\"b\"]},\"maxItems\":2},"
+        "\"score\":{\"type\":[\"number\",\"null\"],\"exclusiveMaximum\":10},\"meta\":true}}",
+        &err);
+    mu_check(s);
+
+    // the valid values have no violation, the others are reported by location
+    struct {
+        const char *json;
+        const char *err;
+    } cases[] = {
+        {"{\"id\":1,\"name\":\"ab\",\"tags\":[\"a\"],\"score\":null,\"meta\":{\"x\":[1]}}", NULL},
+        {"{\"id\":2.0,\"name\":\"h\xc3\xa9ll\",\"score\":9.5}", NULL},
+        {"{\"name\":\"ab\"}", ".: lacks the required property `id`"},
+        {"{\"id\":1.5,\"name\":\"ab\"}", ".id: expected integer"},
+        {"{\"id\":0,\"name\":\"ab\"}", ".id: must be >= 1"},
+        {"{\"id\":1,\"name\":\"h\xc3\xa9llo\"}", ".name: has 5 characters, more than 4"},
+        {"{\"id\":1,\"name\":\"a\",\"tags\":[\"a\",\"c\"]}",
+         ".tags[1]: isn't one of the allowed values"},
+        {"{\"id\":1,\"name\":\"a\",\"x\":1}", ".: has the unexpected property `x`"},
+        {"{\"id\":1,\"name\":\"a\",\"score\":10}", ".score: must be < 10"},
+        {"{\"id\":1,\"name\":\"a\",\"score\":\"x\"}", ".score: expected null or number"},
+        {"[1]", ".: expected object"},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        err = _validateJSON(s, cases[i].json);
+        mu_check(cases[i].err ? err && !strcmp(cases[i].err, err) : !err);
+        sdsfree(err);
+    }
+
+    // writes below the root are validated against the subschema of their path
+    SearchPath sp = NewSearchPath(0);
+    mu_assert_int_eq(PARSE_OK, ParseJSONPath("tags", 4, &sp, NULL));
+    SchemaRef tags = Schema_At(s, &sp, sp.len);
+    Node *arr, *sub;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("[\"a\"]", 5, &arr, NULL));
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("[\"b\",\"a\"]", 9, &sub, NULL));
+    mu_assert_int_eq(OBJ_ERR, Schema_ValidateInsert(s, tags, arr, sub, 1, "tags", &err));
+    mu_check(!strcmp("tags: has 3 items, more than 2", err));
+    sdsfree(err);
+    Node_ArrayDelRange(sub, 0, 1);
+    mu_assert_int_eq(OBJ_OK, Schema_ValidateInsert(s, tags, arr, sub, 0, "tags", &err));
+    Node *old;
+    Node_ArrayItem(sub, 0, &old);
+    mu_assert_int_eq(OBJ_OK, Node_ArraySet(sub, 0, NewCStringNode("x")));
+    Node_Free(old);
+    mu_assert_int_eq(OBJ_ERR, Schema_ValidateInsert(s, tags, arr, sub, 1, "tags", &err));
+    mu_check(!strcmp("tags[1]: isn't one of the allowed values", err));
+    sdsfree(err);
+    mu_check(SCHEMA_NONE == Schema_Property(s, Schema_Root(s), "x"));
+    mu_check(SCHEMA_ANY == Schema_Property(s, Schema_Property(s, Schema_Root(s), "meta"), "x"));
+
+    Node *obj;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON("{\"id\":1,\"name\":\"a\",\"score\":1}", 29, &obj,
+                                                 NULL));
+    mu_assert_int_eq(OBJ_OK, Schema_ValidateRemove(s, Schema_Root(s), obj, "score", ".", &err));
+    mu_assert_int_eq(OBJ_ERR, Schema_ValidateRemove(s, Schema_Root(s), obj, "id", ".", &err));
+    mu_check(!strcmp(".: `id` is a required property", err));
+    sdsfree(err);
+    Node_Free(obj);
+    Node_Free(arr);
+    Node_Free(sub);
+    SearchPath_Free(&sp);
+    Schema_Free(s);
+
+    // unsupported and invalid schemas are reported by their location in the schema
+    struct {
+        const char *json;
+        const char *err;
+    } bad[] = {
+        {"5", "#: a schema must be an object or a boolean"},
+        {"{\"type\":\"foo\"}", "#: `type` must be type names"},
+        {"{\"properties\":{\"a\":{\"pattern\":\"x\"}}}",
+         "#/properties/a: unsupported keyword `pattern`"},
+        {"{\"items\":[true]}", "#: `items` supports only a single schema"},
+        {"{\"items\":{\"enum\":[[1]]}}", "#/items: `enum` supports only scalars"},
+        {"{\"minLength\":-1}", "#: `minLength` must be a non-negative integer"},
+    };
+    for (int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        err = NULL;
+        mu_check(!_compileSchema(bad[i].json, &err));
+        mu_check(err && !strcmp(bad[i].err, err));
+        sdsfree(err);
+    }
+
+    // nesting is limited
+    sds deep = sdsempty();
+    for (int i = 0; i <= SCHEMA_MAX_DEPTH; i++) deep = sdscat(deep, "{\"items\":");
+    deep = sdscat(deep, "true");
+    for (int i = 0; i <= SCHEMA_MAX_DEPTH; i++) deep = sdscat(deep, "}");
+    err = NULL;
+    mu_check(!_compileSchema(deep, &err));
+    mu_check(err);
+    sdsfree(err);
+    sdsfree(deep);
+
+    s = _compileSchema("false", &err);
+    mu_check(s && SCHEMA_NONE == Schema_Root(s));
+    Schema_Free(s);
+}
+
+/* Sets the TTL of a path, which is parsed. */
+static void _setExpiry(JSONType_t *jt, const char *path, uint64_t when) {
+    SearchPath sp = NewSearchPath(0);
+    ParseJSONPath(path, strlen(path), &sp, NULL);
+    sds canonical = Expiry_FormatPath(&sp, jt->root);
+    Expiry_Set(jt, 0, "doc", 3, canonical, sdslen(canonical), when);
+    sdsfree(canonical);
+    SearchPath_Free(&sp);
+}
+
+/* Returns the number of due entries, clearing them. */
+static int _popDue(uint64_t now, uint64_t after) {
+    int count = 0;
+    ExpiryEntry *e;
+    while ((e = Expiry_NextDue())) {
+        if (e->when > now || e->when <= after) return -1;
+        Expiry_Remove(e);
+        count++;
+    }
+    return count;
+}
+
+MU_TEST(testExpiry) {
+    // paths are canonical, and only those of single values have TTLs
+    const char *paths[][2] = {{"a[3]['b\"c'].d", "[\"a\"][3]['b\"c'][\"d\"]"},
+                              {"[-1]", NULL},
+                              {".", ""},
+                              {"a[*]", NULL},
+                              {"..a", NULL}};
+    for (int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        SearchPath sp = NewSearchPath(0);
+        mu_assert_int_eq(PARSE_OK, ParseJSONPath(paths[i][0], strlen(paths[i][0]), &sp, NULL));
+        sds canonical = Expiry_FormatPath(&sp, NULL);
+        mu_check(paths[i][1] ? canonical && !strcmp(paths[i][1], canonical) : !canonical);
+        sdsfree(canonical);
+        SearchPath_Free(&sp);
+    }
+    SearchPath sp = NewSearchPath(0);
+    SearchPath_AppendKey(&sp, "a\"'", 3);
+    mu_check(!Expiry_FormatPath(&sp, NULL));
+    SearchPath_Free(&sp);
+
+    // negative indices are counted from the ends of the document's arrays
+    const char *json = "[1, {\"a\": [2, 3]}]";
+    Node *doc = NULL;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(json, strlen(json), &doc, NULL));
+    const char *negative[][2] = {{"[-1].a[-2]", "[1][\"a\"][0]"},
+                                 {"[-2]", "[0]"},
+                                 {"[-3]", NULL},
+                                 {"[5][-1]", NULL},
+                                 {"[5].b", "[5][\"b\"]"}};
+    for (int i = 0; i < sizeof(negative) / sizeof(negative[0]); i++) {
+        sp = NewSearchPath(0);
+        mu_assert_int_eq(PARSE_OK, ParseJSONPath(negative[i][0], strlen(negative[i][0]), &sp, NULL));
+        sds canonical = Expiry_FormatPath(&sp, doc);
+        mu_check(negative[i][1] ? canonical && !strcmp(negative[i][1], canonical) : !canonical);
+        sdsfree(canonical);
+        SearchPath_Free(&sp);
+    }
+    Node_Free(doc);
+
+    // paths are unshifted by the deleted elements of their arrays
+    sds deleted[] = {sdsnew("[0]"), sdsnew("[2]"), sdsnew("[3][\"a\"][1]"), sdsnew("[\"b\"][0]")};
+    const char *unshifted[][2] = {{"[0]", "[1]"},
+                                  {"[1]", "[3]"},
+                                  {"[1][\"a\"][1]", "[3][\"a\"][2]"},
+                                  {"[\"b\"][\"[0]\"]", "[\"b\"][\"[0]\"]"},
+                                  {"[\"b\"][0][0]", "[\"b\"][1][0]"},
+                                  {"", ""}};
+    for (int i = 0; i < sizeof(unshifted) / sizeof(unshifted[0]); i++) {
+        sds path = Expiry_UnshiftPath(unshifted[i][0], deleted, 4);
+        mu_check(!strcmp(unshifted[i][1], path));
+        sdsfree(path);
+    }
+    for (int i = 0; i < 4; i++) sdsfree(deleted[i]);
+
+    const uint64_t base = 1000000;
+    Expiry_Advance(base);
+    JSONType_t *jt = NewJSONType(NewDictNode(1), NULL), *other = NewJSONType(NewDictNode(1), NULL);
+    _setExpiry(jt, "a", base + 10);
+    _setExpiry(jt, "a.b", base + 70);
+    _setExpiry(jt, "ab", base + 70);
+    _setExpiry(jt, "c", base + 5000);
+    _setExpiry(jt, "d", base + 3 * EXPIRY_WHEEL_SPAN);
+    _setExpiry(other, "a", base + 10);
+    mu_assert_int_eq(6, Expiry_Count());
+    mu_check(base + 70 == Expiry_Get(jt, "[\"a\"][\"b\"]"));
+    mu_check(!Expiry_Get(jt, "[\"b\"]"));
+    mu_check(!strcmp("doc", jt->expiries->key));
+
+    // TTLs pass when their time is reached, whether or not the wheel advanced to it
+    mu_check(!Expiry_Passed(jt, base + 9));
+    mu_check(Expiry_Passed(jt, base + 10) && Expiry_Passed(other, base + 10));
+
+    // entries are due when their time is reached, not before
+    mu_check(!Expiry_Pending(base + 9));
+    Expiry_Advance(base + 9);
+    mu_assert_int_eq(0, _popDue(base + 9, base));
+    mu_check(Expiry_Pending(base + 10));
+    Expiry_Advance(base + 10);
+    mu_assert_int_eq(2, _popDue(base + 10, base + 9));
+    mu_check(!other->expiries);
+
+    // clearing a path clears its descendants, and setting a path replaces its TTL
+    Expiry_Clear(jt, "[\"a\"]");
+    mu_assert_int_eq(3, Expiry_Count());
+    _setExpiry(jt, "c", base + 4000);
+    mu_assert_int_eq(3, Expiry_Count());
+    Expiry_Advance(base + 3999);
+    mu_assert_int_eq(1, _popDue(base + 3999, base + 10));
+    Expiry_Advance(base + 4000);
+    mu_assert_int_eq(1, _popDue(base + 4000, base + 3999));
+
+    // entries beyond the wheel's span are placed again until they're due
+    Expiry_Advance(base + 3 * EXPIRY_WHEEL_SPAN - 1);
+    mu_assert_int_eq(0, _popDue(base + 3 * EXPIRY_WHEEL_SPAN - 1, base));
+    Expiry_Advance(base + 3 * EXPIRY_WHEEL_SPAN);
+    mu_assert_int_eq(1, _popDue(base + 3 * EXPIRY_WHEEL_SPAN, base + 3 * EXPIRY_WHEEL_SPAN - 1));
+    mu_check(!jt->expiries);
+
+    // entries are never early or late, however the wheel advances
+    uint64_t now = base + 3 * EXPIRY_WHEEL_SPAN;
+    char path[16];
+    for (int i = 0; i < 2000; i++) {
+        sprintf(path, "k%d", i);
+        _setExpiry(jt, path, now + 1 + (i * 7919) % (1 << 20));
+    }
+    int expired = 0;
+    for (int i = 0; Expiry_Count(); i++) {
+        uint64_t next = now + 1 + (i * 104729) % 5000;
+        Expiry_Advance(next);
+        int count = _popDue(next, now);
+        mu_check(count >= 0);
+        expired += count;
+        now = next;
+    }
+    mu_assert_int_eq(2000, expired);
+
+    // due entries of values that aren't in their keys are parked until the values are bound again
+    _setExpiry(jt, "a", now + 1);
+    Expiry_Advance(now + 1);
+    ExpiryEntry *e = Expiry_NextDue();
+    mu_check(e != NULL);
+    Expiry_Park(e);
+    mu_check(!Expiry_NextDue() && !Expiry_Pending(now + 1));
+    mu_assert_int_eq(1, jt->expiries->parked);
+    Expiry_Bind(jt, 0, "doc", 3);
+    mu_check(e == Expiry_NextDue());
+    mu_assert_int_eq(0, jt->expiries->parked);
+    Expiry_Park(e);
+    Expiry_Bind(jt, 1, "renamed", 7);
+    mu_check(e == Expiry_NextDue());
+    mu_check(!strcmp("renamed", jt->expiries->key) && 1 == jt->expiries->db);
+    Expiry_Remove(e);
+    mu_assert_int_eq(0, Expiry_Count());
+
+    // splicing an array shifts the TTLs of its following elements and clears the deleted ones'
+    _setExpiry(jt, "a[0]", now + 10);
+    _setExpiry(jt, "a[1].b", now + 11);
+    _setExpiry(jt, "a[9]", now + 12);
+    _setExpiry(jt, "a", now + 13);
+    _setExpiry(jt, "ab[1]", now + 14);
+    Expiry_Splice(jt, "[\"a\"]", 0, 1, 3);
+    mu_check(!Expiry_Get(jt, "[\"a\"][0]"));
+    mu_check(now + 11 == Expiry_Get(jt, "[\"a\"][3][\"b\"]"));
+    mu_check(now + 12 == Expiry_Get(jt, "[\"a\"][11]"));
+    mu_check(now + 13 == Expiry_Get(jt, "[\"a\"]"));
+    mu_check(now + 14 == Expiry_Get(jt, "[\"ab\"][1]"));
+    Expiry_Splice(jt, "[\"a\"]", 3, 9, 0);
+    mu_assert_int_eq(2, Expiry_Count());
+    Expiry_Forget(jt);
+    mu_assert_int_eq(0, Expiry_Count());
+
+    // the TTLs of freed values are cleared, including due and parked ones
+    _setExpiry(jt, "a", now + 1);
+    _setExpiry(jt, "b", now + 100);
+    _setExpiry(jt, "c", now + 1);
+    Expiry_Advance(now + 1);
+    Expiry_Park(Expiry_NextDue());
+    JSONTypeFree(jt);
+    JSONTypeFree(other);
+    mu_assert_int_eq(0, Expiry_Count());
+    mu_check(!Expiry_NextDue());
+}
+
 MU_TEST(testPathParse) {
     const char *path = "foo.bar[3][\"baz\"].bar[\"boo\"][''][6379][-17].$nake_ca$e____";
 
@@ -366,14 +1629,50 @@ MU_TEST(testPathParse) {
 
     const char *badpaths[] = {
         "3",        "6379",        "foo[bar]", "foo[]",         "foo[3",        "bar[\"]",
-        "foo..bar", "foo[\"bar']", "foo/bar",  "foo.bar[-1.2]", "foo.bar[1.1]", "foo.bar[+3]",
-        "1foo",     "f?oo",        "foo\n",    "foo\tbar",      "foobar[-i]",   NULL};
+        "foo...bar", "foo[\"bar']", "foo/bar",  "foo.bar[-1.2]", "foo.bar[1.1]", "foo.bar[+3]",
+        "1foo",     "f?oo",        "foo\n",    "foo\tbar",      "foobar[-i]",   "foo[1:2:0]",
+        "foo[1:2:3:4]", "foo[1:-]", "foo[:a]",  "foo[1:2",       "foo[::-0]",    "foo[*",
+        "foo[**]",  "foo.**",      "foo..",    "foo..'bar'",    "..",           NULL};
 
     for (int idx = 0; badpaths[idx] != NULL; idx++) {
         mu_check(ParseJSONPath(badpaths[idx], strlen(badpaths[idx]), &sp, NULL) == PARSE_ERR);
     }
 
     SearchPath_Free(&sp);
+
+    // slices, with the bounds that are left out flagged
+    path = "foo[1:3][:-1][::2][-3::-1][:][2:].bar";
+    sp = NewSearchPath(0);
+    rc = ParseJSONPath(path, strlen(path), &sp, NULL);
+    mu_assert_int_eq(rc, PARSE_OK);
+    mu_assert_int_eq(sp.len, 8);
+    PathSlice slices[] = {{1, 3, 1, PATH_SLICE_START | PATH_SLICE_STOP},
+                          {0, -1, 1, PATH_SLICE_STOP},
+                          {0, 0, 2, 0},
+                          {-3, 0, -1, PATH_SLICE_START},
+                          {0, 0, 1, 0},
+                          {2, 0, 1, PATH_SLICE_START}};
+    for (int i = 0; i < 6; i++) {
+        PathSlice *ps = &sp.nodes[i + 1].value.slice;
+        mu_check(NT_SLICE == sp.nodes[i + 1].type);
+        mu_check(ps->start == slices[i].start && ps->stop == slices[i].stop);
+        mu_check(ps->step == slices[i].step && ps->flags == slices[i].flags);
+    }
+    mu_check(sp.nodes[7].type == NT_KEY && !strcmp(sp.nodes[7].value.key, "bar"));
+    mu_check(SearchPath_IsMulti(&sp));
+    SearchPath_Free(&sp);
+
+    // wildcards and recursive descents
+    path = "..foo[*].*..[0]..*";
+    sp = NewSearchPath(0);
+    rc = ParseJSONPath(path, strlen(path), &sp, NULL);
+    mu_assert_int_eq(rc, PARSE_OK);
+    mu_assert_int_eq(sp.len, 8);
+    PathNodeType types[] = {NT_DESCENT, NT_KEY,   NT_WILDCARD, NT_WILDCARD,
+                            NT_DESCENT, NT_INDEX, NT_DESCENT,  NT_WILDCARD};
+    for (int i = 0; i < 8; i++) mu_check(types[i] == sp.nodes[i].type);
+    mu_check(SearchPath_IsMulti(&sp));
+    SearchPath_Free(&sp);
 }
 
 MU_TEST(testPathParseRoot) {
@@ -388,15 +1687,347 @@ MU_TEST(testPathParseRoot) {
     SearchPath_Free(&sp);
 }
 
+/* An in-memory RDB for the object type's encodings. */
+#define TEST_RDB_MAX 1024
+static struct {
+    uint64_t u;
+    char *buf;
+    size_t len;
+} _rdb[TEST_RDB_MAX];
+static int _rdbLen, _rdbPos;
+
+static void _rdbSaveStringBuffer(RedisModuleIO *io, const char *s, size_t len) {
+    _rdb[_rdbLen].buf = RedisModule_Alloc(len);
+    memcpy(_rdb[_rdbLen].buf, s, len);
+    _rdb[_rdbLen++].len = len;
+}
+
+static char *_rdbLoadStringBuffer(RedisModuleIO *io, size_t *len) {
+    if (_rdbPos == _rdbLen) return NULL;
+    *len = _rdb[_rdbPos].len;
+    char *buf = RedisModule_Alloc(*len + 1);
+    memcpy(buf, _rdb[_rdbPos++].buf, *len);
+    return buf;
+}
+
+static void _rdbSaveUnsigned(uint64_t u) { _rdb[_rdbLen++].u = u; }
+
+static uint64_t _rdbLoadUnsigned(RedisModuleIO *io) { return _rdb[_rdbPos++].u; }
+
+static int64_t _rdbLoadSigned(RedisModuleIO *io) { return (int64_t)_rdb[_rdbPos++].u; }
+
+static void _rdbReset() {
+    for (int i = 0; i < _rdbLen; i++) RedisModule_Free(_rdb[i].buf);
+    memset(_rdb, 0, sizeof(_rdb));
+    _rdbLen = _rdbPos = 0;
+    RedisModule_SaveStringBuffer = _rdbSaveStringBuffer;
+    RedisModule_LoadStringBuffer = _rdbLoadStringBuffer;
+    RedisModule_LoadUnsigned = _rdbLoadUnsigned;
+    RedisModule_LoadSigned = _rdbLoadSigned;
+}
+
+/* Checks that two nodes are identical, types included. */
+static int _sameNode(const Node *a, const Node *b) {
+    if (NODETYPE(a) != NODETYPE(b)) return 0;
+    switch (NODETYPE(a)) {
+        case N_NULL:
+            return 1;
+        case N_BOOLEAN:
+            return NODE_BOOLVAL(a) == NODE_BOOLVAL(b);
+        case N_INTEGER:
+            return NODE_INTVAL(a) == NODE_INTVAL(b);
+        case N_NUMBER:
+            return !memcmp(&a->value.numval, &b->value.numval, sizeof(double));
+        case N_STRING: {
+            if (a->value.strval.len != b->value.strval.len) return 0;
+            char *abuf, *bbuf;
+            int eq = !memcmp(Node_StringData(a, &abuf), Node_StringData(b, &bbuf),
+                             a->value.strval.len);
+            Node_StringRelease(abuf);
+            Node_StringRelease(bbuf);
+            return eq;
+        }
+        case N_KEYVAL:
+            return a->value.kvval.key == b->value.kvval.key &&
+                   _sameNode(a->value.kvval.val, b->value.kvval.val);
+        case N_DICT:
+        case N_ARRAY:
+            if (Node_Length(a) != Node_Length(b)) return 0;
+            for (uint32_t i = 0; i < Node_Length(a); i++) {
+                Node **ea = N_DICT == a->type ? a->value.dictval.entries : a->value.arrval.entries;
+                Node **eb = N_DICT == b->type ? b->value.dictval.entries : b->value.arrval.entries;
+                if (!_sameNode(ea[i], eb[i])) return 0;
+            }
+            return 1;
+    }
+    return 0;
+}
+
+MU_TEST(testRdbPacked) {
+    Node *loaded, *doc = NewDictNode(1), *arr = NewArrayNode(0);
+    char key[32];
+
+    // every type, tag boundary and a string that spans blocks
+    static const int64_t ints[] = {0, 1, -1, 15, 16, -16, -17, 1 << 20, INT64_MAX, INT64_MIN};
+    for (int i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) Node_ArrayAppend(arr, NewIntNode(ints[i]));
+    Node_ArrayAppend(arr, NewDoubleNode(-0.0));
+    Node_ArrayAppend(arr, NewDoubleNode(3.14159));
+    Node_ArrayAppend(arr, NewBoolNode(0));
+    Node_ArrayAppend(arr, NewBoolNode(1));
+    Node_ArrayAppend(arr, NULL);
+    Node_ArrayAppend(arr, NewStringNode("", 0));
+    Node_ArrayAppend(arr, NewArrayNode(0));
+    Node_ArrayAppend(arr, NewDictNode(0));
+    char *big = RedisModule_Alloc(3 * OBJECT_TYPE_RDB_BLOCK_SIZE);
+    memset(big, 'x', 3 * OBJECT_TYPE_RDB_BLOCK_SIZE);
+    Node_ArrayAppend(arr, NewStringNode(big, 3 * OBJECT_TYPE_RDB_BLOCK_SIZE));
+    RedisModule_Free(big);
+    Node_DictSet(doc, "types", arr);
+
+    // repeated keys are saved once in the dictionary
+    arr = NewArrayNode(0);
+    for (int i = 0; i < 1000; i++) {
+        Node *d = NewDictNode(2);
+        Node_DictSet(d, "a_rather_long_key_name", NewIntNode(i));
+        sprintf(key, "key%d", i % 10);
+        Node_DictSet(d, key, NewCStringNode("value"));
+        Node_ArrayAppend(arr, d);
+    }
+    Node_DictSet(doc, "dicts", arr);
+
+    _rdbReset();
+    ObjectTypeRdbSave(NULL, doc);
+    mu_check(_rdbLen > 3);
+    size_t size = 0;
+    for (int i = 0; i < _rdbLen; i++) size += _rdb[i].len;
+    mu_check(size < 3 * OBJECT_TYPE_RDB_BLOCK_SIZE + 1000 * 16);
+    mu_assert_int_eq(OBJ_OK, ObjectTypeRdbLoadPacked(NULL, &loaded));
+    mu_check(_sameNode(doc, loaded));
+    Node_Free(loaded);
+
+    // a root scalar
+    _rdbReset();
+    ObjectTypeRdbSave(NULL, NULL);
+    loaded = NewBoolNode(1);
+    mu_assert_int_eq(OBJ_OK, ObjectTypeRdbLoadPacked(NULL, &loaded));
+    mu_check(NULL == loaded);
+
+    // truncated and corrupt encodings are errors
+    _rdbReset();
+    ObjectTypeRdbSave(NULL, doc);
+    _rdbLen--;
+    mu_assert_int_eq(OBJ_ERR, ObjectTypeRdbLoadPacked(NULL, &loaded));
+    _rdbLen++;
+    _rdbReset();
+    _rdbSaveStringBuffer(NULL, "\x01\x01k\x0e\x05", 5);  // a dict of a key with id 5
+    mu_assert_int_eq(OBJ_ERR, ObjectTypeRdbLoadPacked(NULL, &loaded));
+    _rdbReset();
+    Node_Free(doc);
+}
+
+MU_TEST(testRdbPlain) {
+    // the original encoding: {"a":1,"b":["x",true]}
+    Node *n, *loaded;
+    _rdbReset();
+    _rdbSaveUnsigned(N_DICT);
+    _rdbSaveUnsigned(2);
+    _rdbSaveUnsigned(N_KEYVAL);
+    _rdbSaveStringBuffer(NULL, "a", 1);
+    _rdbSaveUnsigned(N_INTEGER);
+    _rdbSaveUnsigned(1);
+    _rdbSaveUnsigned(N_KEYVAL);
+    _rdbSaveStringBuffer(NULL, "b", 1);
+    _rdbSaveUnsigned(N_ARRAY);
+    _rdbSaveUnsigned(2);
+    _rdbSaveUnsigned(N_STRING);
+    _rdbSaveStringBuffer(NULL, "x", 1);
+    _rdbSaveUnsigned(N_BOOLEAN);
+    _rdbSaveStringBuffer(NULL, "1", 1);
+
+    // the loader interleaves unsigned and string items, so they share the in-memory RDB
+    mu_assert_int_eq(OBJ_OK, ObjectTypeRdbLoad(NULL, &loaded));
+    mu_assert_int_eq(N_DICT, NODETYPE(loaded));
+    mu_assert_int_eq(OBJ_OK, Node_DictGet(loaded, "a", &n));
+    mu_assert_int_eq(1, NODE_INTVAL(n));
+    mu_assert_int_eq(OBJ_OK, Node_DictGet(loaded, "b", &n));
+    mu_assert_int_eq(2, Node_Length(n));
+    mu_check(!strncmp("x", n->value.arrval.entries[0]->value.strval.data, 1));
+    mu_check(NODE_BOOLVAL(n->value.arrval.entries[1]));
+    Node_Free(loaded);
+
+    // unknown types are errors
+    _rdbReset();
+    _rdbSaveUnsigned(N_ARRAY);
+    _rdbSaveUnsigned(2);
+    _rdbSaveUnsigned(N_NULL);
+    _rdbSaveUnsigned(0x400);
+    mu_assert_int_eq(OBJ_ERR, ObjectTypeRdbLoad(NULL, &loaded));
+    _rdbReset();
+}
+
+MU_TEST(testRdbLoadWide) {
+    ObjectTypeLoadStats before, after;
+    Node *n, *loaded, *dict = NewDictNode(0);
+    char key[32];
+
+    // wide dicts are loaded in linear time, indexed as if they were built by setting every key
+    for (int i = 0; i < 100000; i++) {
+        sprintf(key, "key%d", i);
+        Node_DictSet(dict, key, NewIntNode(i));
+    }
+    _rdbReset();
+    ObjectTypeRdbSave(NULL, dict);
+    ObjectType_GetLoadStats(&before);
+    mu_assert_int_eq(OBJ_OK, ObjectTypeRdbLoadPacked(NULL, &loaded));
+    ObjectType_GetLoadStats(&after);
+    mu_check(_sameNode(dict, loaded));
+    mu_assert_int_eq(Node_Count(dict), Node_Count(loaded));
+    mu_check(Node_DictIndexSize(loaded) > 0);
+    mu_assert_int_eq(OBJ_OK, Node_DictGet(loaded, "key99999", &n));
+    mu_assert_int_eq(99999, NODE_INTVAL(n));
+    mu_assert_int_eq(1, after.keys - before.keys);
+    mu_assert_int_eq(100001, after.nodes - before.nodes);
+
+    Node_Free(loaded);
+    Node_Free(dict);
+    _rdbReset();
+}
+
+MU_TEST(testFreeze) {
+    // the codec round trips data of every size, and a trained dictionary compresses small inputs
+    char src[4096], enc[4096 + 4096 / 32 + 2], dec[4096];
+    srand(7);
+    for (size_t len = 0; len <= sizeof(src); len += 1 + len / 3) {
+        for (size_t i = 0; i < len; i++) src[i] = i % 3 ? rand() : 'a' + rand() % 4;
+        size_t clen = Compress_Encode(src, len, enc, Compress_Bound(len));
+        mu_check(!len || clen);
+        mu_assert_int_eq(OBJ_OK, Compress_Decode(enc, clen, dec, len));
+        mu_check(!memcmp(src, dec, len));
+    }
+    const char *doc =
+        "{\"user\":{\"name\":\"someone\",\"email\":\"someone@example.com\",\"age\":42}}";
+    const char *samples[JSONTYPE_FREEZE_SAMPLES];
+    size_t lens[JSONTYPE_FREEZE_SAMPLES];
+    for (int i = 0; i < JSONTYPE_FREEZE_SAMPLES; i++) samples[i] = doc, lens[i] = strlen(doc);
+    CompressDict *dict = Compress_Train(samples, lens, JSONTYPE_FREEZE_SAMPLES, 1024);
+    mu_check(dict && Compress_DictSize(dict) > 0 && Compress_DictSize(dict) <= 1024);
+    size_t plain = Compress_Encode(doc, strlen(doc), enc, sizeof(enc));
+    size_t clen = Compress_EncodeDict(dict, doc, strlen(doc), enc, sizeof(enc));
+    mu_check(clen && clen < plain / 2);
+    mu_assert_int_eq(OBJ_OK, Compress_DecodeDict(dict, enc, clen, dec, strlen(doc)));
+    mu_check(!memcmp(doc, dec, strlen(doc)));
+    mu_assert_int_eq(OBJ_ERR, Compress_Decode(enc, clen, dec, strlen(doc)));
+    mu_check(dict == Compress_DictRetain(dict));
+    Compress_DictRelease(dict);
+    mu_assert_int_eq(OBJ_OK, Compress_DecodeDict(dict, enc, clen, dec, strlen(doc)));
+    Compress_DictRelease(dict);
+
+    // the packed encoding round trips in memory
+    Node *root, *copy, *unpacked;
+    mu_check(JSONOBJECT_OK == CreateNodeFromJSON(doc, strlen(doc), &root, NULL));
+    sds packed = ObjectTypePack(root);
+    mu_assert_int_eq(OBJ_OK, ObjectTypeUnpack(packed, sdslen(packed), &unpacked));
+    mu_check(_sameNode(root, unpacked));
+    mu_assert_int_eq(OBJ_ERR, ObjectTypeUnpack(packed, sdslen(packed) - 1, &copy));
+    sdsfree(packed);
+    Node_Free(unpacked);
+
+    // frozen values take less memory, and are thawed when they're accessed
+    JSONTypeFreezeStats stats;
+    JSONTypeFreezeReset();
+    JSONType_t *jts[JSONTYPE_FREEZE_SAMPLES + 1], *null = NewJSONType(NULL, NULL);
+    for (int i = 0; i <= JSONTYPE_FREEZE_SAMPLES; i++) {
+        mu_check(JSONOBJECT_OK == CreateNodeFromJSON(doc, strlen(doc), &copy, NULL));
+        jts[i] = NewJSONType(copy, NULL);
+    }
+    size_t memory = JSONTypeMemoryUsage(jts[0]);
+    mu_assert_int_eq(OBJ_OK, JSONTypeFreeze(jts[0]));
+    mu_assert_int_eq(OBJ_ERR, JSONTypeFreeze(jts[0]));
+    mu_check(!jts[0]->root && jts[0]->frozen && JSONTypeMemoryUsage(jts[0]) < memory);
+    JSONTypeGetFreezeStats(&stats);
+    mu_check(1 == stats.frozen && 1 == stats.freezes && 0 == stats.thaws && 0 == stats.dictionary);
+    unpacked = JSONTypeDecode(jts[0]);
+    mu_check(_sameNode(root, unpacked) && jts[0]->frozen);
+    Node_Free(unpacked);
+
+    // indexing a frozen value decodes it without thawing it
+    SIndex *ix = NewSIndex("doc:", 4, "user.age", 8, SINDEX_NUMERIC, 0, NULL);
+    SIndex_AddDoc(ix, "doc:a", 5, jts[0]);
+    mu_check(1 == ix->ndocs && 1 == ix->nentries && jts[0]->frozen);
+    SIndex_Free(ix);
+    mu_check(jts[0] == JSONTypeAccess(jts[0]) && !jts[0]->frozen);
+    mu_check(_sameNode(root, jts[0]->root));
+    mu_assert_int_eq(OBJ_OK, JSONTypeFreeze(null));
+    JSONTypeThaw(null);
+    mu_check(!null->root && !null->frozen);
+
+    // enough samples train the dictionary, and values frozen with it take less memory
+    for (int i = 1; i <= JSONTYPE_FREEZE_SAMPLES; i++)
+        mu_assert_int_eq(OBJ_OK, JSONTypeFreeze(jts[i]));
+    JSONTypeGetFreezeStats(&stats);
+    mu_check(stats.dictionary > 0 && JSONTYPE_FREEZE_SAMPLES == stats.frozen);
+    mu_check(JSONTypeMemoryUsage(jts[JSONTYPE_FREEZE_SAMPLES]) < JSONTypeMemoryUsage(jts[1]));
+
+    // values that were frozen with a dictionary keep it after it's forgotten
+    JSONTypeFreezeReset();
+    JSONTypeGetFreezeStats(&stats);
+    mu_assert_int_eq(0, stats.dictionary);
+    for (int i = 1; i <= JSONTYPE_FREEZE_SAMPLES; i++) {
+        JSONTypeAccess(jts[i]);
+        mu_check(_sameNode(root, jts[i]->root));
+    }
+    JSONTypeGetFreezeStats(&stats);
+    mu_check(0 == stats.frozen && 0 == stats.memory && JSONTYPE_FREEZE_SAMPLES + 2 == stats.thaws);
+
+    // idle values are frozen least recently accessed first, and accessing a value defers it
+    JSONTypeSetFreezeIdleTime(200);
+    mu_assert_int_eq(0, JSONTypeFreezeIdle(100));
+    usleep(300000);
+    JSONTypeAccess(jts[0]);
+    mu_assert_int_eq(2, JSONTypeFreezeIdle(2));
+    mu_check(null->frozen && jts[1]->frozen && !jts[2]->frozen);
+    mu_assert_int_eq(JSONTYPE_FREEZE_SAMPLES - 1, JSONTypeFreezeIdle(100));
+    mu_check(!jts[0]->frozen && jts[JSONTYPE_FREEZE_SAMPLES]->frozen);
+    JSONTypeSetFreezeIdleTime(0);
+    mu_assert_int_eq(0, JSONTypeFreezeIdle(100));
+
+    // frozen values are freed without being thawed
+    for (int i = 0; i <= JSONTYPE_FREEZE_SAMPLES; i++) JSONTypeFree(jts[i]);
+    JSONTypeFree(null);
+    JSONTypeGetFreezeStats(&stats);
+    mu_check(0 == stats.frozen && 0 == stats.memory && 0 == stats.packed);
+    JSONTypeFreezeReset();
+    Node_Free(root);
+}
+
 MU_TEST_SUITE(test_object) {
     // MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
 
     MU_RUN_TEST(testNodeString);
+    MU_RUN_TEST(testNodeCompact);
     MU_RUN_TEST(testNodeArray);
     MU_RUN_TEST(testObject);
+    MU_RUN_TEST(testObjectIndex);
+    MU_RUN_TEST(testObjectInternedKeys);
+    MU_RUN_TEST(testNodeSizes);
+    MU_RUN_TEST(testStringCompression);
+    MU_RUN_TEST(testObjectArena);
+    MU_RUN_TEST(testLazyFree);
+    MU_RUN_TEST(testThreadPool);
+    MU_RUN_TEST(testRdbPacked);
+    MU_RUN_TEST(testRdbPlain);
+    MU_RUN_TEST(testRdbLoadWide);
+    MU_RUN_TEST(testFreeze);
     MU_RUN_TEST(testPath);
     MU_RUN_TEST(testPathEx);
     MU_RUN_TEST(testPathArray);
+    MU_RUN_TEST(testPathSlice);
+    MU_RUN_TEST(testPathWildcard);
+    MU_RUN_TEST(testPathFilter);
+    MU_RUN_TEST(testSIndex);
+    MU_RUN_TEST(testSchema);
+    MU_RUN_TEST(testExpiry);
+    MU_RUN_TEST(testPathCache);
     MU_RUN_TEST(testPathParse);
     MU_RUN_TEST(testPathParseRoot);
 }